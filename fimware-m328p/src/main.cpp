@@ -29,6 +29,24 @@
 
 #define PIN_DEBUG_LED PB6
 
+/* キーの状態が変化したことをメインプロセッサへ知らせる信号線 (PD4)
+   オープンドレインとして使う。キーイベントが積まれるとLOWにし、I2Cですべて読み出されたら開放する。
+   プルアップはメインプロセッサ側で行う。 */
+#define PIN_CHANGE_NOTIFY 4
+
+// キーマトリクスを走査する間隔
+constexpr uint8_t KEYMATRIX_SCAN_INTERVAL_MS = 5;
+
+/* チャタリング除去の時間幅[ms]
+   キーごとの積分カウンタが、この時間ぶん連続して同じ状態を観測したときに押下・解放を確定する。
+   ビルド時に -DKEYMATRIX_DEBOUNCE_MS=... で変更できる。0なら除去しない。 */
+#ifndef KEYMATRIX_DEBOUNCE_MS
+#define KEYMATRIX_DEBOUNCE_MS 10
+#endif
+constexpr uint8_t KEYMATRIX_DEBOUNCE_SCANS =
+    (KEYMATRIX_DEBOUNCE_MS + KEYMATRIX_SCAN_INTERVAL_MS - 1) / KEYMATRIX_SCAN_INTERVAL_MS > 0
+    ? (KEYMATRIX_DEBOUNCE_MS + KEYMATRIX_SCAN_INTERVAL_MS - 1) / KEYMATRIX_SCAN_INTERVAL_MS : 1;
+
 /* キーの物理レイアウトとキー番号の対応
  1,  2,  3,  4,    5,  6,  7,  8,  9, 10,  11,  [23],
 13, 14, 15, 16,   17, 18, 19, 20, 21, 22, [35],
@@ -55,7 +73,13 @@ constexpr uint8_t KEYMATRIX_LAYOUT_COLS_COUNT = 12;
 constexpr uint8_t KEYMATRIX_LAYOUT_ROWS_COUNT = 4;
 
 // 43 keys < 6bytes * 8bits/byte = 48bits
+// チャタリング除去とゴースト除去を済ませた、確定したキー状態
 uint8_t keystatus[6] = { 0 };
+// 今回の走査で読み取ったそのままのキー状態
+uint8_t raw_keystatus[sizeof(keystatus)] = { 0 };
+constexpr uint8_t KEYMATRIX_KEYS_COUNT = sizeof(keystatus) * 8;
+// キーごとの積分カウンタ（0なら解放、KEYMATRIX_DEBOUNCE_SCANSなら押下で確定）
+uint8_t debounce_counters[KEYMATRIX_KEYS_COUNT] = { 0 };
 
 void keymatrix_init(void) {
     for (int col = 0; col < KEYMATRIX_COLS_COUNT; ++col) {
@@ -67,21 +91,27 @@ void keymatrix_init(void) {
 }
 
 
-void keymatrix_set_key_status(uint8_t col, uint8_t row, bool status) {
-    uint8_t keyindex = col + row * 12;
-    uint8_t byteindex = keyindex / 8;
-    uint8_t bitindex = keyindex % 8;
+static inline bool get_bit(const uint8_t* bits, uint8_t index) {
+    return bits[index / 8] & (0x01 << (index % 8));
+}
+
+static inline void set_bit(uint8_t* bits, uint8_t index, bool status) {
     if (status) {
-        keystatus[byteindex] |= (0x01 << bitindex);
+        bits[index / 8] |= (0x01 << (index % 8));
     } else {
-        keystatus[byteindex] &= ~(0x01 << bitindex);
+        bits[index / 8] &= ~(0x01 << (index % 8));
     }
 }
 
+/** 走査結果をそのままのキー状態 (raw_keystatus) へ記録する */
+void keymatrix_set_key_status(uint8_t col, uint8_t row, bool status) {
+    uint8_t keyindex = col + row * 12;
+    set_bit(raw_keystatus, keyindex, status);
+}
+
+/** 確定したキー状態を得る */
 bool keymatrix_get_key_status_by_keyindex(uint8_t keyindex) {
-    uint8_t byteindex = keyindex / 8;
-    uint8_t bitindex = keyindex % 8;
-    return keystatus[byteindex] & (0x01 << bitindex);
+    return get_bit(keystatus, keyindex);
 }
 
 void keymatrix_dump_status(void) {
@@ -101,7 +131,77 @@ void keymatrix_dump_status(void) {
 
 
 void keymatrix_clear_status(void) {
-    memset(keystatus, 0x00, sizeof(keystatus));
+    memset(raw_keystatus, 0x00, sizeof(raw_keystatus));
+}
+
+
+/** ゴーストの可能性がある新たな押下を取り消す
+
+   2パスの走査では、物理的な列と行の交点ひとつに2つのキー（偶数番目の列は col2row 、奇数番目は row2col ）がある。
+   逆向きのダイオードを経由する回り込みがあるため、2つの行が2つ以上の物理列を共有して押されていると、
+   その長方形の4つめの角が押されているように見えることがある。
+   どのキーが本物か区別できないので、長方形に含まれるキーのうち、まだ押下が確定していないものは押されていないとみなす。
+   すでに押下が確定しているキーはそのまま保つ。
+ */
+void keymatrix_reject_ghosts(void) {
+    // 行ごとの、押されているキーがある物理列のビットマスク
+    uint8_t rowmasks[KEYMATRIX_ROWS_COUNT] = { 0 };
+    for (uint8_t row = 0; row < KEYMATRIX_ROWS_COUNT; ++row) {
+        for (uint8_t col = 0; col < KEYMATRIX_COLS_COUNT; ++col) {
+            uint8_t keyindex = col * 2 + row * KEYMATRIX_LAYOUT_COLS_COUNT;
+            if (get_bit(raw_keystatus, keyindex) || get_bit(raw_keystatus, keyindex + 1)) {
+                rowmasks[row] |= (0x01 << col);
+            }
+        }
+    }
+
+    for (uint8_t row1 = 0; row1 < KEYMATRIX_ROWS_COUNT; ++row1) {
+        for (uint8_t row2 = row1 + 1; row2 < KEYMATRIX_ROWS_COUNT; ++row2) {
+            uint8_t common = rowmasks[row1] & rowmasks[row2];
+            if ((common & (common - 1)) == 0) {
+                // 共有する列が1つ以下なら長方形にならない
+                continue;
+            }
+            for (uint8_t col = 0; col < KEYMATRIX_COLS_COUNT; ++col) {
+                if (!(common & (0x01 << col))) {
+                    continue;
+                }
+                const uint8_t rows[] = { row1, row2 };
+                for (uint8_t r : rows) {
+                    uint8_t keyindex = col * 2 + r * KEYMATRIX_LAYOUT_COLS_COUNT;
+                    for (uint8_t k = keyindex; k < keyindex + 2; ++k) {
+                        if (!get_bit(keystatus, k)) {
+                            set_bit(raw_keystatus, k, false);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/** 走査結果を積分カウンタに通し、確定したキー状態 (keystatus) を更新する */
+void keymatrix_debounce(void) {
+    for (uint8_t key = 0; key < KEYMATRIX_KEYS_COUNT; ++key) {
+        uint8_t counter = debounce_counters[key];
+        if (get_bit(raw_keystatus, key)) {
+            if (counter < KEYMATRIX_DEBOUNCE_SCANS) {
+                counter += 1;
+            }
+        } else {
+            if (counter > 0) {
+                counter -= 1;
+            }
+        }
+        debounce_counters[key] = counter;
+        // 途中の値では前の状態を保つ
+        if (counter == KEYMATRIX_DEBOUNCE_SCANS) {
+            set_bit(keystatus, key, true);
+        } else if (counter == 0) {
+            set_bit(keystatus, key, false);
+        }
+    }
 }
 
 #define SMALL_DELAY()   delayMicroseconds(30)
@@ -165,29 +265,196 @@ Mutex keystatus_mutex;
 
 uint8_t i2c_addr = 0x21;
 
-uint8_t prev_report[6] = { 0 };
-
-void wire_onRequest(void) {
-
-    update_keystatus();
-
+// レポートのバイト数（キー番号6バイトと終端0xFF）
+constexpr uint8_t REPORT_LENGTH = 7;
+
+// I2Cで読み出されたときに返す、最新のレポート
+// 割り込み（ wire_onRequest() ）からも読むので、書き換えは割り込み禁止の中で行う
+uint8_t ready_report[REPORT_LENGTH] = { 0, 0, 0, 0, 0, 0, 0xFF };
+
+// タイマー割り込みで立て、loop()で走査したら下ろす
+volatile bool keymatrix_scan_requested = false;
+
+/* I2Cのコマンド
+   メインプロセッサは、コマンドを1バイト書き込んでから読み出す。書き込まずに読み出すとレポートを返す。 */
+// 押下中のキーのレポート（ REPORT_LENGTH バイト）
+constexpr uint8_t I2C_COMMAND_REPORT = 0x00;
+// キーイベントのまとめ読み
+//   ヘッダ3バイト：イベントの個数（ビット7はあふれて捨てたイベントがあったことを示す）、現在時刻[ms]の下位16ビット
+//   イベント3バイトずつ：キー番号（ビット7が立っていれば離された）、発生時刻[ms]の下位16ビット
+constexpr uint8_t I2C_COMMAND_EVENTS = 0x01;
+constexpr uint8_t KEYEVENT_BURST_HEADER_LENGTH = 3;
+constexpr uint8_t KEYEVENT_LENGTH = 3;
+// 1回で送るイベントの最大数（Wireのバッファ32バイトに収める）
+constexpr uint8_t KEYEVENT_BURST_MAX = 9;
+constexpr uint8_t KEYEVENT_RELEASED = 0x80;
+constexpr uint8_t KEYEVENT_OVERFLOWED = 0x80;
+
+// 次の読み出しで応答するコマンド（ wire_onReceive() で設定する）
+volatile uint8_t i2c_command = I2C_COMMAND_REPORT;
+
+struct keyevent_t {
+    // キー番号（1始まり）。離されたならKEYEVENT_RELEASEDを立てる
+    uint8_t key;
+    // 発生時刻[ms]の下位16ビット
+    uint16_t timestamp;
+};
+
+// 未送信のキーイベントのリングバッファ。書き換えは割り込み禁止の中で行う
+constexpr uint8_t KEYEVENT_QUEUE_LENGTH = 32;
+keyevent_t keyevent_queue[KEYEVENT_QUEUE_LENGTH];
+uint8_t keyevent_queue_head = 0;
+uint8_t keyevent_queue_count = 0;
+// キューがあふれてイベントを捨てたらtrue
+bool keyevent_queue_overflowed = false;
+
+// 前回の走査でのキー状態（イベントを作るための比較用）
+uint8_t prev_keystatus[sizeof(keystatus)] = { 0 };
+
+
+/** 現在のキー状態から、I2Cで返すレポートを作る
+ * @param dst [OUT] REPORT_LENGTH バイト
+ */
+void build_report(uint8_t* dst) {
     int writtencount = 0;
     for (uint8_t key = 0; key < 8 * 6 && writtencount < 6; ++key) {
         if (keymatrix_get_key_status_by_keyindex(key)) {
-            Wire.write(key + 1);
+            dst[writtencount] = key + 1;
             ++writtencount;
         }
     }
     for (int i = writtencount; i < 6; ++i) {
-        Wire.write(0x00);
+        dst[i] = 0x00;
     }
     // Termination byte
-    Wire.write(0xFF);
+    dst[6] = 0xFF;
+}
+
+
+void set_change_notify(bool notify);
+
+
+/** 前回の走査からのキー状態の変化を、イベントとしてキューに積む
+ * @return イベントを積んだらtrue
+ */
+bool push_keyevents(void) {
+    uint16_t now = (uint16_t)millis();
+    bool pushed = false;
+    for (uint8_t i = 0; i < sizeof(keystatus); ++i) {
+        uint8_t changed = keystatus[i] ^ prev_keystatus[i];
+        if (changed == 0) {
+            continue;
+        }
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            if (!(changed & (0x01 << bit))) {
+                continue;
+            }
+            uint8_t key = i * 8 + bit + 1;
+            if (!(keystatus[i] & (0x01 << bit))) {
+                key |= KEYEVENT_RELEASED;
+            }
+            noInterrupts();
+            if (keyevent_queue_count < KEYEVENT_QUEUE_LENGTH) {
+                uint8_t tail = (keyevent_queue_head + keyevent_queue_count) % KEYEVENT_QUEUE_LENGTH;
+                keyevent_queue[tail].key = key;
+                keyevent_queue[tail].timestamp = now;
+                keyevent_queue_count += 1;
+            } else {
+                keyevent_queue_overflowed = true;
+            }
+            set_change_notify(true);
+            interrupts();
+            pushed = true;
+        }
+        prev_keystatus[i] = keystatus[i];
+    }
+    return pushed;
+}
+
+
+/** キーイベントをまとめてI2Cで送り、キューから取り除く（割り込みの中から呼ぶ） */
+void write_keyevents(void) {
+    uint8_t count = keyevent_queue_count;
+    if (count > KEYEVENT_BURST_MAX) {
+        count = KEYEVENT_BURST_MAX;
+    }
+    uint16_t now = (uint16_t)millis();
+    uint8_t buf[KEYEVENT_BURST_HEADER_LENGTH + KEYEVENT_BURST_MAX * KEYEVENT_LENGTH];
+    buf[0] = count | (keyevent_queue_overflowed ? KEYEVENT_OVERFLOWED : 0);
+    buf[1] = now & 0xFF;
+    buf[2] = now >> 8;
+    uint8_t* ptr = &buf[KEYEVENT_BURST_HEADER_LENGTH];
+    for (uint8_t i = 0; i < count; ++i) {
+        const keyevent_t* ev = &keyevent_queue[keyevent_queue_head];
+        *ptr++ = ev->key;
+        *ptr++ = ev->timestamp & 0xFF;
+        *ptr++ = ev->timestamp >> 8;
+        keyevent_queue_head = (keyevent_queue_head + 1) % KEYEVENT_QUEUE_LENGTH;
+    }
+    keyevent_queue_count -= count;
+    keyevent_queue_overflowed = false;
+    Wire.write(buf, ptr - buf);
+    if (keyevent_queue_count == 0) {
+        set_change_notify(false);
+    }
+}
+
+
+/** 変化の通知線を操作する
+ * @param notify [IN] trueならLOWにして通知する。falseなら開放する
+ */
+void set_change_notify(bool notify) {
+    if (notify) {
+        digitalWrite(PIN_CHANGE_NOTIFY, LOW);
+        pinMode(PIN_CHANGE_NOTIFY, OUTPUT);
+    } else {
+        pinMode(PIN_CHANGE_NOTIFY, INPUT);
+    }
+}
+
+
+/** キーマトリクスの走査の時間間隔をはかるタイマー (Timer2) を開始する */
+void scantimer_init(void) {
+    // CTCモード、1024分周。8MHzでは 7812.5Hz となり、39カウントでおよそ5ms
+    TCCR2A = _BV(WGM21);
+    TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20);
+    OCR2A = (uint8_t)(F_CPU / 1024UL * KEYMATRIX_SCAN_INTERVAL_MS / 1000UL - 1);
+    TCNT2 = 0;
+    TIMSK2 = _BV(OCIE2A);
+}
+
+
+ISR(TIMER2_COMPA_vect) {
+    // 走査には時間がかかるので、割り込みの中では行わない
+    keymatrix_scan_requested = true;
+}
+
+
+void wire_onRequest(void) {
+    // 走査は済ませてあるので、用意しておいたものを返すだけ
+    if (i2c_command == I2C_COMMAND_EVENTS) {
+        write_keyevents();
+    } else {
+        Wire.write(ready_report, REPORT_LENGTH);
+    }
+    // コマンドは1回の読み出しに限り有効
+    i2c_command = I2C_COMMAND_REPORT;
 
     return;
 }
 
 
+void wire_onReceive(int len) {
+    if (len < 1) {
+        return;
+    }
+    i2c_command = Wire.read();
+    while (Wire.available() > 0) {
+        Wire.read();
+    }
+}
+
+
 void setup(void) {
     Serial.begin(57600);
 
@@ -205,11 +472,24 @@ void setup(void) {
         digitalWrite(KEYMATRIX_COL_PINS[col], LOW);
     }
 
+    // 起動時に押されているキーは、チャタリング除去を待たずに確定させる
     update_keystatus();
+    for (uint8_t key = 0; key < KEYMATRIX_KEYS_COUNT; ++key) {
+        if (get_bit(raw_keystatus, key)) {
+            debounce_counters[key] = KEYMATRIX_DEBOUNCE_SCANS;
+            set_bit(keystatus, key, true);
+        }
+    }
+    build_report(ready_report);
+    memcpy(prev_keystatus, keystatus, sizeof(keystatus));
+
+    set_change_notify(false);
+    scantimer_init();
 
     Serial.print("Init Wire...");
     Wire.begin(i2c_addr);
     Wire.onRequest(wire_onRequest);
+    Wire.onReceive(wire_onReceive);
     Serial.print(" OK. My address is 0x"); Serial.println(i2c_addr, HEX);
 
     sleepMode(SLEEP_IDLE);
@@ -228,10 +508,29 @@ void update_keystatus(void) {
     keymatrix_clear_status();
     keymatrix_col2row();
     keymatrix_row2col();
+    keymatrix_reject_ghosts();
+    keymatrix_debounce();
 }
 
 
 void loop(void) {
 
+    if (keymatrix_scan_requested) {
+        keymatrix_scan_requested = false;
+
+        update_keystatus();
+        uint8_t report[REPORT_LENGTH];
+        build_report(report);
+        if (memcmp(report, ready_report, REPORT_LENGTH) != 0) {
+            // レポートの差し替えを、I2Cの読み出しと競合しないように行う
+            noInterrupts();
+            memcpy(ready_report, report, REPORT_LENGTH);
+            interrupts();
+        }
+        // 変化をイベントとして積み、通知する（キューが空になるまで通知を続ける）
+        push_keyevents();
+    }
+
+    // タイマーかI2Cの割り込みで起床する
     sleep();
 }
@@ -0,0 +1,71 @@
+#include "profile.h"
+
+#if (!defined(SUPRESS_DEBUG_MESSAGE) || !(SUPRESS_DEBUG_MESSAGE)) && (!defined(SUPRESS_PROFILE) || !(SUPRESS_PROFILE))
+
+#include "debug.h"
+
+
+namespace Profile {
+
+    static constexpr uint8_t COUNTER_COUNT = (uint8_t)Id::COUNT;
+
+    static Counter counters[COUNTER_COUNT];
+
+    // Id と同じ並び
+    static const char* const names[COUNTER_COUNT] = {
+        "henkan",
+        "henkan_okuriari",
+        "search_index",
+        "search_table",
+        "get_glyph_from_kuten",
+        "draw_glyph_2",
+        "print_text",
+        "Keyboard::update",
+        "send_text_via_uart",
+    };
+
+    void record(Id id, uint32_t elapsed_usec) {
+        Counter* counter = &counters[(uint8_t)id];
+        if (counter->count == 0 || elapsed_usec < counter->min_usec) {
+            counter->min_usec = elapsed_usec;
+        }
+        if (elapsed_usec > counter->max_usec) {
+            counter->max_usec = elapsed_usec;
+        }
+        counter->count += 1;
+        counter->total_usec += elapsed_usec;
+    }
+
+    const Counter* get_counter(Id id) {
+        return &counters[(uint8_t)id];
+    }
+
+    const char* get_name(Id id) {
+        return names[(uint8_t)id];
+    }
+
+    void reset(void) {
+        for (uint8_t i = 0; i < COUNTER_COUNT; i++) {
+            counters[i].count = 0;
+            counters[i].total_usec = 0;
+            counters[i].min_usec = 0;
+            counters[i].max_usec = 0;
+        }
+    }
+
+    void dump(void) {
+        DEBUG_PRINTF("Profile: name, count, total, avg, min, max [usec]\n");
+        for (uint8_t i = 0; i < COUNTER_COUNT; i++) {
+            const Counter* counter = &counters[i];
+            if (counter->count == 0) {
+                continue;
+            }
+            DEBUG_PRINTF("  %s, %lu, %lu, %lu, %lu, %lu\n", names[i],
+                    (unsigned long)counter->count, (unsigned long)counter->total_usec,
+                    (unsigned long)(counter->total_usec / counter->count),
+                    (unsigned long)counter->min_usec, (unsigned long)counter->max_usec);
+        }
+    }
+}
+
+#endif
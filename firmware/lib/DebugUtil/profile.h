@@ -0,0 +1,89 @@
+#pragma once
+
+// 実行時間を計測するカウンタ
+// 区間ごとに、呼び出し回数と所要時間の合計・最小・最大を [usec] で静的な表へ記録する。
+// 計測中はなにも出力せず、 Profile::dump() を呼んだときにまとめてデバッグ出力へ書き出す。
+// SUPRESS_DEBUG_MESSAGE または SUPRESS_PROFILE を真にすると、計測はなにもしない。
+
+#include <stdint.h>
+
+
+#if (!defined(SUPRESS_DEBUG_MESSAGE) || !(SUPRESS_DEBUG_MESSAGE)) && (!defined(SUPRESS_PROFILE) || !(SUPRESS_PROFILE))
+
+// プラットフォーム側のコードで、micros()を定義する必要がある
+
+extern "C" {
+    unsigned long micros(void);
+}
+
+namespace Profile {
+
+    /** 計測する区間。名前は get_name() で得る */
+    enum class Id : uint8_t {
+        Henkan,
+        HenkanOkuriari,
+        SearchIndex,
+        SearchTable,
+        GetGlyphFromKuten,
+        DrawGlyph2,
+        PrintText,
+        KeyboardUpdate,
+        SendTextViaUart,
+        COUNT
+    };
+
+    struct Counter {
+        uint32_t count;
+        uint32_t total_usec;
+        uint32_t min_usec;
+        uint32_t max_usec;
+    };
+
+    /** 区間の所要時間を1回ぶん記録する
+     * @param id [IN]
+     * @param elapsed_usec [IN]
+     */
+    void record(Id id, uint32_t elapsed_usec);
+
+    /** 区間のカウンタを得る */
+    const Counter* get_counter(Id id);
+
+    /** 区間の名前を得る */
+    const char* get_name(Id id);
+
+    /** すべてのカウンタを0に戻す */
+    void reset(void);
+
+    /** 1回以上記録された区間のカウンタを、デバッグ出力へ書き出す */
+    void dump(void);
+
+    /** 生成から破棄までを計測する。途中でreturnしても記録される */
+    class Scope {
+    public:
+        Scope(Id id) : id(id), start_usec(micros()) { }
+
+        ~Scope() {
+            record(this->id, (uint32_t)(micros() - this->start_usec));
+        }
+
+    private:
+        Id id;
+        unsigned long start_usec;
+    };
+}
+
+// このマクロを書いたスコープの終わりまでを、指定区間として計測する
+#define PROFILE_SCOPE(id) \
+    Profile::Scope __profile_scope_ ## id(Profile::Id::id)
+
+
+#else
+
+namespace Profile {
+    inline void reset(void) { }
+    inline void dump(void) { }
+}
+
+#define PROFILE_SCOPE(id) ((void)0)
+
+#endif
@@ -0,0 +1,210 @@
+#include <string.h>
+
+#include "BufferedFileAccessor.h"
+#include <commondef.h>
+
+
+bool BufferedFileAccessor::init(FileAccessWrapper* inner, uint8_t* buffer, size_t bufferlen) {
+    size_t count = bufferlen / SECTOR_SIZE;
+    if (inner == nullptr || buffer == nullptr || count == 0) {
+        return false;
+    }
+    if (count > MAX_SECTOR_COUNT) {
+        count = MAX_SECTOR_COUNT;
+    }
+    this->inner = inner;
+    this->buffer = buffer;
+    this->sector_count = (uint8_t)count;
+    this->invalidate();
+    this->reset_stats();
+    return true;
+}
+
+
+void BufferedFileAccessor::invalidate(void) {
+    for (uint8_t i = 0; i < MAX_SECTOR_COUNT; i++) {
+        this->sector_numbers[i] = INVALID_UINT32;
+        this->sector_lengths[i] = 0;
+        this->sector_ages[i] = i;
+    }
+    this->current_slot = 0;
+    if (this->inner != nullptr && this->inner->is_opened()) {
+        this->filesize = this->inner->size();
+        this->pos = this->inner->position();
+    } else {
+        this->filesize = 0;
+        this->pos = 0;
+    }
+}
+
+
+void BufferedFileAccessor::reset_stats(void) {
+    this->hit_count = 0;
+    this->miss_count = 0;
+}
+
+
+void BufferedFileAccessor::touch_slot(uint8_t slot) {
+    uint8_t age = this->sector_ages[slot];
+    for (uint8_t i = 0; i < this->sector_count; i++) {
+        if (this->sector_ages[i] < age) {
+            this->sector_ages[i] += 1;
+        }
+    }
+    this->sector_ages[slot] = 0;
+    this->current_slot = slot;
+}
+
+
+uint8_t BufferedFileAccessor::get_sector_slot(uint32_t sectornumber) {
+    // 連続した読み込みでは直前と同じバッファに当たることがほとんど
+    if (this->sector_numbers[this->current_slot] == sectornumber) {
+        this->hit_count += 1;
+        return this->current_slot;
+    }
+
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < this->sector_count; i++) {
+        if (this->sector_numbers[i] == sectornumber) {
+            this->hit_count += 1;
+            this->touch_slot(i);
+            return i;
+        }
+        if (this->sector_ages[i] > this->sector_ages[oldest]) {
+            oldest = i;
+        }
+    }
+
+    this->miss_count += 1;
+    uint32_t head = sectornumber * SECTOR_SIZE;
+    if (head >= this->filesize) {
+        return INVALID_UINT8;
+    }
+    uint16_t len = SECTOR_SIZE;
+    if (this->filesize - head < len) {
+        len = (uint16_t)(this->filesize - head);
+    }
+    if (this->inner->seek(head) != head) {
+        return INVALID_UINT8;
+    }
+    int readlen = this->inner->read(&this->buffer[(size_t)oldest * SECTOR_SIZE], len);
+    if (readlen <= 0) {
+        this->sector_numbers[oldest] = INVALID_UINT32;
+        return INVALID_UINT8;
+    }
+    this->sector_numbers[oldest] = sectornumber;
+    this->sector_lengths[oldest] = (uint16_t)readlen;
+    this->touch_slot(oldest);
+    return oldest;
+}
+
+
+bool BufferedFileAccessor::open(const char* path, FileMode mode) {
+    if (mode != FileMode::READ) {
+        return false;
+    }
+    if (!this->inner->open(path, mode)) {
+        return false;
+    }
+    this->invalidate();
+    return true;
+}
+
+
+bool BufferedFileAccessor::is_opened(void) {
+    return this->inner != nullptr && this->inner->is_opened();
+}
+
+
+void BufferedFileAccessor::close(void) {
+    if (this->is_opened()) {
+        this->inner->close();
+    }
+    this->invalidate();
+}
+
+
+int BufferedFileAccessor::read(void) {
+    if (this->pos >= this->filesize) {
+        return -1;
+    }
+    uint8_t slot = this->get_sector_slot(this->pos / SECTOR_SIZE);
+    if (slot == INVALID_UINT8) {
+        return -1;
+    }
+    uint16_t offset = this->pos % SECTOR_SIZE;
+    if (offset >= this->sector_lengths[slot]) {
+        return -1;
+    }
+    this->pos += 1;
+    return this->buffer[(size_t)slot * SECTOR_SIZE + offset];
+}
+
+
+int BufferedFileAccessor::read(uint8_t* buf, size_t buflen) {
+    size_t readlen = 0;
+    while (readlen < buflen && this->pos < this->filesize) {
+        uint8_t slot = this->get_sector_slot(this->pos / SECTOR_SIZE);
+        if (slot == INVALID_UINT8) {
+            break;
+        }
+        uint16_t offset = this->pos % SECTOR_SIZE;
+        if (offset >= this->sector_lengths[slot]) {
+            break;
+        }
+        size_t chunklen = this->sector_lengths[slot] - offset;
+        if (chunklen > buflen - readlen) {
+            chunklen = buflen - readlen;
+        }
+        memcpy(&buf[readlen], &this->buffer[(size_t)slot * SECTOR_SIZE + offset], chunklen);
+        readlen += chunklen;
+        this->pos += chunklen;
+    }
+    return (int)readlen;
+}
+
+
+uint16_t BufferedFileAccessor::read_uint16(void) {
+    uint8_t b[2] = { 0 };
+    this->read(b, 2);
+    return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+}
+
+
+uint32_t BufferedFileAccessor::read_uint24(void) {
+    uint8_t b[3] = { 0 };
+    this->read(b, 3);
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16);
+}
+
+
+uint32_t BufferedFileAccessor::read_uint32(void) {
+    uint8_t b[4] = { 0 };
+    this->read(b, 4);
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+
+uint32_t BufferedFileAccessor::position(void) {
+    if (!this->is_opened()) {
+        return INVALID_UINT32;
+    }
+    return this->pos;
+}
+
+
+uint32_t BufferedFileAccessor::seek(uint32_t pos) {
+    if (!this->is_opened()) {
+        return INVALID_UINT32;
+    }
+    // 実際のファイルへのシークは、バッファにないセクタを読み込むときまで遅らせる
+    if (pos <= this->filesize) {
+        this->pos = pos;
+    }
+    return this->pos;
+}
+
+
+uint32_t BufferedFileAccessor::size(void) {
+    return this->filesize;
+}
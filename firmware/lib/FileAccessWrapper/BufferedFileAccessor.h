@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "FileAccessWrapper.h"
+
+
+/** 他のFileAccessWrapperを包み、512バイト単位のセクタバッファで読み込みを肩代わりするクラス
+ * バッファは呼び出し元が用意する。セクタの個数はバッファの大きさで決まる（最大 MAX_SECTOR_COUNT ）。
+ * 読み込み専用。
+ */
+class BufferedFileAccessor : public FileAccessWrapper {
+public:
+    // ひとつのセクタバッファのバイト数
+    static constexpr uint16_t SECTOR_SIZE = 512;
+    // 保持できるセクタバッファの最大数
+    static constexpr uint8_t MAX_SECTOR_COUNT = 4;
+
+// private:
+    // 実際の読み込みを担うファイル
+    FileAccessWrapper* inner = nullptr;
+    // セクタバッファ（ SECTOR_SIZE * sector_count バイト）
+    uint8_t* buffer = nullptr;
+    uint8_t sector_count = 0;
+    // 各バッファに読み込んであるセクタの番号。空ならINVALID_UINT32
+    uint32_t sector_numbers[MAX_SECTOR_COUNT];
+    // 各バッファの有効なバイト数（ファイル末尾のセクタでは SECTOR_SIZE 未満）
+    uint16_t sector_lengths[MAX_SECTOR_COUNT];
+    // 各バッファの古さ。0が直近に使われたもの
+    uint8_t sector_ages[MAX_SECTOR_COUNT];
+    // 直前に使ったバッファの番号
+    uint8_t current_slot = 0;
+    // ファイルの現在の読み込み位置
+    uint32_t pos = 0;
+    uint32_t filesize = 0;
+
+    /** 指定セクタを保持するバッファを探し、なければ最も古いバッファへ読み込む
+     * @return バッファの番号、読み込めなかったらINVALID_UINT8
+     */
+    uint8_t get_sector_slot(uint32_t sectornumber);
+
+    /** 指定バッファを直近に使ったものとして記録する */
+    void touch_slot(uint8_t slot);
+
+public:
+    // バッファから読み込めた回数と、ファイルから読み込みなおした回数
+    uint32_t hit_count = 0;
+    uint32_t miss_count = 0;
+
+    /** 初期化する
+     * @param inner [IN] 実際に読み込むファイル
+     * @param buffer [IN] セクタバッファに用いる領域
+     * @param bufferlen [IN] バッファのバイト数。 SECTOR_SIZE の倍数であること
+     * @return 成功すればtrue
+     */
+    bool init(FileAccessWrapper* inner, uint8_t* buffer, size_t bufferlen);
+
+    /** セクタバッファをすべて破棄する */
+    void invalidate(void);
+
+    /** hit_countとmiss_countを0に戻す */
+    void reset_stats(void);
+
+    virtual bool open(const char* path, FileMode mode) override;
+    virtual bool is_opened(void) override;
+    virtual void close(void) override;
+    virtual int read(void) override;
+    virtual uint32_t position(void) override;
+    virtual uint32_t seek(uint32_t pos) override;
+    virtual uint32_t size(void) override;
+
+    virtual int read(uint8_t* buf, size_t buflen) override;
+    virtual uint16_t read_uint16(void) override;
+    virtual uint32_t read_uint24(void) override;
+    virtual uint32_t read_uint32(void) override;
+};
@@ -12,8 +12,11 @@ public:
     // ---- プラットフォーム依存の実装が必要なメソッド ----
 
     enum class FileMode {
+        // 読み込み専用
         READ,
+        // 新しい空のファイルとして書き込む（既存の内容は捨てる）
         WRITE,
+        // 読み込みと、ファイル末尾への追記
         READWRITE
     };
 
@@ -49,6 +52,11 @@ public:
      */
     virtual uint32_t seek(uint32_t pos) = 0;
 
+    /** ファイルの大きさを取得する
+     * @return ファイルのバイト数
+     */
+    virtual uint32_t size(void) = 0;
+
     /** ファイルの現在の読み込み位置を指定差分だけずらす
      * @param posdelta
      * @return 新しいファイル位置
@@ -93,4 +101,37 @@ public:
         val += (uint32_t)((uint8_t)this->read()) << 24;
         return val;
     }
+
+
+    // ---- 書き込み（対応する実装のみ。デフォルトでは失敗する） ----
+
+    /** 指定バイト数を書き込む。 FileMode::READWRITE ではファイル末尾へ追記する
+     * @return 書き込めたバイト数、書き込めなかったら負の値
+     */
+    virtual int write(const uint8_t* buf, size_t buflen) {
+        (void)buf;
+        (void)buflen;
+        return -1;
+    }
+
+    /** 書き込んだ内容を記録媒体へ反映させる
+     * @return 成功すればtrue
+     */
+    virtual bool flush(void) {
+        return false;
+    }
+
+    bool write_uint8(uint8_t val) {
+        return this->write(&val, 1) == 1;
+    }
+
+    bool write_uint16(uint16_t val) {
+        uint8_t b[2] = { (uint8_t)val, (uint8_t)(val >> 8) };
+        return this->write(b, 2) == 2;
+    }
+
+    bool write_uint24(uint32_t val) {
+        uint8_t b[3] = { (uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16) };
+        return this->write(b, 3) == 3;
+    }
 };
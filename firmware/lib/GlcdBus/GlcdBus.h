@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+
+/* SG12232Cのデータバス D0-D7 と、ATmega4809のポートのビットとの対応
+
+   現在の配線では、データバスは2つのポートにまたがり、ビットの並びも逆順になっている。
+     D0-D3 : PD3-PD0 (Arduinoピン番号 17-14)
+     D4-D7 : PC5-PC2 (Arduinoピン番号 13-10)
+   PD4(RW), PD5(E), PC0(CL), PC1(RES) など、同じポートの他のビットは変更しない。
+
+   ポートの型は DIR, OUT, IN メンバを持つものなら何でもよい（実機では VPORT_t、テストではモック）。
+ */
+namespace GlcdBus {
+
+    // データバスが使うポートDのビット
+    static constexpr uint8_t PORTD_MASK = 0x0F;
+    // データバスが使うポートCのビット
+    static constexpr uint8_t PORTC_MASK = 0x3C;
+
+    /** 下位4ビットの並びを逆順にする */
+    inline uint8_t reverse_nibble(uint8_t v) {
+        static const uint8_t table[16] = {
+            0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+            0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+        };
+        return table[v & 0x0F];
+    }
+
+    /** データバスの値から、ポートDへ出力するビットを得る */
+    inline uint8_t to_portd_bits(uint8_t data) {
+        return reverse_nibble(data & 0x0F);
+    }
+
+    /** データバスの値から、ポートCへ出力するビットを得る */
+    inline uint8_t to_portc_bits(uint8_t data) {
+        return (uint8_t)(reverse_nibble(data >> 4) << 2);
+    }
+
+    /** ポートD, Cの入力値から、データバスの値を得る */
+    inline uint8_t from_port_bits(uint8_t portd_in, uint8_t portc_in) {
+        return reverse_nibble(portd_in & PORTD_MASK)
+             | (uint8_t)(reverse_nibble((portc_in & PORTC_MASK) >> 2) << 4);
+    }
+
+    template <typename PortT>
+    inline void set_output(PortT& portd, PortT& portc) {
+        portd.DIR |= PORTD_MASK;
+        portc.DIR |= PORTC_MASK;
+    }
+
+    template <typename PortT>
+    inline void set_input(PortT& portd, PortT& portc) {
+        portd.DIR &= (uint8_t)~PORTD_MASK;
+        portc.DIR &= (uint8_t)~PORTC_MASK;
+    }
+
+    /** データバスへ1バイトを出力する。ポートごとに1回ずつの書き込みで済む */
+    template <typename PortT>
+    inline void write(PortT& portd, PortT& portc, uint8_t data) {
+        portd.OUT = (uint8_t)((portd.OUT & ~PORTD_MASK) | to_portd_bits(data));
+        portc.OUT = (uint8_t)((portc.OUT & ~PORTC_MASK) | to_portc_bits(data));
+    }
+
+    /** データバスから1バイトを読み込む */
+    template <typename PortT>
+    inline uint8_t read(PortT& portd, PortT& portc) {
+        return from_port_bits(portd.IN, portc.IN);
+    }
+}
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "ByteRingBuffer.h"
+
+
+bool ByteRingBuffer::init(uint8_t* buffer, size_t bufferlen) {
+    if (buffer == nullptr || bufferlen == 0) {
+        return false;
+    }
+    this->buffer = buffer;
+    this->buffer_length = bufferlen;
+    this->clear();
+    return true;
+}
+
+
+void ByteRingBuffer::clear(void) {
+    this->head = 0;
+    this->count = 0;
+}
+
+
+bool ByteRingBuffer::push(const uint8_t* data, size_t len) {
+    if (len > this->free_space()) {
+        return false;
+    }
+    size_t tail = this->head + this->count;
+    if (tail >= this->buffer_length) {
+        tail -= this->buffer_length;
+    }
+    // 領域の末尾までと、折り返した先頭からの2回に分けて書く
+    size_t firstlen = this->buffer_length - tail;
+    if (firstlen > len) {
+        firstlen = len;
+    }
+    memcpy(&this->buffer[tail], data, firstlen);
+    memcpy(this->buffer, &data[firstlen], len - firstlen);
+    this->count += len;
+    return true;
+}
+
+
+bool ByteRingBuffer::push_byte(uint8_t data) {
+    return this->push(&data, 1);
+}
+
+
+size_t ByteRingBuffer::peek_contiguous(const uint8_t** data) const {
+    *data = &this->buffer[this->head];
+    size_t len = this->buffer_length - this->head;
+    if (len > this->count) {
+        len = this->count;
+    }
+    return len;
+}
+
+
+void ByteRingBuffer::consume(size_t len) {
+    if (len >= this->count) {
+        this->clear();
+        return;
+    }
+    this->head += len;
+    if (this->head >= this->buffer_length) {
+        this->head -= this->buffer_length;
+    }
+    this->count -= len;
+}
+
+
+size_t ByteRingBuffer::pop(uint8_t* dst, size_t len) {
+    size_t readlen = 0;
+    while (readlen < len && !this->is_empty()) {
+        const uint8_t* src;
+        size_t chunklen = this->peek_contiguous(&src);
+        if (chunklen > len - readlen) {
+            chunklen = len - readlen;
+        }
+        memcpy(&dst[readlen], src, chunklen);
+        this->consume(chunklen);
+        readlen += chunklen;
+    }
+    return readlen;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/** バイト列のリングバッファ
+ * 領域は呼び出し元が用意する。書き込み側と読み出し側は同じコンテキストから使う（割り込みからは使わない）。
+ */
+class ByteRingBuffer {
+public:
+
+// private:
+    uint8_t* buffer = nullptr;
+    size_t buffer_length = 0;
+    // 先頭（次に読み出す）バイトの位置
+    size_t head = 0;
+    // 格納しているバイト数
+    size_t count = 0;
+
+public:
+    /** 初期化する
+     * @param buffer [IN] 利用する領域
+     * @param bufferlen [IN] 領域のバイト数
+     * @return 成功すればtrue
+     */
+    bool init(uint8_t* buffer, size_t bufferlen);
+
+    /** 空にする */
+    void clear(void);
+
+    /** 格納しているバイト数 */
+    size_t size(void) const {
+        return this->count;
+    }
+
+    /** 追加できるバイト数 */
+    size_t free_space(void) const {
+        return this->buffer_length - this->count;
+    }
+
+    bool is_empty(void) const {
+        return this->count == 0;
+    }
+
+    /** 末尾に追加する。収まらなければ何もしない
+     * @return 追加できたらtrue
+     */
+    bool push(const uint8_t* data, size_t len);
+
+    bool push_byte(uint8_t data);
+
+    /** 先頭から、折り返さずに連続して読み出せる範囲を得る
+     * @param data [OUT] 範囲の先頭
+     * @return 範囲のバイト数
+     */
+    size_t peek_contiguous(const uint8_t** data) const;
+
+    /** 先頭から指定のバイト数を捨てる */
+    void consume(size_t len);
+
+    /** 先頭から読み出す
+     * @return 読み出したバイト数
+     */
+    size_t pop(uint8_t* dst, size_t len);
+};
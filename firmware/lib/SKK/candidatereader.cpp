@@ -6,28 +6,371 @@
 
 using namespace SKK;
 
-void CandidateReader::init(SkkDict* parent, uint8_t candidatescnt, uint16_t candidateslen, uint32_t startaddr) {
+void CandidateReader::init(SkkDict* parent, uint8_t candidatescnt, uint16_t candidateslen, uint32_t startaddr, bool compressed) {
     this->parentDict = parent;
+    this->compressed = compressed;
     this->candidates_count = candidatescnt;
     this->candidateslen = candidateslen;
     this->startaddr = startaddr;
-    this->parentDict->file->seek(startaddr);
-    this->current_candidate_head = startaddr;
-    this->current_candidate_len = (uint8_t)this->parentDict->file->read_uint8();
-    this->current_remains = this->current_candidate_len;
-    this->current_candidate_count = 1;
+    this->pinned_candidate = nullptr;
+    this->pinned_candidate_len = 0;
+    this->pinned_duplicate_index = 0;
+    this->dict_candidates_count = candidatescnt;
+    this->preferred_count = 0;
+    this->okurigana = nullptr;
+    this->okurigana_len = 0;
+    this->prefetch();
+    this->move_head();
     // this->move_next();
     // DEBUG("count=%d, len=%d, addr=%ld", this->candidates_count, this->candidateslen, this->startaddr);
     // DEBUG("current candidate: len=%d, remains=%d", (uint8_t)this->current_candidate_len, (uint8_t)this->current_remains);
 }
 
+void CandidateReader::init_pinned_only(const char* candidate, uint8_t candidatelen) {
+    this->parentDict = nullptr;
+    this->compressed = false;
+    this->prefetched = false;
+    this->candidates_count = 1;
+    this->candidateslen = candidatelen;
+    this->startaddr = INVALID_UINT32;
+    this->pinned_candidate = candidate;
+    this->pinned_candidate_len = candidatelen;
+    this->pinned_duplicate_index = 0;
+    this->dict_candidates_count = 0;
+    this->preferred_count = 0;
+    this->okurigana = nullptr;
+    this->okurigana_len = 0;
+    this->move_head();
+}
+
+void CandidateReader::set_prefetch_buffer(uint8_t* buffer, uint16_t bufferlen) {
+    this->prefetch_buffer = buffer;
+    this->prefetch_buffer_len = buffer ? bufferlen : 0;
+    this->prefetched = false;
+}
+
+bool CandidateReader::is_prefetched(void) {
+    return this->prefetched;
+}
+
+bool CandidateReader::prefetch(void) {
+    this->prefetched = false;
+    if (this->prefetch_buffer == nullptr || this->dict_candidates_count == 0) {
+        return false;
+    }
+    uint16_t tablelen = (uint16_t)this->dict_candidates_count * 2;
+    if ((uint32_t)tablelen + this->candidateslen > this->prefetch_buffer_len) {
+        DEBUG("Streaming %d bytes (buffer is %d bytes).", this->candidateslen, this->prefetch_buffer_len);
+        return false;
+    }
+    this->parentDict->file->seek(this->startaddr);
+    if (this->parentDict->file->read(&this->prefetch_buffer[tablelen], this->candidateslen) != (int)this->candidateslen) {
+        return false;
+    }
+
+    // 各候補の長さをたどって、位置を表に書く。ここからは fetch_dict_byte() がバッファから読む
+    this->prefetched = true;
+    uint16_t tail = tablelen + this->candidateslen;
+    this->prefetch_pos = tablelen;
+    for (uint8_t i = 0; i < this->dict_candidates_count; i++) {
+        if (this->prefetch_pos >= tail) {
+            this->prefetched = false;
+            return false;
+        }
+        this->prefetch_buffer[i * 2] = (uint8_t)this->prefetch_pos;
+        this->prefetch_buffer[i * 2 + 1] = (uint8_t)(this->prefetch_pos >> 8);
+        this->current_remains = this->prefetch_buffer[this->prefetch_pos];
+        this->prefetch_pos += 1;
+        if (this->compressed) {
+            // 展開後のバイト数しかわからないので、展開してたどる
+            this->phrase_remains = 0;
+            this->expect_trail_byte = false;
+            while (this->current_remains > 0) {
+                this->current_remains -= 1;
+                if (this->read_dict_byte() < 0) {
+                    this->prefetched = false;
+                    return false;
+                }
+            }
+        } else {
+            this->prefetch_pos += this->current_remains;
+        }
+    }
+    if (this->prefetch_pos > tail) {
+        this->prefetched = false;
+        return false;
+    }
+    return true;
+}
+
+uint16_t CandidateReader::get_prefetched_offset(uint8_t index) {
+    uint16_t i = (uint16_t)(index - 1) * 2;
+    return (uint16_t)this->prefetch_buffer[i] | ((uint16_t)this->prefetch_buffer[i + 1] << 8);
+}
+
+void CandidateReader::dict_seek_prefetched(uint8_t index) {
+    uint16_t offset = this->get_prefetched_offset(index);
+    this->dict_candidate_index = index;
+    this->phrase_remains = 0;
+    this->expect_trail_byte = false;
+    this->current_candidate_head = this->startaddr + (offset - (uint16_t)this->dict_candidates_count * 2);
+    this->current_candidate_len = this->prefetch_buffer[offset];
+    this->current_remains = this->current_candidate_len;
+    this->okurigana_remains = this->okurigana_len;
+    this->prefetch_pos = offset + 1;
+}
+
+int CandidateReader::fetch_dict_byte(void) {
+    if (this->prefetched) {
+        if (this->prefetch_pos >= (uint16_t)this->dict_candidates_count * 2 + this->candidateslen) {
+            return -1;
+        }
+        return this->prefetch_buffer[this->prefetch_pos++];
+    }
+    return this->parentDict->file->read();
+}
+
+void CandidateReader::set_pinned(const char* candidate, uint8_t candidatelen) {
+    // 辞書の候補から同じものを探す
+    this->pinned_duplicate_index = 0;
+    this->dict_move_head();
+    while (this->dict_candidate_index <= this->dict_candidates_count) {
+        if (this->current_candidate_len == candidatelen) {
+            uint8_t i = 0;
+            while (i < candidatelen && this->read() == (uint8_t)candidate[i]) {
+                ++i;
+            }
+            if (i == candidatelen) {
+                this->pinned_duplicate_index = this->dict_candidate_index;
+                break;
+            }
+        }
+        this->dict_move_next();
+    }
+
+    this->pinned_candidate = candidate;
+    this->pinned_candidate_len = candidatelen;
+    this->candidates_count = this->dict_candidates_count + (this->pinned_duplicate_index == 0 ? 1 : 0);
+    this->move_head();
+}
+
+void CandidateReader::set_preferred(const uint8_t* indices, uint8_t count) {
+    this->preferred_count = 0;
+    for (uint8_t i = 0; i < count && this->preferred_count < MAX_PREFERRED; i++) {
+        uint8_t index = indices[i];
+        if (index == 0 || index > this->dict_candidates_count || index == this->pinned_duplicate_index) {
+            continue;
+        }
+        if (this->is_reordered(index)) {
+            // 同じ番号が重ねて指定された
+            continue;
+        }
+        this->preferred_indices[this->preferred_count] = index;
+        this->preferred_count += 1;
+    }
+    this->move_head();
+}
+
+void CandidateReader::set_okurigana(const char* okurigana, uint8_t okuriganalen) {
+    this->okurigana = okurigana;
+    this->okurigana_len = okurigana ? okuriganalen : 0;
+    this->move_head();
+}
+
+bool CandidateReader::is_reordered(uint8_t index) {
+    if (index == this->pinned_duplicate_index) {
+        return true;
+    }
+    for (uint8_t i = 0; i < this->preferred_count; i++) {
+        if (this->preferred_indices[i] == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CandidateReader::dict_move_head(void) {
+    this->dict_candidate_index = 1;
+    if (this->dict_candidates_count == 0) {
+        this->current_candidate_len = 0;
+        this->current_remains = 0;
+        this->okurigana_remains = 0;
+        return;
+    }
+    if (this->prefetched) {
+        this->dict_seek_prefetched(1);
+        return;
+    }
+    this->dict_seek_offset(1, 0);
+}
+
+void CandidateReader::dict_seek_offset(uint8_t index, uint16_t offset) {
+    this->dict_candidate_index = index;
+    this->current_candidate_head = this->startaddr + offset;
+    this->parentDict->file->seek(this->current_candidate_head);
+    this->phrase_remains = 0;
+    this->expect_trail_byte = false;
+    this->current_candidate_len = (uint8_t)this->parentDict->file->read_uint8();
+    this->current_remains = this->current_candidate_len;
+    this->okurigana_remains = this->okurigana_len;
+}
+
+void CandidateReader::dict_move_next(void) {
+    this->dict_candidate_index += 1;
+    if (this->dict_candidate_index > this->dict_candidates_count) {
+        // 末尾を越えたので、ファイルは読まない
+        this->current_candidate_len = 0;
+        this->current_remains = 0;
+        this->okurigana_remains = 0;
+        return;
+    }
+    if (this->prefetched) {
+        this->dict_seek_prefetched(this->dict_candidate_index);
+        return;
+    }
+    // 読み残したぶんを飛ばして、次の候補の先頭へ
+    this->skip_dict_remains();
+    this->current_candidate_head = this->parentDict->file->position();
+    this->current_candidate_len = this->parentDict->file->read_uint8();
+    this->current_remains = this->current_candidate_len;
+    this->okurigana_remains = this->okurigana_len;
+}
+
+int CandidateReader::read_dict_byte(void) {
+    if (this->phrase_remains > 0) {
+        this->phrase_remains -= 1;
+        return *this->phrase_ptr++;
+    }
+    int b = this->fetch_dict_byte();
+    if (b < 0 || !this->compressed) {
+        return b;
+    }
+    if (this->expect_trail_byte) {
+        this->expect_trail_byte = false;
+        return b;
+    }
+    if (SkkDict::is_phrase_code((uint8_t)b)) {
+        uint8_t len = 0;
+        const uint8_t* phrase = this->parentDict->get_phrase((uint8_t)b, &len);
+        if (phrase == nullptr || len == 0) {
+            return -1;
+        }
+        this->phrase_ptr = phrase + 1;
+        this->phrase_remains = len - 1;
+        return phrase[0];
+    }
+    // Shift_JISの2バイト文字の1バイト目
+    this->expect_trail_byte = (0x81 <= b && b <= 0x9F) || (0xE0 <= b && b <= 0xEF);
+    return b;
+}
+
+void CandidateReader::skip_dict_remains(void) {
+    if (!this->compressed) {
+        this->parentDict->file->seek_delta(this->current_remains);
+        return;
+    }
+    // 展開後のバイト数しかわからないので、展開しながら読み飛ばす
+    while (this->current_remains > 0) {
+        this->current_remains -= 1;
+        this->read_dict_byte();
+    }
+    this->phrase_remains = 0;
+    this->expect_trail_byte = false;
+}
+
+void CandidateReader::dict_move_to(uint8_t index) {
+    if (index > this->dict_candidates_count) {
+        this->dict_candidate_index = index;
+        this->current_candidate_len = 0;
+        this->current_remains = 0;
+        this->okurigana_remains = 0;
+        return;
+    }
+    if (this->prefetched) {
+        // 位置がわかっているので、前後どちらへも直接移動できる
+        this->dict_seek_prefetched(index);
+        return;
+    }
+    if (this->dict_candidate_index == index) {
+        // 同じ候補なら、その先頭へ戻るだけでよい
+        this->dict_rewind_current();
+        return;
+    }
+    if (this->dict_candidate_index == 0 || this->dict_candidate_index > index
+            || this->dict_candidate_index > this->dict_candidates_count) {
+        // ファイルは前へは読み進められないので、先頭から数えなおす
+        this->dict_move_head();
+    }
+    while (this->dict_candidate_index < index) {
+        this->dict_move_next();
+    }
+}
+
+void CandidateReader::dict_rewind_current(void) {
+    this->okurigana_remains = this->okurigana_len;
+    if (this->current_remains == this->current_candidate_len
+            && this->phrase_remains == 0 && !this->expect_trail_byte) {
+        // まだ読んでいないので、ファイルの位置はそのまま
+        return;
+    }
+    this->parentDict->file->seek(this->current_candidate_head);
+    this->phrase_remains = 0;
+    this->expect_trail_byte = false;
+    this->current_candidate_len = (uint8_t)this->parentDict->file->read_uint8();
+    this->current_remains = this->current_candidate_len;
+}
+
+uint8_t CandidateReader::get_dict_index_of_order(uint8_t position) {
+    if (position <= this->preferred_count) {
+        return this->preferred_indices[position - 1];
+    }
+    // 先に返した候補を除いて、ファイルの順番で続ける
+    uint8_t remains = position - this->preferred_count;
+    uint8_t index = 0;
+    while (remains > 0 && index <= this->dict_candidates_count) {
+        ++index;
+        if (index > this->dict_candidates_count || !this->is_reordered(index)) {
+            remains -= 1;
+        }
+    }
+    return index;
+}
+
+void CandidateReader::dict_move_to_order(uint8_t position) {
+    this->dict_order_position = position;
+    this->dict_move_to(this->get_dict_index_of_order(position));
+}
+
 uint8_t CandidateReader::get_candidates_count(void) {
     return this->candidates_count;
 }
 
 
 uint16_t CandidateReader::get_current_candidate_length(void) {
-    return this->current_candidate_len;
+    if (this->current_candidate_len == 0) {
+        return 0;
+    }
+    return this->current_candidate_len + this->okurigana_len;
+}
+
+uint8_t CandidateReader::get_current_index(void) {
+    return this->current_candidate_count;
+}
+
+uint8_t CandidateReader::get_current_dict_index(void) {
+    if (this->dict_candidate_index == 0) {
+        // RAM上の候補が辞書にもあれば、その番号
+        return this->pinned_duplicate_index;
+    }
+    return this->dict_candidate_index;
+}
+
+uint8_t CandidateReader::get_dict_candidates_count(void) {
+    return this->dict_candidates_count;
+}
+
+bool CandidateReader::is_pinned_only(void) {
+    return this->parentDict == nullptr && this->pinned_candidate != nullptr;
 }
 
 int CandidateReader::read(void) {
@@ -35,11 +378,22 @@ int CandidateReader::read(void) {
         // DEBUG("Reached to end.");
         return -1;
     } else if (this->current_remains == 0) {
+        if (this->okurigana_remains > 0) {
+            // 候補の後ろに送り仮名を続ける
+            uint8_t pos = this->okurigana_len - this->okurigana_remains;
+            this->okurigana_remains -= 1;
+            return (uint8_t)this->okurigana[pos];
+        }
         // DEBUG("No byte remains in this candidate.");
         return -1;
+    } else if (this->dict_candidate_index == 0) {
+        // RAM上の候補
+        uint8_t pos = this->pinned_candidate_len - this->current_remains;
+        this->current_remains -= 1;
+        return (uint8_t)this->pinned_candidate[pos];
     } else {
         this->current_remains -= 1;
-        return this->parentDict->file->read_uint8();
+        return this->read_dict_byte();
     }
 }
 
@@ -49,29 +403,79 @@ bool CandidateReader::move_next(void) {
         return false;
     }
 
-    // Seek to next head.
-    // uint32_t next_candidate_head_addr = this->current_candidate_head + 1 + this->current_candidate_len;
-    // this->parentDict->file->seek(next_candidate_head_addr);
-    // this->parentDict->file->seek_delta(this->current_candidate_len + 1);
-    while (this->current_remains > 0) {
-        (void)this->read();
-    }
-
-    // Set fields.
-    this->current_candidate_head = this->parentDict->file->position();
-    this->current_candidate_len = this->parentDict->file->read_uint8();
-    this->current_remains = this->current_candidate_len;
     this->current_candidate_count += 1;
+    // RAM上の候補の次は、辞書の候補の順番の先頭
+    this->dict_move_to_order(this->dict_order_position + 1);
     DEBUG("moved. count=%d, len=%d, addr=%ld", this->candidates_count, this->candidateslen, this->startaddr);
     return true;
 }
 
+bool CandidateReader::move_prev(void) {
+    if (this->current_candidate_count <= 1) {
+        return false;
+    }
+    return this->move_to(this->current_candidate_count - 1);
+}
+
+bool CandidateReader::move_to(uint8_t index) {
+    if (index == 0 || index > this->candidates_count) {
+        return false;
+    }
+    if (index == 1) {
+        return this->move_head();
+    }
+    this->current_candidate_count = index;
+    // RAM上の候補があれば、辞書の候補の順番はひとつずれる
+    this->dict_move_to_order(this->pinned_candidate ? index - 1 : index);
+    return true;
+}
+
+uint16_t CandidateReader::get_current_offset(void) {
+    if (this->dict_candidate_index == 0 || this->dict_candidate_index > this->dict_candidates_count) {
+        return INVALID_UINT16;
+    }
+    return (uint16_t)(this->current_candidate_head - this->startaddr);
+}
+
+bool CandidateReader::move_to_offset(uint8_t index, uint16_t offset) {
+    if (offset == INVALID_UINT16 || index == 0 || index > this->candidates_count) {
+        return this->move_to(index);
+    }
+    uint8_t position = this->pinned_candidate ? index - 1 : index;
+    if (position == 0) {
+        // RAM上の候補
+        return this->move_head();
+    }
+    uint8_t dictindex = this->get_dict_index_of_order(position);
+    if (dictindex > this->dict_candidates_count) {
+        return this->move_to(index);
+    }
+    this->current_candidate_count = index;
+    this->dict_order_position = position;
+    if (this->prefetched) {
+        this->dict_seek_prefetched(dictindex);
+    } else if (this->dict_candidate_index == dictindex) {
+        this->dict_rewind_current();
+    } else {
+        // 間の候補の長さをたどらずに、直接シークする
+        this->dict_seek_offset(dictindex, offset);
+    }
+    return true;
+}
+
 bool CandidateReader::move_head(void) {
-    this->parentDict->file->seek(this->startaddr);
-    this->current_candidate_head = this->startaddr;
-    this->current_candidate_len = this->parentDict->file->read_uint8();
-    this->current_remains = this->current_candidate_len;
     this->current_candidate_count = 1;
+    if (this->pinned_candidate) {
+        // RAM上の候補なので、ファイルは読まない
+        this->dict_candidate_index = 0;
+        this->dict_order_position = 0;
+        this->current_candidate_len = this->pinned_candidate_len;
+        this->current_remains = this->pinned_candidate_len;
+        this->okurigana_remains = this->okurigana_len;
+    } else {
+        this->dict_candidate_index = 0;
+        this->dict_move_to_order(1);
+    }
     DEBUG("Move to head.");
     return true;
 }
@@ -12,7 +12,7 @@ namespace SKK {
      */
     class CandidateReader {
     public:
-        SkkDict* parentDict;
+        SkkDict* parentDict = nullptr;
         uint8_t candidates_count = 0;
         uint16_t candidateslen = 0;
         uint32_t startaddr = INVALID_UINT32;
@@ -21,14 +21,166 @@ namespace SKK {
         uint8_t current_remains = 0;
         uint8_t current_candidate_count = 0;
 
+        // 辞書の候補より先に返す、RAM上の候補（学習した候補）。なければnullptr
+        const char* pinned_candidate = nullptr;
+        uint8_t pinned_candidate_len = 0;
+        // 辞書の候補のうち pinned_candidate と同じもの（1始まり）。なければ0
+        uint8_t pinned_duplicate_index = 0;
+        // 辞書に収録されている候補の個数
+        uint8_t dict_candidates_count = 0;
+        // いま読んでいる辞書の候補（1始まり）。 pinned_candidate を読んでいるなら0
+        uint8_t dict_candidate_index = 0;
+
+        static constexpr uint8_t MAX_PREFERRED = 4;
+        // 辞書の候補のうち、ファイルの順番より先に返すもの（1始まり）
+        uint8_t preferred_indices[MAX_PREFERRED];
+        uint8_t preferred_count = 0;
+        // 辞書の候補を返す順番での、いまの位置（1始まり）。 pinned_candidate を読んでいるなら0
+        uint8_t dict_order_position = 0;
+
+        // 各候補の後ろに付ける送り仮名。なければnullptr
+        const char* okurigana = nullptr;
+        uint8_t okurigana_len = 0;
+        // いまの候補で、まだ読んでいない送り仮名のバイト数
+        uint8_t okurigana_remains = 0;
+
+        // 'TBZ' の項目か。そうなら候補は定型句の番号を含むので、展開しながら読む
+        bool compressed = false;
+        // 展開中の定型句の、まだ返していない部分
+        const uint8_t* phrase_ptr = nullptr;
+        uint8_t phrase_remains = 0;
+        // 直前に読んだバイトが2バイト文字の1バイト目なら、次のバイトは定型句の番号ではない
+        bool expect_trail_byte = false;
+
+        // 辞書の候補の区間をまとめて読み込む、呼び出し元が用意した領域。なければnullptr
+        uint8_t* prefetch_buffer = nullptr;
+        uint16_t prefetch_buffer_len = 0;
+        // 候補の区間を prefetch_buffer に読み込んであるか。
+        // 先頭に各候補の位置（ prefetch_buffer 内の位置、リトルエンディアンの2バイト）を候補の個数だけ並べ、その後ろに区間を置く
+        bool prefetched = false;
+        // prefetch_buffer の中で、次に読むバイトの位置
+        uint16_t prefetch_pos = 0;
+
+        /** 辞書の候補の区間を prefetch_buffer へ読み込み、各候補の位置を求める
+         * @return 読み込めたらtrue。領域が足りなければfalseで、ファイルから少しずつ読む
+         */
+        bool prefetch(void);
+
+        /** prefetch_buffer の中の、指定の候補の位置
+         * @param index [IN] 候補の番号（1始まり）
+         */
+        uint16_t get_prefetched_offset(uint8_t index);
+
+        /** prefetch_buffer の指定の候補へ移動する
+         * @param index [IN] 候補の番号（1始まり）
+         */
+        void dict_seek_prefetched(uint8_t index);
+
+        /** 辞書の候補の区間から1バイト読む。定型句は展開しない */
+        int fetch_dict_byte(void);
+
+        /** 辞書の候補を1バイト読む。定型句は展開する */
+        int read_dict_byte(void);
+
+        /** 辞書のいまの候補の、読み残したぶんを飛ばす */
+        void skip_dict_remains(void);
+
+        /** 辞書の指定の候補の先頭へシークする（先読みしていないとき）
+         * @param index [IN] 候補の番号（1始まり）
+         * @param offset [IN] その候補の先頭の位置（ startaddr からのバイト数）
+         */
+        void dict_seek_offset(uint8_t index, uint16_t offset);
+
+        /** 辞書の最初の候補へ移動する */
+        void dict_move_head(void);
+
+        /** 辞書の次の候補へ移動する */
+        void dict_move_next(void);
+
+        /** 辞書のいまの候補の先頭へ戻る（先読みしていないとき）。読んでいなければファイルは読まない */
+        void dict_rewind_current(void);
+
+        /** 辞書の指定の候補へ移動する。いまの候補より前なら先頭から読みなおす
+         * @param index [IN] 候補の番号（1始まり）
+         */
+        void dict_move_to(uint8_t index);
+
+        /** 辞書の候補を返す順番で、指定の位置にある候補の番号（1始まり）
+         * 番号を数えるだけなのでファイルは読まない。
+         * @param position [IN] 位置（1始まり）
+         */
+        uint8_t get_dict_index_of_order(uint8_t position);
+
+        /** 辞書の候補を返す順番で、指定の位置の候補へ移動する
+         * 先に preferred_indices を、次にそれ以外をファイルの順番で返す。
+         * @param position [IN] 位置（1始まり）
+         */
+        void dict_move_to_order(uint8_t position);
+
+        /** ファイルの順番で返すときに飛ばす候補か（先に返したもの） */
+        bool is_reordered(uint8_t index);
+
+        /** init() で辞書の候補の区間をまとめて読み込む領域を設定する
+         * 区間が収まれば、以降の移動と読み込みはRAM上で済む。収まらなければファイルから少しずつ読む。
+         * init() より前に呼ぶ。設定は次の init() 以降も保たれる。
+         * @param buffer [IN] 候補の個数 * 2 + 区間のバイト数 が必要。nullptrなら使わない
+         * @param bufferlen [IN]
+         */
+        void set_prefetch_buffer(uint8_t* buffer, uint16_t bufferlen);
+
+        /** 辞書の候補の区間を、 set_prefetch_buffer() の領域へ読み込んであるか */
+        bool is_prefetched(void);
+
         /**
          * NOTE: 内部で読み込み動作をする。
          * @param parent [IN] 変換候補を収録している辞書へのポインタ
          * @param candidatescnt [IN] 変換候補の個数
          * @param candidateslen [IN] 変換候補の総バイト数 （終端NULを含まない）
          * @param startaddr [IN] 最初の変換候補の先頭アドレス（このアドレス位置に最初の変換候補のバイト数がある）
+         * @param compressed [IN] 'TBZ' の項目か（変換候補のバイト数は展開後のもの）
+         */
+        void init(SkkDict* parent, uint8_t candidatescnt, uint16_t candidateslen, uint32_t startaddr, bool compressed = false);
+
+        /** RAM上の1つの候補だけを返すように初期化する（辞書に見つからなかった学習候補）
+         * @param candidate [IN] 候補の文字列。読み終えるまで保持されていること
+         * @param candidatelen [IN]
+         */
+        void init_pinned_only(const char* candidate, uint8_t candidatelen);
+
+        /** RAM上の候補を、辞書の候補より先に返すようにする。辞書にある同じ候補は飛ばす
+         * init() のあとに呼ぶ。NOTE: 重複を探すために辞書の候補を一通り読み込む。
+         * @param candidate [IN] 候補の文字列。読み終えるまで保持されていること
+         * @param candidatelen [IN]
+         */
+        void set_pinned(const char* candidate, uint8_t candidatelen);
+
+        /** 辞書の候補のうち指定のものを、ファイルの順番より先に、指定の順番で返すようにする
+         * init() と set_pinned() のあとに呼ぶ。範囲外の番号や、 pinned_candidate と同じ候補の番号は無視する。
+         * @param indices [IN] 候補の番号（1始まり）
+         * @param count [IN] 番号の個数。 MAX_PREFERRED を超えるぶんは無視する
+         */
+        void set_preferred(const uint8_t* indices, uint8_t count);
+
+        /** 各候補を読むときに、後ろへ送り仮名を付ける
+         * init() のあとに呼ぶ。候補の長さにも送り仮名のぶんが含まれるようになる。
+         * @param okurigana [IN] 送り仮名の文字列。読み終えるまで保持されていること
+         * @param okuriganalen [IN]
+         */
+        void set_okurigana(const char* okurigana, uint8_t okuriganalen);
+
+        /** 現在の候補が何番目か（1始まり）
          */
-        void init(SkkDict* parent, uint8_t candidatescnt, uint16_t candidateslen, uint32_t startaddr);
+        uint8_t get_current_index(void);
+
+        /** 現在の候補が辞書の何番目の候補か（1始まり）。辞書にないRAM上の候補なら0
+         */
+        uint8_t get_current_dict_index(void);
+
+        /** 辞書に収録されている候補の個数 */
+        uint8_t get_dict_candidates_count(void);
+
+        /** init_pinned_only() で初期化された、RAM上の1つの候補だけを返す状態か */
+        bool is_pinned_only(void);
 
         uint8_t get_candidates_count(void);
 
@@ -42,6 +194,30 @@ namespace SKK {
 
         bool move_next(void);
 
+        /** 前の候補へ移動する
+         * @return 先頭の候補にいたならfalse
+         */
+        bool move_prev(void);
+
+        /** 指定の候補へ移動する
+         * @param index [IN] 何番目か（1始まり、 get_current_index() と同じ）
+         * @return 範囲外ならfalse
+         */
+        bool move_to(uint8_t index);
+
+        /** 現在の候補の先頭の位置（ startaddr からのバイト数）。 move_to_offset() へ渡す
+         * @return 辞書にないRAM上の候補や、末尾を越えていれば INVALID_UINT16
+         */
+        uint16_t get_current_offset(void);
+
+        /** 指定の候補へ、位置がわかっているので前の候補を読まずに移動する
+         * 候補の区間を先読みしていなくても、シークは1回で済む。
+         * @param index [IN] 何番目か（1始まり、 get_current_index() と同じ）
+         * @param offset [IN] その候補で get_current_offset() が返した値。 INVALID_UINT16 なら move_to() と同じ
+         * @return 範囲外ならfalse
+         */
+        bool move_to_offset(uint8_t index, uint16_t offset);
+
         bool move_head(void);
 
         bool is_reached_end(void);
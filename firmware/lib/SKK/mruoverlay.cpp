@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include <debug.h>
+#include <commondef.h>
+
+#include "mruoverlay.h"
+
+
+using namespace SKK;
+
+
+static const uint8_t FILE_HEADER[MruOverlay::FILE_HEADER_LENGTH] = { 'S', 'K', 'M', 2 };
+
+
+bool MruOverlay::init(FileAccessWrapper* file, const char* path, uint8_t* buffer, size_t bufferlen) {
+    size_t count = bufferlen / RECORD_SIZE;
+    if (file == nullptr || buffer == nullptr || count == 0) {
+        return false;
+    }
+    if (count > 0xFF) {
+        count = 0xFF;
+    }
+    this->file = file;
+    this->path = path;
+    this->table = buffer;
+    this->record_count = (uint8_t)count;
+    this->used_count = 0;
+    this->file_records = INVALID_UINT32;
+
+    if (!this->load()) {
+        // まだ一度も選ばれていなければファイルは存在しない
+        DEBUG("No MRU overlay loaded.");
+        this->used_count = 0;
+    }
+    return true;
+}
+
+
+uint16_t MruOverlay::hash_key(const char* yomigana, size_t yomiganalen) {
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < yomiganalen; i++) {
+        hash ^= (uint8_t)yomigana[i];
+        hash *= 16777619UL;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+
+uint8_t MruOverlay::find_record(uint16_t hash, uint8_t dictcount) {
+    for (uint8_t i = 0; i < this->used_count; i++) {
+        uint8_t* record = this->get_record(i);
+        if (record[RECORD_HASH] == (uint8_t)(hash & 0xFF)
+                && record[RECORD_HASH + 1] == (uint8_t)(hash >> 8)
+                && record[RECORD_DICTCOUNT] == dictcount) {
+            return i;
+        }
+    }
+    return INVALID_UINT8;
+}
+
+
+void MruOverlay::put_front(const uint8_t* newrecord) {
+    uint16_t hash = (uint16_t)newrecord[RECORD_HASH] | ((uint16_t)newrecord[RECORD_HASH + 1] << 8);
+    uint8_t found = this->find_record(hash, newrecord[RECORD_DICTCOUNT]);
+    if (found == INVALID_UINT8) {
+        if (this->used_count < this->record_count) {
+            found = this->used_count;
+            this->used_count += 1;
+        } else {
+            // 最も前に選ばれた項目を捨てる
+            found = this->record_count - 1;
+        }
+    }
+    // 項目を表の先頭へ移す
+    memmove(this->get_record(1), this->get_record(0), (size_t)found * RECORD_SIZE);
+    memcpy(this->get_record(0), newrecord, RECORD_SIZE);
+}
+
+
+bool MruOverlay::load(void) {
+    if (this->file->is_opened()) {
+        this->file->close();
+    }
+    if (!this->file->open(this->path, FileAccessWrapper::FileMode::READ)) {
+        return false;
+    }
+    uint8_t header[FILE_HEADER_LENGTH];
+    bool loaded = false;
+    if (this->file->read(header, FILE_HEADER_LENGTH) == FILE_HEADER_LENGTH
+            && memcmp(header, FILE_HEADER, FILE_HEADER_LENGTH) == 0) {
+        // 古い項目から順に表の先頭へ積むので、最後に読んだものが最も新しい
+        uint32_t count = (this->file->size() - FILE_HEADER_LENGTH) / RECORD_SIZE;
+        uint8_t record[RECORD_SIZE];
+        loaded = true;
+        for (uint32_t i = 0; i < count; i++) {
+            if (this->file->read(record, RECORD_SIZE) != RECORD_SIZE) {
+                loaded = false;
+                break;
+            }
+            this->put_front(record);
+        }
+        if (loaded) {
+            this->file_records = count;
+        } else {
+            this->used_count = 0;
+        }
+    }
+    this->file->close();
+    return loaded;
+}
+
+
+bool MruOverlay::save(void) {
+    if (this->file->is_opened()) {
+        this->file->close();
+    }
+    if (!this->file->open(this->path, FileAccessWrapper::FileMode::WRITE)) {
+        DEBUG("Failed to open MRU overlay for writing.");
+        return false;
+    }
+    bool written = this->file->write(FILE_HEADER, FILE_HEADER_LENGTH) == FILE_HEADER_LENGTH;
+    for (uint8_t i = this->used_count; written && i > 0; i--) {
+        written = this->file->write(this->get_record(i - 1), RECORD_SIZE) == RECORD_SIZE;
+    }
+    this->file->flush();
+    this->file->close();
+    this->file_records = written ? this->used_count : INVALID_UINT32;
+    return written;
+}
+
+
+bool MruOverlay::append(const uint8_t* record) {
+    if (this->file_records == INVALID_UINT32
+            || this->file_records >= (uint32_t)this->record_count * COMPACT_FACTOR) {
+        // ファイルがまだないか、古い項目が溜まった
+        return this->save();
+    }
+    if (this->file->is_opened()) {
+        this->file->close();
+    }
+    if (!this->file->open(this->path, FileAccessWrapper::FileMode::READWRITE)) {
+        DEBUG("Failed to open MRU overlay for appending.");
+        return false;
+    }
+    bool written = this->file->write(record, RECORD_SIZE) == RECORD_SIZE;
+    this->file->flush();
+    this->file->close();
+    // 書けなかったときは、次に丸ごと書き出しなおす
+    this->file_records = written ? this->file_records + 1 : INVALID_UINT32;
+    return written;
+}
+
+
+uint8_t MruOverlay::lookup(const char* yomigana, size_t yomiganalen, uint8_t dictcount, uint8_t* indices) {
+    if (this->table == nullptr) {
+        return 0;
+    }
+    uint8_t found = this->find_record(MruOverlay::hash_key(yomigana, yomiganalen), dictcount);
+    if (found == INVALID_UINT8) {
+        return 0;
+    }
+    uint8_t* record = this->get_record(found);
+    uint8_t count = record[RECORD_COUNT];
+    if (count > MAX_INDICES) {
+        count = MAX_INDICES;
+    }
+    memcpy(indices, &record[RECORD_INDICES], count);
+    return count;
+}
+
+
+bool MruOverlay::promote(const char* yomigana, size_t yomiganalen, uint8_t dictcount, uint8_t dictindex) {
+    if (this->table == nullptr || dictindex == 0 || dictindex > dictcount) {
+        return false;
+    }
+    uint16_t hash = MruOverlay::hash_key(yomigana, yomiganalen);
+    uint8_t found = this->find_record(hash, dictcount);
+
+    uint8_t newrecord[RECORD_SIZE];
+    memset(newrecord, 0x00, RECORD_SIZE);
+    newrecord[RECORD_HASH] = (uint8_t)(hash & 0xFF);
+    newrecord[RECORD_HASH + 1] = (uint8_t)(hash >> 8);
+    newrecord[RECORD_DICTCOUNT] = dictcount;
+    newrecord[RECORD_INDICES] = dictindex;
+    uint8_t count = 1;
+    if (found != INVALID_UINT8) {
+        // 以前に選ばれた番号は、今回のものの後ろへずらす
+        uint8_t* record = this->get_record(found);
+        if (record[RECORD_COUNT] > 0 && record[RECORD_INDICES] == dictindex) {
+            // すでに先頭なので書き出さなくてよい
+            return true;
+        }
+        for (uint8_t i = 0; i < record[RECORD_COUNT] && i < MAX_INDICES && count < MAX_INDICES; i++) {
+            if (record[RECORD_INDICES + i] != dictindex) {
+                newrecord[RECORD_INDICES + count] = record[RECORD_INDICES + i];
+                count += 1;
+            }
+        }
+    }
+    newrecord[RECORD_COUNT] = count;
+
+    this->put_front(newrecord);
+    return this->append(newrecord);
+}
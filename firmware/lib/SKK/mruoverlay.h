@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <FileAccessWrapper.h>
+#include <commondef.h>
+
+
+namespace SKK {
+
+    /** 読み仮名ごとに、最近選ばれた辞書の候補の番号を覚えておく表
+     *
+     * システム辞書を書き換えずに、候補を返す順番だけを入れ替えるために使う。
+     * 表はすべてRAM上に置き、選ばれるたびに変わった1項目だけを小さなファイルの末尾へ追記する。
+     * ファイルは古い項目から順に並び、読み込むときは後に書かれた項目ほど新しいものとして表へ積む。
+     * ファイルの項目数が表の COMPACT_FACTOR 倍に達したら、表を丸ごと書き出しなおす。
+     * 読み仮名そのものは持たず、ハッシュと辞書の候補の個数で見分ける（まれに取り違えても順番が変わるだけ）。
+     */
+    class MruOverlay {
+    public:
+        // 1項目のバイト数と、1つの読み仮名に覚えておく候補の番号の最大数
+        static constexpr uint8_t RECORD_SIZE = 8;
+        static constexpr uint8_t MAX_INDICES = 4;
+
+    // private:
+        // 項目の配置：ハッシュ（2バイト）、辞書の候補の個数、覚えている番号の個数、候補の番号（1始まり）
+        static constexpr uint8_t RECORD_HASH = 0;
+        static constexpr uint8_t RECORD_DICTCOUNT = 2;
+        static constexpr uint8_t RECORD_COUNT = 3;
+        static constexpr uint8_t RECORD_INDICES = 4;
+        static_assert(RECORD_INDICES + MAX_INDICES <= RECORD_SIZE, "MruOverlay record overflow");
+
+        // ファイルの先頭のマジックとバージョン
+        static constexpr uint8_t FILE_HEADER_LENGTH = 4;
+        // ファイルの項目数が表の項目数のこの倍数に達したら、書き出しなおす
+        static constexpr uint8_t COMPACT_FACTOR = 2;
+
+        FileAccessWrapper* file = nullptr;
+        const char* path = nullptr;
+
+        // 項目の表。先頭ほど最近選ばれたもの
+        uint8_t* table = nullptr;
+        uint8_t record_count = 0;
+        uint8_t used_count = 0;
+        // ファイルに書かれている項目の個数。ファイルがない、または読めなければ INVALID_UINT32
+        uint32_t file_records = INVALID_UINT32;
+
+        uint8_t* get_record(uint8_t record) {
+            return &this->table[(size_t)record * RECORD_SIZE];
+        }
+
+        static uint16_t hash_key(const char* yomigana, size_t yomiganalen);
+
+        /** 読み仮名の項目を探す
+         * @return 項目の番号、なければINVALID_UINT8
+         */
+        uint8_t find_record(uint16_t hash, uint8_t dictcount);
+
+        /** 項目を表の先頭へ置く。同じ読み仮名の項目は置き換え、表が一杯なら最も前に選ばれた項目を捨てる
+         * @param newrecord [IN] RECORD_SIZE バイトの項目
+         */
+        void put_front(const uint8_t* newrecord);
+
+        /** ファイルから表を読み込む */
+        bool load(void);
+
+        /** 表を丸ごとファイルへ書き出す（古い項目から順に） */
+        bool save(void);
+
+        /** 項目を1つファイルの末尾へ追記する。ファイルが大きくなっていれば、代わりに表を丸ごと書き出す
+         * @param record [IN] RECORD_SIZE バイトの項目
+         */
+        bool append(const uint8_t* record);
+
+    public:
+        /** 初期化する。ファイルがあれば表を読み込む
+         * @param file [IN] 表を保存するファイル（書き込みに対応していること）
+         * @param path [IN] ファイルのパス
+         * @param buffer [IN] 表に用いる領域
+         * @param bufferlen [IN] バッファのバイト数。 RECORD_SIZE の倍数であること
+         * @return 成功すればtrue（ファイルがなくても、空の表で成功する）
+         */
+        bool init(FileAccessWrapper* file, const char* path, uint8_t* buffer, size_t bufferlen);
+
+        /** 読み仮名に対して覚えている候補の番号を、最近選ばれた順に得る
+         * @param yomigana [IN]
+         * @param yomiganalen [IN]
+         * @param dictcount [IN] 辞書に収録されている候補の個数
+         * @param indices [OUT] 候補の番号（1始まり）。 MAX_INDICES 個ぶんの領域があること
+         * @return 得られた番号の個数
+         */
+        uint8_t lookup(const char* yomigana, size_t yomiganalen, uint8_t dictcount, uint8_t* indices);
+
+        /** 選ばれた候補の番号を、その読み仮名の先頭へ移し、ファイルへ追記する
+         * @param yomigana [IN]
+         * @param yomiganalen [IN]
+         * @param dictcount [IN] 辞書に収録されている候補の個数
+         * @param dictindex [IN] 選ばれた候補の辞書での番号（1始まり）
+         * @return 成功すればtrue
+         */
+        bool promote(const char* yomigana, size_t yomiganalen, uint8_t dictcount, uint8_t dictindex);
+    };
+}
@@ -18,7 +18,17 @@ bool SkkDict::init(FileAccessWrapper* file) {
     }
     this->file = file;
     this->load_headers();
-    this->yomiganabuffer = (char*)malloc(this->yomiganamaxlen + 1);
+    // 'IDS' のスロットのキーも同じバッファへ読み込むので、長いほうに合わせる
+    uint16_t bufferlen = this->yomiganamaxlen;
+    if (bufferlen < this->index_slot_keylen) {
+        bufferlen = this->index_slot_keylen;
+    }
+    if (bufferlen < this->okuriari_slot_keylen) {
+        bufferlen = this->okuriari_slot_keylen;
+    }
+    // 開きなおした場合は前のバッファを捨てる
+    free(this->yomiganabuffer);
+    this->yomiganabuffer = (char*)malloc(bufferlen + 1);
     assert(this->yomiganabuffer);
 
     return true;
@@ -41,7 +51,12 @@ void SkkDict::load_headers(void) {
     this->yomiganamaxlen = this->file->read_uint16();
     // DEBUG("yomiganamaxlen=%d\n", this->yomiganamaxlen);
 
-    if (this->file->read() != 'I' || this->file->read() != 'D' || this->file->read() != 'X') {
+    char indexmagic[3] = { (char)this->file->read(), (char)this->file->read(), (char)this->file->read() };
+    if (memcmp(indexmagic, "IDX", 3) == 0) {
+        this->index_type = IndexType::Linear;
+    } else if (memcmp(indexmagic, "IDS", 3) == 0) {
+        this->index_type = IndexType::SortedSlots;
+    } else {
         // assert("IDX" == nullptr);
         PANIC("'IDX' not found.");
     }
@@ -49,29 +64,123 @@ void SkkDict::load_headers(void) {
     indexlen = this->file->read_uint24();
     this->index_head = this->file->position();  // Here is the head of the index body.
     this->index_tail = this->index_head + indexlen;
-    this->file->seek_delta(indexlen);  // Skip index body
+    if (this->index_type == IndexType::SortedSlots) {
+        // 先頭1バイトがスロット内のキーのバイト数で、以降は (キー + uint24のアドレス) の固定長スロットが並ぶ
+        this->index_slot_keylen = this->file->read_uint8();
+        this->index_slot_count = (indexlen - 1) / (this->index_slot_keylen + 3);
+        DEBUG("sorted index: keylen=%d, slots=%d", this->index_slot_keylen, this->index_slot_count);
+    }
+    this->file->seek(this->index_tail);  // Skip index body
     DEBUG("index_head=0x%lx(%ld)", this->index_head, this->index_head);
 
-    if (this->file->read() != 'T' || this->file->read() != 'B' || this->file->read() != 'L') {
+    char tablemagic[3] = { (char)this->file->read(), (char)this->file->read(), (char)this->file->read() };
+    if (memcmp(tablemagic, "TBL", 3) == 0) {
+        this->table_type = TableType::Plain;
+    } else if (memcmp(tablemagic, "TBZ", 3) == 0) {
+        this->table_type = TableType::Blocks;
+    } else {
         // assert("TBL" == nullptr);
         PANIC("'TBL' not found.");
     }
     uint32_t tablelen = 0;
     tablelen = this->file->read_uint24();
     this->table_head = this->file->position();
-    if (tablelen > 0) {
+    if (this->table_type == TableType::Blocks) {
+        // ブロックのバイト数と定型句の後ろに、最初のブロックまでの詰め物がある
+        uint32_t sectionhead = this->table_head;
+        this->table_block_size = this->file->read_uint16();
+        if (this->table_block_size == 0 || !this->load_phrases()) {
+            PANIC("Broken 'TBZ' header.");
+        }
+        uint32_t pos = this->file->position();
+        this->table_head = (pos + this->table_block_size - 1) / this->table_block_size * this->table_block_size;
+        this->table_tail = sectionhead + tablelen;
+        DEBUG("block table: blocksize=%d, phrases=%d", this->table_block_size, this->phrase_count);
+    } else if (tablelen > 0) {
         this->table_tail = this->table_head + tablelen;
     } else if (this->filesize > 0) {
         this->table_tail = this->filesize;
     } else {
         this->table_tail = INVALID_UINT32;
     }
+    this->load_okuriari_header();
+}
+
+bool SkkDict::load_phrases(void) {
+    uint8_t count = this->file->read_uint8();
+    uint16_t phraseslen = this->file->read_uint16();
+    if (count > MAX_PHRASES) {
+        return false;
+    }
+    // 開きなおした場合は前の定型句を捨てる
+    free(this->phrases);
+    this->phrases = (uint8_t*)malloc(count + phraseslen);
+    if (this->phrases == nullptr) {
+        return false;
+    }
+    if (this->file->read(&this->phrases[count], phraseslen) != (int)phraseslen) {
+        return false;
+    }
+    // 各定型句の位置を先頭に並べておく
+    uint16_t offset = count;
+    for (uint8_t i = 0; i < count; i++) {
+        if (offset >= count + phraseslen || offset > 0xFF) {
+            return false;
+        }
+        this->phrases[i] = (uint8_t)offset;
+        offset += 1 + this->phrases[offset];
+    }
+    this->phrase_count = count;
+    return true;
+}
+
+const uint8_t* SkkDict::get_phrase(uint8_t code, uint8_t* len) {
+    uint8_t index = code < 0x20 ? code : 0x20 + (code - 0xF0);
+    if (index >= this->phrase_count) {
+        return nullptr;
+    }
+    const uint8_t* phrase = &this->phrases[this->phrases[index]];
+    *len = phrase[0];
+    return &phrase[1];
+}
+
+void SkkDict::load_okuriari_header(void) {
+    this->has_okuriari = false;
+    this->okuriari_slot_keylen = 0;
+    this->okuriari_slot_count = 0;
+    // 'TBL' の長さが0の辞書は、ファイル末尾までがテーブル
+    if (this->table_tail == INVALID_UINT32 || this->filesize == 0 || this->table_tail + 6 > this->filesize) {
+        return;
+    }
+    this->file->seek(this->table_tail);
+    if (this->file->read() != 'O' || this->file->read() != 'K' || this->file->read() != 'R') {
+        return;
+    }
+    uint32_t sectionlen = this->file->read_uint24();
+    uint32_t sectionhead = this->file->position();
+    // 先頭1バイトがスロット内のキーのバイト数、次の2バイトがスロットの個数で、以降にスロットと項目が並ぶ
+    this->okuriari_index_head = sectionhead;
+    this->okuriari_slot_keylen = this->file->read_uint8();
+    this->okuriari_slot_count = this->file->read_uint16();
+    this->okuriari_table_head = sectionhead + 3 + (uint32_t)(this->okuriari_slot_keylen + 3) * this->okuriari_slot_count;
+    this->okuriari_table_tail = sectionhead + sectionlen;
+    this->has_okuriari = true;
+    DEBUG("okuri-ari: keylen=%d, slots=%d", this->okuriari_slot_keylen, this->okuriari_slot_count);
 }
 
 /** 指定された読み仮名に対応する検索開始アドレスを取得する
  * @return 対応するアドレスが見つからなかったらINVALID_UINT32、見つかればそのアドレス ( < INVALID_UINT32 )
  */
 uint32_t SkkDict::search_startaddr_from_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort) {
+    if (this->index_type == IndexType::SortedSlots) {
+        return this->search_startaddr_from_sorted_index_for(yomigana, yomiganalen, comparelen_on_abort);
+    } else {
+        return this->search_startaddr_from_linear_index_for(yomigana, yomiganalen, comparelen_on_abort);
+    }
+}
+
+
+uint32_t SkkDict::search_startaddr_from_linear_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort) {
     this->file->seek(this->index_head);
 
     while (this->file->position() < this->index_tail) {
@@ -116,14 +225,134 @@ uint32_t SkkDict::search_startaddr_from_index_for(const char* yomigana, size_t y
 }
 
 
+uint32_t SkkDict::read_index_slot(uint16_t slotindex, uint8_t* keylen) {
+    return this->read_slot(this->index_head + 1, this->index_slot_keylen, slotindex, keylen);
+}
+
+
+uint32_t SkkDict::read_slot(uint32_t head, uint8_t slotkeylen, uint16_t slotindex, uint8_t* keylen) {
+    uint8_t slotlen = slotkeylen + 3;
+    this->file->seek(head + (uint32_t)slotlen * slotindex);
+    this->file->read((uint8_t*)this->yomiganabuffer, slotkeylen);
+    // キーの残りはNULでパディングされている
+    uint8_t len = 0;
+    while (len < slotkeylen && this->yomiganabuffer[len] != '\0') {
+        ++len;
+    }
+    *keylen = len;
+    return this->file->read_uint24();
+}
+
+
+/** バイト列を辞書順で比較する。短いほうが前方一致していれば、短いほうを小さいとみなす
+ * @return a < b なら負、a == b なら0、a > b なら正
+ */
+static
+int compare_key_bytes(const char* a, size_t alen, const char* b, size_t blen) {
+    size_t len = alen < blen ? alen : blen;
+    int result = memcmp(a, b, len);
+    if (result != 0) {
+        return result;
+    }
+    if (alen == blen) {
+        return 0;
+    }
+    return alen < blen ? -1 : 1;
+}
+
+
+uint32_t SkkDict::search_startaddr_from_sorted_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort) {
+    return this->search_sorted_slots_for(this->index_head + 1, this->index_slot_keylen, this->index_slot_count,
+                                         yomigana, yomiganalen, comparelen_on_abort);
+}
+
+
+uint32_t SkkDict::search_sorted_slots_for(uint32_t head, uint8_t slotkeylen, uint16_t slotcount, const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort) {
+    if (slotcount == 0) {
+        return INVALID_UINT32;
+    }
+
+    // インデックスのキーは読み仮名の先頭部分なので、スロットのキー長より後ろは比較しない
+    size_t searchlen = yomiganalen < slotkeylen ? yomiganalen : slotkeylen;
+
+    /* 読み仮名に前方一致するキーのうち最長のものを探す。
+       「読み仮名以下で最大のキー」が読み仮名に前方一致しなければ、求めるキーはその共通部分の前方にしかないので、
+       比較する長さを共通部分まで縮めて探索しなおす（長さは単調に減るので、数回で終わる）。
+     */
+    while (searchlen > 0) {
+        uint16_t lo = 0;
+        uint16_t hi = slotcount;
+        while (lo < hi) {
+            uint16_t mid = lo + (hi - lo) / 2;
+            uint8_t keylen;
+            (void)this->read_slot(head, slotkeylen, mid, &keylen);
+            if (compare_key_bytes(this->yomiganabuffer, keylen, yomigana, searchlen) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo == 0) {
+            // 読み仮名以下のキーが存在しない
+            break;
+        }
+
+        uint8_t keylen;
+        uint32_t jumpaddr = this->read_slot(head, slotkeylen, lo - 1, &keylen);
+        size_t commonlen = 0;
+        while (commonlen < keylen && commonlen < searchlen && this->yomiganabuffer[commonlen] == yomigana[commonlen]) {
+            ++commonlen;
+        }
+
+        if (commonlen == keylen) {
+            // ヒットした
+            *comparelen_on_abort = keylen;
+            return jumpaddr;
+        }
+        searchlen = commonlen;
+    }
+
+    DEBUG("not found in sorted index.");
+    return INVALID_UINT32;
+}
+
+
 bool SkkDict::search_henkanentry_for(uint32_t startaddr, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader) {
-    if (0 < startaddr && startaddr < INVALID_UINT32) {
-        this->file->seek(startaddr);
-    } else {
-        this->file->seek(this->table_head);
+    if (!(0 < startaddr && startaddr < INVALID_UINT32)) {
+        startaddr = this->table_head;
+    }
+    if (this->table_type == TableType::Blocks) {
+        return this->search_blocks_for(startaddr, this->table_tail, allow_abort, compare_bytes, yomigana, yomiganalen, reader);
+    }
+    return this->search_table_for(startaddr, this->table_tail, allow_abort, compare_bytes, yomigana, yomiganalen, reader);
+}
+
+
+bool SkkDict::search_okuriari_entry_for(const char* yomigana, size_t yomiganalen, CandidateReader* reader) {
+    uint8_t comparelen;
+    if (!this->has_okuriari) {
+        // 送りありの項目を分けていない辞書
+        uint32_t addr = this->search_startaddr_from_index_for(yomigana, yomiganalen, &comparelen);
+        if (addr == INVALID_UINT32) {
+            return false;
+        }
+        return this->search_henkanentry_for(addr, true, comparelen, yomigana, yomiganalen, reader);
+    }
+    uint32_t addr = this->search_sorted_slots_for(this->okuriari_index_head + 3, this->okuriari_slot_keylen, this->okuriari_slot_count,
+                                                  yomigana, yomiganalen, &comparelen);
+    if (addr == INVALID_UINT32) {
+        DEBUG("No matching okuri-ari index entry found.");
+        return false;
     }
+    return this->search_table_for(addr, this->okuriari_table_tail, true, comparelen, yomigana, yomiganalen, reader);
+}
+
+
+bool SkkDict::search_table_for(uint32_t startaddr, uint32_t tabletail, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader) {
+    this->file->seek(startaddr);
 
-    while (this->file->position() < this->table_tail) {
+    while (this->file->position() < tabletail) {
         uint8_t cur_yomiganalen = this->file->read_uint8();
         bool is_disabled = cur_yomiganalen & 0x80;
         for (uint8_t i = 0; i < cur_yomiganalen; ++i) {
@@ -178,3 +407,44 @@ bool SkkDict::search_henkanentry_for(uint32_t startaddr, bool allow_abort, int c
     DEBUG("Not found. reached to %d(0x%x)", this->file->position(), this->file->position());
     return false;
 }
+
+bool SkkDict::search_blocks_for(uint32_t startaddr, uint32_t tabletail, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader) {
+    this->file->seek(startaddr);
+
+    // 読み仮名は直前の項目から組み立てるので、開始位置の項目は共通部分が0であること
+    uint8_t cur_yomiganalen = 0;
+    while (this->file->position() < tabletail) {
+        uint8_t sharedlen = this->file->read_uint8();
+        if (sharedlen == BLOCK_END_MARK) {
+            // このブロックの残りは詰め物なので、次のブロックの先頭へ
+            uint32_t offset = this->file->position() - this->table_head;
+            uint32_t nextblock = this->table_head + (offset + this->table_block_size - 1) / this->table_block_size * this->table_block_size;
+            this->file->seek(nextblock);
+            continue;
+        }
+        uint8_t suffixlen = this->file->read_uint8();
+        if (sharedlen > cur_yomiganalen || sharedlen + suffixlen > this->yomiganamaxlen) {
+            DEBUG("Broken block entry at %ld(0x%lx)", this->file->position(), this->file->position());
+            return false;
+        }
+        this->file->read((uint8_t*)&this->yomiganabuffer[sharedlen], suffixlen);
+        cur_yomiganalen = sharedlen + suffixlen;
+        uint8_t candidatecount = this->file->read_uint8();
+        uint16_t candidatelen = this->file->read_uint16();
+        uint32_t cur_addr = this->file->position();
+
+        if (cur_yomiganalen == yomiganalen && memcmp(this->yomiganabuffer, yomigana, yomiganalen) == 0) {
+            // Hit
+            reader->init(this, candidatecount, candidatelen, cur_addr, true);
+            return true;
+        }
+        if (allow_abort && memcmp(this->yomiganabuffer, yomigana, compare_bytes) != 0) {
+            // Abort
+            DEBUG("Not found. Abort. reached to %ld(0x%lx)", this->file->position(), this->file->position());
+            return false;
+        }
+        this->file->seek_delta(candidatelen);  // Skip current candidates
+    }
+    DEBUG("Not found. reached to %ld(0x%lx)", this->file->position(), this->file->position());
+    return false;
+}
@@ -14,6 +14,32 @@ namespace SKK {
      * ファイルシステム依存の操作はSkkDictFileへ、変換全体の工程はSkkEngineが担う。
      */
     class SkkDict {
+    public:
+        /** インデックス部の形式 */
+        enum class IndexType : uint8_t {
+            // 'IDX' 可変長のキーとアドレスを並べたもの。先頭から線形に探索する
+            Linear,
+            // 'IDS' 固定長スロット（キー＋アドレス）をキーの昇順に並べたもの。二分探索する
+            SortedSlots
+        };
+
+        /** 変換候補テーブルの形式 */
+        enum class TableType : uint8_t {
+            // 'TBL' 項目をそのまま並べたもの
+            Plain,
+            // 'TBZ' 項目を固定長のブロックへ詰めたもの。
+            // 読み仮名は直前の項目と共通する先頭部分を省き、候補の頻出する文字列は1バイトの定型句の番号に置き換える
+            Blocks
+        };
+
+        // 'TBZ' の定型句の最大数と、定型句の番号に使うバイト（文字の先頭には現れない値）
+        static constexpr uint8_t MAX_PHRASES = 48;
+        static bool is_phrase_code(uint8_t b) {
+            return b < 0x20 || 0xF0 <= b;
+        }
+        // 'TBZ' のブロック内の、以降が詰め物であることを示す値（共通部分のバイト数の位置に置かれる）
+        static constexpr uint8_t BLOCK_END_MARK = 0xFF;
+
     // private:
     public:
         FileAccessWrapper* file = nullptr;
@@ -21,8 +47,25 @@ namespace SKK {
         uint16_t yomiganamaxlen = 0;
         uint32_t index_head = 0;
         uint32_t index_tail = 0;
+        IndexType index_type = IndexType::Linear;
+        // IndexType::SortedSlots の場合の、スロット内のキーのバイト数と、スロットの個数
+        uint8_t index_slot_keylen = 0;
+        uint16_t index_slot_count = 0;
         uint32_t table_head = 0;
         uint32_t table_tail = 0;
+        TableType table_type = TableType::Plain;
+        // TableType::Blocks の場合のブロックのバイト数（最初のブロックが table_head）
+        uint16_t table_block_size = 0;
+        // TableType::Blocks の場合の定型句。先頭に各定型句の位置を phrase_count 個並べ、その後ろに [長さ][バイト列] を並べる
+        uint8_t phrase_count = 0;
+        uint8_t* phrases = nullptr;
+        // 'OKR' 送りありの項目の区間。インデックスは 'IDS' と同じ固定長スロットで、キーは読み仮名の先頭1文字
+        bool has_okuriari = false;
+        uint32_t okuriari_index_head = 0;
+        uint8_t okuriari_slot_keylen = 0;
+        uint16_t okuriari_slot_count = 0;
+        uint32_t okuriari_table_head = 0;
+        uint32_t okuriari_table_tail = 0;
         char* yomiganabuffer = nullptr;
 
     public:
@@ -30,11 +73,65 @@ namespace SKK {
 
         void load_headers(void);
 
+        /** 'TBL' の後ろに 'OKR' があれば読み込む */
+        void load_okuriari_header(void);
+
+        /** 'TBZ' の定型句を読み込む
+         * @return 成功すればtrue
+         */
+        bool load_phrases(void);
+
+        /** 定型句を得る
+         * @param code [IN] 定型句の番号を表すバイト（ is_phrase_code() がtrueのもの）
+         * @param len [OUT] 定型句のバイト数
+         * @return 定型句のバイト列。範囲外の番号ならnullptr
+         */
+        const uint8_t* get_phrase(uint8_t code, uint8_t* len);
+
         /** 指定された読み仮名に対応する検索開始アドレスを取得する
          * @return 対応するアドレスが見つからなかったらINVALID_UINT32、見つかればそのアドレス ( < INVALID_UINT32 )
          */
         uint32_t search_startaddr_from_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort);
 
+        /** 'IDX' 形式のインデックスを先頭から線形に探索する */
+        uint32_t search_startaddr_from_linear_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort);
+
+        /** 'IDS' 形式のインデックスを二分探索する */
+        uint32_t search_startaddr_from_sorted_index_for(const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort);
+
+        /** 'IDS' 形式のインデックスの、指定番号のスロットを読み込む
+         * @param slotindex [IN]
+         * @param keylen [OUT] キーのバイト数（パディングを含まない）
+         * @return スロットのアドレス値
+         */
+        uint32_t read_index_slot(uint16_t slotindex, uint8_t* keylen);
+
+        /** 固定長スロットのインデックスの、指定番号のスロットを読み込む
+         * @param head [IN] インデックスの先頭（スロットのキーのバイト数）のアドレス
+         * @param slotkeylen [IN] スロット内のキーのバイト数
+         * @param slotindex [IN]
+         * @param keylen [OUT] キーのバイト数（パディングを含まない）
+         * @return スロットのアドレス値
+         */
+        uint32_t read_slot(uint32_t head, uint8_t slotkeylen, uint16_t slotindex, uint8_t* keylen);
+
+        /** 固定長スロットのインデックスを二分探索する
+         * @return 対応するアドレスが見つからなかったらINVALID_UINT32
+         */
+        uint32_t search_sorted_slots_for(uint32_t head, uint8_t slotkeylen, uint16_t slotcount, const char* yomigana, size_t yomiganalen, uint8_t* comparelen_on_abort);
+
+        /** 変換候補テーブルの指定範囲から、読み仮名に対応する項目を探す
+         * @param startaddr [IN] 検索を開始するアドレス
+         * @param tabletail [IN] テーブルの末尾のアドレス
+         * @return 変換候補が見つかればtrue
+         */
+        bool search_table_for(uint32_t startaddr, uint32_t tabletail, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader);
+
+        /** 'TBZ' の変換候補テーブルの指定範囲から、読み仮名に対応する項目を探す
+         * 引数は search_table_for() と同じ。
+         */
+        bool search_blocks_for(uint32_t startaddr, uint32_t tabletail, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader);
+
         /** 指定された読み仮名に対応する変換候補を取得する
          * @param startaddr [IN] 検索を開始するアドレス
          * @param allow_abort [IN] 検索を途中で打ち切ることを許可するか否か
@@ -45,5 +142,14 @@ namespace SKK {
          * @return 変換候補が見つかればtrue、見つからなければfalse
          */
         bool search_henkanentry_for(uint32_t startaddr, bool allow_abort, int compare_bytes, const char* yomigana, size_t yomiganalen, CandidateReader* reader);
+
+        /** 送りありの読み仮名に対応する変換候補を取得する
+         * 'OKR' がない辞書では、送りありの項目も 'TBL' にあるものとして探す。
+         * @param yomigana [IN] 語幹と送り仮名の子音（"かk" など、SKK辞書の表記）
+         * @param yomiganalen [IN]
+         * @param reader [OUT] 変換候補のリーダー
+         * @return 変換候補が見つかればtrue、見つからなければfalse
+         */
+        bool search_okuriari_entry_for(const char* yomigana, size_t yomiganalen, CandidateReader* reader);
     };
 }
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include <debug.h>
+#include <profile.h>
 
 #include <skkdict.h>
 #include <candidatereader.h>
@@ -29,6 +30,32 @@ bool SkkEngine::set_sysdict(SkkDict* dict) {
     return true;
 }
 
+bool SkkEngine::set_learningdict(UserDict* dict) {
+    assert(dict);
+    this->learningdict = dict;
+    return true;
+}
+
+bool SkkEngine::set_candidateorder(MruOverlay* overlay) {
+    assert(overlay);
+    this->candidateorder = overlay;
+    return true;
+}
+
+bool SkkEngine::learn(const char* yomigana, size_t yomiganalen, CandidateReader* selected, const char* candidate, size_t candidatelen) {
+    bool result = false;
+    if (this->candidateorder) {
+        uint8_t dictindex = selected->get_current_dict_index();
+        if (dictindex != 0 && this->candidateorder->promote(yomigana, yomiganalen, selected->get_dict_candidates_count(), dictindex)) {
+            result = true;
+        }
+    }
+    if (this->learningdict && this->learningdict->learn(yomigana, yomiganalen, candidate, candidatelen)) {
+        result = true;
+    }
+    return result;
+}
+
 
 /** 指定の辞書を使って変換候補を探す
  * @return 変換候補が１つ以上見つかったらtrue
@@ -38,9 +65,10 @@ bool henkan_with_dict(const char* yomigana, size_t yomiganalen, CandidateReader*
     // unsigned long searchaddr_timer = millis();
     uint32_t indexedaddress;
 
-    STOPWATCH_BLOCK_START(search_startaddr_from_index_for);
-    indexedaddress = dict->search_startaddr_from_index_for(yomigana, yomiganalen, &index_comparelen);
-    STOPWATCH_BLOCK_END(search_startaddr_from_index_for);
+    {
+        PROFILE_SCOPE(SearchIndex);
+        indexedaddress = dict->search_startaddr_from_index_for(yomigana, yomiganalen, &index_comparelen);
+    }
 
     if (indexedaddress == INVALID_UINT32) {
         DEBUG("No matching index entry found.");
@@ -48,9 +76,10 @@ bool henkan_with_dict(const char* yomigana, size_t yomiganalen, CandidateReader*
     }
     // unsigned long search_henkanentry_timer = millis();
     bool result;
-    STOPWATCH_BLOCK_START(search_henkanentry_for);
-    result = dict->search_henkanentry_for(indexedaddress, allow_abort, index_comparelen, yomigana, yomiganalen, candidates);
-    STOPWATCH_BLOCK_END(search_henkanentry_for);
+    {
+        PROFILE_SCOPE(SearchTable);
+        result = dict->search_henkanentry_for(indexedaddress, allow_abort, index_comparelen, yomigana, yomiganalen, candidates);
+    }
     // unsigned long elapsed_search_henkanentry = millis() - search_henkanentry_timer;
     // DEBUG("%lu[msec] elapsed in search_henkanentry() execution.", elapsed_search_henkanentry);
 
@@ -63,7 +92,7 @@ bool henkan_with_dict(const char* yomigana, size_t yomiganalen, CandidateReader*
  * @param candidates [OUT]
  * @return 変換候補が１つ以上見つかったらtrue
  */
-bool SkkEngine::henkan(const char* yomigana, size_t yomiganalen, CandidateReader* candidates) {
+bool SkkEngine::henkan(const char* yomigana, size_t yomiganalen, CandidateReader* candidates, bool all) {
     bool result;
 
     // DEBUG_PRINTF("--------\n");
@@ -71,7 +100,11 @@ bool SkkEngine::henkan(const char* yomigana, size_t yomiganalen, CandidateReader
     // dump_bytes_hex((const uint8_t*)yomigana, yomiganalen);
     // DEBUG_PRINTF("\n");
 
-    STOPWATCH_BLOCK_START(henkan);
+    PROFILE_SCOPE(Henkan);
+
+    if (!all && this->find_learned(yomigana, yomiganalen, candidates)) {
+        return true;
+    }
 
     if (this->userdict && henkan_with_dict(yomigana, yomiganalen, candidates, this->userdict, false)) {
         DEBUG("Found in User dict.");
@@ -86,14 +119,91 @@ bool SkkEngine::henkan(const char* yomigana, size_t yomiganalen, CandidateReader
         result = false;
     }
 
-    // DEBUG_HEADER();
-    STOPWATCH_BLOCK_END(henkan);
+    result = this->apply_learned(yomigana, yomiganalen, result, candidates);
 
     // DEBUG_PRINTF("--------\n");
 
     return result;
 }
 
+bool SkkEngine::henkan_okuriari(const char* yomigana, size_t yomiganalen, const char* okurigana, size_t okuriganalen, CandidateReader* candidates, bool all) {
+    bool result;
+
+    PROFILE_SCOPE(HenkanOkuriari);
+
+    if (!all && this->find_learned(yomigana, yomiganalen, candidates)) {
+        candidates->set_okurigana(okurigana, (uint8_t)okuriganalen);
+        return true;
+    }
+
+    if (this->userdict && this->userdict->search_okuriari_entry_for(yomigana, yomiganalen, candidates)) {
+        DEBUG("Found okuri-ari in User dict.");
+        result = true;
+
+    } else if (this->systdict && this->systdict->search_okuriari_entry_for(yomigana, yomiganalen, candidates)) {
+        DEBUG("Found okuri-ari in System dict.");
+        result = true;
+
+    } else {
+        DEBUG("Nothing found in any dict.");
+        result = false;
+    }
+
+    result = this->apply_learned(yomigana, yomiganalen, result, candidates);
+    if (result) {
+        // 辞書にも学習にも語幹だけがあるので、読み出すときに送り仮名を付ける
+        candidates->set_okurigana(okurigana, (uint8_t)okuriganalen);
+    }
+
+    return result;
+}
+
+bool SkkEngine::find_learned(const char* yomigana, size_t yomiganalen, CandidateReader* candidates) {
+    if (!this->learningdict) {
+        return false;
+    }
+    // 覚えている候補はRAM上にあることが多く、そのときは辞書のファイルを読まずに済む
+    uint8_t learnedlen = 0;
+    const char* learned = this->learningdict->find(yomigana, yomiganalen, &learnedlen);
+    if (!learned) {
+        return false;
+    }
+    DEBUG("Found in learned dict. Dicts are not searched.");
+    candidates->init_pinned_only(learned, learnedlen);
+    return true;
+}
+
+bool SkkEngine::apply_learned(const char* yomigana, size_t yomiganalen, bool found, CandidateReader* candidates) {
+    bool result = found;
+
+    // 辞書の候補と合わせて返すので、 set_pinned() は辞書にある同じ候補を探して候補を一通り読む
+    uint8_t learnedlen = 0;
+    const char* learned = nullptr;
+    if (this->learningdict) {
+        learned = this->learningdict->find(yomigana, yomiganalen, &learnedlen);
+    }
+    if (learned) {
+        // 覚えている候補を先頭にする。辞書の残りの候補はその後ろに続く
+        DEBUG("Found in learned dict.");
+        if (result) {
+            candidates->set_pinned(learned, learnedlen);
+        } else {
+            candidates->init_pinned_only(learned, learnedlen);
+            result = true;
+        }
+    }
+
+    if (result && this->candidateorder && candidates->get_dict_candidates_count() > 1) {
+        // 最近選ばれた候補を、ファイルの順番より先に返す
+        uint8_t order[MruOverlay::MAX_INDICES];
+        uint8_t ordercount = this->candidateorder->lookup(yomigana, yomiganalen, candidates->get_dict_candidates_count(), order);
+        if (ordercount > 0) {
+            candidates->set_preferred(order, ordercount);
+        }
+    }
+    return result;
+}
+
 /** 読み仮名から変換を実行し、変換候補を探す
  * @param yomigana [IN] ゼロ終端の読み仮名の文字列
  * @param candidates [OUT]
@@ -5,6 +5,8 @@
 
 #include <skkdict.h>
 #include <candidatereader.h>
+#include <userdict.h>
+#include <mruoverlay.h>
 
 namespace SKK {
 
@@ -12,16 +14,42 @@ namespace SKK {
     public:
         SkkDict* userdict = nullptr;
         SkkDict* systdict = nullptr;
+        // 選ばれた候補を覚えておく辞書（任意）
+        UserDict* learningdict = nullptr;
+        // 選ばれた候補の順番を覚えておく表（任意）
+        MruOverlay* candidateorder = nullptr;
 
 
         bool init(void);
 
-        /** ユーザー辞書を設定する（任意）
-         * TODO: 辞書へ追記できるようにする。
+        /** ユーザー辞書を設定する（任意）。読み取り専用
+         * 選ばれた候補を覚えるには set_learningdict() を使う。
          * @return 成功したらtrue
          */
         bool set_userdict(SkkDict* dict);
 
+        /** 選ばれた候補を覚えておく辞書を設定する（任意）
+         * 覚えている候補は、辞書の候補より先に返す。
+         * @return 成功したらtrue
+         */
+        bool set_learningdict(UserDict* dict);
+
+        /** 選ばれた候補の順番を覚えておく表を設定する（任意）
+         * 最近選ばれた辞書の候補を、ファイルの順番より先に返す。辞書のファイルは書き換えない。
+         * @return 成功したらtrue
+         */
+        bool set_candidateorder(MruOverlay* overlay);
+
+        /** 選ばれた候補を覚える
+         * @param yomigana [IN]
+         * @param yomiganalen [IN]
+         * @param selected [IN] 候補を選んだときの CandidateReader （選ばれた候補を指していること）
+         * @param candidate [IN]
+         * @param candidatelen [IN]
+         * @return 覚えられたらtrue
+         */
+        bool learn(const char* yomigana, size_t yomiganalen, CandidateReader* selected, const char* candidate, size_t candidatelen);
+
         /** システム辞書を設定する（必須）。読み取り専用
          * @return 成功したらtrue
          */
@@ -29,12 +57,15 @@ namespace SKK {
 
 
         /** 読み仮名から変換を実行し、変換候補を探す
+         * 覚えている候補があれば、辞書は引かずにその1つだけを返す（たいていファイルを読まない）。
+         * ほかの候補が要るときは、 all をtrueにして呼びなおす。
          * @param yomigana [IN] 
          * @param yomiganalen [IN]
          * @param candidates [OUT]
+         * @param all [IN] trueなら、覚えている候補があっても辞書を引き、すべての候補を返す
          * @return 変換候補が１つ以上見つかったらtrue
          */
-        bool henkan(const char* yomigana, size_t yomiganalen, CandidateReader* candidates);
+        bool henkan(const char* yomigana, size_t yomiganalen, CandidateReader* candidates, bool all = false);
         
         /** 読み仮名から変換を実行し、変換候補を探す
          * @param yomigana [IN] ゼロ終端の読み仮名の文字列
@@ -42,5 +73,29 @@ namespace SKK {
          * @return 変換候補が１つ以上見つかったらtrue
          */
         bool henkan(const char* yomigana, CandidateReader* candidates);
+
+        /** 送りありの読み仮名から変換を実行し、変換候補を探す
+         * 各変換候補は、後ろに送り仮名を付けて読み出される。
+         * @param yomigana [IN] 語幹と送り仮名の子音（"かk" など、SKK辞書の表記）。学習にもこの読み仮名を使う
+         * @param yomiganalen [IN]
+         * @param okurigana [IN] 送り仮名（"く" など）。変換候補を読み終えるまで保持されていること
+         * @param okuriganalen [IN]
+         * @param candidates [OUT]
+         * @param all [IN] henkan() と同じ
+         * @return 変換候補が１つ以上見つかったらtrue
+         */
+        bool henkan_okuriari(const char* yomigana, size_t yomiganalen, const char* okurigana, size_t okuriganalen, CandidateReader* candidates, bool all = false);
+
+    // private:
+        /** 覚えている候補だけを返すように初期化する。辞書は引かない
+         * @return 覚えている候補があればtrue
+         */
+        bool find_learned(const char* yomigana, size_t yomiganalen, CandidateReader* candidates);
+
+        /** 覚えている候補と順番を、辞書から見つかった変換候補へ反映する
+         * @param found [IN] 辞書から変換候補が見つかったか
+         * @return 変換候補が１つ以上あればtrue
+         */
+        bool apply_learned(const char* yomigana, size_t yomiganalen, bool found, CandidateReader* candidates);
     };
 }
@@ -0,0 +1,526 @@
+#include <string.h>
+
+#include <debug.h>
+#include <commondef.h>
+
+#include "userdict.h"
+#include "candidatereader.h"
+
+
+using namespace SKK;
+
+
+static const uint8_t LOG_HEADER[UserDict::LOG_HEADER_LENGTH] = { 'S', 'K', 'L', 1 };
+
+
+bool UserDict::init(FileAccessWrapper* dictfile, const char* dictpath,
+                    FileAccessWrapper* logfile, const char* logpath,
+                    FileAccessWrapper* workfile, const char* workpath,
+                    uint8_t* buffer, size_t bufferlen) {
+    size_t count = bufferlen / SLOT_SIZE;
+    if (dictfile == nullptr || logfile == nullptr || workfile == nullptr || buffer == nullptr || count == 0) {
+        return false;
+    }
+    if (count > 0xFF) {
+        count = 0xFF;
+    }
+    this->dictfile = dictfile;
+    this->dictpath = dictpath;
+    this->logfile = logfile;
+    this->logpath = logpath;
+    this->workfile = workfile;
+    this->workpath = workpath;
+    this->table = buffer;
+    this->slot_count = (uint8_t)count;
+    this->dirty_count = 0;
+    for (uint8_t i = 0; i < this->slot_count; i++) {
+        uint8_t* slot = this->get_slot(i);
+        slot[SLOT_FLAGS] = 0;
+        slot[SLOT_AGE] = i;
+    }
+    memset(this->key_filter, 0x00, sizeof(this->key_filter));
+
+    // 圧縮済み辞書を写している途中で途切れていれば、作業ファイルから写しなおす
+    if (this->recover_dict()) {
+        DEBUG("Recovered user dict from work file.");
+    }
+    // 圧縮済み辞書は、まだ一度も圧縮していなければ存在しない
+    this->open_dict();
+
+    bool replayed = this->replay_log();
+    if (!this->logfile->is_opened()) {
+        DEBUG("Failed to open user dict log.");
+        return false;
+    }
+    if (!replayed || this->logfile->size() > LOG_COMPACT_THRESHOLD) {
+        // 末尾が壊れたログへ追記し続けないよう、まとめなおす
+        DEBUG("Compact user dict (log size=%ld).", this->logfile->size());
+        return this->compact();
+    }
+    return true;
+}
+
+
+uint8_t UserDict::hash_key(const char* yomigana, uint8_t yomiganalen) {
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (uint8_t i = 0; i < yomiganalen; i++) {
+        hash ^= (uint8_t)yomigana[i];
+        hash *= 16777619UL;
+    }
+    return (uint8_t)(hash ^ (hash >> 8) ^ (hash >> 16) ^ (hash >> 24));
+}
+
+
+void UserDict::add_to_filter(const char* yomigana, uint8_t yomiganalen) {
+    uint8_t hash = UserDict::hash_key(yomigana, yomiganalen);
+    this->key_filter[hash / 8] |= (0x01 << (hash % 8));
+}
+
+
+bool UserDict::is_in_filter(const char* yomigana, uint8_t yomiganalen) {
+    uint8_t hash = UserDict::hash_key(yomigana, yomiganalen);
+    return this->key_filter[hash / 8] & (0x01 << (hash % 8));
+}
+
+
+bool UserDict::open_dict(void) {
+    this->has_dict = false;
+    if (this->dictfile->is_opened()) {
+        this->dictfile->close();
+    }
+    if (!this->dictfile->open(this->dictpath, FileAccessWrapper::FileMode::READ)) {
+        DEBUG("No compacted user dict.");
+        return false;
+    }
+    if (this->dictfile->size() == 0 || !this->dict.init(this->dictfile)) {
+        this->dictfile->close();
+        return false;
+    }
+
+    // 圧縮済み辞書のインデックスは、すべての読み仮名をそのままキーにしている
+    char key[MAX_YOMIGANA_LEN];
+    this->dictfile->seek(this->dict.index_head);
+    while (this->dictfile->position() < this->dict.index_tail) {
+        uint8_t keylen = this->dictfile->read_uint8();
+        if (keylen == 0 || keylen > MAX_YOMIGANA_LEN) {
+            break;
+        }
+        this->dictfile->read((uint8_t*)key, keylen);
+        this->dictfile->seek_delta(3);
+        this->add_to_filter(key, keylen);
+    }
+    this->has_dict = true;
+    return true;
+}
+
+
+bool UserDict::is_complete_dict(FileAccessWrapper* file) {
+    uint32_t filesize = file->size();
+    if (filesize < 3 + 3) {
+        return false;
+    }
+    uint8_t magic[3];
+    file->seek(0);
+    if (file->read(magic, 3) != 3 || memcmp(magic, "SKD", 3) != 0) {
+        return false;
+    }
+    return file->read_uint24() == filesize;
+}
+
+
+bool UserDict::recover_dict(void) {
+    if (this->dictfile->open(this->dictpath, FileAccessWrapper::FileMode::READ)) {
+        bool complete = UserDict::is_complete_dict(this->dictfile);
+        this->dictfile->close();
+        if (complete) {
+            return false;
+        }
+    }
+    if (!this->workfile->open(this->workpath, FileAccessWrapper::FileMode::READ)) {
+        return false;
+    }
+    bool recovered = false;
+    if (UserDict::is_complete_dict(this->workfile)) {
+        recovered = this->copy_work_to_dict(this->workfile->size());
+    }
+    this->workfile->close();
+    return recovered;
+}
+
+
+bool UserDict::copy_work_to_dict(uint32_t filesize) {
+    if (this->dictfile->is_opened()) {
+        this->dictfile->close();
+    }
+    this->has_dict = false;
+    if (!this->dictfile->open(this->dictpath, FileAccessWrapper::FileMode::WRITE)) {
+        return false;
+    }
+    uint8_t buf[32];
+    this->workfile->seek(0);
+    uint32_t copied = 0;
+    while (copied < filesize) {
+        int len = this->workfile->read(buf, filesize - copied < sizeof(buf) ? filesize - copied : sizeof(buf));
+        if (len <= 0 || this->dictfile->write(buf, len) != len) {
+            break;
+        }
+        copied += len;
+    }
+    this->dictfile->flush();
+    this->dictfile->close();
+    return copied == filesize;
+}
+
+
+uint8_t UserDict::find_slot(const char* yomigana, uint8_t yomiganalen) {
+    for (uint8_t i = 0; i < this->slot_count; i++) {
+        uint8_t* slot = this->get_slot(i);
+        if ((slot[SLOT_FLAGS] & FLAG_USED)
+            && slot[SLOT_YOMIGANALEN] == yomiganalen
+            && memcmp(&slot[SLOT_YOMIGANA], yomigana, yomiganalen) == 0) {
+            return i;
+        }
+    }
+    return INVALID_UINT8;
+}
+
+
+uint8_t UserDict::get_free_slot(void) {
+    uint8_t found = INVALID_UINT8;
+    for (uint8_t i = 0; i < this->slot_count; i++) {
+        uint8_t* slot = this->get_slot(i);
+        if (!(slot[SLOT_FLAGS] & FLAG_USED)) {
+            return i;
+        }
+        if (slot[SLOT_FLAGS] & FLAG_DIRTY) {
+            // 圧縮するまでは捨てられない
+            continue;
+        }
+        if (found == INVALID_UINT8 || slot[SLOT_AGE] > this->get_slot(found)[SLOT_AGE]) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+
+void UserDict::touch_slot(uint8_t slot) {
+    uint8_t age = this->get_slot(slot)[SLOT_AGE];
+    for (uint8_t i = 0; i < this->slot_count; i++) {
+        uint8_t* other = this->get_slot(i);
+        if (other[SLOT_AGE] < age) {
+            other[SLOT_AGE] += 1;
+        }
+    }
+    this->get_slot(slot)[SLOT_AGE] = 0;
+}
+
+
+void UserDict::store_slot(uint8_t slotindex, const char* yomigana, uint8_t yomiganalen, const char* candidate, uint8_t candidatelen, bool dirty) {
+    uint8_t* slot = this->get_slot(slotindex);
+    bool was_dirty = (slot[SLOT_FLAGS] & FLAG_USED) && (slot[SLOT_FLAGS] & FLAG_DIRTY);
+    if (dirty && !was_dirty) {
+        this->dirty_count += 1;
+    } else if (!dirty && was_dirty) {
+        this->dirty_count -= 1;
+    }
+    slot[SLOT_FLAGS] = FLAG_USED | (dirty ? FLAG_DIRTY : 0);
+    slot[SLOT_YOMIGANALEN] = yomiganalen;
+    slot[SLOT_CANDIDATELEN] = candidatelen;
+    memcpy(&slot[SLOT_YOMIGANA], yomigana, yomiganalen);
+    memcpy(&slot[SLOT_CANDIDATE], candidate, candidatelen);
+    this->touch_slot(slotindex);
+}
+
+
+bool UserDict::replay_log(void) {
+    if (!this->logfile->open(this->logpath, FileAccessWrapper::FileMode::READWRITE)) {
+        return false;
+    }
+    uint32_t logsize = this->logfile->size();
+    uint8_t header[LOG_HEADER_LENGTH] = { 0 };
+    this->logfile->seek(0);
+    if (logsize < LOG_HEADER_LENGTH
+        || this->logfile->read(header, LOG_HEADER_LENGTH) != LOG_HEADER_LENGTH
+        || memcmp(header, LOG_HEADER, LOG_HEADER_LENGTH) != 0) {
+        // 新しいログ
+        return this->reset_log();
+    }
+
+    // 1件は [読み仮名の長さ][読み仮名][候補の長さ][候補]
+    char yomigana[MAX_YOMIGANA_LEN];
+    char candidate[MAX_CANDIDATE_LEN];
+    uint32_t pos = LOG_HEADER_LENGTH;
+    while (pos < logsize) {
+        if (pos + 2 > logsize) {
+            break;
+        }
+        uint8_t yomiganalen = this->logfile->read_uint8();
+        if (yomiganalen == 0 || yomiganalen > MAX_YOMIGANA_LEN || pos + 2 + yomiganalen > logsize) {
+            break;
+        }
+        this->logfile->read((uint8_t*)yomigana, yomiganalen);
+        uint8_t candidatelen = this->logfile->read_uint8();
+        if (candidatelen == 0 || candidatelen > MAX_CANDIDATE_LEN || pos + 2 + yomiganalen + candidatelen > logsize) {
+            break;
+        }
+        this->logfile->read((uint8_t*)candidate, candidatelen);
+
+        uint8_t slot = this->find_slot(yomigana, yomiganalen);
+        if (slot == INVALID_UINT8) {
+            slot = this->get_free_slot();
+        }
+        if (slot == INVALID_UINT8) {
+            // ログにしかない読み仮名が表に収まらない（圧縮の前に電源が切れたなど）
+            break;
+        }
+        this->store_slot(slot, yomigana, yomiganalen, candidate, candidatelen, true);
+        this->add_to_filter(yomigana, yomiganalen);
+        pos += 2 + yomiganalen + candidatelen;
+    }
+    DEBUG("Replayed user dict log: %ld of %ld bytes, %d entries.", pos, logsize, this->dirty_count);
+    return pos == logsize;
+}
+
+
+bool UserDict::reset_log(void) {
+    if (this->logfile->is_opened()) {
+        this->logfile->close();
+    }
+    if (!this->logfile->open(this->logpath, FileAccessWrapper::FileMode::WRITE)) {
+        return false;
+    }
+    bool written = this->logfile->write(LOG_HEADER, LOG_HEADER_LENGTH) == LOG_HEADER_LENGTH;
+    this->logfile->close();
+    if (!this->logfile->open(this->logpath, FileAccessWrapper::FileMode::READWRITE)) {
+        return false;
+    }
+    return written;
+}
+
+
+const char* UserDict::find(const char* yomigana, size_t yomiganalen, uint8_t* candidatelen) {
+    if (yomiganalen == 0 || yomiganalen > MAX_YOMIGANA_LEN) {
+        return nullptr;
+    }
+    uint8_t slotindex = this->find_slot(yomigana, yomiganalen);
+    if (slotindex != INVALID_UINT8) {
+        uint8_t* slot = this->get_slot(slotindex);
+        this->touch_slot(slotindex);
+        *candidatelen = slot[SLOT_CANDIDATELEN];
+        return (const char*)&slot[SLOT_CANDIDATE];
+    }
+
+    if (!this->has_dict || !this->is_in_filter(yomigana, yomiganalen)) {
+        return nullptr;
+    }
+
+    // 圧縮済み辞書を引く
+    uint8_t comparelen;
+    uint32_t addr = this->dict.search_startaddr_from_index_for(yomigana, yomiganalen, &comparelen);
+    if (addr == INVALID_UINT32) {
+        return nullptr;
+    }
+    CandidateReader reader;
+    if (!this->dict.search_henkanentry_for(addr, false, comparelen, yomigana, yomiganalen, &reader)) {
+        return nullptr;
+    }
+    uint8_t len = reader.get_current_candidate_length();
+    if (len == 0 || len > MAX_CANDIDATE_LEN) {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        this->found_candidate[i] = (char)reader.read();
+    }
+    *candidatelen = len;
+
+    // 次からはファイルを読まずに済むよう、表に置いておく
+    slotindex = this->get_free_slot();
+    if (slotindex == INVALID_UINT8) {
+        return this->found_candidate;
+    }
+    this->store_slot(slotindex, yomigana, yomiganalen, this->found_candidate, len, false);
+    return (const char*)&this->get_slot(slotindex)[SLOT_CANDIDATE];
+}
+
+
+bool UserDict::learn(const char* yomigana, size_t yomiganalen, const char* candidate, size_t candidatelen) {
+    if (yomiganalen == 0 || yomiganalen > MAX_YOMIGANA_LEN || candidatelen == 0 || candidatelen > MAX_CANDIDATE_LEN) {
+        return false;
+    }
+
+    uint8_t slotindex = this->find_slot(yomigana, yomiganalen);
+    if (slotindex != INVALID_UINT8) {
+        uint8_t* slot = this->get_slot(slotindex);
+        if (slot[SLOT_CANDIDATELEN] == candidatelen && memcmp(&slot[SLOT_CANDIDATE], candidate, candidatelen) == 0) {
+            // すでに覚えている
+            this->touch_slot(slotindex);
+            return true;
+        }
+    } else {
+        slotindex = this->get_free_slot();
+        if (slotindex == INVALID_UINT8) {
+            DEBUG("User dict table is full of unsaved entries.");
+            return false;
+        }
+    }
+    this->store_slot(slotindex, yomigana, (uint8_t)yomiganalen, candidate, (uint8_t)candidatelen, true);
+    this->add_to_filter(yomigana, (uint8_t)yomiganalen);
+
+    uint8_t lens[2] = { (uint8_t)yomiganalen, (uint8_t)candidatelen };
+    bool written = this->logfile->write(&lens[0], 1) == 1
+        && this->logfile->write((const uint8_t*)yomigana, yomiganalen) == (int)yomiganalen
+        && this->logfile->write(&lens[1], 1) == 1
+        && this->logfile->write((const uint8_t*)candidate, candidatelen) == (int)candidatelen;
+    this->logfile->flush();
+    if (!written) {
+        DEBUG("Failed to append to user dict log.");
+    }
+
+    if (this->dirty_count >= this->slot_count) {
+        // 次の学習で表があふれないよう、いまのうちにまとめる
+        return this->compact();
+    }
+    return written;
+}
+
+
+bool UserDict::compact_entry(CompactPass pass, CompactState* state, const char* yomigana, uint8_t yomiganalen, const char* candidate, uint8_t candidatelen) {
+    // 項目は [読み仮名の長さ][読み仮名][候補の個数][候補の総バイト数 uint16][候補の長さ][候補]
+    uint32_t entrylen = 1 + yomiganalen + 1 + 2 + 1 + candidatelen;
+    FileAccessWrapper* out = this->workfile;
+    switch (pass) {
+        case CompactPass::Measure:
+            state->entry_count += 1;
+            state->indexlen += 1 + yomiganalen + 3;
+            state->tablelen += entrylen;
+            if (yomiganalen > state->yomiganamaxlen) {
+                state->yomiganamaxlen = yomiganalen;
+            }
+            return true;
+
+        case CompactPass::Index:
+            // キーは読み仮名そのもの。読み仮名の長い順に並べるので、最初に前方一致するキーが完全一致になる
+            if (!out->write_uint8(yomiganalen)
+                || out->write((const uint8_t*)yomigana, yomiganalen) != yomiganalen
+                || !out->write_uint24(state->nextaddr)) {
+                return false;
+            }
+            state->nextaddr += entrylen;
+            return true;
+
+        case CompactPass::Table:
+            return out->write_uint8(yomiganalen)
+                && out->write((const uint8_t*)yomigana, yomiganalen) == yomiganalen
+                && out->write_uint8(1)
+                && out->write_uint16(1 + candidatelen)
+                && out->write_uint8(candidatelen)
+                && out->write((const uint8_t*)candidate, candidatelen) == candidatelen;
+    }
+    return false;
+}
+
+
+bool UserDict::compact_entries(CompactPass pass, CompactState* state) {
+    char yomigana[MAX_YOMIGANA_LEN];
+    char candidate[MAX_CANDIDATE_LEN];
+    uint32_t dictpos = this->has_dict ? this->dict.table_head : 0;
+    uint32_t dicttail = this->has_dict ? this->dict.table_tail : 0;
+
+    for (uint8_t len = MAX_YOMIGANA_LEN; len > 0; len--) {
+        for (uint8_t i = 0; i < this->slot_count; i++) {
+            uint8_t* slot = this->get_slot(i);
+            if ((slot[SLOT_FLAGS] & FLAG_DIRTY) && slot[SLOT_YOMIGANALEN] == len) {
+                if (!this->compact_entry(pass, state, (const char*)&slot[SLOT_YOMIGANA], len,
+                                         (const char*)&slot[SLOT_CANDIDATE], slot[SLOT_CANDIDATELEN])) {
+                    return false;
+                }
+            }
+        }
+
+        // 圧縮済み辞書も読み仮名の長い順に並んでいる
+        while (dictpos < dicttail) {
+            this->dictfile->seek(dictpos);
+            uint8_t yomiganalen = this->dictfile->read_uint8() & 0x7F;
+            if (yomiganalen < len) {
+                break;
+            }
+            this->dictfile->read((uint8_t*)yomigana, yomiganalen);
+            (void)this->dictfile->read_uint8();
+            uint16_t candidateslen = this->dictfile->read_uint16();
+            uint32_t candidateshead = this->dictfile->position();
+            dictpos = candidateshead + candidateslen;
+
+            uint8_t candidatelen = this->dictfile->read_uint8();
+            if (yomiganalen > MAX_YOMIGANA_LEN || candidatelen == 0 || candidatelen > MAX_CANDIDATE_LEN) {
+                continue;
+            }
+            uint8_t slotindex = this->find_slot(yomigana, yomiganalen);
+            if (slotindex != INVALID_UINT8 && (this->get_slot(slotindex)[SLOT_FLAGS] & FLAG_DIRTY)) {
+                // ログのほうが新しい
+                continue;
+            }
+            this->dictfile->read((uint8_t*)candidate, candidatelen);
+            if (!this->compact_entry(pass, state, yomigana, yomiganalen, candidate, candidatelen)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+bool UserDict::compact(void) {
+    CompactState state;
+    memset(&state, 0x00, sizeof(state));
+    if (!this->compact_entries(CompactPass::Measure, &state)) {
+        return false;
+    }
+
+    // SKD形式で作業ファイルへ書き出す
+    if (!this->workfile->open(this->workpath, FileAccessWrapper::FileMode::WRITE)) {
+        DEBUG("Failed to open work file for user dict.");
+        return false;
+    }
+    FileAccessWrapper* out = this->workfile;
+    const uint32_t globalheaderlen = 3 + 3 + 2 + 2;
+    const uint32_t indexheaderlen = 3 + 3;
+    const uint32_t tableheaderlen = 3 + 3;
+    uint32_t filesize = globalheaderlen + indexheaderlen + state.indexlen + tableheaderlen + state.tablelen;
+    state.nextaddr = globalheaderlen + indexheaderlen + state.indexlen + tableheaderlen;
+
+    bool ok = out->write((const uint8_t*)"SKD", 3) == 3
+        && out->write_uint24(filesize)
+        && out->write_uint16(0)  // コメントなし
+        && out->write_uint16(state.yomiganamaxlen)
+        && out->write((const uint8_t*)"IDX", 3) == 3
+        && out->write_uint24(state.indexlen)
+        && this->compact_entries(CompactPass::Index, &state)
+        && out->write((const uint8_t*)"TBL", 3) == 3
+        && out->write_uint24(state.tablelen)
+        && this->compact_entries(CompactPass::Table, &state);
+    out->flush();
+    if (!ok) {
+        out->close();
+        DEBUG("Failed to write compacted user dict.");
+        return false;
+    }
+
+    // 作業ファイルを圧縮済み辞書へ写す。途中で途切れたら、次の init() で写しなおす
+    bool copied = this->copy_work_to_dict(filesize);
+    out->close();
+    if (!copied) {
+        DEBUG("Failed to copy compacted user dict.");
+        return false;
+    }
+
+    // 辞書に反映できたので、ログを空にする
+    for (uint8_t i = 0; i < this->slot_count; i++) {
+        this->get_slot(i)[SLOT_FLAGS] &= ~FLAG_DIRTY;
+    }
+    this->dirty_count = 0;
+    this->open_dict();
+    DEBUG("Compacted user dict: %d entries, %ld bytes.", state.entry_count, filesize);
+    return this->reset_log();
+}
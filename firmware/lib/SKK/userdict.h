@@ -0,0 +1,186 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <FileAccessWrapper.h>
+#include "skkdict.h"
+
+
+namespace SKK {
+
+    /** 選択された変換候補を読み仮名ごとに覚えておく、書き込み可能なユーザー辞書
+     *
+     * 3つの層からなる。
+     *   - RAM上の表：最近使った読み仮名と候補。変換のたびに最初に引く
+     *   - 追記ログ：学習した候補を1件ずつファイル末尾へ追記する。起動時にRAM上の表へ読み戻す
+     *   - 圧縮済み辞書：ログをSKD形式にまとめたもの。RAM上の表にない読み仮名はここを引く
+     * ログにしかない読み仮名がRAM上の表に収まらなくなる前に、圧縮済み辞書へまとめてログを空にする。
+     * 読み仮名ごとに覚える候補は、最後に選ばれた1つだけ。
+     */
+    class UserDict {
+    public:
+        // RAM上の表の1項目のバイト数と、覚えられる読み仮名・候補の最大バイト数
+        static constexpr uint8_t SLOT_SIZE = 48;
+        static constexpr uint8_t MAX_YOMIGANA_LEN = 20;
+        static constexpr uint8_t MAX_CANDIDATE_LEN = 24;
+        // 起動時にログがこれより大きければ圧縮する
+        static constexpr uint32_t LOG_COMPACT_THRESHOLD = 2048;
+
+    // private:
+        // RAM上の表の項目の配置：フラグ、古さ、読み仮名の長さ、候補の長さ、読み仮名、候補
+        static constexpr uint8_t SLOT_FLAGS = 0;
+        static constexpr uint8_t SLOT_AGE = 1;
+        static constexpr uint8_t SLOT_YOMIGANALEN = 2;
+        static constexpr uint8_t SLOT_CANDIDATELEN = 3;
+        static constexpr uint8_t SLOT_YOMIGANA = 4;
+        static constexpr uint8_t SLOT_CANDIDATE = SLOT_YOMIGANA + MAX_YOMIGANA_LEN;
+        static_assert(SLOT_CANDIDATE + MAX_CANDIDATE_LEN <= SLOT_SIZE, "UserDict slot overflow");
+
+        static constexpr uint8_t FLAG_USED = 0x01;
+        // ログにだけあり、圧縮済み辞書には反映されていない
+        static constexpr uint8_t FLAG_DIRTY = 0x02;
+
+        // ログの先頭のマジックとバージョン
+        static constexpr uint8_t LOG_HEADER_LENGTH = 4;
+
+        FileAccessWrapper* dictfile = nullptr;
+        const char* dictpath = nullptr;
+        FileAccessWrapper* logfile = nullptr;
+        const char* logpath = nullptr;
+        FileAccessWrapper* workfile = nullptr;
+        const char* workpath = nullptr;
+
+        // 圧縮済み辞書。ファイルがなければ has_dict がfalse
+        SkkDict dict;
+        bool has_dict = false;
+
+        uint8_t* table = nullptr;
+        uint8_t slot_count = 0;
+        // FLAG_DIRTY の項目の個数
+        uint8_t dirty_count = 0;
+
+        // 覚えている読み仮名のハッシュのビット集合。ビットが立っていなければ、ファイルを読まずに「ない」とわかる
+        uint8_t key_filter[32];
+
+        // RAM上の表に置けなかった、圧縮済み辞書から読んだ候補
+        char found_candidate[MAX_CANDIDATE_LEN];
+
+        uint8_t* get_slot(uint8_t slot) {
+            return &this->table[(size_t)slot * SLOT_SIZE];
+        }
+
+        /** 読み仮名の項目を探す
+         * @return 項目の番号、なければINVALID_UINT8
+         */
+        uint8_t find_slot(const char* yomigana, uint8_t yomiganalen);
+
+        /** 新しい項目に使える番号を得る。空いていなければ、ログに残っていない最も古い項目を使う
+         * @return 項目の番号、すべてログにしかない項目ならINVALID_UINT8
+         */
+        uint8_t get_free_slot(void);
+
+        /** 指定項目を直近に使ったものとして記録する */
+        void touch_slot(uint8_t slot);
+
+        /** 項目へ書き込む */
+        void store_slot(uint8_t slot, const char* yomigana, uint8_t yomiganalen, const char* candidate, uint8_t candidatelen, bool dirty);
+
+        static uint8_t hash_key(const char* yomigana, uint8_t yomiganalen);
+        void add_to_filter(const char* yomigana, uint8_t yomiganalen);
+        bool is_in_filter(const char* yomigana, uint8_t yomiganalen);
+
+        /** 圧縮済み辞書を開き、読み仮名をフィルタへ登録する */
+        bool open_dict(void);
+
+        /** ヘッダのファイルサイズが実際の大きさと一致するSKDか（書き出しの途中で途切れていないか）
+         * @param file [IN] 開いてあること
+         */
+        static bool is_complete_dict(FileAccessWrapper* file);
+
+        /** 圧縮済み辞書が途中までしか写されていなければ、作業ファイルから写しなおす
+         * 作業ファイルが完全なSKDでなければなにもしない。
+         * @return 写しなおしたらtrue
+         */
+        bool recover_dict(void);
+
+        /** 作業ファイルの内容を圧縮済み辞書へ写す（SDライブラリには名前の変更がない）
+         * @param filesize [IN] 写すバイト数。作業ファイルは開いてあること
+         * @return すべて写せたらtrue
+         */
+        bool copy_work_to_dict(uint32_t filesize);
+
+        /** ログを読み、RAM上の表へ反映する
+         * @return ログを最後まで読めたらtrue
+         */
+        bool replay_log(void);
+
+        /** ログを空にして、追記できるように開きなおす */
+        bool reset_log(void);
+
+        /** 圧縮済み辞書の書き出しの工程 */
+        enum class CompactPass : uint8_t {
+            Measure,
+            Index,
+            Table
+        };
+        struct CompactState {
+            uint16_t entry_count;
+            uint16_t yomiganamaxlen;
+            uint32_t indexlen;
+            uint32_t tablelen;
+            // Index の工程で、次の項目が置かれるアドレス
+            uint32_t nextaddr;
+        };
+
+        /** 書き出す項目を、読み仮名の長い順にすべて処理する
+         * 同じ長さの中では、ログにしかない項目を先に、圧縮済み辞書の項目をその後に並べる
+         */
+        bool compact_entries(CompactPass pass, CompactState* state);
+
+        /** 1項目を書き出す（Measureでは大きさを数えるだけ） */
+        bool compact_entry(CompactPass pass, CompactState* state, const char* yomigana, uint8_t yomiganalen, const char* candidate, uint8_t candidatelen);
+
+    public:
+        /** 初期化する。ログを読み戻し、大きくなっていれば圧縮する
+         * @param dictfile [IN] 圧縮済み辞書に使うファイル
+         * @param dictpath [IN] 圧縮済み辞書のパス
+         * @param logfile [IN] ログに使うファイル（書き込みに対応していること）
+         * @param logpath [IN] ログのパス
+         * @param workfile [IN] 圧縮の作業に使うファイル（書き込みに対応していること）
+         * @param workpath [IN] 作業ファイルのパス
+         * @param buffer [IN] RAM上の表に用いる領域
+         * @param bufferlen [IN] バッファのバイト数。 SLOT_SIZE の倍数であること
+         * @return 成功すればtrue
+         */
+        bool init(FileAccessWrapper* dictfile, const char* dictpath,
+                  FileAccessWrapper* logfile, const char* logpath,
+                  FileAccessWrapper* workfile, const char* workpath,
+                  uint8_t* buffer, size_t bufferlen);
+
+        /** 読み仮名に対して覚えている候補を探す
+         * RAM上の表になければ、圧縮済み辞書を引く（フィルタで「ない」とわかればファイルは読まない）
+         * @param yomigana [IN]
+         * @param yomiganalen [IN]
+         * @param candidatelen [OUT] 候補のバイト数
+         * @return 候補の文字列（NUL終端されない）。次に学習・検索するまで有効。なければnullptr
+         */
+        const char* find(const char* yomigana, size_t yomiganalen, uint8_t* candidatelen);
+
+        /** 選ばれた候補を覚え、ログへ追記する
+         * @return 成功すればtrue（長すぎて覚えられなければfalse）
+         */
+        bool learn(const char* yomigana, size_t yomiganalen, const char* candidate, size_t candidatelen);
+
+        /** RAM上の表とログの内容を圧縮済み辞書へまとめ、ログを空にする
+         * 作業ファイルへ書き出し終えてから圧縮済み辞書へ写し、写し終えてからログを空にする。
+         * 途中で電源が切れても、 init() は次の順で復旧する。
+         *   1. 圧縮済み辞書が途中までしかなく、作業ファイルが完全なら、作業ファイルを写しなおす
+         *   2. 圧縮済み辞書を開く
+         *   3. ログを読み戻す（空にする前に切れたなら、ログの項目はそのまま残っている）
+         * @return 成功すればtrue
+         */
+        bool compact(void);
+    };
+}
@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include "SjisGb18030Converter.h"
+#include <commondef.h>
+#include <sjis.h>
+#include <debug.h>
+
+
+bool SjisGb18030Converter::init(FileAccessWrapper* file, uint8_t* buffer, size_t bufferlen) {
+    if (file == nullptr || buffer == nullptr || bufferlen < SLOT_SIZE) {
+        return false;
+    }
+    if (!file->is_opened() || file->size() < HEADER_LENGTH + (uint32_t)SLOT_COUNT * SLOT_SIZE) {
+        return false;
+    }
+    uint8_t header[7];
+    if (file->seek(0) != 0 || file->read(header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    if (memcmp(header, "TED", 3) != 0 || header[3] != 1 || header[4] != SLOT_SIZE
+            || header[5] != KU_COUNT || header[6] != TEN_COUNT) {
+        return false;
+    }
+
+    this->file = file;
+    this->buffer = buffer;
+    size_t slots = bufferlen / SLOT_SIZE;
+    this->buffer_slots = slots > SLOT_COUNT ? SLOT_COUNT : (uint16_t)slots;
+    this->invalidate();
+    this->hit_count = 0;
+    this->miss_count = 0;
+    return true;
+}
+
+
+void SjisGb18030Converter::invalidate(void) {
+    this->block_head_slot = INVALID_UINT16;
+    this->block_slot_count = 0;
+}
+
+
+uint16_t SjisGb18030Converter::get_slot_index(uint8_t ku, uint8_t ten) {
+    if (ku < 1 || KU_COUNT < ku || ten < 1 || TEN_COUNT < ten) {
+        return INVALID_UINT16;
+    }
+    return (uint16_t)(ku - 1) * TEN_COUNT + (ten - 1);
+}
+
+
+uint8_t SjisGb18030Converter::get_gb18030_length(const uint8_t* slot) {
+    if (slot[0] == 0x00) {
+        return 0;
+    }
+    // 4バイトのGB18030は、2バイト目が数字（0x30-0x39）になる
+    if (0x30 <= slot[1] && slot[1] <= 0x39) {
+        return 4;
+    }
+    return 2;
+}
+
+
+const uint8_t* SjisGb18030Converter::load_slot(uint16_t slot) {
+    if (this->block_head_slot != INVALID_UINT16
+            && this->block_head_slot <= slot && slot < this->block_head_slot + this->block_slot_count) {
+        this->hit_count += 1;
+        return &this->buffer[(size_t)(slot - this->block_head_slot) * SLOT_SIZE];
+    }
+
+    this->miss_count += 1;
+    // 指定スロットから後ろへ続くブロックを読む
+    uint16_t count = this->buffer_slots;
+    if (SLOT_COUNT - slot < count) {
+        count = SLOT_COUNT - slot;
+    }
+    uint32_t addr = HEADER_LENGTH + (uint32_t)slot * SLOT_SIZE;
+    size_t len = (size_t)count * SLOT_SIZE;
+    if (this->file->seek(addr) != addr || this->file->read(this->buffer, len) != (int)len) {
+        this->invalidate();
+        return nullptr;
+    }
+    this->block_head_slot = slot;
+    this->block_slot_count = count;
+    return this->buffer;
+}
+
+
+uint8_t SjisGb18030Converter::convert_char(const char* sjis, uint8_t* dst) {
+    if (this->file == nullptr) {
+        return 0;
+    }
+    uint8_t ku, ten;
+    if (!convert_mb_to_kuten_sjis(sjis, &ku, &ten)) {
+        return 0;
+    }
+    uint16_t slot = get_slot_index(ku, ten);
+    if (slot == INVALID_UINT16) {
+        return 0;
+    }
+    const uint8_t* data = this->load_slot(slot);
+    if (data == nullptr) {
+        return 0;
+    }
+    uint8_t len = get_gb18030_length(data);
+    memcpy(dst, data, len);
+    return len;
+}
+
+
+size_t SjisGb18030Converter::convert_text(const char* sjis, size_t len, uint8_t* dst, size_t dstlen, size_t* consumed) {
+    size_t readpos = 0;
+    size_t writepos = 0;
+    while (readpos < len) {
+        uint8_t ch = (uint8_t)sjis[readpos];
+        if (sjis_is_first_byte(ch)) {
+            if (readpos + 1 >= len) {
+                // 第2バイトのない第1バイトは捨てる
+                readpos += 1;
+                break;
+            }
+            uint8_t converted[SLOT_SIZE];
+            uint8_t convertedlen = this->convert_char(&sjis[readpos], converted);
+            if (writepos + convertedlen > dstlen) {
+                break;
+            }
+            if (convertedlen == 0) {
+                DEBUG("Error: cannot convert 0x%02x, 0x%02x", ch, (uint8_t)sjis[readpos + 1]);
+            }
+            memcpy(&dst[writepos], converted, convertedlen);
+            writepos += convertedlen;
+            readpos += 2;
+
+        } else if (0xa0 <= ch && ch <= 0xdf) {
+            // 半角カナはGB18030と互換性が（たぶん）ないので、とりあえず無視
+            // FIXME: 適切な対応法を考える
+            DEBUG("Warn: encount Hankaku-Kana char: 0x%02x(%d)", ch, ch);
+            readpos += 1;
+
+        } else {
+            // 1バイトのASCII文字（もしくは制御バイト）なので、そのまま出力する
+            if (writepos + 1 > dstlen) {
+                break;
+            }
+            dst[writepos] = ch;
+            writepos += 1;
+            readpos += 1;
+        }
+    }
+    *consumed = readpos;
+    return writepos;
+}
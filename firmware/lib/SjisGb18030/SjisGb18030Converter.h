@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <FileAccessWrapper.h>
+
+
+/** ShiftJISの2バイト文字をGB18030へ変換するクラス
+
+   変換テーブルは tool/generate_sjisgb18030dict で生成する、区点番号で直接引ける形式（'TED'）。
+     ヘッダ（ HEADER_LENGTH バイト）に続き、第1区第1点から第94区第94点まで、 SLOT_SIZE バイト固定長のスロットが並ぶ。
+     スロットにはGB18030のバイト列を先頭から詰め、余りは0で埋める。変換できない区点はすべて0。
+   1文字の変換は、位置を計算してのシーク1回で済む。
+   テーブルはブロック単位で読み込み、続く文字が同じブロックにあればファイルを読まない
+   （ひらがなの連続など、近い区点の文字が続く場合に効く）。
+   ブロックのバッファは呼び出し元が用意する。
+ */
+class SjisGb18030Converter {
+public:
+    static constexpr uint8_t HEADER_LENGTH = 16;
+    static constexpr uint8_t SLOT_SIZE = 4;
+    static constexpr uint8_t KU_COUNT = 94;
+    static constexpr uint8_t TEN_COUNT = 94;
+    static constexpr uint16_t SLOT_COUNT = (uint16_t)KU_COUNT * TEN_COUNT;
+
+// private:
+    FileAccessWrapper* file = nullptr;
+    // テーブルのブロックを読み込むバッファ
+    uint8_t* buffer = nullptr;
+    // バッファに収まるスロットの数
+    uint16_t buffer_slots = 0;
+    // バッファに読み込んであるブロックの先頭のスロット番号。空ならINVALID_UINT16
+    uint16_t block_head_slot;
+    // バッファに読み込んであるスロットの数
+    uint16_t block_slot_count = 0;
+
+    /** 指定スロットを含むブロックをバッファへ読み込む
+     * @return バッファ上のスロットの先頭、読み込めなかったらnullptr
+     */
+    const uint8_t* load_slot(uint16_t slot);
+
+public:
+    // ブロックから変換できた回数と、ファイルから読み込みなおした回数
+    uint32_t hit_count = 0;
+    uint32_t miss_count = 0;
+
+    /** 初期化する
+     * @param file [IN] 開かれた変換テーブルのファイル
+     * @param buffer [IN] ブロックの読み込みに用いる領域
+     * @param bufferlen [IN] バッファのバイト数。 SLOT_SIZE 以上
+     * @return テーブルの形式が正しければtrue
+     */
+    bool init(FileAccessWrapper* file, uint8_t* buffer, size_t bufferlen);
+
+    /** 読み込んであるブロックを破棄する */
+    void invalidate(void);
+
+    /** 区点番号からスロット番号を得る
+     * @return スロット番号、範囲外ならINVALID_UINT16
+     */
+    static uint16_t get_slot_index(uint8_t ku, uint8_t ten);
+
+    /** スロットに格納されたGB18030のバイト数
+     * @param slot [IN] SLOT_SIZE バイトのスロット
+     * @return 2か4、変換できない文字なら0
+     */
+    static uint8_t get_gb18030_length(const uint8_t* slot);
+
+    /** 1文字を変換する
+     * @param sjis [IN] ShiftJISの2バイト文字
+     * @param dst [OUT] GB18030のバイト列。 SLOT_SIZE バイト以上
+     * @return 書き込んだバイト数、変換できなければ0
+     */
+    uint8_t convert_char(const char* sjis, uint8_t* dst);
+
+    /** ShiftJISの文字列を、dstに収まるところまで変換する
+     * 1バイト文字はそのまま書き出し、半角カナと変換できない文字は読み飛ばす。
+     * 文字の途中で書き出しを止めることはない。
+     * @param sjis [IN]
+     * @param len [IN] sjisのバイト数
+     * @param dst [OUT]
+     * @param dstlen [IN] dstのバイト数
+     * @param consumed [OUT] 読み進めたsjisのバイト数
+     * @return dstへ書き込んだバイト数
+     */
+    size_t convert_text(const char* sjis, size_t len, uint8_t* dst, size_t dstlen, size_t* consumed);
+};
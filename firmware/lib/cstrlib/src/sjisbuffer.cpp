@@ -0,0 +1,125 @@
+#include "sjisbuffer.h"
+
+#include <string.h>
+
+#include "sjis.h"
+
+
+bool SjisBuffer::init(char* buffer, size_t bufferlen) {
+    if (buffer == nullptr || bufferlen < required_buffer_length(1)) {
+        return false;
+    }
+    // 容量 c に対して c + 1 + ceil(c / 8) バイトが必要なので、収まる最大の c を求める
+    size_t capacity = ((bufferlen - 1) * 8) / 9;
+    while (required_buffer_length(capacity) > bufferlen) {
+        capacity -= 1;
+    }
+    this->buffer = buffer;
+    this->charstarts = (uint8_t*)&buffer[capacity + 1];
+    this->buffer_capacity = capacity;
+    this->clear();
+    return true;
+}
+
+
+void SjisBuffer::clear(void) {
+    this->buffer_length = 0;
+    this->waiting_second_byte = false;
+    this->buffer[0] = '\0';
+}
+
+
+void SjisBuffer::set_char_start(size_t index, bool is_start) {
+    if (is_start) {
+        this->charstarts[index / 8] |= (uint8_t)(0x01 << (index % 8));
+    } else {
+        this->charstarts[index / 8] &= (uint8_t)~(0x01 << (index % 8));
+    }
+}
+
+
+void SjisBuffer::push_byte(char ch) {
+    size_t index = this->buffer_length;
+    if (this->waiting_second_byte) {
+        this->set_char_start(index, false);
+        this->waiting_second_byte = false;
+    } else {
+        this->set_char_start(index, true);
+        this->waiting_second_byte = sjis_is_first_byte(ch);
+    }
+    this->buffer[index] = ch;
+    this->buffer_length = index + 1;
+}
+
+
+size_t SjisBuffer::append(const char* s, size_t len) {
+    if (len > this->remaining()) {
+        len = this->remaining();
+    }
+    for (size_t i = 0; i < len; i++) {
+        this->push_byte(s[i]);
+    }
+    this->buffer[this->buffer_length] = '\0';
+    return len;
+}
+
+
+bool SjisBuffer::append_char(char ch) {
+    if (this->remaining() < 1) {
+        return false;
+    }
+    this->push_byte(ch);
+    this->buffer[this->buffer_length] = '\0';
+    return true;
+}
+
+
+uint8_t SjisBuffer::pop_last_char(void) {
+    if (this->buffer_length == 0) {
+        return 0;
+    }
+    size_t head = this->get_prev_char_index(this->buffer_length);
+    uint8_t bytes = (uint8_t)(this->buffer_length - head);
+    this->buffer_length = head;
+    this->buffer[head] = '\0';
+    // 残った末尾の文字は完結している
+    this->waiting_second_byte = false;
+    return bytes;
+}
+
+
+void SjisBuffer::remove_head(size_t count) {
+    if (count >= this->buffer_length) {
+        this->clear();
+        return;
+    }
+    size_t newlen = this->buffer_length - count;
+    memmove(this->buffer, &this->buffer[count], newlen);
+    this->buffer[newlen] = '\0';
+    for (size_t i = 0; i < newlen; i++) {
+        this->set_char_start(i, this->is_char_start(i + count));
+    }
+    this->buffer_length = newlen;
+}
+
+
+uint8_t SjisBuffer::get_char_bytes(size_t index) const {
+    if (index >= this->buffer_length) {
+        return 0;
+    }
+    if (index + 1 < this->buffer_length && !this->is_char_start(index + 1)) {
+        return 2;
+    }
+    return 1;
+}
+
+
+size_t SjisBuffer::get_prev_char_index(size_t index) const {
+    if (index == 0) {
+        return 0;
+    }
+    if (index >= 2 && !this->is_char_start(index - 1)) {
+        return index - 2;
+    }
+    return index - 1;
+}
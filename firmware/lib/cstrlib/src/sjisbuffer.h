@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* 長さを保持するShiftJIS文字列バッファ
+
+   - 末尾への追加、末尾1文字の削除、長さの取得は、文字列を走査せずに行える。
+   - 常にNUL終端を保つので、c_str() はそのままCの文字列として使える。
+   - 各バイトが文字の先頭か否かをビット表で持ち、末尾の文字のバイト数を求める
+     （SJISでは末尾のバイトだけを見ても、それが第2バイトかを判定できないため）。
+   - メモリは呼び出し側が用意する。容量 capacity バイトの文字列には required_buffer_length(capacity) バイトが必要。
+ */
+class SjisBuffer {
+public:
+    /** 指定の容量の文字列を保持するのに必要なメモリのバイト数（文字列、終端のNUL、ビット表） */
+    static constexpr size_t required_buffer_length(size_t capacity) {
+        return capacity + 1 + (capacity + 7) / 8;
+    }
+
+// private:
+    // 文字列（NUL終端）
+    char* buffer = nullptr;
+    // 各バイトが文字の先頭なら1となるビット表
+    uint8_t* charstarts = nullptr;
+    // 保持できる最大のバイト数（終端のNULを除く）
+    size_t buffer_capacity = 0;
+    // 現在のバイト数
+    size_t buffer_length = 0;
+    // 末尾が、第2バイトを待っているSJISの第1バイトならtrue
+    bool waiting_second_byte = false;
+
+    bool is_char_start(size_t index) const {
+        return (this->charstarts[index / 8] >> (index % 8)) & 0x01;
+    }
+
+    void set_char_start(size_t index, bool is_start);
+
+    /** 1バイトを末尾に追加する（容量は呼び出し側で確認する） */
+    void push_byte(char ch);
+
+public:
+    /** 初期化し、空の文字列にする
+     * @param buffer [IN] 利用するメモリ
+     * @param bufferlen [IN] メモリのバイト数。容量はこの大きさから決まる
+     * @return 成功すればtrue
+     */
+    bool init(char* buffer, size_t bufferlen);
+
+    /** 空にする */
+    void clear(void);
+
+    /** 文字列のバイト数 */
+    size_t length(void) const {
+        return this->buffer_length;
+    }
+
+    /** 保持できる最大のバイト数 */
+    size_t capacity(void) const {
+        return this->buffer_capacity;
+    }
+
+    /** 追加できる残りのバイト数 */
+    size_t remaining(void) const {
+        return this->buffer_capacity - this->buffer_length;
+    }
+
+    bool is_empty(void) const {
+        return this->buffer_length == 0;
+    }
+
+    /** NUL終端された文字列 */
+    const char* c_str(void) const {
+        return this->buffer;
+    }
+
+    /** 文字列を直接書き換えるためのポインタ。文字の区切りと長さが変わらない操作（ひらがなからカタカナへ等）に限る */
+    char* data(void) {
+        return this->buffer;
+    }
+
+    /** 末尾に追加する。容量を超える分は追加しない
+     * @param s [IN]
+     * @param len [IN] バイト数
+     * @return 追加したバイト数
+     */
+    size_t append(const char* s, size_t len);
+
+    /** 末尾に1バイトを追加する
+     * @return 追加できたらtrue
+     */
+    bool append_char(char ch);
+
+    /** 末尾の1文字を削除する
+     * @return 削除したバイト数（空なら0）
+     */
+    uint8_t pop_last_char(void);
+
+    /** 先頭から指定のバイト数を削除し、残りを前へ詰める
+     * @param count [IN] 削除するバイト数。文字の先頭で区切ること
+     */
+    void remove_head(size_t count);
+
+    /** 指定位置の文字のバイト数
+     * @param index [IN] 文字の先頭のバイト位置
+     */
+    uint8_t get_char_bytes(size_t index) const;
+
+    /** 指定位置の直前の文字の先頭位置
+     * @param index [IN] 文字の先頭のバイト位置（末尾を表す length() も可）
+     * @return 直前の文字の先頭位置。index が0なら0
+     */
+    size_t get_prev_char_index(size_t index) const;
+};
@@ -0,0 +1,62 @@
+#include "romaji.h"
+
+#include <string.h>
+
+#include "romajidef.h"
+
+
+/** 表の項目のローマ字と、NUL埋めしたキーとを比較する
+ * @return strcmp() と同じ
+ */
+static int compare_romaji(const romajientry_t* entry, const char* key) {
+    return memcmp(entry->romaji, key, ROMAJI_MAX_LENGTH);
+}
+
+
+const romajientry_t* romaji_lookup(const char* romaji, uint8_t romaji_len, bool* is_prefix) {
+    *is_prefix = false;
+    if (romaji_len == 0 || romaji_len > ROMAJI_MAX_LENGTH) {
+        return nullptr;
+    }
+    char key[ROMAJI_MAX_LENGTH];
+    memset(key, '\0', sizeof(key));
+    memcpy(key, romaji, romaji_len);
+
+    // キー以上となる最初の項目を探す
+    uint8_t low = 0;
+    uint8_t high = ROMAJITABLE_ENTRIES;
+    while (low < high) {
+        uint8_t mid = (low + high) / 2;
+        if (compare_romaji(&romajitable[mid], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    const romajientry_t* found = nullptr;
+    uint8_t next = low;
+    if (low < ROMAJITABLE_ENTRIES && compare_romaji(&romajitable[low], key) == 0) {
+        found = &romajitable[low];
+        next = low + 1;
+    }
+    // NULはアルファベットより小さいので、キーで始まる長い項目は直後に並んでいる
+    if (next < ROMAJITABLE_ENTRIES && memcmp(romajitable[next].romaji, romaji, romaji_len) == 0) {
+        *is_prefix = true;
+    }
+
+    return found;
+}
+
+
+uint8_t romaji_get_table_entries(void) {
+    return ROMAJITABLE_ENTRIES;
+}
+
+
+const romajientry_t* romaji_get_table_entry(uint8_t index) {
+    if (index >= ROMAJITABLE_ENTRIES) {
+        return nullptr;
+    }
+    return &romajitable[index];
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// ローマ字の最大バイト数（"xtsu" など）
+static constexpr uint8_t ROMAJI_MAX_LENGTH = 4;
+// 変換後のひらがな（と書き戻すアルファベット）の最大バイト数
+static constexpr uint8_t ROMAJI_HIRAGANA_MAX_LENGTH = 4;
+
+/* ローマ字表の項目。表は romajidef.h にあり、 tool/generate_romajitable で生成する。
+   ATmega4809ではconstの表はフラッシュに置かれ、RAMへコピーせずにそのまま読める。 */
+typedef struct {
+    // ローマ字。NUL終端
+    char romaji[ROMAJI_MAX_LENGTH + 1];
+    // ひらがなと、その後ろに続く書き戻すアルファベット（"っ" + "k" など）。NUL終端
+    char hiragana[ROMAJI_HIRAGANA_MAX_LENGTH + 1];
+    // ひらがなの部分のバイト数
+    uint8_t hiraganabytelength;
+    // 書き戻すアルファベットも含めたバイト数
+    uint8_t totalbytelength;
+} romajientry_t;
+
+
+/** ローマ字表を引く。表はローマ字の昇順に並んでいるので二分探索する
+ * @param romaji [IN] ローマ字（NUL終端でなくてよい）
+ * @param romaji_len [IN] ローマ字のバイト数
+ * @param is_prefix [OUT] より長いローマ字の先頭部分として一致する項目があればtrue（入力を続ければ変換できうる）
+ * @return 完全に一致した項目。なければnullptr
+ */
+const romajientry_t* romaji_lookup(const char* romaji, uint8_t romaji_len, bool* is_prefix);
+
+/** ローマ字表の項目数 */
+uint8_t romaji_get_table_entries(void);
+
+/** ローマ字表の指定番号の項目 */
+const romajientry_t* romaji_get_table_entry(uint8_t index);
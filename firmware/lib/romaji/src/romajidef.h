@@ -0,0 +1,170 @@
+// このファイルは tool/generate_romajitable/generate_romajitable.py で生成する。直接編集しないこと。
+// romajientry_t は romaji.h で定義する。
+
+// ローマ字の昇順（NUL埋めしたバイト列として）に並べる。romaji_lookup() はこの順序に依存する
+const romajientry_t romajitable[] = {
+
+    { "a", "\x82\xa0", 2, 2 },
+    { "ba", "\x82\xce", 2, 2 },
+    { "bb", "\x82\xc1\x62", 2, 3 },
+    { "be", "\x82\xd7", 2, 2 },
+    { "bi", "\x82\xd1", 2, 2 },
+    { "bo", "\x82\xda", 2, 2 },
+    { "bu", "\x82\xd4", 2, 2 },
+    { "bya", "\x82\xd1\x82\xe1", 4, 4 },
+    { "byo", "\x82\xd1\x82\xe5", 4, 4 },
+    { "byu", "\x82\xd1\x82\xe3", 4, 4 },
+    { "cha", "\x82\xbf\x82\xe1", 4, 4 },
+    { "chi", "\x82\xbf", 2, 2 },
+    { "cho", "\x82\xbf\x82\xe5", 4, 4 },
+    { "chu", "\x82\xbf\x82\xe3", 4, 4 },
+    { "da", "\x82\xbe", 2, 2 },
+    { "dd", "\x82\xc1\x64", 2, 3 },
+    { "de", "\x82\xc5", 2, 2 },
+    { "di", "\x82\xc0", 2, 2 },
+    { "do", "\x82\xc7", 2, 2 },
+    { "du", "\x82\xc3", 2, 2 },
+    { "e", "\x82\xa6", 2, 2 },
+    { "fu", "\x82\xd3", 2, 2 },
+    { "ga", "\x82\xaa", 2, 2 },
+    { "ge", "\x82\xb0", 2, 2 },
+    { "gg", "\x82\xc1\x67", 2, 3 },
+    { "gi", "\x82\xac", 2, 2 },
+    { "go", "\x82\xb2", 2, 2 },
+    { "gu", "\x82\xae", 2, 2 },
+    { "gya", "\x82\xac\x82\xe1", 4, 4 },
+    { "gyo", "\x82\xac\x82\xe5", 4, 4 },
+    { "gyu", "\x82\xac\x82\xe3", 4, 4 },
+    { "ha", "\x82\xcd", 2, 2 },
+    { "he", "\x82\xd6", 2, 2 },
+    { "hh", "\x82\xc1\x68", 2, 3 },
+    { "hi", "\x82\xd0", 2, 2 },
+    { "ho", "\x82\xd9", 2, 2 },
+    { "hu", "\x82\xd3", 2, 2 },
+    { "hya", "\x82\xd0\x82\xe1", 4, 4 },
+    { "hyo", "\x82\xd0\x82\xe5", 4, 4 },
+    { "hyu", "\x82\xd0\x82\xe3", 4, 4 },
+    { "i", "\x82\xa2", 2, 2 },
+    { "ja", "\x82\xb6\x82\xe1", 4, 4 },
+    { "je", "\x82\xb6\x82\xa5", 4, 4 },
+    { "ji", "\x82\xb6", 2, 2 },
+    { "jj", "\x82\xc1\x6a", 2, 3 },
+    { "jo", "\x82\xb6\x82\xe5", 4, 4 },
+    { "ju", "\x82\xb6\x82\xe3", 4, 4 },
+    { "jya", "\x82\xb6\x82\xe1", 4, 4 },
+    { "jyo", "\x82\xb6\x82\xe5", 4, 4 },
+    { "jyu", "\x82\xb6\x82\xe3", 4, 4 },
+    { "ka", "\x82\xa9", 2, 2 },
+    { "ke", "\x82\xaf", 2, 2 },
+    { "ki", "\x82\xab", 2, 2 },
+    { "kk", "\x82\xc1\x6b", 2, 3 },
+    { "ko", "\x82\xb1", 2, 2 },
+    { "ku", "\x82\xad", 2, 2 },
+    { "kya", "\x82\xab\x82\xe1", 4, 4 },
+    { "kyo", "\x82\xab\x82\xe5", 4, 4 },
+    { "kyu", "\x82\xab\x82\xe3", 4, 4 },
+    { "ma", "\x82\xdc", 2, 2 },
+    { "mb", "\x82\xf1\x62", 2, 3 },
+    { "me", "\x82\xdf", 2, 2 },
+    { "mi", "\x82\xdd", 2, 2 },
+    { "mm", "\x82\xf1\x6d", 2, 3 },
+    { "mo", "\x82\xe0", 2, 2 },
+    { "mp", "\x82\xf1\x70", 2, 3 },
+    { "mu", "\x82\xde", 2, 2 },
+    { "mya", "\x82\xdd\x82\xe1", 4, 4 },
+    { "myo", "\x82\xdd\x82\xe5", 4, 4 },
+    { "myu", "\x82\xdd\x82\xe3", 4, 4 },
+    { "na", "\x82\xc8", 2, 2 },
+    { "nb", "\x82\xf1\x62", 2, 3 },
+    { "nd", "\x82\xf1\x64", 2, 3 },
+    { "ne", "\x82\xcb", 2, 2 },
+    { "ng", "\x82\xf1\x67", 2, 3 },
+    { "nh", "\x82\xf1\x68", 2, 3 },
+    { "ni", "\x82\xc9", 2, 2 },
+    { "nj", "\x82\xf1\x6a", 2, 3 },
+    { "nk", "\x82\xf1\x6b", 2, 3 },
+    { "nm", "\x82\xf1\x6d", 2, 3 },
+    { "nn", "\x82\xf1", 2, 2 },
+    { "no", "\x82\xcc", 2, 2 },
+    { "np", "\x82\xf1\x70", 2, 3 },
+    { "nr", "\x82\xf1\x72", 2, 3 },
+    { "ns", "\x82\xf1\x73", 2, 3 },
+    { "nt", "\x82\xf1\x74", 2, 3 },
+    { "nu", "\x82\xca", 2, 2 },
+    { "nw", "\x82\xf1\x77", 2, 3 },
+    { "nya", "\x82\xc9\x82\xe1", 4, 4 },
+    { "nyo", "\x82\xc9\x82\xe5", 4, 4 },
+    { "nyu", "\x82\xc9\x82\xe3", 4, 4 },
+    { "nz", "\x82\xf1\x7a", 2, 3 },
+    { "o", "\x82\xa8", 2, 2 },
+    { "pa", "\x82\xcf", 2, 2 },
+    { "pe", "\x82\xd8", 2, 2 },
+    { "pi", "\x82\xd2", 2, 2 },
+    { "po", "\x82\xdb", 2, 2 },
+    { "pp", "\x82\xc1\x70", 2, 3 },
+    { "pu", "\x82\xd5", 2, 2 },
+    { "pya", "\x82\xd2\x82\xe1", 4, 4 },
+    { "pyo", "\x82\xd2\x82\xe5", 4, 4 },
+    { "pyu", "\x82\xd2\x82\xe3", 4, 4 },
+    { "ra", "\x82\xe7", 2, 2 },
+    { "re", "\x82\xea", 2, 2 },
+    { "ri", "\x82\xe8", 2, 2 },
+    { "ro", "\x82\xeb", 2, 2 },
+    { "rr", "\x82\xc1\x72", 2, 3 },
+    { "ru", "\x82\xe9", 2, 2 },
+    { "rya", "\x82\xe8\x82\xe1", 4, 4 },
+    { "ryo", "\x82\xe8\x82\xe5", 4, 4 },
+    { "ryu", "\x82\xe8\x82\xe3", 4, 4 },
+    { "sa", "\x82\xb3", 2, 2 },
+    { "se", "\x82\xb9", 2, 2 },
+    { "sha", "\x82\xb5\x82\xe1", 4, 4 },
+    { "shi", "\x82\xb5", 2, 2 },
+    { "sho", "\x82\xb5\x82\xe5", 4, 4 },
+    { "shu", "\x82\xb5\x82\xe3", 4, 4 },
+    { "si", "\x82\xb5", 2, 2 },
+    { "so", "\x82\xbb", 2, 2 },
+    { "ss", "\x82\xc1\x73", 2, 3 },
+    { "su", "\x82\xb7", 2, 2 },
+    { "sya", "\x82\xb5\x82\xe1", 4, 4 },
+    { "syo", "\x82\xb5\x82\xe5", 4, 4 },
+    { "syu", "\x82\xb5\x82\xe3", 4, 4 },
+    { "ta", "\x82\xbd", 2, 2 },
+    { "te", "\x82\xc4", 2, 2 },
+    { "ti", "\x82\xbf", 2, 2 },
+    { "to", "\x82\xc6", 2, 2 },
+    { "tsu", "\x82\xc2", 2, 2 },
+    { "tt", "\x82\xc1\x74", 2, 3 },
+    { "tu", "\x82\xc2", 2, 2 },
+    { "tya", "\x82\xbf\x82\xe1", 4, 4 },
+    { "tyo", "\x82\xbf\x82\xe5", 4, 4 },
+    { "tyu", "\x82\xbf\x82\xe3", 4, 4 },
+    { "u", "\x82\xa4", 2, 2 },
+    { "va", "\x83\x94\x82\x9f", 4, 4 },
+    { "vo", "\x83\x94\x82\xa7", 4, 4 },
+    { "vu", "\x83\x94", 2, 2 },
+    { "wa", "\x82\xed", 2, 2 },
+    { "wo", "\x82\xf0", 2, 2 },
+    { "ww", "\x82\xc1\x77", 2, 3 },
+    { "xa", "\x82\x9f", 2, 2 },
+    { "xe", "\x82\xa5", 2, 2 },
+    { "xi", "\x82\xa1", 2, 2 },
+    { "xo", "\x82\xa7", 2, 2 },
+    { "xtsu", "\x82\xc1", 2, 2 },
+    { "xtu", "\x82\xc1", 2, 2 },
+    { "xu", "\x82\xa3", 2, 2 },
+    { "xya", "\x82\xe1", 2, 2 },
+    { "xyo", "\x82\xe5", 2, 2 },
+    { "xyu", "\x82\xe3", 2, 2 },
+    { "ya", "\x82\xe2", 2, 2 },
+    { "yo", "\x82\xe6", 2, 2 },
+    { "yu", "\x82\xe4", 2, 2 },
+    { "yy", "\x82\xc1\x79", 2, 3 },
+    { "za", "\x82\xb4", 2, 2 },
+    { "ze", "\x82\xba", 2, 2 },
+    { "zi", "\x82\xb6", 2, 2 },
+    { "zo", "\x82\xbc", 2, 2 },
+    { "zu", "\x82\xb8", 2, 2 },
+    { "zz", "\x82\xc1\x7a", 2, 3 }
+};
+
+constexpr uint8_t ROMAJITABLE_ENTRIES = sizeof(romajitable) / sizeof(romajientry_t);
@@ -10,11 +10,18 @@
 
 
 bool ArduinoSDFileAccessor::open(const char* path, FileMode mode) {
-    if (mode != FileMode::READ) {
-        PANIC("FileAccessor supports only FileMode::READ");
+    uint8_t sdmode;
+    if (mode == FileMode::READ) {
+        sdmode = FILE_READ;
+    } else if (mode == FileMode::WRITE) {
+        // 既存の内容は切り詰める
+        sdmode = O_READ | O_WRITE | O_CREAT | O_TRUNC;
+    } else {
+        // FILE_WRITE は書き込みの前に末尾へシークする
+        sdmode = FILE_WRITE;
     }
 
-    File f = SD.open(path, FILE_READ);
+    File f = SD.open(path, sdmode);
     if (!f) {
         DEBUG("Requested file cannot open. \"%s\"", path);
         return false;
@@ -68,3 +75,41 @@ uint32_t ArduinoSDFileAccessor::seek(uint32_t pos) {
         return newpos;
     }
 }
+
+uint32_t ArduinoSDFileAccessor::size(void) {
+    if (!this->is_opened()) {
+        return 0;
+    } else {
+        return this->file.size();
+    }
+}
+
+int ArduinoSDFileAccessor::read(uint8_t* buf, size_t buflen) {
+    if (!this->is_opened()) {
+        return -1;
+    } else {
+        // 1バイトずつ読むよりもSDライブラリの呼び出し回数が少なく済む
+        return this->file.read(buf, buflen);
+    }
+}
+
+int ArduinoSDFileAccessor::write(const uint8_t* buf, size_t buflen) {
+    if (!this->is_opened() || this->mode == FileMode::READ) {
+        return -1;
+    } else {
+        if (this->mode == FileMode::READWRITE) {
+            // 読み込みで動かした位置に関わらず、追記にする
+            this->file.seek(this->file.size());
+        }
+        return (int)this->file.write(buf, buflen);
+    }
+}
+
+bool ArduinoSDFileAccessor::flush(void) {
+    if (!this->is_opened() || this->mode == FileMode::READ) {
+        return false;
+    } else {
+        this->file.flush();
+        return true;
+    }
+}
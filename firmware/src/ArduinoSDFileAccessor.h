@@ -44,4 +44,23 @@ public:
      * @return 新しいファイル位置
      */
     virtual uint32_t seek(uint32_t pos) override;
+
+    /** ファイルの大きさを取得する
+     * @return ファイルのバイト数
+     */
+    virtual uint32_t size(void) override;
+
+    /** 指定バイト数をまとめて読み込む
+     * @return 読み込めたバイト数
+     */
+    virtual int read(uint8_t* buf, size_t buflen) override;
+
+    /** 指定バイト数を書き込む（ FileMode::READWRITE では末尾へ追記する）
+     * @return 書き込めたバイト数
+     */
+    virtual int write(const uint8_t* buf, size_t buflen) override;
+
+    /** 書き込んだ内容をSDカードへ反映させる
+     */
+    virtual bool flush(void) override;
 };
@@ -1,8 +1,11 @@
 #include "font.h"
 
 #include <assert.h>
+#include <alloca.h>
 
 #include <debug.h>
+#include <profile.h>
+#include <commondef.h>
 
 
 bool FontManager::init(FileAccessWrapper* file, uint8_t height, uint8_t halfwidth, uint8_t fullwidth) {
@@ -21,42 +24,72 @@ bool FontManager::init(FileAccessWrapper* file, uint8_t height, uint8_t halfwidt
     this->FONT_WIDTH_DOUBLEBYTE = fullwidth;
     this->GLYPH_LENGTH_SINGLEBYTE = this->FONT_WIDTH_SINGLEBYTE * ((this->FONT_HEIGHT + 7) / 8);
     this->GLYPH_LENGTH_DOUBLEBYTE = this->FONT_WIDTH_DOUBLEBYTE * ((this->FONT_HEIGHT + 7) / 8);
+    if (!this->load_ku_offset_table()) {
+        DEBUG("failed to load ku offset table.");
+        return false;
+    }
     this->font_loaded = true;
 
     return true;
 }
 
 
+bool FontManager::load_ku_offset_table(void) {
+    memset(this->ku_offset_table, 0xFF, sizeof(this->ku_offset_table));
+
+    this->fontfile->seek(0);
+    byte header[GLOBAL_HEADER_LENGTH + INDEX_HEADER_LENGTH];
+    if (this->fontfile->read(header, sizeof(header)) != (int)sizeof(header)) {
+        DEBUG("failed to read font header.");
+        return false;
+    }
+    if (header[0] != 'F' || header[1] != 'N' || header[5] != 'T' || header[6] != 'B') {
+        DEBUG("invalid font header.");
+        return false;
+    }
+    uint32_t indexlen = ((uint32_t)header[9] << 16) | ((uint32_t)header[8] << 8) | (uint32_t)header[7];
+
+    // インデックスは (1byte 区, 3byte オフセット) の繰り返し
+    for (uint32_t pos = 0; pos + 4 <= indexlen; pos += 4) {
+        byte entry[4];
+        this->fontfile->read(entry, 4);
+        uint8_t ku = entry[0];
+        uint8_t tableindex;
+        if (ku == 0xFF) {
+            tableindex = KU_OFFSET_TABLE_INDEX_TOFU;
+        } else if (ku <= 94) {
+            tableindex = ku;
+        } else {
+            continue;
+        }
+        memcpy(&this->ku_offset_table[tableindex * 3], &entry[1], 3);
+    }
+
+    return true;
+}
+
+
 uint32_t FontManager::get_ku_offset(uint8_t ku) {
     if (!this->font_loaded) {
         Serial.println("get_ku_offset(): font not loaded.");
         return INVALID_UINT32_VALUE;
     }
-    this->fontfile->seek(0);
-    constexpr size_t buflen = 128;
-    byte buf[buflen];
-    uint32_t offset = 0;
-    this->fontfile->read(buf, buflen);
-    uint32_t headertail = GLOBAL_HEADER_LENGTH + (INDEX_HEADER_LENGTH - 3) + (((uint32_t)buf[4] << 16) | ((uint32_t)buf[3] << 8) | (uint32_t)buf[2]);
-    offset = GLOBAL_HEADER_LENGTH + INDEX_HEADER_LENGTH;
-    do {
-        // Serial.print("get_ku_offset(): read offset=");
-        // Serial.println(offset);
-        this->fontfile->seek(offset);
-        this->fontfile->read(buf, buflen);
-        uint32_t endpos = (buflen / 4) * 4;
-        for (uint32_t i = 0; i < endpos; ) {
-            uint8_t cur_ku = buf[i];
-            if (cur_ku == ku) {
-                uint32_t cur_offset = (((uint32_t)buf[i+3] << 16) | ((uint32_t)buf[i+2] << 8) | (uint32_t)buf[i+1]);
-                // Serial.print("get_ku_offset(): found ku offset=");
-                // Serial.println(cur_offset);
-                return cur_offset;
-            }
-            i += 4;
+    uint8_t tableindex;
+    if (ku == 0xFF) {
+        tableindex = KU_OFFSET_TABLE_INDEX_TOFU;
+    } else if (ku <= 94) {
+        tableindex = ku;
+    } else {
+        tableindex = INVALID_UINT8;
+    }
+
+    if (tableindex != INVALID_UINT8) {
+        const uint8_t* entry = &this->ku_offset_table[tableindex * 3];
+        uint32_t offset = ((uint32_t)entry[2] << 16) | ((uint32_t)entry[1] << 8) | (uint32_t)entry[0];
+        if (offset != 0xFFFFFF) {
+            return offset;
         }
-        offset += buflen;
-    } while (offset < headertail);
+    }
 
     Serial.print("get_ku_offset(): Ku not found. Ku=");
     Serial.println(ku);
@@ -88,6 +121,7 @@ uint32_t FontManager::get_glyph_offset(uint8_t ku, uint8_t ten) {
 
 
 bool FontManager::get_glyph_from_kuten(uint8_t ku, uint8_t ten, byte* dst, uint8_t* width, uint8_t* height) {
+    PROFILE_SCOPE(GetGlyphFromKuten);
     uint32_t glyph_offset = this->get_glyph_offset(ku, ten);
     if (glyph_offset == INVALID_UINT32_VALUE) {
         return false;
@@ -174,44 +208,201 @@ bool FontManager::get_glyph_from_kuten(uint8_t ku, uint8_t ten, byte* dst, uint8
 }
 
 
+bool FontManager::get_glyphs_from_kuten(const uint8_t* kuten, uint8_t count, byte* dst) {
+    // 各グリフの出力先の位置と、ファイル上の位置
+    uint16_t* dstoffsets = (uint16_t*)alloca(sizeof(uint16_t) * count);
+    uint32_t* glyphoffsets = (uint32_t*)alloca(sizeof(uint32_t) * count);
+    // キャッシュになかったグリフの番号を、ファイル上の位置の順に並べたもの
+    uint8_t* misses = (uint8_t*)alloca(count);
+    uint8_t misscount = 0;
+    bool succeeded = true;
+
+    uint16_t dstoffset = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t ku = kuten[i * 2];
+        uint8_t ten = kuten[i * 2 + 1];
+        uint8_t length_per_glyph = (ku == 0) ? GLYPH_LENGTH_SINGLEBYTE : GLYPH_LENGTH_DOUBLEBYTE;
+        dstoffsets[i] = dstoffset;
+        dstoffset += length_per_glyph;
+
+        if ((ku > 94) || (ku != 0 && ten > 94)) {
+            DEBUG("Invalid KuTen. Ku,Ten=%d,%d", ku, ten);
+            ku = 1;
+            ten = 94;
+        }
+
+        byte* ptr = this->lookup_cache(ku, ten);
+        if (ptr) {
+            memcpy(&dst[dstoffsets[i]], ptr, length_per_glyph);
+            continue;
+        }
+        glyphoffsets[i] = this->get_glyph_offset(ku, ten);
+        if (glyphoffsets[i] == INVALID_UINT32_VALUE) {
+            memset(&dst[dstoffsets[i]], 0x00, length_per_glyph);
+            succeeded = false;
+            continue;
+        }
+
+        // 挿入ソートで、ファイル上の位置の順に並べる（グリフの数は1行分なので十分）
+        uint8_t pos = misscount;
+        while (pos > 0 && glyphoffsets[misses[pos - 1]] > glyphoffsets[i]) {
+            misses[pos] = misses[pos - 1];
+            pos--;
+        }
+        misses[pos] = i;
+        misscount++;
+    }
+
+    // ファイルの前方から順に読み込む
+    for (uint8_t n = 0; n < misscount; n++) {
+        uint8_t i = misses[n];
+        uint8_t ku = kuten[i * 2];
+        uint8_t ten = kuten[i * 2 + 1];
+        uint8_t length_per_glyph = (ku == 0) ? GLYPH_LENGTH_SINGLEBYTE : GLYPH_LENGTH_DOUBLEBYTE;
+        byte* p = &dst[dstoffsets[i]];
+
+        if (n > 0 && glyphoffsets[misses[n - 1]] == glyphoffsets[i]) {
+            // 同じ文字が複数回現れた
+            memcpy(p, &dst[dstoffsets[misses[n - 1]]], length_per_glyph);
+            continue;
+        }
+
+        if (this->fontfile->position() != glyphoffsets[i]) {
+            this->fontfile->seek(glyphoffsets[i]);
+        }
+        int readlen = this->fontfile->read(p, length_per_glyph);
+        if (readlen != length_per_glyph) {
+            DEBUG("Error in reading glyph. readlen=%d, glyph_offset=%lu", readlen, (unsigned long)glyphoffsets[i]);
+            memset(p, 0xF0, length_per_glyph);
+            succeeded = false;
+            continue;
+        }
+
+        if ((ku > 94) || (ku != 0 && ten > 94)) {
+            ku = 1;
+            ten = 94;
+        }
+        this->add_to_cache(ku, ten, p, length_per_glyph);
+    }
+
+    return succeeded;
+}
+
+
 /*
 キャッシュのメモリ構造
-Glyphs:
+  (Bbyte) ハッシュ表。区点のハッシュ値から線形探索で、スロット番号を引く。Bは2のべき乗
+  1バイト文字用スロット群、2バイト文字用スロット群。各スロットは以下の通り
     (1byte) Ku
     (1byte) Ten
+    (1byte) フラグ（使用中、参照済み）
     (nbyte) Glyph data
-    (nbyte) padding 1バイト文字の場合、2バイト文字と同じバイト数になるまでパディングする
 
-リングバッファとし、もっとも追加されたものを追い出す。
+追い出しはスロット群ごとにCLOCK方式で行う。
 */
 
 
+byte* FontManager::get_cache_slot(uint8_t slot) {
+    if (slot < this->cache_singlebyte_slots) {
+        return this->cache_singlebyte_pool + (uint16_t)(CACHE_SLOT_HEADER_LENGTH + this->GLYPH_LENGTH_SINGLEBYTE) * slot;
+    } else {
+        slot -= this->cache_singlebyte_slots;
+        return this->cache_doublebyte_pool + (uint16_t)(CACHE_SLOT_HEADER_LENGTH + this->GLYPH_LENGTH_DOUBLEBYTE) * slot;
+    }
+}
+
+
+uint8_t FontManager::get_cache_hash(uint8_t ku, uint8_t ten) {
+    return (uint8_t)(ku * 37 + ten) & this->cache_hashtable_mask;
+}
+
+
+void FontManager::remove_from_cache_hashtable(uint8_t slot) {
+    uint8_t pos = this->get_cache_hash(this->get_cache_slot(slot)[0], this->get_cache_slot(slot)[1]);
+    while (this->cache_hashtable[pos] != slot) {
+        if (this->cache_hashtable[pos] == INVALID_UINT8) {
+            return;
+        }
+        pos = (pos + 1) & this->cache_hashtable_mask;
+    }
+    this->cache_hashtable[pos] = INVALID_UINT8;
+
+    // 後続の項目を詰めて、探索が途切れないようにする
+    uint8_t next = pos;
+    while (true) {
+        next = (next + 1) & this->cache_hashtable_mask;
+        uint8_t nextslot = this->cache_hashtable[next];
+        if (nextslot == INVALID_UINT8) {
+            break;
+        }
+        byte* p = this->get_cache_slot(nextslot);
+        uint8_t home = this->get_cache_hash(p[0], p[1]);
+        // home から next までの間に空きの pos が含まれるなら、pos へ移せる
+        bool movable;
+        if (pos <= next) {
+            movable = (home <= pos) || (home > next);
+        } else {
+            movable = (home <= pos) && (home > next);
+        }
+        if (movable) {
+            this->cache_hashtable[pos] = nextslot;
+            this->cache_hashtable[next] = INVALID_UINT8;
+            pos = next;
+        }
+    }
+}
+
+
 void FontManager::add_to_cache(uint8_t ku, uint8_t ten, byte* data, uint16_t data_length) {
     if (!this->cache_buffer || this->cache_length < 1) {
         return;
     }
-    
-    uint16_t glyphobjectbytes_in_cache = 1 + 1 + this->GLYPH_LENGTH_DOUBLEBYTE;
-    byte* dstptr = this->cache_tail;
 
-    *dstptr++ = ku;
-    *dstptr++ = ten;
-    memcpy(dstptr, data, data_length);
-    dstptr += data_length;
-    // 2バイト文字に満たない文をパディングする
-    for (int i = data_length; i < this->GLYPH_LENGTH_DOUBLEBYTE; i++) {
-        *dstptr++ = 0xFF;
+    uint8_t poolhead;
+    uint8_t poolslots;
+    uint8_t* hand;
+    if (ku == 0) {
+        poolhead = 0;
+        poolslots = this->cache_singlebyte_slots;
+        hand = &this->cache_singlebyte_hand;
+    } else {
+        poolhead = this->cache_singlebyte_slots;
+        poolslots = this->cache_doublebyte_slots;
+        hand = &this->cache_doublebyte_hand;
+    }
+    if (poolslots == 0) {
+        return;
     }
 
-
-    if (dstptr + glyphobjectbytes_in_cache > this->cache_buffer + this->cache_length) {
-        // 次を書き込む余裕はないので、先頭へ戻す
-        this->cache_tail = this->cache_buffer;
-    } else {
-        this->cache_tail = dstptr;
+    // 参照済みのものは一度だけ見逃し、参照されていないものを追い出す
+    uint8_t slot;
+    byte* p;
+    while (true) {
+        slot = poolhead + *hand;
+        p = this->get_cache_slot(slot);
+        *hand = (*hand + 1 < poolslots) ? *hand + 1 : 0;
+        if (!(p[2] & CACHE_SLOT_FLAG_USED)) {
+            break;
+        }
+        if (p[2] & CACHE_SLOT_FLAG_REFERENCED) {
+            p[2] &= ~CACHE_SLOT_FLAG_REFERENCED;
+            continue;
+        }
+        this->remove_from_cache_hashtable(slot);
+        this->cache_eviction_count += 1;
+        break;
     }
 
-    // D("buf=%p, buflen=%d, tail=%p\n", this->cache_buffer, this->cache_length, this->cache_tail);
+    p[0] = ku;
+    p[1] = ten;
+    p[2] = CACHE_SLOT_FLAG_USED;
+    memcpy(p + CACHE_SLOT_HEADER_LENGTH, data, data_length);
+
+    uint8_t pos = this->get_cache_hash(ku, ten);
+    while (this->cache_hashtable[pos] != INVALID_UINT8) {
+        pos = (pos + 1) & this->cache_hashtable_mask;
+    }
+    this->cache_hashtable[pos] = slot;
 }
 
 
@@ -219,18 +410,17 @@ byte* FontManager::lookup_cache(uint8_t ku, uint8_t ten) {
     if (!this->cache_buffer || (this->cache_length < 1)) {
         return nullptr;
     }
-    byte* ptr = this->cache_buffer;
-    byte* cache_end = this->cache_buffer + this->cache_length;
-    while (ptr < cache_end) {
-        uint8_t cur_ku = *ptr++;
-        uint8_t cur_ten = *ptr++;
-        if (cur_ku == ku && cur_ten == ten) {
-            return ptr;
-        } else {
-            ptr += this->GLYPH_LENGTH_DOUBLEBYTE;
-            continue;
+    uint8_t pos = this->get_cache_hash(ku, ten);
+    while (this->cache_hashtable[pos] != INVALID_UINT8) {
+        byte* p = this->get_cache_slot(this->cache_hashtable[pos]);
+        if (p[0] == ku && p[1] == ten) {
+            p[2] |= CACHE_SLOT_FLAG_REFERENCED;
+            this->cache_hit_count += 1;
+            return p + CACHE_SLOT_HEADER_LENGTH;
         }
+        pos = (pos + 1) & this->cache_hashtable_mask;
     }
+    this->cache_miss_count += 1;
     return nullptr;
 }
 
@@ -239,14 +429,53 @@ void FontManager::enable_cache(byte* buffer, uint16_t cachesize) {
     assert(buffer);
     assert(cachesize > 0);
 
+    uint16_t singleslotlen = CACHE_SLOT_HEADER_LENGTH + this->GLYPH_LENGTH_SINGLEBYTE;
+    uint16_t doubleslotlen = CACHE_SLOT_HEADER_LENGTH + this->GLYPH_LENGTH_DOUBLEBYTE;
+
+    // 1バイト文字用におよそ1/4を割り当て、残りからハッシュ表と2バイト文字用を取る
+    uint16_t singleslots = (cachesize / 4) / singleslotlen;
+    uint16_t rest = cachesize - singleslots * singleslotlen;
+    // ハッシュ表は、スロット総数の1.5倍以上になる2のべき乗の大きさとする
+    uint16_t buckets = 2;
+    while (true) {
+        uint16_t doubleslots = (rest > buckets) ? (rest - buckets) / doubleslotlen : 0;
+        uint16_t totalslots = singleslots + doubleslots;
+        if (buckets >= totalslots + totalslots / 2 || buckets >= 256) {
+            if (totalslots > buckets - 1) {
+                doubleslots = buckets - 1 - singleslots;
+            }
+            this->cache_doublebyte_slots = (uint8_t)doubleslots;
+            break;
+        }
+        buckets *= 2;
+    }
+
     this->cache_buffer = buffer;
     this->cache_length = cachesize;
-    this->cache_tail = buffer;
+    this->cache_hashtable = buffer;
+    this->cache_hashtable_mask = (uint8_t)(buckets - 1);
+    this->cache_singlebyte_pool = buffer + buckets;
+    this->cache_singlebyte_slots = (uint8_t)singleslots;
+    this->cache_singlebyte_hand = 0;
+    this->cache_doublebyte_pool = this->cache_singlebyte_pool + singleslots * singleslotlen;
+    this->cache_doublebyte_hand = 0;
+
+    memset(this->cache_hashtable, INVALID_UINT8, buckets);
+    for (uint8_t slot = 0; slot < this->cache_singlebyte_slots + this->cache_doublebyte_slots; slot++) {
+        this->get_cache_slot(slot)[2] = 0;
+    }
+    this->cache_hit_count = 0;
+    this->cache_miss_count = 0;
+    this->cache_eviction_count = 0;
 }
 
 
 void FontManager::disable_cache(void) {
     this->cache_buffer = nullptr;
     this->cache_length = 0;
-    this->cache_tail = nullptr;
+    this->cache_hashtable = nullptr;
+    this->cache_singlebyte_pool = nullptr;
+    this->cache_singlebyte_slots = 0;
+    this->cache_doublebyte_pool = nullptr;
+    this->cache_doublebyte_slots = 0;
 }
@@ -24,14 +24,50 @@ public:
     uint8_t GLYPH_LENGTH_DOUBLEBYTE = 0;
     uint8_t GLYPH_LENGTH_SINGLEBYTE = 0;
 
+    // 区ごとのオフセット表の項目数。0区から94区と、豆腐（0xFF区）
+    static constexpr uint8_t KU_OFFSET_TABLE_LENGTH = 95 + 1;
+    static constexpr uint8_t KU_OFFSET_TABLE_INDEX_TOFU = 95;
+
 // private:
 public:
+    /* 区ごとのグリフの先頭オフセット。uint24のリトルエンディアンで詰めて並べる。
+       フォントに存在しない区は 0xFFFFFF */
+    uint8_t ku_offset_table[KU_OFFSET_TABLE_LENGTH * 3];
+
+    /** フォントファイルのインデックスを読み、区ごとのオフセット表を作る
+     * @return 成功すればtrue
+     */
+    bool load_ku_offset_table(void);
+
     uint32_t get_ku_offset(uint8_t ku);
     uint32_t get_glyph_offset(uint8_t ku, uint8_t ten);
 
+    // キャッシュの各スロットの先頭に置く情報のバイト数（区、点、フラグ）
+    static constexpr uint8_t CACHE_SLOT_HEADER_LENGTH = 3;
+    static constexpr uint8_t CACHE_SLOT_FLAG_USED = 0x01;
+    static constexpr uint8_t CACHE_SLOT_FLAG_REFERENCED = 0x02;
+
     byte* cache_buffer = nullptr;
     uint16_t cache_length = 0;
-    byte* cache_tail = nullptr;
+    // 区点からスロット番号を引くハッシュ表（オープンアドレス法、空きはINVALID_UINT8）
+    uint8_t* cache_hashtable = nullptr;
+    uint8_t cache_hashtable_mask = 0;
+    // 1バイト文字用のスロット群。スロット番号は 0 から cache_singlebyte_slots - 1
+    byte* cache_singlebyte_pool = nullptr;
+    uint8_t cache_singlebyte_slots = 0;
+    uint8_t cache_singlebyte_hand = 0;
+    // 2バイト文字用のスロット群。スロット番号は cache_singlebyte_slots から続く
+    byte* cache_doublebyte_pool = nullptr;
+    uint8_t cache_doublebyte_slots = 0;
+    uint8_t cache_doublebyte_hand = 0;
+
+    /** スロット番号からスロットの先頭を得る */
+    byte* get_cache_slot(uint8_t slot);
+
+    uint8_t get_cache_hash(uint8_t ku, uint8_t ten);
+
+    /** ハッシュ表から指定スロットを取り除く */
+    void remove_from_cache_hashtable(uint8_t slot);
 
     /** 指定のグリフのキャッシュを探す
      * @param ku
@@ -42,6 +78,12 @@ public:
 
     void add_to_cache(uint8_t ku, uint8_t ten, byte* data, uint16_t data_length);
 
+public:
+    // キャッシュの統計
+    uint32_t cache_hit_count = 0;
+    uint32_t cache_miss_count = 0;
+    uint32_t cache_eviction_count = 0;
+
 public:
 
     bool font_loaded = false;
@@ -59,7 +101,17 @@ public:
       */
     bool get_glyph_from_kuten(uint8_t ku, uint8_t ten, byte* dst, uint8_t* width, uint8_t* height);
 
+    /** 複数のグリフをまとめて取得する。
+      キャッシュにないグリフは、フォントファイル上の位置の順に並べ替えてから読み込む（同じグリフは1度だけ読む）。
+      @param kuten [IN] 区と点を交互に並べた配列（ count * 2 バイト）
+      @param count [IN] グリフの数
+      @param dst [OUT] グリフの出力先。与えた順に、各グリフのバイト数（ GLYPH_LENGTH_SINGLEBYTE か GLYPH_LENGTH_DOUBLEBYTE ）ずつ詰めて並べる
+      @return すべてのグリフの取得に成功したらtrue
+      */
+    bool get_glyphs_from_kuten(const uint8_t* kuten, uint8_t count, byte* dst);
+
     /** 指定サイズのキャッシュを有効にする
+     * バッファはハッシュ表と、1バイト文字用・2バイト文字用のスロット群に分けて使う。
      * @param buffer
      * @param cachesize キャッシュで利用するメモリのバイト数
      */
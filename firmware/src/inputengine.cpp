@@ -6,28 +6,27 @@
 #include <candidatereader.h>
 
 #include <debug.h>
+#include <profile.h>
 #include <commondef.h>
 #include "cstrlib.h"
 #include "sjis.h"
-#include "romajidef.h"
+#include "romaji.h"
 
 
 /** テキストを描画する
   @param line [IN] テキストを表示するテキスト行 (0 or 1)
   @param col [IN] 表示を開始する列番号 (0-121)
-  @param sjis [IN] 表示するテキスト (NUL終端)
+  @param sjis [IN] 表示するテキスト
+  @param sjislen [IN] テキストのバイト数
   @return 描画した列数
   */
-uint8_t print_text(InputEngine* input, uint8_t line, uint8_t col, const char* sjis) {
+uint8_t print_text(InputEngine* input, uint8_t line, uint8_t col, const char* sjis, size_t sjislen) {
 // #if true
 #if false
     uint8_t printed_cols = col;
     const char* end = sjis + strlen(sjis);
 
     // Clear lines
-
-    STOPWATCH_BLOCK_START(inputengine_print_text_currentimpl);
-
     {
         uint8_t x1 = col;
         uint8_t y1 = line * 2 * 8;
@@ -79,20 +78,15 @@ uint8_t print_text(InputEngine* input, uint8_t line, uint8_t col, const char* sj
             continue;
         }
     }
-    STOPWATCH_BLOCK_END(inputengine_print_text_currentimpl);
 
     return printed_cols - col;
 #else
-
-    size_t sjislen = strlen(sjis);
-    const char* end = sjis + sjislen;
+    PROFILE_SCOPE(PrintText);
 
     if (sjislen < 1) {
         return 0;
     }
 
-    // STOPWATCH_BLOCK_START(inputengine_print_text_newimpl);
-
     // Clear rect
     uint8_t x1 = col,
             y1 = line * 2 * 8,
@@ -102,8 +96,6 @@ uint8_t print_text(InputEngine* input, uint8_t line, uint8_t col, const char* sj
 
     input->screen->print_at(x1, y1, sjis, sjislen);
 
-    // STOPWATCH_BLOCK_END(inputengine_print_text_newimpl);
-
     return sjislen * input->font->FONT_WIDTH_SINGLEBYTE;
 #endif
 }
@@ -126,8 +118,8 @@ void draw_texts(InputEngine* input, bool update_romajibuffer, bool update_henkan
     input->screen->clear_rect_pagealined(x1, y1, x2, y2);
 
     uint8_t printed_col = 0;
-    printed_col = print_text(input, 1, 0, input->henkanbuffer);
-    print_text(input, 1, printed_col, input->romajibuffer);
+    printed_col = print_text(input, 1, 0, input->henkanbuffer.c_str(), input->henkanbuffer.length());
+    print_text(input, 1, printed_col, input->romajibuffer.c_str(), input->romajibuffer.length());
 }
 
 
@@ -139,226 +131,312 @@ void draw_texts(InputEngine* input, bool update_romajibuffer, bool update_henkan
   @param dst_len [IN]
   @param consumed_bytes [OUT]
   @param written_bytes [OUT]
+  @param is_pending [OUT] 変換できなかったときに、入力を続ければ変換できうるならtrue。falseならこのローマ字はどの項目にもつながらない
   @return 成功すれば変換後のひらがなの文字数（>0）、もしくは0（ひらがなに変換できず）
   */
-uint8_t try_convert_romaji_to_hiragana(const char* romaji, uint16_t romaji_len, char* dst, uint16_t dst_len, uint16_t* consumed_bytes, uint16_t* written_bytes) {
+uint8_t try_convert_romaji_to_hiragana(const char* romaji, uint16_t romaji_len, char* dst, uint16_t dst_len, uint16_t* consumed_bytes, uint16_t* written_bytes, bool* is_pending) {
     assert(romaji);
     assert(dst);
     assert(dst_len > 0);
+    assert(is_pending);
 
     // Serial.println();
     // Serial.print("try_convert_romaji_to_hiragana(): Called with \"");
     // Serial.print(romaji);
     // Serial.println("\"");
 
-    for (size_t i = 0; i < ROMAJITABLE_ENTRIES; ++i) {
-        uint16_t entry_romaji_len = strlen(romajitable[i].romaji);
-        if (entry_romaji_len != romaji_len) {
-            continue;
-        } else {
-            if (memcmp(romaji, romajitable[i].romaji, romaji_len) == 0) {
-                // 一致
-                if (romaji_len > dst_len) {
-                    // 書き出し先バッファの長さが足りない
-                    return 0;
-                }
-                uint16_t totalhiraganabytelen = strlen(romajitable[i].hiragana);
-                uint16_t hiraganabytelen = romajitable[i].hiraganabytelength;
-                memcpy(dst, romajitable[i].hiragana, hiraganabytelen);
-                if (totalhiraganabytelen == hiraganabytelen) {
-                    // 余りのアルファベットがない場合
-                    *consumed_bytes = romaji_len;
-                    *written_bytes = hiraganabytelen;
-                    // ShiftJIS決め打ちなので、ひらがなは2バイト1文字と推定して良い
-                    return hiraganabytelen / 2;
-                } else {
-                    // 余りのアルファベットがある場合。末尾のアルファベットを書き戻す（消費しない）
-                    *consumed_bytes = romaji_len - 1;
-                    *written_bytes = hiraganabytelen;
-                    return hiraganabytelen / 2;
-                }
+    *is_pending = false;
+    if (romaji_len > ROMAJI_MAX_LENGTH) {
+        return 0;
+    }
+    const romajientry_t* entry = romaji_lookup(romaji, romaji_len, is_pending);
+    if (!entry) {
+        return 0;
+    }
+    // 一致
+    *is_pending = false;
+    uint16_t hiraganabytelen = entry->hiraganabytelength;
+    if (hiraganabytelen > dst_len) {
+        // 書き出し先バッファの長さが足りない
+        return 0;
+    }
+    memcpy(dst, entry->hiragana, hiraganabytelen);
+    if (entry->totalbytelength == hiraganabytelen) {
+        // 余りのアルファベットがない場合
+        *consumed_bytes = romaji_len;
+    } else {
+        // 余りのアルファベットがある場合。末尾のアルファベットを書き戻す（消費しない）
+        *consumed_bytes = romaji_len - 1;
+    }
+    *written_bytes = hiraganabytelen;
+    // ShiftJIS決め打ちなので、ひらがなは2バイト1文字と推定して良い
+    return hiraganabytelen / 2;
+}
+
+
+
+// 変換候補の選択キー。画面の2バイト文字1つぶんごとに、左から順に割り当てる
+static constexpr char CANDIDATE_SELECTORS[] = {'q','w','e','r','t','y','u','i','o','p'};
+static constexpr uint8_t CANDIDATE_SELECTORS_COUNT = sizeof(CANDIDATE_SELECTORS) / sizeof(CANDIDATE_SELECTORS[0]);
+// 変換候補の選択画面で、一度に割り付けるページ数。ページの区切りはスタックに置くので、候補の個数ぶんは取らない
+// これを超える候補は、カーソルがその範囲へ移ったときに続きから割り付けなおす
+static constexpr uint8_t MAX_CANDIDATE_PAGES = 32;
+
+/** 変換候補をページへ割り付け、各ページの先頭の候補とその位置を求める
+ * 候補の長さだけを見るので、CandidateReaderが候補の区間を先読みしていればファイルを読まない。
+ * 画面をはみ出す長い候補は、それだけで1ページにする。ページ数が上限に達したら、残りの候補は割り付けない。
+ * @param candidates [IN]
+ * @param max_display_bytes [IN] 1ページに表示できるバイト数
+ * @param first [IN] 割り付けを始める候補の番号（0始まり）。ページの先頭の候補であること
+ * @param first_offset [IN] その候補で CandidateReader::get_current_offset() が返した値。わからなければ INVALID_UINT16
+ * @param page_heads [OUT] 各ページの先頭の候補の番号（0始まり）。 max_pages + 1 の領域が必要で、最終ページの次には割り付けた範囲の次の候補の番号を置く
+ * @param page_offsets [OUT] page_heads の各候補の CandidateReader::get_current_offset() 。 max_pages + 1 の領域が必要
+ * @param max_pages [IN]
+ * @return ページ数
+ */
+static
+uint8_t layout_candidate_pages(SKK::CandidateReader* candidates, uint8_t max_display_bytes, uint8_t first, uint16_t first_offset, uint8_t* page_heads, uint16_t* page_offsets, uint8_t max_pages) {
+    uint8_t candidatecount = candidates->get_candidates_count();
+    uint8_t pagecount = 0;
+    uint16_t page_bytes = 0;
+    uint8_t page_candidates = 0;
+
+    candidates->move_to_offset(first + 1, first_offset);
+    uint8_t i;
+    for (i = first; i < candidatecount; ++i) {
+        uint16_t len = candidates->get_current_candidate_length();
+        if (page_candidates == 0 || page_candidates >= CANDIDATE_SELECTORS_COUNT || page_bytes + len > max_display_bytes) {
+            if (pagecount >= max_pages) {
+                break;
             }
+            // 新しいページを始める
+            page_heads[pagecount] = i;
+            page_offsets[pagecount] = candidates->get_current_offset();
+            pagecount += 1;
+            page_bytes = 0;
+            page_candidates = 0;
         }
+        page_bytes += len;
+        page_candidates += 1;
+        candidates->move_next();
     }
-
-    return 0;
+    page_heads[pagecount] = i;
+    page_offsets[pagecount] = candidates->get_current_offset();
+    return pagecount;
 }
 
-
+/** 指定の候補を含むページを求める。割り付けた範囲の外なら、その候補を含む範囲を割り付けなおす
+ * 前の範囲へ戻るときは、ページの区切りを先頭の候補から求めなおす。
+ * @param candidates [IN]
+ * @param max_display_bytes [IN] 1ページに表示できるバイト数
+ * @param candidx [IN] 候補の番号（0始まり）
+ * @param page_heads [IN/OUT] layout_candidate_pages() と同じ
+ * @param page_offsets [IN/OUT] layout_candidate_pages() と同じ
+ * @param pagecount [IN/OUT] 割り付けたページ数
+ * @return page_heads の中での、候補を含むページの番号（0始まり）
+ */
+static
+uint8_t locate_candidate_page(SKK::CandidateReader* candidates, uint8_t max_display_bytes, uint8_t candidx, uint8_t* page_heads, uint16_t* page_offsets, uint8_t* pagecount) {
+    if (candidx < page_heads[0]) {
+        *pagecount = layout_candidate_pages(candidates, max_display_bytes, 0, INVALID_UINT16, page_heads, page_offsets, MAX_CANDIDATE_PAGES);
+    }
+    while (candidx >= page_heads[*pagecount] && page_heads[*pagecount] < candidates->get_candidates_count()) {
+        // 割り付けた範囲の続きから、次の範囲を割り付ける
+        DEBUG("Laying out pages from candidate %d.", page_heads[*pagecount] + 1);
+        *pagecount = layout_candidate_pages(candidates, max_display_bytes, page_heads[*pagecount], page_offsets[*pagecount], page_heads, page_offsets, MAX_CANDIDATE_PAGES);
+    }
+    uint8_t page = 0;
+    while (page + 1 < *pagecount && page_heads[page + 1] <= candidx) {
+        page += 1;
+    }
+    return page;
+}
 
 /** 変換候補を一つ選んで確定する
- * @param candidates [IN]
+ * 候補はページに分けて表示する。ページの区切りとその位置は最初に一度だけ求めるので、
+ * ページの行き来で候補の長さを読みなおさず、ページの先頭へは直接シークする。
+ *   - q〜p : 押したキーの位置に表示されている候補を選んで確定する
+ *   - Space, → : 次の候補へカーソルを進める（ページをまたぎ、末尾からは先頭へ戻る）
+ *   - ← : 前の候補へカーソルを戻す
+ *   - n, PageDown, ↓ : 次のページへ（最終ページからは先頭へ戻る）
+ *   - x, PageUp, ↑ : 前のページへ（先頭ページからは最終ページへ）
+ *   - Enter : カーソルの候補を確定する
+ *   - ESC, Backspace : 変換を中断する
+ * @param candidates [IN] 確定したら、選択された変換候補の先頭を読み取る状態で戻る
  * @param dst [OUT] 選択された変換候補を書き出すバッファ。常にNUL終端された状態で戻る
  * @param dstlen [IN]
+ * @param more_requested [OUT] nullptrでなければ、候補を移動するキーで「ほかの候補」を求めたときにtrueにしてfalseで戻る
+ *                             （覚えている候補だけを出しているとき）
  * @return 正常に書き込めたらtrue、バッファ長が不足していたらfalse
  */
 static
-bool choose_one_candidates(InputEngine* input, SKK::CandidateReader* candidates, char* dst, size_t dstlen) {
+bool choose_one_candidates(InputEngine* input, SKK::CandidateReader* candidates, char* dst, size_t dstlen, bool* more_requested) {
 
     DEBUG("called.");
 
+    // 画面上に表示できる最大バイト数（この範囲内で、かつ変換候補が分断されない範囲で詰め込む）
+    constexpr uint8_t max_display_bytes = 8 * 2;
+
+    uint8_t page_heads[MAX_CANDIDATE_PAGES + 1];
+    uint16_t page_offsets[MAX_CANDIDATE_PAGES + 1];
+    uint8_t pagecount = layout_candidate_pages(candidates, max_display_bytes, 0, INVALID_UINT16, page_heads, page_offsets, MAX_CANDIDATE_PAGES);
     uint8_t candidatecount = candidates->get_candidates_count();
-    uint8_t next_start_index = 0;
+    DEBUG("%d of %d candidates in %d pages.", page_heads[pagecount], candidatecount, pagecount);
 
-    // 画面上に表示できる最大バイト数（この範囲内で、かつ変換候補が分断されない範囲で詰め込む）
-    uint8_t max_display_bytes = 8 * 2;
+    // 変換候補選択用の表示バッファ（ShiftJIS）
+    char displaytextbuffer[max_display_bytes];
+    uint8_t cur_display_bytes = 0;
+    // 表示中のページの各候補の、表示バッファ上の開始位置。末尾の候補の次には表示したバイト数を置く
+    uint8_t candidate_display_heads[CANDIDATE_SELECTORS_COUNT + 1];
+    // どの選択キーがどの変換候補（0始まり）に結びついているかを保持する
+    uint8_t associated_candidate_index[CANDIDATE_SELECTORS_COUNT];
 
-    while (true) {
-        // 変換候補選択用の表示バッファ（ShiftJIS）
-        constexpr size_t DISPLAYTEXTBUFFERLEN = 16;
-        uint8_t displaytextbuffer[DISPLAYTEXTBUFFERLEN + 1];
-        memset(displaytextbuffer, '!', DISPLAYTEXTBUFFERLEN);
-        displaytextbuffer[DISPLAYTEXTBUFFERLEN] = '\0';
-
-        // どの選択キーがどの変換候補に結びついているかを保持する
-        uint8_t associated_candidate_index[10];
-        memset(associated_candidate_index, INVALID_UINT8, 10);
-        // DEBUG("associated_candidate_index initialized.");
-        // dump_bytes_hex(associated_candidate_index, 10);
-        // DPUT("\n");
-        
-        // 変換候補を画面に詰め込む
-        uint8_t cur_display_bytes = 0;
-        uint8_t candidx = 0;
-        // NOTE: 選択キーの都合で、一度に10個が上限（この上限に到達することはまずないけど）
-        // for (candidx = 0; candidx < 10 && !candidates->is_reached_end(); ++candidx) {
-        while (true) {
-            // DEBUG("next_start_index=%d, candidx=%d", next_start_index, candidx);
-
-            if (candidx >= 10) {
-                DEBUG("Reached to limit.");
-                break;
-            }
-            if (candidates->is_reached_end()) {
-                DEBUG("Reached to end.");
-                break;
-            }
+    // 表示中のページ（ page_heads の中での番号）とその先頭の候補、カーソルのある候補（0始まり）
+    uint8_t page = INVALID_UINT8;
+    uint8_t page_head = INVALID_UINT8;
+    uint8_t cursor = 0;
 
-            uint8_t cur_len = candidates->get_current_candidate_length();
-            DEBUG("cur_len=%d", cur_len);
+    // 候補を選ぶキーを押す前のキー入力（変換を始めたSpaceなど）は捨てる
+    input->keyboard->flush();
 
-            if (candidx == 0 && cur_len > max_display_bytes) {
-                // 最初の変換候補が画面をはみ出す場合は、その一つだけを出す
-                // next_start_index += 1;
-                next_start_index += 1;
-                // DEBUG("Too long candidate at first. next_start_index=%d", next_start_index);
-                break;
-            }
-            if (cur_display_bytes + cur_len > max_display_bytes) {
-                // 画面からはみ出すので抜ける
-                // next_start_index += candidx;
-                DEBUG("Break due to display overflow. next_start_index=%d, cur_display_bytes=%d, cur_len=%d,", next_start_index, (uint8_t)cur_display_bytes, (uint8_t)cur_len);
-                break;
-            }
-            // バッファへ納める
-            // for (uint8_t j = 0; j < cur_len; ++j) {
-            while (true) {
-                int ch = candidates->read();
-                if (ch < 0) {
-                    // DEBUG("CandidateReader.read() returned %d. next_start_index=%d", ch, next_start_index);
-                    break;
+    while (true) {
+        // カーソルのある候補を含むページを求める
+        page = locate_candidate_page(candidates, max_display_bytes, cursor, page_heads, page_offsets, &pagecount);
+
+        if (page_heads[page] != page_head) {
+            // ページの候補を表示バッファへ詰め込む
+            page_head = page_heads[page];
+            cur_display_bytes = 0;
+            memset(associated_candidate_index, INVALID_UINT8, CANDIDATE_SELECTORS_COUNT);
+            candidates->move_to_offset(page_head + 1, page_offsets[page]);
+            for (uint8_t candidx = page_heads[page]; candidx < page_heads[page + 1]; ++candidx) {
+                uint8_t head = cur_display_bytes;
+                candidate_display_heads[candidx - page_heads[page]] = head;
+                uint16_t cur_len = candidates->get_current_candidate_length();
+                int ch;
+                while (cur_display_bytes < max_display_bytes && (ch = candidates->read()) >= 0) {
+                    if (cur_display_bytes % 2 == 0) {
+                        // 選択キー用のインデックス値を追加する
+                        associated_candidate_index[cur_display_bytes / 2] = candidx;
+                    }
+                    displaytextbuffer[cur_display_bytes] = (char)ch;
+                    cur_display_bytes += 1;
                 }
-                // DEBUG("  ch=%d(0x%x)", (uint8_t)ch, (uint8_t)ch);
-                // バッファへ文字コードを追加する
-                // displaytextbuffer[cur_display_bytes+j] = (uint8_t)ch;
-                displaytextbuffer[cur_display_bytes] = (uint8_t)ch;
-                if (cur_display_bytes % 2 == 0) {
-                    // 選択キー用のインデックス値を追加する
-                    // DEBUG("Associated index: %d at %d", next_start_index + candidx, cur_display_bytes);
-                    associated_candidate_index[cur_display_bytes / 2] = next_start_index + candidx;
+                if (cur_len > cur_display_bytes - head) {
+                    // 画面をはみ出す候補は切り詰める。2バイト文字の途中で切れていれば、その1バイト目を捨てる
+                    uint8_t pos = head;
+                    while (pos < cur_display_bytes) {
+                        uint8_t charlen = count_bytes_of_a_char_sjis(&displaytextbuffer[pos]);
+                        if (pos + charlen > cur_display_bytes) {
+                            cur_display_bytes = pos;
+                            break;
+                        }
+                        pos += charlen;
+                    }
                 }
-                cur_display_bytes += 1;
+                candidates->move_next();
             }
-            candidates->move_next();
+            candidate_display_heads[page_heads[page + 1] - page_heads[page]] = cur_display_bytes;
+            DEBUG("Page of candidates %d-%d.", page_heads[page] + 1, page_heads[page + 1]);
+        }
 
-            candidx += 1;
+        // 候補を表示し、カーソルのある候補を反転する
+        print_text(input, 1, 0, displaytextbuffer, cur_display_bytes);
+        {
+            uint8_t x1 = candidate_display_heads[cursor - page_heads[page]] * input->font->FONT_WIDTH_SINGLEBYTE,
+                    y1 = input->top_on_screen,
+                    x2 = candidate_display_heads[cursor - page_heads[page] + 1] * input->font->FONT_WIDTH_SINGLEBYTE - 1,
+                    y2 = y1 + input->font->FONT_HEIGHT;
+            input->screen->invert_rect(x1, y1, x2, y2);
         }
-        next_start_index += candidx;
-        displaytextbuffer[cur_display_bytes] = '\0';
-        // DEBUG("Dump displaytextbuffer:");
-        // dump_bytes_hex(displaytextbuffer, DISPLAYTEXTBUFFERLEN);
-        // DPUT("\n");
-        DEBUG("Displayed candidates (next index=%ud).", next_start_index);
-        print_text(input, 1, 0, (const char*)displaytextbuffer);
+        input->screen->flush();
         // ここまでで、画面に変換候補が表示できた
 
-
-        while (true) {
-            constexpr char selectors[] = {'q','w','e','r','t','y','u','i','o','p'};
-            constexpr uint8_t selectors_count = sizeof(selectors) / sizeof(selectors[0]);
-
-            input->keyboard->flush();
+        // キー入力を待つ
+        Keyboard::keycode_t key = Keyboard::KEYCODE_NONE;
+        while (key == Keyboard::KEYCODE_NONE) {
+            delay(3);
             input->keyboard->update();
-            Keyboard::keycode_t key = input->keyboard->get_key();
-
-            if (key == Keyboard::KEYCODE_ESC || key == Keyboard::KEYCODE_BACKSPACE) {
-                // 変換を中断して戻る
-                DEBUG("Canceled by ESC key");
-                return false;
-            }
+            key = input->keyboard->get_key();
+        }
+        // 矢印キーのリピートは、追いつかなかったぶんがまとめて届く
+        uint8_t keycount = input->keyboard->get_key_count();
+
+        if (more_requested
+                && (key == ' ' || key == 'n' || key == 'x'
+                    || key == Keyboard::KEYCODE_ARROWLEFT || key == Keyboard::KEYCODE_ARROWRIGHT
+                    || key == Keyboard::KEYCODE_ARROWUP || key == Keyboard::KEYCODE_ARROWDOWN
+                    || key == Keyboard::KEYCODE_PAGEUP || key == Keyboard::KEYCODE_PAGEDOWN)) {
+            // 辞書の候補を引いてから選びなおす
+            DEBUG("More candidates requested.");
+            *more_requested = true;
+            return false;
+        }
 
-            if (key == 'n') {
-                input->keyboard->wait_allkey_released();
+        if (key == Keyboard::KEYCODE_ESC || key == Keyboard::KEYCODE_BACKSPACE) {
+            // 変換を中断して戻る
+            DEBUG("Canceled by ESC key");
+            return false;
+        }
 
-                if (next_start_index >= candidatecount) {
-                    // 先頭へ戻る
-                    candidates->move_head();
-                    next_start_index = 0;
-                    DEBUG("Move back to head.");
-                    break;
-                } else {
-                    // 次のページへ
-                    DEBUG("Go next page.");
-                    break;
-                }
+        if (key == ' ' || key == Keyboard::KEYCODE_ARROWRIGHT) {
+            // 次の候補へ。末尾からは先頭へ戻る
+            cursor = (uint8_t)(((uint16_t)cursor + keycount) % candidatecount);
+            continue;
+        }
+        if (key == Keyboard::KEYCODE_ARROWLEFT) {
+            // 前の候補へ。先頭からは末尾へ
+            cursor = (uint8_t)(((uint16_t)cursor + candidatecount - keycount % candidatecount) % candidatecount);
+            continue;
+        }
+        if (key == 'n' || key == Keyboard::KEYCODE_PAGEDOWN || key == Keyboard::KEYCODE_ARROWDOWN) {
+            // 次のページへ。最終ページからは先頭へ戻る
+            for (uint8_t i = 0; i < keycount; ++i) {
+                uint8_t p = locate_candidate_page(candidates, max_display_bytes, cursor, page_heads, page_offsets, &pagecount);
+                cursor = page_heads[p + 1] < candidatecount ? page_heads[p + 1] : 0;
             }
-
-            int8_t selectionbykey = -1;
-            for (int i = 0; i < selectors_count; ++i) {
-                if (key == selectors[i]) {
-                    selectionbykey = i;
-                    break;
-                }
+            continue;
+        }
+        if (key == 'x' || key == Keyboard::KEYCODE_PAGEUP || key == Keyboard::KEYCODE_ARROWUP) {
+            // 前のページへ。先頭ページからは最終ページへ
+            for (uint8_t i = 0; i < keycount; ++i) {
+                uint8_t p = locate_candidate_page(candidates, max_display_bytes, cursor, page_heads, page_offsets, &pagecount);
+                uint8_t prev = page_heads[p] > 0 ? page_heads[p] - 1 : candidatecount - 1;
+                p = locate_candidate_page(candidates, max_display_bytes, prev, page_heads, page_offsets, &pagecount);
+                cursor = page_heads[p];
             }
+            continue;
+        }
 
-            if (selectionbykey >= 0) {
-                // 候補選択と思われるキー入力があった
-
-                uint8_t selected_candidate_index = associated_candidate_index[selectionbykey];
-
-                // if (0 <= selectionbykey && selectionbykey < candidatecount) {
-                if (selected_candidate_index != INVALID_UINT8) {
-                    // 有効な選択キーが押下された
-                    DEBUG("selected_candidate_index=%d(0x%x)", selected_candidate_index, selected_candidate_index);
-                    // DEBUG("associated_candidate_index = ");
-                    // dump_bytes_hex(associated_candidate_index, 10);
-                    // DPUT("\n");
-
-                    candidates->move_head();
-                    for (uint8_t i = 0; i < selected_candidate_index; ++i) {
-                        DEBUG("Move next (current candidate len=%d)", candidates->get_current_candidate_length());
-                        candidates->move_next();
+        uint8_t selected_candidate_index = INVALID_UINT8;
+        if (key == Keyboard::KEYCODE_ENTER) {
+            selected_candidate_index = cursor;
+        } else {
+            for (uint8_t i = 0; i < CANDIDATE_SELECTORS_COUNT; ++i) {
+                if (key == CANDIDATE_SELECTORS[i]) {
+                    // 候補選択と思われるキー入力があった
+                    selected_candidate_index = associated_candidate_index[i];
+                    if (selected_candidate_index == INVALID_UINT8) {
+                        // 範囲外のキーが指定された
+                        DEBUG("No candidate at selector '%c'.", key);
                     }
-                    // ここで、candidateは選択された変換候補の先頭を読み取る準備ができている
-                    DEBUG("OK. key=%c, selected index=%d, candidate length=%d", key, selected_candidate_index, candidates->get_current_candidate_length());
-                    return true;
-                } else {
-                    // 範囲外のキーが指定された
-                    DEBUG_HEADER();
-                    DEBUG_PRINTF("selected_candidate_index=%d(0x%x)\n", selected_candidate_index, selected_candidate_index);
-                    DEBUG_PRINTF("  associated_candidate_inde = ");
-                    dump_bytes_hex(associated_candidate_index, 10);
-                    DEBUG_PRINTF("\n");
+                    break;
                 }
             }
+        }
 
-            // if (key == ' ') {
-                // TODO: スペースキー押下による、選択候補の順次選択を実装したい
-            // }
-
-            // 有効なキー入力ではなかったので無視
-            delay(1);
+        if (selected_candidate_index != INVALID_UINT8) {
+            // 表示中のページの先頭へシークしてから、選択された候補へ進む
+            candidates->move_to_offset(page_head + 1, page_offsets[page]);
+            while (candidates->get_current_index() < selected_candidate_index + 1) {
+                candidates->move_next();
+            }
+            // ここで、candidateは選択された変換候補の先頭を読み取る準備ができている
+            DEBUG("OK. key=%c, selected index=%d, candidate length=%d", key, selected_candidate_index, candidates->get_current_candidate_length());
+            return true;
         }
+
+        // 有効なキー入力ではなかったので無視
     }
 
     DEBUG("Should not be reached.");
@@ -376,8 +454,28 @@ bool henkan(InputEngine* input) {
     // DPUT("\n");
     // unsigned long henkan_timer = millis();
     SKK::CandidateReader reader;
-
-    bool henkan_found = input->skk->henkan(input->henkanbuffer, &reader);
+    reader.set_prefetch_buffer(input->candidatebuffer, input->candidatebuffer_length);
+
+    // 送り仮名があれば、語幹に送り仮名の子音を付けた読み仮名（"かk"）で送りありの項目を引く
+    const char* yomigana = input->henkanbuffer.c_str();
+    size_t yomiganalen = input->henkanbuffer.length();
+    const char* okurigana = nullptr;
+    size_t okuriganalen = 0;
+    bool henkan_found;
+    if (input->okuri_head != INVALID_UINT8 && input->okuri_head < yomiganalen) {
+        okuriganalen = yomiganalen - input->okuri_head;
+        yomiganalen = input->okuri_head + 1;
+        char* okurikey = (char*)alloca(yomiganalen);
+        memcpy(okurikey, yomigana, input->okuri_head);
+        okurikey[input->okuri_head] = input->okuri_consonant;
+        okurigana = &input->henkanbuffer.c_str()[input->okuri_head];
+        henkan_found = input->skk->henkan_okuriari(okurikey, yomiganalen, okurigana, okuriganalen, &reader);
+        yomigana = okurikey;
+    } else {
+        henkan_found = input->skk->henkan(yomigana, yomiganalen, &reader);
+    }
+    // 変換できなかった場合は、送り仮名も読み仮名の一部として扱いなおす
+    input->okuri_head = INVALID_UINT8;
     // unsigned long elapsed_time_henkan = millis() - henkan_timer;
     // DEBUG("%lu[msec] elapsed in henkan() executing.", elapsed_time_henkan);
 
@@ -391,14 +489,28 @@ bool henkan(InputEngine* input) {
     if (henkan_found) {
         uint8_t found_candidates = reader.get_candidates_count();
         multiple_candidate_found = found_candidates > 1;
-        if (found_candidates == 1 || input->enabled_autodecide) {
+        // 覚えている候補だけが返ったなら、辞書はまだ引いていない
+        bool learned_only = reader.is_pinned_only();
+        if ((found_candidates == 1 && !learned_only) || input->enabled_autodecide) {
             // 候補は1つだけなので、もしくは変換自動確定モードなので、先頭候補をそのまま使う
             // DEBUG("Only one candidate found. Use it.");
             // Fallthrough
 
         } else {
-            // 複数の候補があるので、ユーザーに選択させる
-            if (!choose_one_candidates(input, &reader, buf, 64 * 2)) {
+            // 複数の候補があるので、もしくはほかの候補を求められうるので、ユーザーに選択させる
+            bool more_requested = false;
+            bool chosen = choose_one_candidates(input, &reader, buf, 64 * 2, learned_only ? &more_requested : nullptr);
+            if (!chosen && more_requested) {
+                // ほかの候補を求められたので、ここで初めて辞書を引く
+                if (okurigana) {
+                    input->skk->henkan_okuriari(yomigana, yomiganalen, okurigana, okuriganalen, &reader, true);
+                } else {
+                    input->skk->henkan(yomigana, yomiganalen, &reader, true);
+                }
+                multiple_candidate_found = reader.get_candidates_count() > 1;
+                chosen = choose_one_candidates(input, &reader, buf, 64 * 2, nullptr);
+            }
+            if (!chosen) {
                 // 候補が選択されなかった
                 DEBUG("Henkan canceled by user.");
                 return false;
@@ -418,6 +530,7 @@ bool henkan(InputEngine* input) {
                     x2 = input->screen->SCREEN_WIDTH,
                     y2 = y1 + input->font->FONT_HEIGHT;
             input->screen->invert_rect(x1, y1, x2, y2);
+            input->screen->flush();
             delay(50);
         }
         return false;
@@ -436,6 +549,11 @@ bool henkan(InputEngine* input) {
         for (int i = 0; i < candlen; i++) {
             candbuf[i] = reader.read();
         }
+
+        if (reader.get_current_index() > 1) {
+            // 先頭以外の候補が選ばれたので、次からは先頭に出す。送り仮名は覚えない
+            input->skk->learn(yomigana, yomiganalen, &reader, candbuf, candlen - okuriganalen);
+        }
         // while (((ch = reader.read()) > 0) && !reader.is_reached_end()) {
             // cstr_append_byte(textbuffer, TEXTBUFFER_LENGTH, (uint8_t)ch);
         // }
@@ -505,7 +623,7 @@ bool henkan(InputEngine* input) {
 
         // DEBUG("Done");
     }    
-    input->henkanbuffer[0] = '\0';
+    input->henkanbuffer.clear();
 
     DEBUG("Henkan done.");
     return true;
@@ -523,10 +641,14 @@ bool InputEngine::init(ScreenEx& screen, uint8_t top, FontManager& font,
             char* henkanbuffer, size_t henkanbuffer_length,
             char* romajibuffer, size_t romajibuffer_length) {
 
-    assert(henkanbuffer_length > 16);
-    assert(romajibuffer_length > 4);
     assert(henkanbuffer);
     assert(romajibuffer);
+    if (!this->henkanbuffer.init(henkanbuffer, henkanbuffer_length)
+            || !this->romajibuffer.init(romajibuffer, romajibuffer_length)) {
+        return false;
+    }
+    assert(this->henkanbuffer.capacity() > 16);
+    assert(this->romajibuffer.capacity() > 4);
 
     this->screen = &screen;
     this->top_on_screen = top;
@@ -534,12 +656,6 @@ bool InputEngine::init(ScreenEx& screen, uint8_t top, FontManager& font,
     this->skk = &skk;
     this->keyboard = &keyboard;
     this->currentInputMode = defaultInputMode;
-    this->henkanbuffer_length = henkanbuffer_length;
-    this->henkanbuffer = henkanbuffer;
-    memset(this->henkanbuffer, '\0', this->henkanbuffer_length);
-    this->romajibuffer_length = romajibuffer_length;
-    this->romajibuffer = romajibuffer;
-    memset(this->romajibuffer, '\0', this->romajibuffer_length);
     // this->henkanbuffer = (char*)calloc(1, this->HENKANBUFFER_LENGTH);
     // assert(this->henkanbuffer);
     // this->romajibuffer = (char*)calloc(1, this->ROMAJIBUFFER_LENGTH);
@@ -587,13 +703,16 @@ void InputEngine::run(void) {
 
     while (this->running) {
 
+        // 前回のループまでに描画された内容を画面へ転送する
+        this->screen->flush();
+
         if (millis() - blink_timer_millis > blink_interval_ms) {
             constexpr int CURSOR_FULLWIDTH = 14;
             constexpr int CURSOR_HALFWIDTH = 7;
             constexpr int CURSOR_SLIM = 3;
             constexpr int CURSOR_LINE = 1;
             constexpr int CURSOR_YOFFSET_ON_KATAKANA = 8;
-            uint8_t bytelength = strlen(henkanbuffer) + strlen(romajibuffer);
+            uint8_t bytelength = this->henkanbuffer.length() + this->romajibuffer.length();
             uint8_t startcol = bytelength * 7;
             uint8_t x1, y1, x2, y2, blinkwidth;
 
@@ -629,7 +748,7 @@ void InputEngine::run(void) {
         }
 
         
-        if (strlen(romajibuffer) == 0 && strlen(henkanbuffer) == 0) {
+        if (this->romajibuffer.is_empty() && this->henkanbuffer.is_empty()) {
             // 入力待ちバッファが空なら、変換モードを抜ける
             this->is_henkan_waiting = false;
         }
@@ -740,13 +859,23 @@ void InputEngine::run(void) {
 
             // Backspace
             if (ch == Keyboard::KEYCODE_BACKSPACE) {
-                if (strlen(romajibuffer) > 0) {
-                    sjis_remove_tail_char(this->romajibuffer);
-                    draw_texts(this, true, true);
-                    continue;
-
-                } else if (strlen(henkanbuffer) > 0) {
-                    sjis_remove_tail_char(this->henkanbuffer);
+                // リピートでまとめられたぶんを削除してから、1回だけ描画する
+                uint8_t count = this->keyboard->get_key_count();
+                uint8_t removed = 0;
+                while (removed < count) {
+                    if (this->romajibuffer.pop_last_char() > 0 || this->henkanbuffer.pop_last_char() > 0) {
+                        removed += 1;
+                    } else {
+                        break;
+                    }
+                }
+                if (this->okuri_head != INVALID_UINT8 && this->romajibuffer.is_empty()
+                        && this->henkanbuffer.length() <= this->okuri_head) {
+                    // 送り仮名をすべて消した
+                    this->okuri_head = INVALID_UINT8;
+                }
+                if (removed > 0) {
+                    // 確定済みの文字までは続けて消さない
                     draw_texts(this, true, true);
                     continue;
 
@@ -797,8 +926,6 @@ void InputEngine::run(void) {
                 this->flush(true);
                 draw_texts(this, true, true);
 
-                this->keyboard->wait_allkey_released();
-
                 continue;
             }
 
@@ -806,7 +933,7 @@ void InputEngine::run(void) {
                 if (is_henkan_waiting) {
                     // 変換待機中に「変換」キーが押されたら、カタカナにして確定する。
                     // ひらがな・カタカナのモード切替は行わない。
-                    convert_hiragana_to_katakana_sjis(henkanbuffer, henkanbuffer);
+                    convert_hiragana_to_katakana_sjis(this->henkanbuffer.c_str(), this->henkanbuffer.data());
                     this->flush(true);
                     draw_texts(this, true, true);
                     continue;
@@ -825,7 +952,6 @@ void InputEngine::run(void) {
                         DEBUG("Change mode to Henkan Hiragana input");
                         currentInputMode = InputMode::Henkan_Hiragana;
                     }
-                    this->keyboard->wait_allkey_released();
 
                     continue;
                 }
@@ -857,30 +983,56 @@ void InputEngine::run(void) {
                 }
 
                 // ローマ字バッファに押し込む
-                cstr_append_char(romajibuffer, this->romajibuffer_length, ch);
-                uint16_t romajibuffer_strlen = strlen(romajibuffer);
+                this->romajibuffer.append_char(ch);
+                uint16_t romajibuffer_strlen = this->romajibuffer.length();
                 
                 if (is_henkan_waiting && is_upper_char_input) {
-                    // 変換待ちで大文字入力なら、ひらがなへの変換をせずに漢字変換を実行する。
-                    Serial.println("Henkan tirggered with Shift key.");
-                    // 送り仮名（と思われる）ローマ字を変換バッファへ追加する
-                    cstr_append(henkanbuffer, this->henkanbuffer_length, romajibuffer, strlen(romajibuffer));
-                    henkan(this);
-                    DEBUG("Henkan waiting chars gone.");
-                    is_henkan_waiting = false;
+                    // 変換待ちで大文字入力なら、そこから送り仮名が始まる。
+                    // 送り仮名がひらがなになるまで、漢字変換は待つ
+                    if (this->okuri_head == INVALID_UINT8 && !this->henkanbuffer.is_empty()) {
+                        DEBUG("Okurigana started with Shift key.");
+                        this->okuri_head = (uint8_t)this->henkanbuffer.length();
+                        this->okuri_consonant = (char)ch;
+                    }
 
                     is_upper_char_input = false;
                 }
 
                 // ひらがなへの変換を試みる
-                uint16_t henkanbuffer_strlen = strlen(henkanbuffer);
+                // 変換結果はいったん手元に書き出し、まとめて変換バッファへ追加する
+                char converted[ROMAJI_HIRAGANA_MAX_LENGTH + ROMAJI_MAX_LENGTH];
+                uint16_t converted_len = sizeof(converted);
+                if (converted_len > this->henkanbuffer.remaining()) {
+                    converted_len = this->henkanbuffer.remaining();
+                }
                 uint16_t consumed_bytes = 0;
                 uint16_t written_len = 0;
-                char* dst_ptr = &henkanbuffer[henkanbuffer_strlen];
-                uint16_t hiragana_chlen = try_convert_romaji_to_hiragana(romajibuffer, strlen(romajibuffer),
-                        dst_ptr, this->henkanbuffer_length, //HENKANBUFFER_LENGTH,
-                        &consumed_bytes, &written_len);
-                henkanbuffer[henkanbuffer_strlen+written_len] = '\0';
+                bool romaji_pending = false;
+                uint16_t hiragana_chlen = 0;
+                if (converted_len > 0) {
+                    hiragana_chlen = try_convert_romaji_to_hiragana(this->romajibuffer.c_str(), romajibuffer_strlen,
+                            converted, converted_len,
+                            &consumed_bytes, &written_len, &romaji_pending);
+                }
+                // 変換できなかったのが、一致した項目のひらがなが変換バッファに収まらないためなら、
+                // ローマ字はそのまま残す（ "ja" を "jあ" にしない）
+                if (hiragana_chlen == 0 && !romaji_pending && romajibuffer_strlen > 1
+                        && romajibuffer_strlen < converted_len
+                        && romaji_lookup(this->romajibuffer.c_str(), romajibuffer_strlen, &romaji_pending) == nullptr) {
+                    // どの項目にもつながらないローマ字は、最後の1文字を残してそのまま書き出し、
+                    // 最後の1文字から変換をやり直す（"qa" → "qあ"）
+                    uint16_t deadlen = romajibuffer_strlen - 1;
+                    memcpy(converted, this->romajibuffer.c_str(), deadlen);
+                    uint16_t tail_consumed = 0;
+                    uint16_t tail_written = 0;
+                    try_convert_romaji_to_hiragana(&this->romajibuffer.c_str()[deadlen], 1,
+                            &converted[deadlen], converted_len - deadlen,
+                            &tail_consumed, &tail_written, &romaji_pending);
+                    consumed_bytes = deadlen + tail_consumed;
+                    written_len = deadlen + tail_written;
+                    hiragana_chlen = written_len;
+                }
+                this->henkanbuffer.append(converted, written_len);
 
                 // Serial.print(("try_convert_romaji_to_hiragana() returned "));
                 // Serial.print(hiragana_chlen);
@@ -894,14 +1046,10 @@ void InputEngine::run(void) {
 
                 if (hiragana_chlen > 0) {
                     if (romajibuffer_strlen == consumed_bytes) {
-                        romajibuffer[0] = '\0';
+                        this->romajibuffer.clear();
                     } else {
                         // アルファベットを末尾に残す場合、ひらがなにできた分だけ前へ移動する
-                        uint8_t unconsumed_bytes = romajibuffer_strlen - consumed_bytes;
-                        for (int i = 0; i < unconsumed_bytes; ++i) {
-                            romajibuffer[i] = romajibuffer[consumed_bytes + i];
-                        }
-                        romajibuffer[unconsumed_bytes] = '\0';
+                        this->romajibuffer.remove_head(consumed_bytes);
                         // romajibufferに残した分は確定させない
                         flush_include_romajibuffer_flush = false;
                     }
@@ -927,7 +1075,7 @@ void InputEngine::run(void) {
                     // ひらがなをそのまま確定させる
                     // Serial.println("Push hiragana to textbuffer.");
                     if (currentInputMode == InputMode::Henkan_Katakana) {
-                        convert_hiragana_to_katakana_sjis(henkanbuffer, henkanbuffer);
+                        convert_hiragana_to_katakana_sjis(this->henkanbuffer.c_str(), this->henkanbuffer.data());
                     }
                     this->flush(flush_include_romajibuffer_flush);
 
@@ -937,6 +1085,14 @@ void InputEngine::run(void) {
                     is_henkan_waiting = true;
                 }
 
+                if (is_henkan_waiting && this->okuri_head != INVALID_UINT8
+                        && this->romajibuffer.is_empty() && this->henkanbuffer.length() > this->okuri_head) {
+                    // 送り仮名がひらがなになったので、漢字変換を実行する（"KaKu" → 「書く」）
+                    if (henkan(this)) {
+                        is_henkan_waiting = false;
+                    }
+                }
+
                 draw_texts(this, true, true);
 
             } else if ((' ' <= ch && ch <= '~') ||    // ASCIIの記号（アルファベットは上でとらえているので、ここではざっくりと）
@@ -949,11 +1105,7 @@ void InputEngine::run(void) {
                 is_henkan_waiting = false;
                 // カタカナ処理
                 if (currentInputMode == InputMode::Henkan_Katakana) {
-                    char* ptr = henkanbuffer;
-                    do {
-                        convert_hiragana_to_katakana_sjis(ptr, ptr);
-                        ptr = get_next_char_ptr_sjis(ptr);
-                    } while (ptr);
+                    convert_hiragana_to_katakana_sjis(this->henkanbuffer.c_str(), this->henkanbuffer.data());
                 }
 
                 // バッファを確定させる
@@ -1034,22 +1186,24 @@ void InputEngine::stop(void) {
 
 void InputEngine::clear(void) {
     // DEBUG("Called.");
-    this->henkanbuffer[0] = '\0';
-    this->romajibuffer[0] = '\0';
+    this->henkanbuffer.clear();
+    this->romajibuffer.clear();
+    this->okuri_head = INVALID_UINT8;
 }
 
 
 void InputEngine::flush(bool include_alphabet) {
     // DEBUG("strlen(henkan)=%d, strlen(romaji)=%d", strlen(this->henkanbuffer), strlen(this->romajibuffer));
-    this->call_input_callback(this->henkanbuffer, strlen(this->henkanbuffer));
+    this->call_input_callback(this->henkanbuffer.c_str(), this->henkanbuffer.length());
     if (include_alphabet) {
-        this->call_input_callback(this->romajibuffer, strlen(this->romajibuffer));
+        this->call_input_callback(this->romajibuffer.c_str(), this->romajibuffer.length());
     }
 
-    this->henkanbuffer[0] = '\0';
+    this->henkanbuffer.clear();
     if (include_alphabet) {
-        this->romajibuffer[0] = '\0';
+        this->romajibuffer.clear();
     }
+    this->okuri_head = INVALID_UINT8;
 }
 
 void InputEngine::set_sands(bool enabled) {
@@ -1059,3 +1213,8 @@ void InputEngine::set_sands(bool enabled) {
 bool InputEngine::get_sands(void) {
     return this->enabled_sands;
 }
+
+void InputEngine::set_candidate_buffer(uint8_t* buffer, uint16_t buffer_length) {
+    this->candidatebuffer = buffer;
+    this->candidatebuffer_length = buffer_length;
+}
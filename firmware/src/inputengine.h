@@ -12,6 +12,7 @@
 #include "screen.h"
 #include "font.h"
 #include <skkengine.h>
+#include <sjisbuffer.h>
 #include "keyboard.h"
 #include "screenex.h"
 
@@ -64,13 +65,22 @@ public:
 
     InputMode currentInputMode;
 
-    size_t henkanbuffer_length;
-    char* henkanbuffer = nullptr;
-    size_t romajibuffer_length;
-    char* romajibuffer = nullptr;
+    // ひらがなから漢字への変換を待つ文字
+    SjisBuffer henkanbuffer;
+    // ひらがなへの変換を待つアルファベット
+    SjisBuffer romajibuffer;
 
     bool is_henkan_waiting = false;
 
+    // 送り仮名が始まる henkanbuffer 上の位置。送り仮名を入力していなければ INVALID_UINT8
+    uint8_t okuri_head = INVALID_UINT8;
+    // 送り仮名の子音（「書く」なら 'k'）。SKK辞書の送りありの読み仮名の末尾に付く
+    char okuri_consonant = '\0';
+
+    // 変換候補の区間をまとめて読み込む領域。なければnullptr（辞書から少しずつ読む）
+    uint8_t* candidatebuffer = nullptr;
+    uint16_t candidatebuffer_length = 0;
+
     bool call_keydown_prehook_callback(uint8_t ch);
     void call_keydown_uncaught_callback(uint8_t ch);
     void call_input_callback(const char* s, size_t len);
@@ -78,6 +88,9 @@ public:
 
 public:
 
+    /** 初期化する
+     * henkanbuffer, romajibufferの領域は SjisBuffer::required_buffer_length() で大きさを求めて用意する
+     */
     bool init(ScreenEx& screen, uint8_t top, FontManager& font,
               Keyboard& keyboard, SKK::SkkEngine& skk, InputMode defaultInputMode,
               char* henkanbuffer, size_t henkanbuffer_length,
@@ -96,6 +109,13 @@ public:
     void set_sands(bool enabled);
     bool get_sands(void);
 
+    /** 変換候補の区間をまとめて読み込む領域を設定する
+     * 候補の選択中の移動がRAM上で済むようになる。収まらない項目は辞書から少しずつ読む。
+     * @param buffer [IN] nullptrなら使わない
+     * @param buffer_length [IN]
+     */
+    void set_candidate_buffer(uint8_t* buffer, uint16_t buffer_length);
+
     // InputEngineの処理に制御を移す
     void run(void);
 
@@ -4,6 +4,8 @@
 #include <Wire.h>
 
 #include <debug.h>
+#include <profile.h>
+#include <commondef.h>
 
 
 /** ユーザーのキー入力を待機する場合のdelay()の共通実装 */
@@ -44,86 +46,137 @@ bool get_diff(byte* a, byte* b, byte* dst, uint8_t len) {
 }
 
 
-/** バイト列に新しい要素があるかをチェックする
- * @param prev [IN] 
- * @param newer [IN] 
- * @param dst [OUT]
- * @param len [IN]
- * @return 新しい要素が登場していたらtrue
- */
-static
-bool get_new_appear(byte* prev, byte* newer, byte* dst, uint8_t len) {
-    byte* ptr = dst;
-    for (int i = 0; i < len; ++i) {
-        byte item_from_newer = newer[i];
-        bool found_in_prev = false;
-        for (int j = 0; j < len; ++j) {
-            byte item_from_prev = prev[j];
-            if (item_from_prev == item_from_newer) {
-                // 過去の配列にも存在する要素
-                found_in_prev = true;
-            }
-        }
-        if (!found_in_prev) {
-            // 新しい要素が見つかった
-            *dst++ = item_from_newer;
+bool Keyboard::request_from_keyboardcontroller(uint8_t command, byte* dst, uint8_t len) {
+    memset(dst, 0x00, len);
+
+    if (command != I2C_COMMAND_REPORT) {
+        Wire.beginTransmission(this->target_i2c_addr);
+        Wire.write(command);
+        if (Wire.endTransmission() != 0) {
+            DEBUG("request_from_keyboardcontroller() : I2C write failed.");
+            return false;
         }
     }
-    return ptr != dst;
-#if false
-prev [ 0, 1, 2, 3 ]
-newer[ 0, 1, 2, 4 ]  ->> [ 4 ]
-
-prev [0, 1, 2, 3 ]
-nerwer[0, 1, 2, 2]  ->> [ ]
-
-#endif
-
-    // byte* ptr = dst;
-    // for (int acnt = 0; acnt < len; ++acnt) {
-    //     byte aval = a[acnt];
-    //     bool found = false;
-    //     for (int bcnt = 0; bcnt < len; ++bcnt) {
-    //         if (aval == b[bcnt]) {
-    //             // 見つかった。差分ではない
-    //             found = true;
-    //             break;
-    //         }
-    //     }
-    //     if (!found) {
-    //         // 見つからなかった。差分
-    //         *ptr++ = aval;
-    //     }
-    // }
-    // return ptr != dst;
-}
 
-bool Keyboard::read_report_from_keyboardcontroller(rawkeycode_t *dst) {
-    // memcpy(this->prev_report, this->latest_report, Keyboard::READDATACOUNT);
-    memset(dst, 0x00, Keyboard::READDATACOUNT);
-
-    Wire.requestFrom(this->target_i2c_addr, READDATACOUNT);
+    Wire.requestFrom(this->target_i2c_addr, len);
     unsigned int err = 150 / 7 * 5;
-    for (int readcnt = 0; readcnt < READDATACOUNT && err != 0; ++readcnt) {
-        while (Wire.available() < 1) {
+    for (int readcnt = 0; readcnt < len && err != 0; ++readcnt) {
+        while (Wire.available() < 1 && err != 0) {
             delayMicroseconds(5);
             --err;
         }
         dst[readcnt] = Wire.read();
     }
-    bool succeeded = err > 0;
+    this->last_read_millis = millis();
+    return err > 0;
+}
+
+
+bool Keyboard::read_report_from_keyboardcontroller(rawkeycode_t *dst) {
+    bool succeeded = this->request_from_keyboardcontroller(I2C_COMMAND_REPORT, dst, Keyboard::READDATACOUNT);
     if (!succeeded) {
         DEBUG("read_report_from_keyboardcontroller() : I2C read failed.");
     }
     return succeeded;
 }
 
-bool Keyboard::read_report(void) {
 
-    return this->read_report_from_keyboardcontroller(this->latest_report);
+bool Keyboard::read_events_from_keyboardcontroller(void) {
+    byte buf[KEYEVENT_BURST_HEADER_LENGTH + KEYEVENT_LENGTH * KEYEVENT_BURST_MAX];
+    bool overflowed = false;
+
+    // 1回の読み込みは KEYEVENT_BURST_MAX 個まで。溜まっていれば続けて読む
+    while (EVENTQUEUE_LENGTH - this->event_queue_count >= KEYEVENT_BURST_MAX) {
+        if (!this->request_from_keyboardcontroller(I2C_COMMAND_EVENTS, buf, sizeof(buf))) {
+            DEBUG("read_events_from_keyboardcontroller() : I2C read failed.");
+            return false;
+        }
+        unsigned long now = millis();
+        uint8_t count = buf[0] & ~KEYEVENT_OVERFLOWED;
+        if (buf[0] & KEYEVENT_OVERFLOWED) {
+            overflowed = true;
+        }
+        if (count > KEYEVENT_BURST_MAX) {
+            count = KEYEVENT_BURST_MAX;
+        }
+        uint16_t controller_now = (uint16_t)buf[1] | ((uint16_t)buf[2] << 8);
+
+        for (uint8_t i = 0; i < count; i++) {
+            byte* src = &buf[KEYEVENT_BURST_HEADER_LENGTH + i * KEYEVENT_LENGTH];
+            uint16_t timestamp = (uint16_t)src[1] | ((uint16_t)src[2] << 8);
+            keyevent_t ev;
+            ev.rawkeycode = src[0] & ~KEYEVENT_RELEASED;
+            ev.is_down = (src[0] & KEYEVENT_RELEASED) == 0;
+            // コントローラの時計とはずれているので、経過時間だけを使って換算する
+            ev.timestamp_millis = now - (uint16_t)(controller_now - timestamp);
+
+            uint8_t tail = (this->event_queue_head + this->event_queue_count) % EVENTQUEUE_LENGTH;
+            this->event_queue[tail] = ev;
+            this->event_queue_count += 1;
+        }
+
+        if (count < KEYEVENT_BURST_MAX) {
+            break;
+        }
+    }
+
+    if (overflowed) {
+        // 捨てられたイベントがある。押下状況だけはレポートから取り戻す
+        DEBUG("read_events_from_keyboardcontroller() : Event queue overflowed on the controller.");
+        this->read_report();
+    }
+    return true;
+}
+
+
+bool Keyboard::discard_events_on_keyboardcontroller(void) {
+    byte buf[KEYEVENT_BURST_HEADER_LENGTH + KEYEVENT_LENGTH * KEYEVENT_BURST_MAX];
+
+    // 読み出している間に押されたキーで溜まり続けても抜けられるよう、回数を区切る
+    for (uint8_t i = 0; i < DISCARD_BURST_LIMIT; i++) {
+        if (!this->request_from_keyboardcontroller(I2C_COMMAND_EVENTS, buf, sizeof(buf))) {
+            DEBUG("discard_events_on_keyboardcontroller() : I2C read failed.");
+            return false;
+        }
+        uint8_t count = buf[0] & ~KEYEVENT_OVERFLOWED;
+        if (count < KEYEVENT_BURST_MAX) {
+            return true;
+        }
+    }
+    return true;
+}
+
+
+bool Keyboard::is_report_pending(void) {
+    if (digitalRead(PIN_CHANGE_NOTIFY) == LOW) {
+        return true;
+    }
+    return millis() - this->last_read_millis >= FALLBACK_READ_INTERVAL_MS;
+}
+
+bool Keyboard::read_report(void) {
+    rawkeycode_t report[READDATACOUNT];
+    if (!this->read_report_from_keyboardcontroller(report)) {
+        return false;
+    }
+    unsigned long now = millis();
+    unsigned long pressing_millis[MAXKEYS];
+    for (uint8_t i = 0; i < MAXKEYS; ++i) {
+        pressing_millis[i] = (report[i] == 0x00) ? 0 : now;
+        for (uint8_t j = 0; j < MAXKEYS; ++j) {
+            if (report[i] != 0x00 && this->latest_report[j] == report[i] && this->key_pressing_millis[j] != 0) {
+                pressing_millis[i] = this->key_pressing_millis[j];
+                break;
+            }
+        }
+    }
+    memcpy(this->latest_report, report, sizeof(this->latest_report));
+    memcpy(this->key_pressing_millis, pressing_millis, sizeof(this->key_pressing_millis));
+    return true;
 }
 
 void Keyboard::init(void) {
+    pinMode(PIN_CHANGE_NOTIFY, INPUT_PULLUP);
     this->flush();
 }
 
@@ -306,38 +359,135 @@ Keyboard::keycode_t convert_from_rawkeycode_to_keycode(Keyboard::rawkeycode_t ra
 }
 
 
-void Keyboard::update(void) {
-    
+bool Keyboard::pop_event(keyevent_t* ev) {
+    if (this->event_queue_count == 0) {
+        return false;
+    }
+    *ev = this->event_queue[this->event_queue_head];
+    this->event_queue_head = (this->event_queue_head + 1) % EVENTQUEUE_LENGTH;
+    this->event_queue_count -= 1;
+    return true;
+}
 
-    // （もう古い）最新レポートをコピーする
-    memcpy(this->prev_report, this->latest_report, Keyboard::READDATACOUNT);
 
-    // キーの押下状況を取得して、最新レポートとしてキャッシュする
-    if (!this->read_report()) {
-        return;
+void Keyboard::apply_event(const keyevent_t& ev) {
+    if (ev.is_down) {
+        uint8_t empty = INVALID_UINT8;
+        for (uint8_t i = 0; i < Keyboard::MAXKEYS; ++i) {
+            if (this->latest_report[i] == ev.rawkeycode) {
+                // 同期しなおした押下状況にすでに含まれている
+                this->key_pressing_millis[i] = ev.timestamp_millis;
+                return;
+            }
+            if (this->latest_report[i] == 0x00 && empty == INVALID_UINT8) {
+                empty = i;
+            }
+        }
+        if (empty != INVALID_UINT8) {
+            this->latest_report[empty] = ev.rawkeycode;
+            this->key_pressing_millis[empty] = ev.timestamp_millis;
+        }
+    } else {
+        for (uint8_t i = 0; i < Keyboard::MAXKEYS; ++i) {
+            if (this->latest_report[i] == ev.rawkeycode) {
+                this->latest_report[i] = 0x00;
+                this->key_pressing_millis[i] = 0;
+            }
+        }
     }
+}
 
-    //DEBUG:
-    // {
-    //     DEBUG("Raw keycodes: ");
-    //     dump_bytes_dec(this->latest_report, 7);
-    //     Serial.println();
-    // }
 
-    // DEBUG:
-    {
-        if (memcmp(this->prev_report, this->latest_report, READDATACOUNT) == 0) {
-            // DEBUG("Not changed.");
-            memset(this->buffered_keydown, 0x00, MAXKEYS);
-            return;
+bool Keyboard::is_repeatable_keycode(keycode_t keycode) {
+    if (Keyboard::is_coalescable_keycode(keycode)) {
+        return true;
+    }
+    // スペースはSandSで、その他の制御キーはモード切替などで使うのでリピートしない
+    return '!' <= keycode && keycode <= '~';
+}
+
+
+bool Keyboard::is_coalescable_keycode(keycode_t keycode) {
+    return keycode == KEYCODE_BACKSPACE
+        || (KEYCODE_ARROWLEFT <= keycode && keycode <= KEYCODE_ARROWRIGHT);
+}
+
+
+void Keyboard::update_repeat(void) {
+    if (this->repeat_rawkeycode == 0x00 || this->repeat_delay_millis == 0) {
+        return;
+    }
+    uint8_t slot = INVALID_UINT8;
+    for (uint8_t i = 0; i < Keyboard::MAXKEYS; ++i) {
+        if (this->latest_report[i] == this->repeat_rawkeycode) {
+            slot = i;
+            break;
         }
     }
+    if (slot == INVALID_UINT8) {
+        // 解放イベントを取りこぼしても、押されていなければ止める
+        this->repeat_rawkeycode = 0x00;
+        return;
+    }
 
-    // DEBUG:
-    // {
-    //     rawkeycode_t *nowpressedkeys = (rawkeycode_t*)memchr(this->latest_report, 0x00, Keyboard::READDATACOUNT);
-    //     DEBUG("Keys in down: %d", nowpressedkeys - this->latest_report);
-    // }
+    // 押下からの経過時間で回数を決めるので、update() の呼び出し間隔が乱れても速さは変わらない
+    unsigned long held_millis = millis() - this->key_pressing_millis[slot];
+    if (held_millis < this->repeat_delay_millis) {
+        return;
+    }
+    uint32_t total = (held_millis - this->repeat_delay_millis) / this->repeat_interval_millis + 1;
+    if (total <= this->repeat_emitted_count) {
+        return;
+    }
+    uint32_t count = total - this->repeat_emitted_count;
+    this->repeat_emitted_count = total;
+    if (!Keyboard::is_coalescable_keycode(this->repeat_keycode)) {
+        // 文字は1回ずつ処理させる。遅れたぶんは捨てる
+        count = 1;
+    }
+    this->buffered_keydown[0] = this->repeat_keycode;
+    this->buffered_keydown_count = count > 0xFF ? 0xFF : (uint8_t)count;
+}
+
+
+void Keyboard::set_repeat(unsigned long delay_millis, unsigned long interval_millis) {
+    this->repeat_delay_millis = delay_millis;
+    this->repeat_interval_millis = interval_millis > 0 ? interval_millis : 1;
+    this->repeat_rawkeycode = 0x00;
+}
+
+
+void Keyboard::update(void) {
+    PROFILE_SCOPE(KeyboardUpdate);
+    memset(this->buffered_keydown, 0x00, MAXKEYS);
+    this->buffered_keydown_count = 0;
+
+    if (this->needs_resync) {
+        // flush() で捨てた押下状況を取り戻す。キーコードは生成しない
+        this->needs_resync = false;
+        this->read_report();
+    }
+
+    // 変化の通知がなければ、I2Cで読み込まずに済ませる
+    if (this->event_queue_count == 0 && this->is_report_pending()) {
+        this->read_events_from_keyboardcontroller();
+    }
+
+    // イベントはひとつずつ処理する。ポーリングの間に押して離されたキーも取りこぼさない
+    keyevent_t ev;
+    if (!this->pop_event(&ev)) {
+        this->update_repeat();
+        return;
+    }
+    this->apply_event(ev);
+    this->last_event_millis = ev.timestamp_millis;
+
+    if (!ev.is_down) {
+        if (ev.rawkeycode == this->repeat_rawkeycode) {
+            this->repeat_rawkeycode = 0x00;
+        }
+        return;
+    }
 
     // 修飾キーのチェック
     bool is_shift_pressed = false;
@@ -346,9 +496,7 @@ void Keyboard::update(void) {
     for (int i = 0; i < Keyboard::MAXKEYS; ++i) {
         rawkeycode_t cur = this->latest_report[i];
         if (cur == 25 || cur == 46) {
-            // DEBUG("Shift key pressed.");
             is_shift_pressed = true;
-            this->latest_report[i] = 0x00;
         }
         if (cur == 13 || cur == 45) {
             is_fn1_pressed = true;
@@ -358,74 +506,19 @@ void Keyboard::update(void) {
         }
     }
 
-    // rawkeycodeで前回との差分をとる
-    rawkeycode_t new_pressed_keys[Keyboard::MAXKEYS];
-    memset(new_pressed_keys, 0x00, Keyboard::MAXKEYS);
-    // get_diff(this->prev_report, this->latest_report, new_pressed_keys, Keyboard::MAXKEYS);
-    get_new_appear(this->prev_report, this->latest_report, new_pressed_keys, Keyboard::MAXKEYS);
-    // uint8_t new_pressed_keys_idx = 0;
-    // for (int i = 0; i < MAXKEYS; ++i) {
-    //     rawkeycode_t cur_key = this->latest_report[i];
-    //     if (cur_key == 0x00) {
-    //         continue;
-    //     }
-    //     bool is_new_key = true;
-    //     for (int j = 0; j < MAXKEYS; ++j) {
-    //         rawkeycode_t prev_key = this->prev_report[i];
-    //         if (prev_key == 0x00) {
-    //             continue;
-    //         }
-    //         if (cur_key == prev_key) {
-    //             is_new_key = false;
-    //             break;
-    //         }
-    //     }
-    //     if (is_new_key) {
-    //         // New key pressed down now
-    //         if (new_pressed_keys_idx < MAXKEYS) {
-    //             new_pressed_keys[new_pressed_keys_idx] = cur_key;
-    //         }
-    //         ++new_pressed_keys_idx;
-    //     }
-    // }
-
-    //DEBUG:
-    // {
-    //     DEBUG("Prev rawkeycodes: ");
-    //     dump_bytes_dec(this->prev_report, 7);
-    //     Serial.println();
-    //     DEBUG("Cur  rawkeycodes: ");
-    //     dump_bytes_dec(this->latest_report, 7);
-    //     Serial.println();
-    //     DEBUG("New  rawkeycodes: ");
-    //     dump_bytes_dec(new_pressed_keys, 7);
-    //     Serial.println();
-    // }
-
-    //DEBUG:
-    // {
-    //     rawkeycode_t *tail = (rawkeycode_t*)memchr(new_pressed_keys, 0x00, Keyboard::MAXKEYS);
-    //     uint8_t len = tail - new_pressed_keys;
-    //     DEBUG("New Pressed Keys : %d", len);
-    // }
-
-    // keycodeの配列を初期化する
-    // memset(this->keycodes_pressing, 0x00, Keyboard::MAXKEYS);
-    memset(this->buffered_keydown, 0x00, Keyboard::MAXKEYS);
-
-    // 新たに押下されたキーについてのみ、キーコードへ変換する
-    for (int i = 0; i < Keyboard::MAXKEYS; ++i) {
-        rawkeycode_t rawkeycode = new_pressed_keys[i];
-        keycode_t keycode = 0x00;
-        keycode = convert_from_rawkeycode_to_keycode(rawkeycode, is_shift_pressed, is_fn1_pressed, is_fn2_pressed);
-        if (keycode != 0x00) {
-            this->buffered_keydown[i] = keycode;
-        }
+    // 新たに押下されたキーについてのみ、キーコードへ変換する（修飾キー自身は0x00になる）
+    keycode_t keycode = convert_from_rawkeycode_to_keycode(ev.rawkeycode, is_shift_pressed, is_fn1_pressed, is_fn2_pressed);
+    this->buffered_keydown[0] = keycode;
+    this->buffered_keydown_count = 1;
+
+    // 最後に押されたキーをリピートの対象にする
+    if (Keyboard::is_repeatable_keycode(keycode)) {
+        this->repeat_rawkeycode = ev.rawkeycode;
+        this->repeat_keycode = keycode;
+        this->repeat_emitted_count = 0;
+    } else if (keycode != KEYCODE_NONE) {
+        this->repeat_rawkeycode = 0x00;
     }
-
-    // DEBUG("Dump this->buffered_keydown\n  ");
-    // dump_bytes_hex(this->buffered_keydown, MAXKEYS);
-    // Serial.println();
 }
 
 
@@ -436,19 +529,36 @@ uint8_t Keyboard::get_key(void) {
             continue;
         } else {
             this->buffered_keydown[i] = 0x00;
+            this->last_key_count = (i == 0 && this->buffered_keydown_count > 1) ? this->buffered_keydown_count : 1;
             return keycode;
         }
     }
+    this->last_key_count = 0;
     return 0x00;
 }
 
 
+uint8_t Keyboard::get_key_count(void) {
+    return this->last_key_count;
+}
+
+
 void Keyboard::flush(void) {
     memset(this->prev_report, 0x00, 7);
     memset(this->latest_report, 0x00, 7);
 
     // memset(this->keycodes_pressing, 0x00, 6);
     memset(this->buffered_keydown, 0x00, 6);
+
+    // 受け取り済みのイベントも、コントローラに溜まっているイベントも捨てる。押下中のキーは次の update() で読み直す
+    this->discard_events_on_keyboardcontroller();
+    this->event_queue_head = 0;
+    this->event_queue_count = 0;
+    this->needs_resync = true;
+
+    this->buffered_keydown_count = 0;
+    memset(this->key_pressing_millis, 0x00, sizeof(this->key_pressing_millis));
+    this->repeat_rawkeycode = 0x00;
 }
 
 
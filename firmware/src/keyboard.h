@@ -41,28 +41,131 @@ public:
     // キーボードコントローラから報告されるキーコード（物理レイアウトに近い番号）
     typedef uint8_t rawkeycode_t;
 
+    // キーボードコントローラが、キーの状態の変化を知らせる信号線（LOWで変化あり）
+    // コントローラはレポートが読み出されるまでLOWを保つ
+    static constexpr uint8_t PIN_CHANGE_NOTIFY = 24;
+
+    // 通知がなくても、この間隔でレポートを読み込む（通知線の取りこぼしや未接続への備え）
+    // コントローラ側でチャタリングを除去しているので、頻繁に読み直す必要はない
+    static constexpr unsigned long FALLBACK_READ_INTERVAL_MS = 1000;
+
+    // 最後にレポートを読み込んだ時刻
+    unsigned long last_read_millis = 0;
+
+    /* キーボードコントローラへのI2Cコマンド（ fimware-m328p と合わせる）
+       コマンドを1バイト書き込んでから読み出す。書き込まずに読み出すとレポートを返す。 */
+    static constexpr uint8_t I2C_COMMAND_REPORT = 0x00;
+    // キーイベントのまとめ読み
+    //   ヘッダ3バイト：イベントの個数（ビット7はあふれて捨てたイベントがあったことを示す）、コントローラの現在時刻[ms]の下位16ビット
+    //   イベント3バイトずつ：キー番号（ビット7が立っていれば離された）、発生時刻[ms]の下位16ビット
+    static constexpr uint8_t I2C_COMMAND_EVENTS = 0x01;
+    static constexpr uint8_t KEYEVENT_BURST_HEADER_LENGTH = 3;
+    static constexpr uint8_t KEYEVENT_LENGTH = 3;
+    static constexpr uint8_t KEYEVENT_BURST_MAX = 9;
+    static constexpr uint8_t KEYEVENT_RELEASED = 0x80;
+    static constexpr uint8_t KEYEVENT_OVERFLOWED = 0x80;
+    // flush() でコントローラのイベントを捨てるときに、まとめ読みを繰り返す上限
+    static constexpr uint8_t DISCARD_BURST_LIMIT = 8;
+
+    /** キーの押下・解放のイベント */
+    struct keyevent_t {
+        rawkeycode_t rawkeycode;
+        // 押下ならtrue、解放ならfalse
+        bool is_down;
+        // 発生時刻（このプロセッサの millis() に換算したもの）
+        unsigned long timestamp_millis;
+    };
+
+    // コントローラから受け取り、まだ処理していないイベント
+    static constexpr uint8_t EVENTQUEUE_LENGTH = 16;
+    keyevent_t event_queue[EVENTQUEUE_LENGTH];
+    uint8_t event_queue_head = 0;
+    uint8_t event_queue_count = 0;
+
+    // flush() したあと、押下中のキーをレポートから読み直すならtrue
+    bool needs_resync = false;
+
     byte prev_report[7];
     byte latest_report[7];
 
+    // 最後に処理したキーイベントの発生時刻
+    unsigned long last_event_millis = 0;
+
     // 記憶しておく最大キー数（この数のキーが同時に押下された場合までは正常に動作する）
     // TODO: これを超えた場合に、安全にエラーを吐くようにする
     static constexpr uint8_t MAXKEYS = 6;
 
     // keycode_t keycodes_pressing[6];
     keycode_t buffered_keydown[6];
+    // buffered_keydown[0] をまとめて何回ぶんとして扱うか（キーリピートをまとめたもの）
+    uint8_t buffered_keydown_count = 0;
+    // 直前に get_key() で返したキーの回数
+    uint8_t last_key_count = 0;
 
+    // latest_report の各キーが押下された時刻
     unsigned long key_pressing_millis[MAXKEYS] = { 0 };
 
+    // キーリピートの既定値
+    static constexpr unsigned long REPEAT_DELAY_MS_DEFAULT = 500;
+    static constexpr unsigned long REPEAT_INTERVAL_MS_DEFAULT = 40;
+    // 押下からリピートが始まるまでの時間。0ならリピートしない
+    unsigned long repeat_delay_millis = REPEAT_DELAY_MS_DEFAULT;
+    // リピートの間隔
+    unsigned long repeat_interval_millis = REPEAT_INTERVAL_MS_DEFAULT;
+    // リピート中のキー。なければ0x00
+    rawkeycode_t repeat_rawkeycode = 0x00;
+    keycode_t repeat_keycode = KEYCODE_NONE;
+    // これまでに送ったリピートの回数
+    uint32_t repeat_emitted_count = 0;
+
+    /** 押されたままのキーのリピートを処理する */
+    void update_repeat(void);
+
+    /** リピートするキーか（文字とBackspace、矢印キー） */
+    static bool is_repeatable_keycode(keycode_t keycode);
+
+    /** 溜まったリピートを1回にまとめて返してよいキーか（Backspaceと矢印キー） */
+    static bool is_coalescable_keycode(keycode_t keycode);
+
     /**
       @brief サブプロセッサからキーボードの入力状態を読み取り、指定のバッファへ格納する
       */
     bool read_report_from_keyboardcontroller(rawkeycode_t *dst);
 
+    /** サブプロセッサから指定のバイト数を読み込む
+     * @param command [IN] 先に書き込むコマンド。 I2C_COMMAND_REPORT なら書き込まない
+     */
+    bool request_from_keyboardcontroller(uint8_t command, byte* dst, uint8_t len);
+
+    /** サブプロセッサに溜まっているキーイベントを、イベントキューへ読み込む
+     * @return 読み込めたらtrue
+     */
+    bool read_events_from_keyboardcontroller(void);
+
+    /** サブプロセッサに溜まっているキーイベントを読み出して捨てる
+     * レポートの読み込みではコントローラのイベントキューは空にならないので、 flush() で使う
+     * @return 読み込めたらtrue
+     */
+    bool discard_events_on_keyboardcontroller(void);
+
+    /** イベントキューの先頭を取り出す
+     * @return 取り出せたらtrue
+     */
+    bool pop_event(keyevent_t* ev);
+
+    /** イベントを押下状況（ latest_report ）へ反映する */
+    void apply_event(const keyevent_t& ev);
+
     /**
       @brief サブプロセッサからキーボードの入力状態を読み取り、現在状態として更新する
+      押下中のままのキーは押下時刻を引き継ぎ、新たに現れたキーは読み込んだ時刻に押されたものとする
       */
     bool read_report(void);
 
+    /** レポートを読み込む必要があるか（変化の通知があるか、前回から時間が経っているか）
+      */
+    bool is_report_pending(void);
+
 public:
     /**
      @brief 使用前の初期化処理。
@@ -70,11 +173,12 @@ public:
     void init(void);
 
     /* ---- バッファ付き入力 ----
-       入力をバッファし、ひとつずつ処理する場合。長押し時のキーリピートも処理する（未実装）。
+       入力をバッファし、ひとつずつ処理する場合。長押し時のキーリピートも処理する。
        おもに文字入力を想定
      */
 
     /** キー状態を更新する
+     * キーイベントを1つ処理する。ポーリングの間に押して離されたキーも、順に1つずつ現れる
      */
     void update(void);
 
@@ -82,6 +186,18 @@ public:
       */
     uint8_t get_key(void);
 
+    /** 直前に get_key() で返したキーを何回ぶん処理すべきか
+     * Backspaceや矢印キーのリピートは、処理が追いつかない間のぶんをまとめて1回で返す。
+     * @return 1以上。キーがなければ0
+     */
+    uint8_t get_key_count(void);
+
+    /** キーリピートを設定する
+     * @param delay_millis [IN] 押下からリピートが始まるまでの時間[ms]。0ならリピートしない
+     * @param interval_millis [IN] リピートの間隔[ms]
+     */
+    void set_repeat(unsigned long delay_millis, unsigned long interval_millis);
+
     /** 未処理のキーを破棄する
       */
     void flush(void);
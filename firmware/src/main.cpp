@@ -7,16 +7,21 @@
 #include <Wire.h>
 
 #include <debug.h>
+#include <profile.h>
 #include <panic.h>
 #include "keyboard.h"
 #include "screen.h"
 #include "font.h"
 #include <candidatereader.h>
 #include <ArduinoSDFileAccessor.h>>
+#include <BufferedFileAccessor.h>
 #include <skkdict.h>
 #include <skkengine.h>
 
 #include <cstrlib.h>
+#include <sjisbuffer.h>
+#include <SjisGb18030Converter.h>
+#include <ByteRingBuffer.h>
 #include <sjis.h>
 
 #include "inputengine.h"
@@ -31,23 +36,60 @@ const char* FILEPATH_FONT8 = "FONT8JIS.FNT";
 const char* FILEPATH_FONT14 = "FNT14JIS.FNT";
 const char* FILEPATH_SYSDICT = "SYSDICT.SKD";
 const char* FILEPATH_USERDICT = "USERDICT.SKD";
+const char* FILEPATH_USERDICTLOG = "USERDICT.LOG";
+const char* FILEPATH_USERDICTWORK = "USERDICT.TMP";
+const char* FILEPATH_SYSDICTMRU = "SYSDICT.MRU";
 
-const char* FILEPATH_SJGB18TABLE = "CNVSJGB.TBL";
+const char* FILEPATH_SJGB18TABLE = "CNVSJGB2.TBL";
 
 ArduinoSDFileAccessor font14file;
 
 ScreenEx screen;
+// 画面の描画はこのフレームバッファ上で行い、flush()でまとめて転送する
+byte screenframebuffer[Screen::FRAMEBUFFER_LENGTH];
 FontManager font;
 
-constexpr uint16_t FONTCACHEBUFFER_LENGTH = (1 + 1 + 28) * 16;
+// グリフキャッシュ。ハッシュ表と、1バイト文字・2バイト文字のスロット群に分けて使われる
+constexpr uint16_t FONTCACHEBUFFER_LENGTH = 512;
 byte fontcachebuffer[FONTCACHEBUFFER_LENGTH];
 
-ArduinoSDFileAccessor sysDictFile;
+ArduinoSDFileAccessor sysDictSdFile;
+// SKK辞書はインデックスの探索で前後に細かく読むので、セクタバッファを経由させる
+constexpr uint16_t SYSDICTBUFFER_LENGTH = BufferedFileAccessor::SECTOR_SIZE * 1;
+byte sysdictbuffer[SYSDICTBUFFER_LENGTH];
+BufferedFileAccessor sysDictFile;
 SKK::SkkDict sysDict;
 SKK::SkkEngine skk;
+// 変換候補の区間をまとめて読み込む領域。候補の個数 * 2 + 区間のバイト数 までの項目が収まる
+constexpr uint16_t CANDIDATEBUFFER_LENGTH = 192;
+byte candidatebuffer[CANDIDATEBUFFER_LENGTH];
+
+// 選ばれた候補を覚えるユーザー辞書。最近使ったものはRAM上の表に置く
+ArduinoSDFileAccessor userDictSdFile;
+ArduinoSDFileAccessor userDictLogSdFile;
+ArduinoSDFileAccessor userDictWorkSdFile;
+constexpr uint16_t USERDICTTABLE_LENGTH = SKK::UserDict::SLOT_SIZE * 8;
+byte userdicttable[USERDICTTABLE_LENGTH];
+SKK::UserDict userDict;
+
+// 辞書の候補のうち最近選ばれたものを先に返すための表。システム辞書は書き換えない
+ArduinoSDFileAccessor candidateOrderSdFile;
+constexpr uint16_t CANDIDATEORDERTABLE_LENGTH = SKK::MruOverlay::RECORD_SIZE * 32;
+byte candidateordertable[CANDIDATEORDERTABLE_LENGTH];
+SKK::MruOverlay candidateOrder;
 
 ArduinoSDFileAccessor convert_sjis_gb18030_table_file;
-SKK::SkkDict convert_sjis_gb18030_table;
+// 変換テーブルのブロックを読み込むバッファ（16文字分）
+constexpr uint8_t SJISGB18030BUFFER_LENGTH = SjisGb18030Converter::SLOT_SIZE * 16;
+byte sjisgb18030buffer[SJISGB18030BUFFER_LENGTH];
+SjisGb18030Converter convert_sjis_gb18030;
+
+// Serial2へ送る変換済みのバイト列。変換とUARTの送信を並行させるために溜めておく
+constexpr uint8_t UARTRINGBUFFER_LENGTH = 64;
+byte uartringbuffer_memory[UARTRINGBUFFER_LENGTH];
+ByteRingBuffer uart_ringbuffer;
+// 一度に変換するバイト数（GB18030で4バイトの文字が収まること）
+constexpr uint8_t UARTCHUNK_LENGTH = 16;
 
 InputEngine inputLine;
 
@@ -55,16 +97,17 @@ InputEngine inputLine;
    FIXME:簡易化のために、固定配列のバッファをそのまま用いる
 */
 #define TEXTBUFFER_LENGTH 256
-char textbuffer[TEXTBUFFER_LENGTH];
+char textbuffermemory[SjisBuffer::required_buffer_length(TEXTBUFFER_LENGTH - 1)];
+SjisBuffer textbuffer;
 
 /* 入力系バッファは以下の2つ。スクリーン上では単純に連結して表示する。
  */
 
-constexpr int HENKANBUFFER_LENGTH = 32;
+constexpr int HENKANBUFFER_LENGTH = SjisBuffer::required_buffer_length(31);
 // ひらがなから漢字への変換待ちの文字を記憶するためのバッファ
 char henkanbuffer[HENKANBUFFER_LENGTH];
 
-constexpr int ROMAJIBUFFER_LENGTH = 6;
+constexpr int ROMAJIBUFFER_LENGTH = SjisBuffer::required_buffer_length(5);
 // アルファベットからひらがなへ変換待ちの文字を記憶するためのバッファ
 char romajibuffer[ROMAJIBUFFER_LENGTH];
 
@@ -113,9 +156,10 @@ uint8_t print_text(uint8_t line, uint8_t col, const char* sjis);
   @param dst_len [IN]
   @param consumed_bytes [OUT]
   @param written_bytes [OUT]
+  @param is_pending [OUT]
   @return 成功すれば変換後のひらがなの文字数（>0）、もしくは0（ひらがなに変換できず）
   */
-uint8_t try_convert_romaji_to_hiragana(const char* romaji, uint16_t romaji_len, char* dst, uint16_t dst_len, uint16_t* consumed_bytes, uint16_t* written_bytes);
+uint8_t try_convert_romaji_to_hiragana(const char* romaji, uint16_t romaji_len, char* dst, uint16_t dst_len, uint16_t* consumed_bytes, uint16_t* written_bytes, bool* is_pending);
 
 
 #include <WString.h>
@@ -172,6 +216,13 @@ bool input_keydown_prehook_callback(uint8_t ch) {
         return true;
     }
 
+    if (func1_pressed && ch == 'p') {
+        // 計測した実行時間を出力し、計測をやり直す
+        Profile::dump();
+        Profile::reset();
+        return true;
+    }
+
     if (ch == Keyboard::KEYCODE_FUNCTION_2) {
         inputLine.set_autodecide_mode(!inputLine.get_autodecide_mode());
         DEBUG("henkanAutoDecide=%s", inputLine.get_autodecide_mode() ? "true" : "false");
@@ -196,7 +247,7 @@ bool input_keydown_prehook_callback(uint8_t ch) {
         // if (enter_pressed) {
         //     DEBUG("Enter key is pressed down now.");
         // }
-        if (enter_pressed && (strlen(inputLine.henkanbuffer) == 0) && (strlen(inputLine.romajibuffer)) == 0) {
+        if (enter_pressed && inputLine.henkanbuffer.is_empty() && inputLine.romajibuffer.is_empty()) {
             req_send_text_via_uart = true;
         }
     }
@@ -215,7 +266,10 @@ bool input_keydown_prehook_callback(uint8_t ch) {
 
 bool input_keydown_uncaught_callback(uint8_t ch) {
     if (ch == Keyboard::KEYCODE_BACKSPACE) {
-        sjis_remove_tail_char(textbuffer);
+        // リピートでまとめられたぶんを削除してから、1回だけ描画する
+        for (uint8_t i = 0; i < keyboard.get_key_count(); i++) {
+            textbuffer.pop_last_char();
+        }
         draw_texts(true);
     } else if (ch == Keyboard::KEYCODE_ENTER) {
         //
@@ -225,7 +279,7 @@ bool input_keydown_uncaught_callback(uint8_t ch) {
 
 
 void input_callback(const char* str, size_t len) {
-    cstr_append(textbuffer, TEXTBUFFER_LENGTH, str, len);
+    textbuffer.append(str, len);
     draw_texts(true);
 }
 
@@ -237,12 +291,13 @@ void setup(void) {
     Serial.begin(115200);
     Serial.println("Initializing...");
 
-    memset(textbuffer, '\0', TEXTBUFFER_LENGTH);
+    textbuffer.init(textbuffermemory, sizeof(textbuffermemory));
 
 
     DEBUG("Init screen... ");
     screen.init();
     screen.clear();
+    screen.enable_framebuffer(screenframebuffer);
     Serial.println("Screen ready.");
 
     DEBUG("Init Keyboard...");
@@ -272,6 +327,9 @@ void setup(void) {
 
     DEBUG("Init skk... ");
     skk.init();
+    if (!sysDictFile.init(&sysDictSdFile, sysdictbuffer, SYSDICTBUFFER_LENGTH)) {
+        PANIC("Failed to init buffer for sys dict.");
+    }
     if (!sysDictFile.open(FILEPATH_SYSDICT, ArduinoSDFileAccessor::FileMode::READ)) {
         DEBUG("Failed to load skk sys dict file.");
         assert(false);
@@ -284,6 +342,21 @@ void setup(void) {
         DEBUG("Failed to set sysDict to SkkEngine.");
         assert(false);
     }
+    if (!userDict.init(&userDictSdFile, FILEPATH_USERDICT,
+                       &userDictLogSdFile, FILEPATH_USERDICTLOG,
+                       &userDictWorkSdFile, FILEPATH_USERDICTWORK,
+                       userdicttable, USERDICTTABLE_LENGTH)) {
+        // ユーザー辞書がなくても変換はできる
+        DEBUG("Failed to init user dict. Learning is disabled.");
+    } else {
+        skk.set_learningdict(&userDict);
+    }
+    if (!candidateOrder.init(&candidateOrderSdFile, FILEPATH_SYSDICTMRU,
+                             candidateordertable, CANDIDATEORDERTABLE_LENGTH)) {
+        DEBUG("Failed to init candidate order. Candidates are shown in dict order.");
+    } else {
+        skk.set_candidateorder(&candidateOrder);
+    }
     Serial.println("SKK ready.");
 
 
@@ -294,6 +367,7 @@ void setup(void) {
         PANIC("Failed to initialize InputEngine.");
     }
     inputLine.set_sands(true);
+    inputLine.set_candidate_buffer(candidatebuffer, CANDIDATEBUFFER_LENGTH);
     inputLine.set_keydown_prehook_callback(input_keydown_prehook_callback);
     inputLine.set_keydown_uncaught_callback(input_keydown_uncaught_callback);
     inputLine.set_input_callback(input_callback);
@@ -309,9 +383,11 @@ void setup(void) {
     screen.invert_rect(0, 16, 7 * 10 - 1, 31);
     screen.draw_line(121, 0, 121, 31);
     screen.draw_line(121 - 7 * 8 - 3, 14, 121, 14);
+    screen.flush();
 
     DEBUG("Init Serial2 with 57600bps... ");
     Serial2.begin(57600);
+    uart_ringbuffer.init(uartringbuffer_memory, UARTRINGBUFFER_LENGTH);
     Serial.println("Serial2 ready. (57600bps 8N1)");
 
     DEBUG("Init text encoding utils... ");
@@ -319,7 +395,7 @@ void setup(void) {
         PANIC("FAIL: load convertion table for SJIS and GB18030.");
     }
 
-    if (!convert_sjis_gb18030_table.init(&convert_sjis_gb18030_table_file)) {
+    if (!convert_sjis_gb18030.init(&convert_sjis_gb18030_table_file, sjisgb18030buffer, SJISGB18030BUFFER_LENGTH)) {
         PANIC("FAIL: init table object");
     }
     
@@ -343,6 +419,7 @@ void setup(void) {
 
     screen.clear();
     draw_texts(true);
+    screen.flush();
 
     DEBUG("Leave setup()");
 }
@@ -357,31 +434,28 @@ void draw_texts(bool update_textbuffer) {
 
     // textbufferの文字数が多い場合、末尾が収まるようにする
 
-    if (strlen(textbuffer) < DISPLAY_BYTES_IN_A_LINE) {
+    size_t textlength = textbuffer.length();
+    if (textlength < DISPLAY_BYTES_IN_A_LINE || displaystartindex > textlength) {
         // DEBUG("All text could be displayed in a line.");
         displaystartindex = 0;
+    }
 
-    } else if (strlen(&textbuffer[displaystartindex]) < DISPLAY_BYTES_IN_A_LINE) {
+    if (textlength - displaystartindex < DISPLAY_BYTES_IN_A_LINE) {
         // DEBUG("decrement displaystartindex");
-        uint16_t current_chars_in_a_line = count_chars_sjis(&textbuffer[displaystartindex]);
-        uint16_t current_total_length_chars = count_chars_sjis(textbuffer);
-        uint16_t new_start_chars = current_total_length_chars - current_chars_in_a_line - 1;
-        char* ptr1 = (char*)get_n_char_ptr_sjis(textbuffer, new_start_chars);
-        if (count_chars_sjis(ptr1) > DISPLAY_BYTES_IN_A_LINE) {
-            new_start_chars -= 1;
-            ptr1 = (char*)get_n_char_ptr_sjis(textbuffer, new_start_chars);
+        // 1行に収まる限り、表示の開始位置を1文字ずつ戻す
+        while (displaystartindex > 0
+                && textlength - textbuffer.get_prev_char_index(displaystartindex) <= DISPLAY_BYTES_IN_A_LINE) {
+            displaystartindex = textbuffer.get_prev_char_index(displaystartindex);
         }
-        displaystartindex = ptr1 - textbuffer;
-        
+
     } else {
         // DEBUG("increment displaystartindex");
-        while (strlen(&textbuffer[displaystartindex]) > DISPLAY_BYTES_IN_A_LINE) {
-            uint8_t cur_char_bytes = count_bytes_of_a_char_sjis(&textbuffer[displaystartindex]);
-            displaystartindex += cur_char_bytes;
+        while (textlength - displaystartindex > DISPLAY_BYTES_IN_A_LINE) {
+            displaystartindex += textbuffer.get_char_bytes(displaystartindex);
         }
     }
-    const char* textbuffer_display_head = &textbuffer[displaystartindex];
-    uint8_t display_text_length = strlen(textbuffer_display_head);
+    const char* textbuffer_display_head = &textbuffer.c_str()[displaystartindex];
+    uint8_t display_text_length = textlength - displaystartindex;
     uint8_t x1 = display_text_length * font.FONT_WIDTH_SINGLEBYTE,
             y1 = top,
             x2 = screen.SCREEN_WIDTH,
@@ -392,11 +466,10 @@ void draw_texts(bool update_textbuffer) {
     }
     screen.clear_rect_pagealined(x1, y1, x2, y2);
 
-    screen.print_at(0, 0, textbuffer_display_head);
+    screen.print_at(0, 0, textbuffer_display_head, display_text_length);
 
     { // textbufferのカーソルを表示する（常時点灯）
-        uint8_t bytelen = strlen(textbuffer_display_head);
-        uint8_t startcol = bytelen * 7;
+        uint8_t startcol = display_text_length * 7;
         uint8_t cursorwidth = 1;
         uint8_t x1 = startcol,
                 y1 = 0,
@@ -407,88 +480,70 @@ void draw_texts(bool update_textbuffer) {
 }
 
 
+/** 送信待ちのバイト列を、Serial2の送信バッファに空きがある分だけ書き込む（待たない）
+ * @return 書き込んだバイト数
+ */
+size_t drain_uart_ringbuffer(void) {
+    size_t written = 0;
+    int writable = Serial2.availableForWrite();
+    while (writable > 0 && !uart_ringbuffer.is_empty()) {
+        const uint8_t* data;
+        size_t len = uart_ringbuffer.peek_contiguous(&data);
+        if (len > (size_t)writable) {
+            len = writable;
+        }
+        Serial2.write(data, len);
+        uart_ringbuffer.consume(len);
+        written += len;
+        writable -= len;
+    }
+    return written;
+}
+
+
 /** 現在のテキストバッファの内容をシリアルで出力し、バッファを空にする
+ * 変換した結果をリングバッファへ溜め、Serial2が送信している間に次の文字の変換を進める。
  */
 void send_text_via_uart(void) {
+    PROFILE_SCOPE(SendTextViaUart);
     DEBUG("called.");
-    if (strlen(textbuffer) < 1) {
+    if (textbuffer.is_empty()) {
         Serial2.write((uint8_t)'\n');
         return;
     }
 
-    STOPWATCH_BLOCK_START(textconversion);
+    uart_ringbuffer.clear();
+    uint32_t sent_bytes = 0;
+    unsigned long start_millis = millis();
 
     // SJISからGB18030へ変換したうえで出力する実装
-    size_t len = strlen(textbuffer);
-    const char* end = textbuffer + len;
-    const char* ptr = textbuffer;
-    bool waiting_sjis_second_byte = false;
-    const char* sjischar_start = textbuffer;
-
-    while (ptr < end) {
-        // DEBUG("ch=0x%02x(%d)", (uint8_t)*ptr, (uint8_t)*ptr);
-        if (!waiting_sjis_second_byte && sjis_is_first_byte(*ptr)) {
-            // DEBUG("SJIS 1st byte.");
-            // SJISの第1バイトなので、第2バイトを待つ
-            sjischar_start = ptr;
-            waiting_sjis_second_byte = true;
-            ++ptr;
-            continue;
-
-        } else if (!waiting_sjis_second_byte) {
-            if (0xa0 <= *ptr && *ptr <= 0xdf) {
-                // 半角カナはGB18030と互換性が（たぶん）ないので、とりあえず無視
-                // FIXME: 適切な対応法を考える
-                DEBUG("Warn: encount Hankaku-Kana char: 0x%02x(%d)", (uint8_t)*ptr, (uint8_t)*ptr);
-                ++ptr;
-                continue;
-
-            } else {
-                // DEBUG("ASCII byte.");
-                // 1バイトのASCII文字（もしくは制御バイト）なので、そのまま出力する
-                Serial2.write((uint8_t)*ptr);
-                ++ptr;
-                continue;
-            }
-
-        } else {
-            // DEBUG("SJIS 2nd byte.");
-            // SJISの第2バイトなので、第1バイトと合わせてエンコードを変換し、出力する
-            char sjisbuf[2] = { *sjischar_start, *ptr };
-            waiting_sjis_second_byte = false;
-            ++ptr;
-            uint8_t matched_length;
-            uint32_t startaddr = convert_sjis_gb18030_table.search_startaddr_from_index_for(sjisbuf, 2, &matched_length);
-            // DEBUG("startaddr=0x%lx(%0ld), matched_length=%d", startaddr, startaddr, matched_length);
-            if (startaddr == INVALID_UINT32) {
-                DEBUG("Error: cannot find startaddr for 0x%02x, 0x%02x", (uint8_t)sjisbuf[0], (uint8_t)sjisbuf[1]);
-                continue;
-            }
-            SKK::CandidateReader reader;
-            if (!convert_sjis_gb18030_table.search_henkanentry_for(startaddr, true, matched_length, sjisbuf, 2, &reader) ) {
-                DEBUG("Error: cannot find Henkan entry for 0x%02x, 0x%02x", (uint8_t)sjisbuf[0], (uint8_t)sjisbuf[1]);
-                continue;
-            }
-            uint8_t gb18030_length = reader.get_current_candidate_length();
-            uint8_t gb18030_bytes[4] = { 0, 0, 0, 0 };
-            for (uint8_t i = 0; i < gb18030_length; i++) {
-                gb18030_bytes[i] = reader.read();
-            }
-
-            // DEBUG("Converted from (SJIS) 0x%02x, 0x%02x to (GB18030) 0x%02x, 0x%02x, 0x%02x, 0x%02x",
-            //         (uint8_t)sjisbuf[0], (uint8_t)sjisbuf[1],
-            //         (uint8_t)gb18030_bytes[0], (uint8_t)gb18030_bytes[1], (uint8_t)gb18030_bytes[2], (uint8_t)gb18030_bytes[3]);
-
-            Serial2.write((uint8_t*)gb18030_bytes, gb18030_length);
+    const char* ptr = textbuffer.c_str();
+    size_t remaining = textbuffer.length();
+
+    while (remaining > 0 || !uart_ringbuffer.is_empty()) {
+        if (remaining > 0 && uart_ringbuffer.free_space() >= UARTCHUNK_LENGTH) {
+            // 1チャンク分を変換してリングバッファへ追加する
+            uint8_t chunk[UARTCHUNK_LENGTH];
+            size_t consumed = 0;
+            size_t chunklen = convert_sjis_gb18030.convert_text(ptr, remaining, chunk, UARTCHUNK_LENGTH, &consumed);
+            uart_ringbuffer.push(chunk, chunklen);
+            ptr += consumed;
+            remaining -= consumed;
         }
-
+        sent_bytes += drain_uart_ringbuffer();
     }
 
-    STOPWATCH_BLOCK_END(textconversion);
-
     Serial2.write((uint8_t)'\n');
+    sent_bytes += 1;
+    // すべて送信し終えるまでを計測する
+    Serial2.flush();
+
+    // 57600bps 8N1 では、理論上の上限は5760[bytes/s]
+    unsigned long elapsed_millis = millis() - start_millis;
+    DEBUG("Sent %lu bytes in %lu[msec] (%lu bytes/s)", (unsigned long)sent_bytes, elapsed_millis,
+            elapsed_millis > 0 ? (unsigned long)(sent_bytes * 1000UL / elapsed_millis) : 0UL);
 
-    textbuffer[0] = '\0';
+    textbuffer.clear();
     draw_texts(true);
 
     DEBUG("Finished sending textbuffer content.");
@@ -33,6 +33,7 @@ void panic(const char* modulename, const char* functionname, int lineno, const c
     screen.print(functionname);
     screen.set_cursor(0, font.FONT_HEIGHT);
     screen.print(mes);
+    screen.flush();
 
     Serial.println("Halted by panic.");
 
@@ -1,175 +0,0 @@
-typedef struct {
-    const char* romaji;
-    const char* hiragana;
-    uint8_t hiraganabytelength;
-} romajientry_t;
-
-romajientry_t romajitable[] = {
-
-    { "a", "\x82\xa0", 2 },
-    { "xa", "\x82\x9f", 2 },
-    { "i", "\x82\xa2", 2 },
-    { "xi", "\x82\xa1", 2 },
-    { "u", "\x82\xa4", 2 },
-    { "xu", "\x82\xa3", 2 },
-    { "e", "\x82\xa6", 2 },
-    { "xe", "\x82\xa5", 2 },
-    { "o", "\x82\xa8", 2 },
-    { "xo", "\x82\xa7", 2 },
-    { "ka", "\x82\xa9", 2 },
-    { "ki", "\x82\xab", 2 },
-    { "ku", "\x82\xad", 2 },
-    { "ke", "\x82\xaf", 2 },
-    { "ko", "\x82\xb1", 2 },
-    { "ga", "\x82\xaa", 2 },
-    { "gi", "\x82\xac", 2 },
-    { "gu", "\x82\xae", 2 },
-    { "ge", "\x82\xb0", 2 },
-    { "go", "\x82\xb2", 2 },
-    { "sa", "\x82\xb3", 2 },
-    { "si", "\x82\xb5", 2 },
-    { "shi", "\x82\xb5", 2 },
-    { "su", "\x82\xb7", 2 },
-    { "se", "\x82\xb9", 2 },
-    { "so", "\x82\xbb", 2 },
-    { "za", "\x82\xb4", 2 },
-    { "zi", "\x82\xb6", 2 },
-    { "ji", "\x82\xb6", 2 },
-    { "zu", "\x82\xb8", 2 },
-    { "ze", "\x82\xba", 2 },
-    { "zo", "\x82\xbc", 2 },
-    { "ta", "\x82\xbd", 2 },
-    { "ti", "\x82\xbf", 2 },
-    { "chi", "\x82\xbf", 2 },
-    { "tu", "\x82\xc2", 2 },
-    { "tsu", "\x82\xc2", 2 },
-    { "xtu", "\x82\xc1", 2 },
-    { "xtsu", "\x82\xc1", 2 },
-    { "te", "\x82\xc4", 2 },
-    { "to", "\x82\xc6", 2 },
-    { "da", "\x82\xbe", 2 },
-    { "di", "\x82\xc0", 2 },
-    { "du", "\x82\xc3", 2 },
-    { "de", "\x82\xc5", 2 },
-    { "do", "\x82\xc7", 2 },
-    { "na", "\x82\xc8", 2 },
-    { "ni", "\x82\xc9", 2 },
-    { "nu", "\x82\xca", 2 },
-    { "ne", "\x82\xcb", 2 },
-    { "no", "\x82\xcc", 2 },
-    { "ha", "\x82\xcd", 2 },
-    { "hi", "\x82\xd0", 2 },
-    { "hu", "\x82\xd3", 2 },
-    { "fu", "\x82\xd3", 2 },
-    { "he", "\x82\xd6", 2 },
-    { "ho", "\x82\xd9", 2 },
-    { "pa", "\x82\xcf", 2 },
-    { "pi", "\x82\xd2", 2 },
-    { "pu", "\x82\xd5", 2 },
-    { "pe", "\x82\xd8", 2 },
-    { "po", "\x82\xdb", 2 },
-    { "ba", "\x82\xce", 2 },
-    { "bi", "\x82\xd1", 2 },
-    { "bu", "\x82\xd4", 2 },
-    { "be", "\x82\xd7", 2 },
-    { "bo", "\x82\xda", 2 },
-    { "ma", "\x82\xdc", 2 },
-    { "mi", "\x82\xdd", 2 },
-    { "mu", "\x82\xde", 2 },
-    { "me", "\x82\xdf", 2 },
-    { "mo", "\x82\xe0", 2 },
-    { "ya", "\x82\xe2", 2 },
-    { "xya", "\x82\xe1", 2 },
-    { "yu", "\x82\xe4", 2 },
-    { "xyu", "\x82\xe3", 2 },
-    { "yo", "\x82\xe6", 2 },
-    { "xyo", "\x82\xe5", 2 },
-    { "ra", "\x82\xe7", 2 },
-    { "ri", "\x82\xe8", 2 },
-    { "ru", "\x82\xe9", 2 },
-    { "re", "\x82\xea", 2 },
-    { "ro", "\x82\xeb", 2 },
-    { "wa", "\x82\xed", 2 },
-    { "wo", "\x82\xf0", 2 },
-    { "nn", "\x82\xf1", 2 },
-    { "kya", "\x82\xab\x82\xe1", 4 },
-    { "kyu", "\x82\xab\x82\xe3", 4 },
-    { "kyo", "\x82\xab\x82\xe5", 4 },
-    { "gya", "\x82\xac\x82\xe1", 4 },
-    { "gyu", "\x82\xac\x82\xe3", 4 },
-    { "gyo", "\x82\xac\x82\xe5", 4 },
-    { "sha", "\x82\xb5\x82\xe1", 4 },
-    { "sya", "\x82\xb5\x82\xe1", 4 },
-    { "shu", "\x82\xb5\x82\xe3", 4 },
-    { "syu", "\x82\xb5\x82\xe3", 4 },
-    { "sho", "\x82\xb5\x82\xe5", 4 },
-    { "syo", "\x82\xb5\x82\xe5", 4 },
-    { "ja", "\x82\xb6\x82\xe1", 4 },
-    { "jya", "\x82\xb6\x82\xe1", 4 },
-    { "ju", "\x82\xb6\x82\xe3", 4 },
-    { "jyu", "\x82\xb6\x82\xe3", 4 },
-    { "je", "\x82\xb6\x82\xa5", 4 },
-    { "jo", "\x82\xb6\x82\xe5", 4 },
-    { "jyo", "\x82\xb6\x82\xe5", 4 },
-    { "tya", "\x82\xbf\x82\xe1", 4 },
-    { "cha", "\x82\xbf\x82\xe1", 4 },
-    { "tyu", "\x82\xbf\x82\xe3", 4 },
-    { "chu", "\x82\xbf\x82\xe3", 4 },
-    { "tyo", "\x82\xbf\x82\xe5", 4 },
-    { "cho", "\x82\xbf\x82\xe5", 4 },
-    { "nya", "\x82\xc9\x82\xe1", 4 },
-    { "nyu", "\x82\xc9\x82\xe3", 4 },
-    { "nyo", "\x82\xc9\x82\xe5", 4 },
-    { "hya", "\x82\xd0\x82\xe1", 4 },
-    { "hyu", "\x82\xd0\x82\xe3", 4 },
-    { "hyo", "\x82\xd0\x82\xe5", 4 },
-    { "bya", "\x82\xd1\x82\xe1", 4 },
-    { "byu", "\x82\xd1\x82\xe3", 4 },
-    { "byo", "\x82\xd1\x82\xe5", 4 },
-    { "pya", "\x82\xd2\x82\xe1", 4 },
-    { "pyu", "\x82\xd2\x82\xe3", 4 },
-    { "pyo", "\x82\xd2\x82\xe5", 4 },
-    { "mya", "\x82\xdd\x82\xe1", 4 },
-    { "myu", "\x82\xdd\x82\xe3", 4 },
-    { "myo", "\x82\xdd\x82\xe5", 4 },
-    { "rya", "\x82\xe8\x82\xe1", 4 },
-    { "ryu", "\x82\xe8\x82\xe3", 4 },
-    { "ryo", "\x82\xe8\x82\xe5", 4 },
-    { "va", "\x83\x94\x82\x9f", 4 },
-    { "vu", "\x83\x94", 2 },
-    { "vo", "\x83\x94\x82\xa7", 4 },
-    { "nk", "\x82\xf1\x6b", 2 },
-    { "ng", "\x82\xf1\x67", 2 },
-    { "ns", "\x82\xf1\x73", 2 },
-    { "nz", "\x82\xf1\x7a", 2 },
-    { "nj", "\x82\xf1\x6a", 2 },
-    { "nt", "\x82\xf1\x74", 2 },
-    { "nd", "\x82\xf1\x64", 2 },
-    { "nh", "\x82\xf1\x68", 2 },
-    { "nb", "\x82\xf1\x62", 2 },
-    { "np", "\x82\xf1\x70", 2 },
-    { "nm", "\x82\xf1\x6d", 2 },
-    { "nr", "\x82\xf1\x72", 2 },
-    { "nw", "\x82\xf1\x77", 2 },
-    { "mp", "\x82\xf1\x70", 2 },
-    { "mb", "\x82\xf1\x62", 2 },
-    { "mm", "\x82\xf1\x6d", 2 },
-    { "kk", "\x82\xc1\x6b", 2 },
-    { "gg", "\x82\xc1\x67", 2 },
-    { "ss", "\x82\xc1\x73", 2 },
-    { "ss", "\x82\xc1\x74", 2 },
-    { "zz", "\x82\xc1\x7a", 2 },
-    { "jj", "\x82\xc1\x6a", 2 },
-    { "tt", "\x82\xc1\x74", 2 },
-    { "dd", "\x82\xc1\x64", 2 },
-    { "nn", "\x82\xc1\x6e", 2 },
-    { "hh", "\x82\xc1\x68", 2 },
-    { "bb", "\x82\xc1\x62", 2 },
-    { "pp", "\x82\xc1\x70", 2 },
-    { "mm", "\x82\xc1\x6d", 2 },
-    { "yy", "\x82\xc1\x79", 2 },
-    { "rr", "\x82\xc1\x72", 2 },
-    { "ww", "\x82\xc1\x77", 2 }
-};
-
-#define ROMAJITABLE_ENTRIES (sizeof(romajitable) / sizeof(romajientry_t))
@@ -1,7 +1,12 @@
 #include <Arduino.h>
 
+#include <alloca.h>
+
 #include "screen.h"
 
+#include <profile.h>
+#include <commondef.h>
+
 
 // GLCD Pin1 : Vcc (5V)
 //  Connected to GND.
@@ -36,6 +41,14 @@
 // #define GLCD_BKL 6
 // GLCD Pin 20; Backlight GND
 
+/* データバスの駆動方法
+   ATmega4809では、VPORTC, VPORTDをまとめて読み書きする（ビットの対応は GlcdBus.h を参照）。
+   他のボードや、GLCD_BUS_PER_PIN を定義した場合は、ピンごとに読み書きする。 */
+#if defined(__AVR_ATmega4809__) && !defined(GLCD_BUS_PER_PIN)
+#define GLCD_BUS_VPORT
+#include <GlcdBus.h>
+#endif
+
 
 #define nop() __asm__ volatile ("nop")
 
@@ -54,11 +67,19 @@ void glcd_set_databus_as(uint8_t mode) {
 }
 
 void glcd_set_databus_as_output(void) {
+#ifdef GLCD_BUS_VPORT
+    GlcdBus::set_output(VPORTD, VPORTC);
+#else
     glcd_set_databus_as(OUTPUT);
+#endif
 }
 
 void glcd_set_databus_as_input(void) {
+#ifdef GLCD_BUS_VPORT
+    GlcdBus::set_input(VPORTD, VPORTC);
+#else
     glcd_set_databus_as(INPUT);
+#endif
 }
 
 
@@ -67,6 +88,9 @@ void glcd_send_byte(bool is_command, uint8_t data) {
 
     digitalWriteFast(GLCD_RW, LOW);  // Write mode
     digitalWriteFast(GLCD_A0, is_command ? LOW : HIGH);  // Command mode or data mode
+#ifdef GLCD_BUS_VPORT
+    GlcdBus::write(VPORTD, VPORTC, data);
+#else
     digitalWriteFast(GLCD_D0, data & 0x01 ? HIGH : LOW);
     digitalWriteFast(GLCD_D1, data & 0x02 ? HIGH : LOW);
     digitalWriteFast(GLCD_D2, data & 0x04 ? HIGH : LOW);
@@ -75,6 +99,7 @@ void glcd_send_byte(bool is_command, uint8_t data) {
     digitalWriteFast(GLCD_D5, data & 0x20 ? HIGH : LOW);
     digitalWriteFast(GLCD_D6, data & 0x40 ? HIGH : LOW);
     digitalWriteFast(GLCD_D7, data & 0x80 ? HIGH : LOW);
+#endif
     // delayMicroseconds(1);
     digitalWriteFast(GLCD_E, HIGH);
     // delayMicroseconds(1);
@@ -97,6 +122,9 @@ byte glcd_read_byte(bool is_status_read) {
     nop();
 
     byte val = 0;
+#ifdef GLCD_BUS_VPORT
+    val = GlcdBus::read(VPORTD, VPORTC);
+#else
     val |= (digitalReadFast(GLCD_D0) == HIGH) ? 0x01 : 0;
     val |= (digitalReadFast(GLCD_D1) == HIGH) ? 0x02 : 0;
     val |= (digitalReadFast(GLCD_D2) == HIGH) ? 0x04 : 0;
@@ -105,6 +133,7 @@ byte glcd_read_byte(bool is_status_read) {
     val |= (digitalReadFast(GLCD_D5) == HIGH) ? 0x20 : 0;
     val |= (digitalReadFast(GLCD_D6) == HIGH) ? 0x40 : 0;
     val |= (digitalReadFast(GLCD_D7) == HIGH) ? 0x80 : 0;
+#endif
 
     digitalWriteFast(GLCD_E, LOW);
     // delayMicroseconds(1);
@@ -207,6 +236,77 @@ void readmodifywrite_write_xor(byte xorbyte) {
 }
 
 
+/** 1ページ分の連続した列へ書き込む。
+    チップの境界での分割は1度だけ行い、チップ内は列の自動インクリメントに任せて連続して送る。
+  @param page [IN] 0-3
+  @param x [IN] 先頭の列 (0-121)
+  @param data [IN] 書き込むバイト列。nullptrなら、すべての列にpatternを書き込む
+  @param pattern [IN] dataがnullptrのときに書き込むバイト
+  @param len [IN] 列数。x + len が122を超えないこと
+ */
+static
+void glcd_write_span(uint8_t page, uint8_t x, const byte* data, byte pattern, uint8_t len) {
+    constexpr uint8_t CHIP_WIDTH = Screen::SCREEN_WIDTH_PER_CHIP;
+    uint8_t x2 = x + len;
+    for (uint8_t chip = 0; chip < 2; chip++) {
+        uint8_t chipleft = chip * CHIP_WIDTH;
+        uint8_t chipright = chipleft + CHIP_WIDTH;
+        if (x2 <= chipleft || chipright <= x) {
+            continue;
+        }
+        uint8_t start = max(x, chipleft);
+        uint8_t end = min(x2, chipright);
+        glcd_select_chip(chip == 0, chip == 1);
+        glcd_select_page(page);
+        glcd_select_col(start - chipleft);
+        if (data) {
+            const byte* p = &data[start - x];
+            for (uint8_t col = start; col < end; col++) {
+                glcd_send_byte(false, *p++);
+            }
+        } else {
+            for (uint8_t col = start; col < end; col++) {
+                glcd_send_byte(false, pattern);
+            }
+        }
+    }
+}
+
+
+/** 1ページ分の連続した列へ、Read-modify-writeで論理和を書き込む。
+    チップの境界での分割は1度だけ行い、チップごとにRead-modify-writeモードへ1度だけ出入りする。
+  @param page [IN] 0-3
+  @param x [IN] 先頭の列 (0-121)
+  @param data [IN] 重ね合わせるバイト列
+  @param len [IN] 列数。x + len が122を超えないこと
+ */
+static
+void glcd_or_span(uint8_t page, uint8_t x, const byte* data, uint8_t len) {
+    constexpr uint8_t CHIP_WIDTH = Screen::SCREEN_WIDTH_PER_CHIP;
+    uint8_t x2 = x + len;
+    for (uint8_t chip = 0; chip < 2; chip++) {
+        uint8_t chipleft = chip * CHIP_WIDTH;
+        uint8_t chipright = chipleft + CHIP_WIDTH;
+        if (x2 <= chipleft || chipright <= x) {
+            continue;
+        }
+        uint8_t start = max(x, chipleft);
+        uint8_t end = min(x2, chipright);
+        glcd_select_chip(chip == 0, chip == 1);
+        glcd_select_page(page);
+        glcd_select_col(start - chipleft);
+        // Enter to Read modify write mode
+        glcd_send_byte(true, 0xE0);
+        const byte* p = &data[start - x];
+        for (uint8_t col = start; col < end; col++) {
+            readmodifywrite_write_or(*p++);
+        }
+        // Leave Read modify write mode
+        glcd_send_byte(true, 0xEE);
+    }
+}
+
+
 void Screen::init_pins(void) {
       constexpr int OUTPUTPINS_COUNT = 15;
   int outputpins[OUTPUTPINS_COUNT] = {
@@ -250,6 +350,13 @@ void Screen::init(void) {
 
 
 void Screen::fill(uint8_t pattern) {
+    if (this->framebuffer) {
+        memset(this->framebuffer, pattern, FRAMEBUFFER_LENGTH);
+        for (uint8_t page = 0; page < PAGE_COUNT; page++) {
+            this->mark_dirty(page, 0, SCREEN_WIDTH - 1);
+        }
+        return;
+    }
     glcd_select_chip(true, true);
     for (int page = 0; page < 4; ++page) {
         glcd_select_page(page);
@@ -266,20 +373,77 @@ void Screen::clear(void) {
 }
 
 
-/** カラムを連続して書き込む。チップをまたがないように呼び出し側で調整する
-  @param page [IN] 
-  @param startcol [IN]
-  @param data [IN]
-  @param datalen [IN] 
-  */
-static
-void send_cols(uint8_t page, uint8_t startcol, byte* data, uint8_t datalen) {
-    glcd_select_page(page);
-    glcd_select_col(startcol);
+void Screen::enable_framebuffer(byte* buffer) {
+    this->framebuffer = buffer;
+    for (uint8_t page = 0; page < PAGE_COUNT; page++) {
+        this->dirty_left[page] = INVALID_UINT8;
+    }
+    this->fill(0x00);
+}
+
+
+void Screen::disable_framebuffer(void) {
+    this->flush();
+    this->framebuffer = nullptr;
+}
+
+
+void Screen::mark_dirty(uint8_t page, uint8_t x1, uint8_t x2) {
+    if (this->dirty_left[page] == INVALID_UINT8) {
+        this->dirty_left[page] = x1;
+        this->dirty_right[page] = x2;
+    } else {
+        if (x1 < this->dirty_left[page]) {
+            this->dirty_left[page] = x1;
+        }
+        if (x2 > this->dirty_right[page]) {
+            this->dirty_right[page] = x2;
+        }
+    }
+}
+
+
+void Screen::flush(void) {
+    if (!this->framebuffer) {
+        return;
+    }
+    for (uint8_t page = 0; page < PAGE_COUNT; page++) {
+        if (this->dirty_left[page] == INVALID_UINT8) {
+            continue;
+        }
+        uint8_t x1 = this->dirty_left[page];
+        uint8_t x2 = this->dirty_right[page];
+        glcd_write_span(page, x1, this->framebuffer_at(page, x1), 0x00, x2 - x1 + 1);
+        this->dirty_left[page] = INVALID_UINT8;
+    }
+}
 
-    for (int i = 0; i < datalen; ++i) {
-        glcd_send_byte(false, data[i]);
+
+void Screen::blit_span(uint8_t page, uint8_t x, const byte* data, uint8_t len) {
+    if (page >= PAGE_COUNT || x >= SCREEN_WIDTH || len == 0) {
+        return;
     }
+    len = min(len, SCREEN_WIDTH - x);
+    if (this->framebuffer) {
+        memcpy(this->framebuffer_at(page, x), data, len);
+        this->mark_dirty(page, x, x + len - 1);
+        return;
+    }
+    glcd_write_span(page, x, data, 0x00, len);
+}
+
+
+void Screen::fill_span(uint8_t page, uint8_t x, byte pattern, uint8_t len) {
+    if (page >= PAGE_COUNT || x >= SCREEN_WIDTH || len == 0) {
+        return;
+    }
+    len = min(len, SCREEN_WIDTH - x);
+    if (this->framebuffer) {
+        memset(this->framebuffer_at(page, x), pattern, len);
+        this->mark_dirty(page, x, x + len - 1);
+        return;
+    }
+    glcd_write_span(page, x, nullptr, pattern, len);
 }
 
 
@@ -291,36 +455,8 @@ void send_cols(uint8_t page, uint8_t startcol, byte* data, uint8_t datalen) {
   @param glyphheight [IN] フォントグリフの高さ（ドット単位）
  */
 void Screen::draw_glyph_obsolute(uint8_t line, uint8_t col, byte* glyph, uint8_t glyphwidth, uint8_t glyphheight) {
-    uint8_t startcol_in_chip = col % 61;
-    bool across_chip = (col + glyphwidth < 122) && ((startcol_in_chip + glyphwidth) > 60);
-    uint8_t startchip = ((col / 61) % 2) + 1;
-    uint8_t page = line * 2;
-    glcd_select_chip(startchip & 0x01, startchip & 0x02);
-    if (!across_chip) {
-        uint8_t drawwidth;
-        if (col + glyphwidth >= 122 - 1) {
-            drawwidth = 122 - col - 1;
-        } else {
-            drawwidth = glyphwidth;
-        }
-        // Serial.print("draw_glyph(): col,drawidth=");
-        // Serial.print(col);
-        // Serial.print(",");
-        // Serial.println(drawwidth);
-        send_cols(page, startcol_in_chip, &glyph[0], drawwidth);
-        page = page + 1;
-        send_cols(page, startcol_in_chip, &glyph[glyphwidth], drawwidth);
-    } else {
-        uint8_t width_in_firstchip = 61 - col;
-        uint8_t width_in_secondchip = glyphwidth - width_in_firstchip;
-        uint8_t nextpage = page + 1;
-        send_cols(page, startcol_in_chip, &glyph[0], width_in_firstchip);
-        send_cols(nextpage, startcol_in_chip, &glyph[glyphwidth], width_in_firstchip);
-        uint8_t nextchip = ((startchip - 1 + 1) % 2) + 1;
-        glcd_select_chip(nextchip & 0x01, nextchip & 0x02);
-        send_cols(page, 0, &glyph[width_in_firstchip], width_in_secondchip);
-        send_cols(nextpage, 0, &glyph[glyphwidth + width_in_firstchip], width_in_secondchip);
-    }
+    // ページ単位の上書きなので、draw_glyph_2() と同じ
+    this->draw_glyph_2(line * 2 * 8, col, glyph, glyphwidth, glyphheight);
 
 #if false
     uint8_t startpage = 2 * line;
@@ -413,6 +549,15 @@ void Screen::invert_block(uint8_t chip, uint8_t page, uint8_t start_col, uint8_t
     start_col = start_col % 61;
     end_col = end_col % 61;
 
+    if (this->framebuffer) {
+        uint8_t chipleft = (chip & 0x01) ? 0 : SCREEN_WIDTH_PER_CHIP;
+        for (uint8_t col = start_col; col <= end_col; col++) {
+            *this->framebuffer_at(page, chipleft + col) ^= 0xFF;
+        }
+        this->mark_dirty(page, chipleft + start_col, chipleft + end_col);
+        return;
+    }
+
     select_chip(chip & 0x01, chip & 0x02);
     select_page(page);
     select_col(start_col);
@@ -465,6 +610,20 @@ enum class DrawMode {
     invert
 };
 
+/** フレームバッファ上の1バイトへ描画する
+ * @param b [IN] 対象のビットが1のバイト
+ */
+static void modify_framebuffer(Screen* screen, uint8_t page, uint8_t x, byte b, DrawMode mode) {
+    byte* p = screen->framebuffer_at(page, x);
+    if (mode == DrawMode::put) {
+        *p |= b;
+    } else if (mode == DrawMode::clear) {
+        *p &= ~b;
+    } else if (mode == DrawMode::invert) {
+        *p ^= b;
+    }
+}
+
 /** 指定ドットを描画もしくは反転する
  * @param x 
  * @param y 
@@ -475,6 +634,12 @@ static void draw_or_invert_dot(Screen* screen, uint8_t x, uint8_t y, DrawMode mo
         return;
     }
 
+    if (screen->framebuffer) {
+        modify_framebuffer(screen, y / 8, x, 0x01 << (y % 8), mode);
+        screen->mark_dirty(y / 8, x, x);
+        return;
+    }
+
     if (x < 61) {
         glcd_select_chip(true, false);
     } else {
@@ -639,6 +804,16 @@ static void fill_or_invert_rect(Screen* screen, uint8_t x1, uint8_t y1, uint8_t
             mask = mask >> rightshift;
             b &= (byte)(mask & 0xFF);
         }
+        if (screen->framebuffer) {
+            uint8_t right = min(x2, screen->SCREEN_WIDTH - 1);
+            if (x1 <= right) {
+                for (uint8_t x = x1; x <= right; x++) {
+                    modify_framebuffer(screen, page, x, b, mode);
+                }
+                screen->mark_dirty(page, x1, right);
+            }
+            continue;
+        }
         bool left_switched = false;
         bool right_switched = false;
         for (uint8_t x = x1; x <= x2; x++) {
@@ -689,122 +864,90 @@ void Screen::invert_rect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2) {
     fill_or_invert_rect(this, x1, y1, x2, y2, DrawMode::invert);
 }
 
+void Screen::compose_glyph_row(const byte* buffer, uint8_t width, uint8_t height, uint8_t page, uint8_t leftshift, byte* row, uint8_t rowlen) {
+    uint16_t buffertailoffset = (uint16_t)((height + 7) / 8) * width;
+    for (uint8_t col = 0; col < rowlen; col++) {
+        uint16_t byteoffset = ((uint16_t)page * width) + col;
+        byte b = 0;
+        if (page >= 1) {
+            // 2番目以降のページでは、上のページから溢れた分を回収する必要がある（かもしれない）
+            uint16_t prevbyteoffset = ((uint16_t)(page-1) * width) + col;
+            b |= (byte)(((uint16_t)buffer[prevbyteoffset] << leftshift) >> 8);
+        }
+        if (byteoffset < buffertailoffset) {
+            b |= (byte)((uint16_t)buffer[byteoffset] << leftshift);
+        }
+        row[col] = b;
+    }
+}
+
 void Screen::draw_glyph(uint8_t top, uint8_t left, byte* buffer, uint8_t width, uint8_t height) {
 
     // Serial.printf("draw_buffer(): top=%d,left=%d,width=%d,height=%d\n", top, left, width, height);
 
+    if (left >= SCREEN_WIDTH || width == 0) {
+        return;
+    }
     uint8_t toppage = top / 8;
     uint8_t bottom = min((top + height + 7) / 8, 3+1);
-    uint8_t right = left + width;
-    uint8_t verticalstride = (height + 7) / 8;
     uint8_t leftshift = top % 8;
-    uint8_t buffertailoffset = verticalstride * width;
+    uint8_t drawwidth = min(width, SCREEN_WIDTH - left);
+    byte* row = (byte*)alloca(drawwidth);
 
-    // ページごとに → チップを切り替えながら列ごとに、ループを回す
+    // ページごとに1ページ分の列を組み立て、まとめて重ね書きする
     for (uint8_t page = 0; (toppage + page) < bottom; page++) {
-        uint8_t col = 0;  // current drawing column number (in range of 0-121)
-        bool left_switched = false;
-        bool right_switched = false;
-        for (uint8_t col = 0; col < width; col++) {
-            if (!left_switched && left < 61) {
-                select_chip(true, false);
-                select_page(toppage + page);
-                select_col(left + col);
-                readmodifywrite_start();
-                left_switched = true;
-
-            } else if (!right_switched && 61 <= (left+col)) {
-                readmodifywrite_end();
-                select_chip(false, true);
-                select_page(toppage + page);
-                select_col((left + col) % 61);
-                select_page(toppage + page);
-                readmodifywrite_start();
-                right_switched = true;
-            }
-
-            uint8_t byteoffset = (page * width) + col;
-            // 上のページから溢れた分を合成する
-            byte b = 0;
-            if (page >= 1) {
-                // 2番目以降のページでは、上のページから溢れた分を回収する必要がある（かもしれない）
-                uint8_t prevbyteoffset = ((page-1) * width) + col;
-                uint16_t tmp = (uint16_t)(buffer[prevbyteoffset] << leftshift);
-                b |= ((uint16_t)tmp >> 8) & 0xFF;
+        compose_glyph_row(buffer, width, height, page, leftshift, row, drawwidth);
+        if (this->framebuffer) {
+            byte* dst = this->framebuffer_at(toppage + page, left);
+            for (uint8_t col = 0; col < drawwidth; col++) {
+                dst[col] |= row[col];
             }
-            if (byteoffset < buffertailoffset) {
-                b |= (byte)((uint16_t)buffer[byteoffset] << leftshift);
-            }
-            readmodifywrite_write_or(b);
+            this->mark_dirty(toppage + page, left, left + drawwidth - 1);
+        } else {
+            glcd_or_span(toppage + page, left, row, drawwidth);
         }
-
-        readmodifywrite_end();
     }
 
 }
 
 void Screen::draw_glyph_2(uint8_t top, uint8_t left, byte* buffer, uint8_t width, uint8_t height) {
+    PROFILE_SCOPE(DrawGlyph2);
 
     // Serial.printf("draw_buffer(): top=%d,left=%d,width=%d,height=%d\n", top, left, width, height);
 
+    if (left >= SCREEN_WIDTH || width == 0) {
+        return;
+    }
     uint8_t toppage = top / 8;
     uint8_t bottom = min((top + height + 7) / 8, 3+1);
-    // uint8_t bottompage = (top+height) / 8;
-    uint8_t right = left + width;
-    uint8_t verticalstride = (height + 7) / 8;
     uint8_t leftshift = top % 8;
-    uint8_t buffertailoffset = verticalstride * width;
+    uint8_t drawwidth = min(width, SCREEN_WIDTH - left);
     bool page_aligned = (top % 8) == 0;
+    // ページ境界に揃っていないときに、ずらした列を組み立てる領域
+    byte* row = page_aligned ? nullptr : (byte*)alloca(drawwidth);
 
-    // ページごとに → チップを切り替えながら列ごとに、ループを回す
+    // ページごとに1ページ分の列をまとめて転送する
     for (uint8_t page = 0; (toppage + page) < bottom; page++) {
-    // for (uint8_t page = 0; page < this->PAGE_COUNT; page++) {
-        uint8_t col = 0;  // current drawing column number (in range of 0-121)
-        bool left_switched = false;
-        bool right_switched = false;
-        for (uint8_t col = 0; col < width; col++) {
-            if (!left_switched && left < 61) {
-                select_chip(true, false);
-                select_page(toppage + page);
-                select_col(left + col);
-                left_switched = true;
-
-            } else if (!right_switched && 61 <= (left+col)) {
-                select_chip(false, true);
-                select_page(toppage + page);
-                select_col((left + col) % 61);
-                select_page(toppage + page);
-                right_switched = true;
-            }
-
-            uint8_t byteoffset = (page * width) + col;
-            // 上のページから溢れた分を合成する
-            byte b = 0;
-            if (!page_aligned && (page >= 1)) {
-                // 2番目以降のページでは、上のページから溢れた分を回収する必要がある（かもしれない）
-                uint8_t prevbyteoffset = ((page-1) * width) + col;
-                uint16_t tmp = (uint16_t)(buffer[prevbyteoffset] << leftshift);
-                b |= ((uint16_t)tmp >> 8) & 0xFF;
-            }
-            if (byteoffset < buffertailoffset) {
-                if (page_aligned) {
-                    b = buffer[byteoffset];
-                } else {
-                    b |= (byte)((uint16_t)buffer[byteoffset] << leftshift);
-                }
-            }
-            send_byte(false, b);
+        if (page_aligned) {
+            // グリフの各ページはそのまま画面のページに対応する
+            this->blit_span(toppage + page, left, &buffer[(uint16_t)page * width], drawwidth);
+        } else {
+            compose_glyph_row(buffer, width, height, page, leftshift, row, drawwidth);
+            this->blit_span(toppage + page, left, row, drawwidth);
         }
-
-        // if (page == bottompage) {
-        //     break;
-        // }
     }
 }
 
 
 void Screen::draw_hline(uint8_t x, uint8_t y1, uint8_t y2) {
-    if (x >= 61) {
+    bool use_framebuffer = this->framebuffer != nullptr;
+    if (use_framebuffer && x >= SCREEN_WIDTH) {
+        return;
+    }
+    uint8_t x_in_screen = x;
+    if (use_framebuffer) {
+        // チップの選択は flush() で行う
+    } else if (x >= 61) {
         select_chip(false, true);
         x = x % 61;
     } else {
@@ -826,9 +969,14 @@ void Screen::draw_hline(uint8_t x, uint8_t y1, uint8_t y2) {
         } else {
             b = 0xFF;
         }
-        select_page(page);
-        select_col(x);
-        send_byte(false, b);
+        if (use_framebuffer) {
+            *this->framebuffer_at(page, x_in_screen) = b;
+            this->mark_dirty(page, x_in_screen, x_in_screen);
+        } else {
+            select_page(page);
+            select_col(x);
+            send_byte(false, b);
+        }
         
         if (page == bottompage) {
             break;
@@ -972,22 +1120,9 @@ void fill_or_clear_rect_pagealined(Screen* screen, uint8_t x1, uint8_t y1, uint8
             }
         }
 
-        bool left_switched = false;
-        bool right_switched = false;
-        for (uint8_t x = x1; x <= x2; x++) {
-            if (!left_switched && x < screen->SCREEN_WIDTH_PER_CHIP) {
-                screen->select_chip(true, false);
-                screen->select_page(page);
-                screen->select_col(x);
-                left_switched = true;
-            } else if (!right_switched && screen->SCREEN_WIDTH_PER_CHIP <= x) {
-                screen->select_chip(false, true);
-                screen->select_page(page);
-                screen->select_col(x % screen->SCREEN_WIDTH_PER_CHIP);
-                right_switched = true;
-            }
-            
-            screen->send_byte(false, b);
+        uint8_t right = min(x2, screen->SCREEN_WIDTH - 1);
+        if (x1 <= right) {
+            screen->fill_span(page, x1, b, right - x1 + 1);
         }
 
         if (page == bottompage) {
@@ -22,7 +22,26 @@ public:
     static constexpr uint8_t SCREEN_HEIGHT = 32;
     // 縦方向に8ドットの塊であるページが4つ並んでいる
     static constexpr uint8_t PAGE_COUNT = 4;
+    // フレームバッファのバイト数 (122 * 4 = 488)
+    static constexpr uint16_t FRAMEBUFFER_LENGTH = (uint16_t)SCREEN_WIDTH * PAGE_COUNT;
 
+// private:
+    /* 画面の内容を保持するフレームバッファ。ページごとに122バイトずつ並ぶ。
+       nullptrなら、描画はすべて直接SG12232Cへ送られる */
+    byte* framebuffer = nullptr;
+    // ページごとの、flush()されていない列の範囲（両端を含む）。変更がなければ dirty_left が INVALID_UINT8
+    uint8_t dirty_left[PAGE_COUNT];
+    uint8_t dirty_right[PAGE_COUNT];
+
+    /** フレームバッファの指定範囲を変更済みとして記録する */
+    void mark_dirty(uint8_t page, uint8_t x1, uint8_t x2);
+
+    /** フレームバッファ上の指定位置のバイトへのポインタ */
+    byte* framebuffer_at(uint8_t page, uint8_t x) {
+        return &this->framebuffer[(uint16_t)page * SCREEN_WIDTH + x];
+    }
+
+public:
     void init_pins(void);
     void send_byte(bool is_command, byte data);
     /** チップ1, 2を選択する (1: Chip1, 2: Chip2, 3: 両方) */
@@ -34,6 +53,36 @@ public:
 
     void init(void);
     void clear(void);
+
+    /** フレームバッファを有効にする。以降の描画はRAM上で行われ、flush()で画面へ転送される。
+     * 有効にした時点の画面の内容は引き継がれない（次のflush()で消去される）。
+     * @param buffer [IN] FRAMEBUFFER_LENGTH バイトの領域
+     */
+    void enable_framebuffer(byte* buffer);
+
+    /** フレームバッファを無効にし、以降は直接描画する。未転送の内容は転送してから無効にする */
+    void disable_framebuffer(void);
+
+    /** フレームバッファの変更された範囲を画面へ転送する。フレームバッファが無効なら何もしない */
+    void flush(void);
+
+    /** 1ページ分の連続した列へ、バイト列を上書きする。
+     * チップの境界での分割は1度だけ行い、チップ内は列の自動インクリメントで連続して転送する。
+     * フレームバッファが有効なら、フレームバッファへ書き込む。画面の右端を超える分は捨てる。
+     * @param page [IN] ページ (0-3)
+     * @param x [IN] 先頭の列 (0-121)
+     * @param data [IN] 列ごとのバイト列（LSBが上）
+     * @param len [IN] 列数
+     */
+    void blit_span(uint8_t page, uint8_t x, const byte* data, uint8_t len);
+
+    /** 1ページ分の連続した列を、同じバイトで上書きする。それ以外は blit_span() と同じ
+     * @param page [IN] ページ (0-3)
+     * @param x [IN] 先頭の列 (0-121)
+     * @param pattern [IN] 書き込むバイト
+     * @param len [IN] 列数
+     */
+    void fill_span(uint8_t page, uint8_t x, byte pattern, uint8_t len);
     /** 与えられたバイトをスクリーン全体に設定する */
     void fill(uint8_t pattern);
 
@@ -88,6 +137,17 @@ public:
     // ページ単位で上書き動作をする
     void draw_glyph_2(uint8_t top, uint8_t left, byte* buffer, uint8_t width, uint8_t height);
 
+    /** グリフを縦にずらして、画面の1ページ分に当たる列を組み立てる
+     * @param buffer [IN] グリフ（draw_glyph() と同じ形式）
+     * @param width [IN] グリフの幅
+     * @param height [IN] グリフの高さ
+     * @param page [IN] グリフの上端のページから数えたページ番号
+     * @param leftshift [IN] グリフの上端の、ページ内での位置 (0-7)
+     * @param row [OUT] 組み立てた列の出力先
+     * @param rowlen [IN] 組み立てる列数（先頭から）
+     */
+    static void compose_glyph_row(const byte* buffer, uint8_t width, uint8_t height, uint8_t page, uint8_t leftshift, byte* row, uint8_t rowlen);
+
     void draw_hline(uint8_t x, uint8_t y1, uint8_t y2);
 
     // void clear_pagealined(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2);
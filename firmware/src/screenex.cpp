@@ -112,6 +112,85 @@ void ScreenEx::print_at(uint8_t left, uint8_t top, const char* s) {
     this->print_at(left, top, s, strlen(s));
 }
 
+uint8_t ScreenEx::draw_text(uint8_t x, uint8_t y, const char* s, size_t len) {
+    if (!this->font || !this->font->font_loaded || x >= this->SCREEN_WIDTH || len == 0) {
+        return 0;
+    }
+    FontManager* font = this->font;
+
+    // 画面に収まりうる最大の文字数
+    uint8_t maxchars = (this->SCREEN_WIDTH - x + font->FONT_WIDTH_SINGLEBYTE - 1) / font->FONT_WIDTH_SINGLEBYTE;
+    uint8_t* kuten = (uint8_t*)alloca(maxchars * 2);
+
+    // SJISを区点の列へ解読する
+    uint8_t count = 0;
+    uint16_t textwidth = 0;
+    uint16_t glyphbyteslen = 0;
+    size_t i = 0;
+    while (i < len && count < maxchars && (x + textwidth) < this->SCREEN_WIDTH) {
+        uint8_t ku, ten;
+        if (sjis_is_first_byte(s[i])) {
+            if (i + 1 >= len) {
+                // 第2バイトがない
+                break;
+            }
+            convert_mb_to_kuten_sjis(&s[i], &ku, &ten);
+            i += 2;
+        } else {
+            ku = 0;
+            ten = s[i];
+            i += 1;
+        }
+        kuten[count * 2] = ku;
+        kuten[count * 2 + 1] = ten;
+        count++;
+        if (ku == 0) {
+            textwidth += font->FONT_WIDTH_SINGLEBYTE;
+            glyphbyteslen += font->GLYPH_LENGTH_SINGLEBYTE;
+        } else {
+            textwidth += font->FONT_WIDTH_DOUBLEBYTE;
+            glyphbyteslen += font->GLYPH_LENGTH_DOUBLEBYTE;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // グリフをまとめて取得する
+    byte* glyphs = (byte*)alloca(glyphbyteslen);
+    font->get_glyphs_from_kuten(kuten, count, glyphs);
+
+    // ページごとに1行分の列を組み立てて、まとめて転送する
+    uint8_t toppage = y / 8;
+    uint8_t bottom = min((y + font->FONT_HEIGHT + 7) / 8, this->PAGE_COUNT);
+    uint8_t leftshift = y % 8;
+    uint8_t drawwidth = min(textwidth, this->SCREEN_WIDTH - x);
+    byte* row = (byte*)alloca(drawwidth);
+
+    for (uint8_t page = 0; (toppage + page) < bottom; page++) {
+        uint8_t col = 0;
+        const byte* glyph = glyphs;
+        for (uint8_t n = 0; n < count && col < drawwidth; n++) {
+            uint8_t w;
+            uint8_t glyphlen;
+            if (kuten[n * 2] == 0) {
+                w = font->FONT_WIDTH_SINGLEBYTE;
+                glyphlen = font->GLYPH_LENGTH_SINGLEBYTE;
+            } else {
+                w = font->FONT_WIDTH_DOUBLEBYTE;
+                glyphlen = font->GLYPH_LENGTH_DOUBLEBYTE;
+            }
+            uint8_t rowlen = min(w, drawwidth - col);
+            this->compose_glyph_row(glyph, w, font->FONT_HEIGHT, page, leftshift, &row[col], rowlen);
+            col += w;
+            glyph += glyphlen;
+        }
+        this->blit_span(toppage + page, x, row, drawwidth);
+    }
+
+    return (uint8_t)min(textwidth, 0xFF);
+}
+
 void ScreenEx::print_at(uint8_t left, uint8_t top, const char* s, size_t len) {
 
     uint8_t org_left = this->cursor_left;
@@ -120,8 +199,20 @@ void ScreenEx::print_at(uint8_t left, uint8_t top, const char* s, size_t len) {
     this->cursor_left = left;
     this->cursor_top = top;
 
-    for (size_t i = 0; i < len; i++) {
-        this->put(s[i]);
+    // 改行文字の間をひとまとめにして描画する
+    size_t head = 0;
+    while (head < len) {
+        size_t tail = head;
+        while (tail < len && s[tail] != '\n' && s[tail] != '\r') {
+            tail++;
+        }
+        if (tail > head) {
+            this->cursor_left += this->draw_text(this->cursor_left, this->cursor_top, &s[head], tail - head);
+        }
+        if (tail < len) {
+            this->put(s[tail]);
+        }
+        head = tail + 1;
     }
 
     this->cursor_left = org_left;
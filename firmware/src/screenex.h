@@ -45,6 +45,17 @@ public:
     // 文字列ブロックを追加する
     void put(const char* s, size_t len);
 
+    /** 1行分の文字列をまとめて描画する。カーソル位置は変わらない。
+      SJISの解読を1度で済ませ、グリフはまとめて取得し、ページごとに1度の転送で描画する。
+      改行文字は扱わない。画面の右端をはみ出す文字は途中まで描画し、それ以降は描画しない。
+      @param x [IN] 左端
+      @param y [IN] 上端
+      @param s [IN] SJIS文字列
+      @param len [IN] 文字列のバイト数
+      @return 描画した文字の幅の合計（ドット）
+      */
+    uint8_t draw_text(uint8_t x, uint8_t y, const char* s, size_t len);
+
     void print_at(uint8_t left, uint8_t top, const char* s);
     void print_at(uint8_t left, uint8_t top, const char* s, size_t len);
     void println_at(uint8_t left, uint8_t top, const char* s);
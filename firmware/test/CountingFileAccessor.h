@@ -0,0 +1,71 @@
+#pragma once
+
+#include <FileAccessWrapper.h>
+
+
+/** 他のFileAccessWrapperを包み、読み込みとシークの回数を数える。テスト用
+ */
+class CountingFileAccessor: public FileAccessWrapper {
+public:
+
+    FileAccessWrapper* inner = nullptr;
+
+    // read(void) と read(buf, buflen) が呼ばれた回数
+    uint32_t read_calls = 0;
+    // 読み込んだバイト数の合計
+    uint32_t read_bytes = 0;
+    // seek() が呼ばれた回数
+    uint32_t seek_calls = 0;
+
+    CountingFileAccessor(FileAccessWrapper* inner) : inner(inner) { }
+
+    /** 計数をすべて0に戻す */
+    void reset_counts(void) {
+        this->read_calls = 0;
+        this->read_bytes = 0;
+        this->seek_calls = 0;
+    }
+
+    bool open(const char* path, FileMode mode) override {
+        return this->inner->open(path, mode);
+    }
+
+    bool is_opened(void) override {
+        return this->inner->is_opened();
+    }
+
+    void close(void) override {
+        this->inner->close();
+    }
+
+    int read(void) override {
+        this->read_calls += 1;
+        int ch = this->inner->read();
+        if (ch >= 0) {
+            this->read_bytes += 1;
+        }
+        return ch;
+    }
+
+    int read(uint8_t* buf, size_t buflen) override {
+        this->read_calls += 1;
+        int readlen = this->inner->read(buf, buflen);
+        if (readlen > 0) {
+            this->read_bytes += readlen;
+        }
+        return readlen;
+    }
+
+    uint32_t position(void) override {
+        return this->inner->position();
+    }
+
+    uint32_t seek(uint32_t pos) override {
+        this->seek_calls += 1;
+        return this->inner->seek(pos);
+    }
+
+    uint32_t size(void) override {
+        return this->inner->size();
+    }
+};
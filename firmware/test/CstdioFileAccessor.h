@@ -8,6 +8,7 @@ class CstdioFileAccessor: public FileAccessWrapper {
 public:
 
     FILE* file = nullptr;
+    FileMode mode = FileMode::READ;
 
     /** ファイルを開く
      * @param path ファイルのパス（プラットフォーム依存）
@@ -15,8 +16,14 @@ public:
      * @return ファイルを開けたらtrue、開けなかったらfalse
      */
     bool open(const char* path, FileMode mode) override {
-        assert(mode == FileMode::READ);
-        this->file = fopen(path, "rb");
+        const char* fmode = "rb";
+        if (mode == FileMode::WRITE) {
+            fmode = "w+b";
+        } else if (mode == FileMode::READWRITE) {
+            fmode = "a+b";
+        }
+        this->file = fopen(path, fmode);
+        this->mode = mode;
         return this->file != nullptr;
     }
 
@@ -63,4 +70,40 @@ public:
         fseek(this->file, pos, SEEK_SET);
         return this->position();
     }
+
+    /** ファイルの大きさを取得する
+     * @return ファイルのバイト数
+     */
+    virtual uint32_t size(void) {
+        long pos = ftell(this->file);
+        fseek(this->file, 0, SEEK_END);
+        uint32_t filesize = (uint32_t)ftell(this->file);
+        fseek(this->file, pos, SEEK_SET);
+        return filesize;
+    }
+
+    /** 指定バイト数をまとめて読み込む
+     * @return 読み込めたバイト数
+     */
+    virtual int read(uint8_t* buf, size_t buflen) {
+        return (int)fread(buf, 1, buflen, this->file);
+    }
+
+    /** 指定バイト数を書き込む（ FileMode::READWRITE では末尾へ追記される）
+     * @return 書き込めたバイト数
+     */
+    virtual int write(const uint8_t* buf, size_t buflen) {
+        if (this->mode == FileMode::READ) {
+            return -1;
+        }
+        if (this->mode == FileMode::READWRITE) {
+            // 読み込みから書き込みへ切り替える前には位置づけが必要
+            fseek(this->file, 0, SEEK_END);
+        }
+        return (int)fwrite(buf, 1, buflen, this->file);
+    }
+
+    virtual bool flush(void) {
+        return fflush(this->file) == 0;
+    }
 };
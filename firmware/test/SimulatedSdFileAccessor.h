@@ -0,0 +1,192 @@
+#pragma once
+
+#include <FileAccessWrapper.h>
+
+
+/** 他のFileAccessWrapperを包み、実機のSDカードで同じ読み込みをしたときの所要時間を見積もる。テスト用
+ * Arduino SDライブラリ（ SdFile / SdVolume ）の振る舞いを模す。
+ *   - カードからは512バイトのセクタ単位で読む。キャッシュはFATとデータで共用の1セクタだけ
+ *   - クラスタをまたぐ読み込みでは、FATを引いて次のクラスタを得る
+ *   - 後ろへのシークでは、ファイル先頭のクラスタからFATをたどりなおす
+ * ファイルはクラスタが連続して並んでいるものとする。書き込みは見積もらずにそのまま渡す。
+ */
+class SimulatedSdFileAccessor: public FileAccessWrapper {
+public:
+    static constexpr uint16_t SECTOR_SIZE = 512;
+
+    /** 見積もりに用いる値。既定値は実機（ATmega4809 16MHz）を想定したおおよその値 */
+    struct Params {
+        // SPIのクロック [Hz] 。既定値は実機の値
+        // main.cpp は SD.begin(PIN_SD_CS) で初期化するので、 SPI_SD_CLOCK ではなく
+        // ライブラリ既定の SPI_HALF_SPEED （16MHzのAVRで F_CPU / 4 = 4MHz）で動く
+        uint32_t spi_clock = 16000000UL / 4;
+        // SPIで1バイトを送受信するたびのソフトウェアのオーバーヘッド [usec]
+        double spi_byte_overhead_usec = 0.5;
+        // セクタ読み込みのコマンド発行から、データトークンが来るまでの待ち [usec]
+        double command_usec = 300;
+        // read(void) の1回ぶんのオーバーヘッド [usec]
+        double read_call_usec = 8;
+        // read(buf, buflen) でキャッシュからコピーする1バイトあたり [usec]
+        double copy_byte_usec = 0.3;
+        // seek() の1回ぶんのオーバーヘッド [usec]
+        double seek_call_usec = 10;
+        // 1クラスタのセクタ数（32KiBクラスタのFAT32なら64）
+        uint16_t sectors_per_cluster = 64;
+        // FATの1セクタに載るクラスタの数（FAT32なら128）
+        uint16_t fat_entries_per_sector = 128;
+        // ファイルの最初のクラスタの番号
+        uint32_t first_cluster = 2;
+    };
+
+    FileAccessWrapper* inner = nullptr;
+    Params params;
+
+    // 見積もった所要時間の合計と、直前の操作の所要時間 [usec]
+    double elapsed_usec = 0;
+    double last_usec = 0;
+    // カードからデータのセクタを読んだ回数と、FATのセクタを読んだ回数
+    uint32_t sector_reads = 0;
+    uint32_t fat_reads = 0;
+
+// private:
+    // キャッシュにあるセクタ。FATのセクタは最上位ビットを立てて区別する。空ならINVALID
+    static constexpr uint32_t FAT_SECTOR_FLAG = 0x80000000UL;
+    static constexpr uint32_t INVALID_SECTOR = 0xFFFFFFFFUL;
+    uint32_t cached_sector = INVALID_SECTOR;
+    // SdFileが現在位置として把握しているクラスタ（ファイル内での番号）
+    uint32_t current_cluster = 0;
+    // ファイルのバイト数。読み込みのたびに inner->size() を呼ぶと遅いので覚えておく
+    uint32_t filesize = 0;
+
+public:
+    SimulatedSdFileAccessor(FileAccessWrapper* inner) : inner(inner) { }
+
+    SimulatedSdFileAccessor(FileAccessWrapper* inner, const Params& params) : inner(inner), params(params) { }
+
+    /** 見積もりを0に戻す。キャッシュの状態は保つ */
+    void reset_stats(void) {
+        this->elapsed_usec = 0;
+        this->last_usec = 0;
+        this->sector_reads = 0;
+        this->fat_reads = 0;
+    }
+
+    /** キャッシュを空にする（別のファイルを読んだあとを模す） */
+    void invalidate(void) {
+        this->cached_sector = INVALID_SECTOR;
+    }
+
+    /** 1セクタをカードから読む時間 [usec] 。CRCの2バイトを含む */
+    double get_sector_fetch_usec(void) {
+        double byte_usec = 8.0 * 1000000.0 / this->params.spi_clock + this->params.spi_byte_overhead_usec;
+        return this->params.command_usec + (SECTOR_SIZE + 2) * byte_usec;
+    }
+
+    bool open(const char* path, FileMode mode) override {
+        this->current_cluster = 0;
+        if (!this->inner->open(path, mode)) {
+            return false;
+        }
+        this->filesize = this->inner->size();
+        return true;
+    }
+
+    bool is_opened(void) override {
+        return this->inner->is_opened();
+    }
+
+    void close(void) override {
+        this->inner->close();
+    }
+
+    int read(void) override {
+        this->last_usec = this->params.read_call_usec;
+        uint32_t pos = this->inner->position();
+        if (pos < this->filesize) {
+            this->access_bytes(pos, 1);
+        }
+        this->elapsed_usec += this->last_usec;
+        return this->inner->read();
+    }
+
+    int read(uint8_t* buf, size_t buflen) override {
+        this->last_usec = this->params.read_call_usec;
+        uint32_t pos = this->inner->position();
+        if (pos + buflen > this->filesize) {
+            buflen = pos < this->filesize ? this->filesize - pos : 0;
+        }
+        this->access_bytes(pos, buflen);
+        this->last_usec += buflen * this->params.copy_byte_usec;
+        this->elapsed_usec += this->last_usec;
+        return this->inner->read(buf, buflen);
+    }
+
+    uint32_t position(void) override {
+        return this->inner->position();
+    }
+
+    uint32_t seek(uint32_t pos) override {
+        this->last_usec = this->params.seek_call_usec;
+        uint32_t cluster = this->get_cluster_of(pos);
+        if (cluster < this->current_cluster) {
+            // SdFile::seekSet() は後ろへ戻るとき、先頭のクラスタからたどりなおす
+            this->current_cluster = 0;
+        }
+        this->walk_clusters_to(cluster);
+        this->elapsed_usec += this->last_usec;
+        return this->inner->seek(pos);
+    }
+
+    uint32_t size(void) override {
+        return this->filesize;
+    }
+
+    int write(const uint8_t* buf, size_t buflen) override {
+        int writelen = this->inner->write(buf, buflen);
+        this->filesize = this->inner->size();
+        return writelen;
+    }
+
+    bool flush(void) override {
+        return this->inner->flush();
+    }
+
+// private:
+    uint32_t get_cluster_of(uint32_t pos) {
+        return pos / ((uint32_t)SECTOR_SIZE * this->params.sectors_per_cluster);
+    }
+
+    /** セクタがキャッシュになければ読み込んだものとして時間を足す */
+    void touch_sector(uint32_t sector) {
+        if (this->cached_sector == sector) {
+            return;
+        }
+        this->cached_sector = sector;
+        if (sector & FAT_SECTOR_FLAG) {
+            this->fat_reads += 1;
+        } else {
+            this->sector_reads += 1;
+        }
+        this->last_usec += this->get_sector_fetch_usec();
+    }
+
+    /** 現在のクラスタから指定クラスタまで、FATをたどる */
+    void walk_clusters_to(uint32_t cluster) {
+        while (this->current_cluster < cluster) {
+            uint32_t fatsector = (this->params.first_cluster + this->current_cluster) / this->params.fat_entries_per_sector;
+            this->touch_sector(FAT_SECTOR_FLAG | fatsector);
+            this->current_cluster += 1;
+        }
+    }
+
+    /** 指定位置から指定バイト数を読むときの、FATとデータのセクタの読み込みを見積もる */
+    void access_bytes(uint32_t pos, size_t len) {
+        uint32_t end = pos + len;
+        while (pos < end) {
+            this->walk_clusters_to(this->get_cluster_of(pos));
+            uint32_t sector = pos / SECTOR_SIZE;
+            this->touch_sector(sector);
+            pos = (sector + 1) * SECTOR_SIZE;
+        }
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string.h>
+
+#include <FileAccessWrapper.h>
+#include <candidatereader.h>
+
+
+// テスト用のSKD辞書を書き出し、変換候補を読み出すための関数。
+// ASCIIをShift_JISの代わりに使う（エンジンはバイトを比べるだけなので）。
+
+
+/** いまの変換候補の残りをすべて読み、NUL終端して書き出す
+ * @param reader [IN]
+ * @param dst [OUT] 候補の長さ + 1 の領域が必要
+ */
+static inline void read_candidate(SKK::CandidateReader* reader, char* dst) {
+    int ch;
+    while ((ch = reader->read()) >= 0) {
+        *dst++ = (char)ch;
+    }
+    *dst = '\0';
+}
+
+/** SKDのヘッダ（コメントなし）を書く
+ * @param out [IN] 書き込みで開いたファイル
+ * @param filesize [IN] ファイル全体のバイト数
+ * @param yomiganamaxlen [IN] 読みの最大バイト数
+ */
+static inline void write_skd_header(FileAccessWrapper* out, uint32_t filesize, uint16_t yomiganamaxlen) {
+    out->write((const uint8_t*)"SKD", 3);
+    out->write_uint24(filesize);
+    out->write_uint16(0);
+    out->write_uint16(yomiganamaxlen);
+}
+
+/** セクションの見出しを書く
+ * @param out [IN] 書き込みで開いたファイル
+ * @param type [IN] "IDX" などの3文字
+ * @param len [IN] 見出しに続く中身のバイト数
+ */
+static inline void write_skd_section_head(FileAccessWrapper* out, const char* type, uint32_t len) {
+    out->write((const uint8_t*)type, 3);
+    out->write_uint24(len);
+}
+
+/** 'IDX' の項目を1つ書く
+ * @param out [IN] 書き込みで開いたファイル
+ * @param yomigana [IN]
+ * @param addr [IN] 読みの項目（またはブロック）のファイル上の位置
+ */
+static inline void write_skd_index_item(FileAccessWrapper* out, const char* yomigana, uint32_t addr) {
+    uint8_t len = (uint8_t)strlen(yomigana);
+    out->write_uint8(len);
+    out->write((const uint8_t*)yomigana, len);
+    out->write_uint24(addr);
+}
+
+/** 'IDX' に読みが1つだけある、 'IDX' と 'TBL' からなるSKDを書く
+ * @param out [IN] 書き込みで開いたファイル。閉じるのは呼び出し元
+ * @param yomigana [IN] 'IDX' に載せる読み（ 'TBL' の最初の項目の読み）
+ * @param table [IN] 'TBL' の中身（読みの項目の並び）
+ * @param tablelen [IN]
+ */
+static inline void write_skd_single_table(FileAccessWrapper* out, const char* yomigana, const uint8_t* table, uint32_t tablelen) {
+    uint8_t len = (uint8_t)strlen(yomigana);
+    uint32_t tablehead = 10 + 6 + (1 + len + 3) + 6;
+    write_skd_header(out, tablehead + tablelen, len);
+    write_skd_section_head(out, "IDX", 1 + len + 3);
+    write_skd_index_item(out, yomigana, tablehead);
+    write_skd_section_head(out, "TBL", tablelen);
+    out->write(table, tablelen);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <debug.h>
+#include <profile.h>
 
 #include <unity.h>
 
@@ -8,9 +9,17 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include <chrono>
+
+// Set true to suppress DEBUG() output, e.g. while measuring time
+bool debug_impl_quiet = false;
+
 // --- Required by debug.h
 
 void debug_printf(const char* format, ...) {
+    if (debug_impl_quiet) {
+        return;
+    }
     constexpr size_t buflen = 255;
     char buf[buflen];
 
@@ -23,7 +32,15 @@ void debug_printf(const char* format, ...) {
 }
 
 unsigned long millis(void) {
-    return 0;
+    static const auto start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// --- Required by profile.h
+
+unsigned long micros(void) {
+    static const auto start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
 }
 
 void panic(char const* filename, char const* funcname, int lineno, char const* mes) {
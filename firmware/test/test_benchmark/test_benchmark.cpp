@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../CountingFileAccessor.h"
+#include "../SimulatedSdFileAccessor.h"
+#include <BufferedFileAccessor.h>
+
+#include <skkdict.h>
+#include <skkengine.h>
+
+/* Replays the yomigana in corpus.txt through SkkEngine::henkan() and reports,
+   for each lookup, the wall time, the file accesses seen by CountingFileAccessor
+   and the time SimulatedSdFileAccessor estimates for the device.
+   Nothing here is a pass/fail threshold: compare the numbers before and after a change.
+
+   The dictionaries are the ones used by test_skk. Set SKK_BENCHMARK_DICT to benchmark
+   another SKD file as well (e.g. one converted with "sorted blocks").
+ */
+
+// NOTE: test is executed on the root of this project.
+const char* FILEPATH_CORPUS = "test/test_benchmark/corpus.txt";
+const char* FILEPATH_DICTS[] = {
+    "test/test_skk/test_skkdict.skd",
+    "test/test_skk/test_skkdict_sorted.skd",
+};
+
+// Each lookup is repeated and the fastest run is reported, to hide the noise of the host
+static constexpr int REPEAT_COUNT = 5;
+
+static constexpr size_t CORPUS_BUFFER_SIZE = 4096;
+static constexpr size_t MAX_CORPUS_ENTRIES = 256;
+static char corpus_buffer[CORPUS_BUFFER_SIZE];
+static const char* corpus_entries[MAX_CORPUS_ENTRIES];
+static uint8_t corpus_lengths[MAX_CORPUS_ENTRIES];
+static size_t corpus_count = 0;
+
+// Result of the first dictionary, to check that every dictionary finds the same entries
+static bool reference_found[MAX_CORPUS_ENTRIES];
+static uint8_t reference_counts[MAX_CORPUS_ENTRIES];
+static bool has_reference = false;
+
+
+/** Result of one lookup */
+struct LookupStats {
+    bool found;
+    uint8_t candidates;
+    double usec;
+    double device_usec;
+    uint32_t sector_reads;
+    uint32_t read_bytes;
+    uint32_t read_calls;
+    uint32_t seek_calls;
+};
+
+
+/** Load the corpus. Empty lines and lines starting with ';' are skipped */
+static bool load_corpus(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+    size_t len = fread(corpus_buffer, 1, CORPUS_BUFFER_SIZE - 1, fp);
+    fclose(fp);
+    corpus_buffer[len] = '\0';
+
+    corpus_count = 0;
+    char* line = corpus_buffer;
+    while (*line != '\0' && corpus_count < MAX_CORPUS_ENTRIES) {
+        char* next = strchr(line, '\n');
+        if (next != nullptr) {
+            *next = '\0';
+        }
+        size_t linelen = strlen(line);
+        while (linelen > 0 && line[linelen - 1] == '\r') {
+            line[--linelen] = '\0';
+        }
+        if (linelen > 0 && line[0] != ';') {
+            corpus_entries[corpus_count] = line;
+            corpus_lengths[corpus_count] = (uint8_t)linelen;
+            corpus_count += 1;
+        }
+        if (next == nullptr) {
+            break;
+        }
+        line = next + 1;
+    }
+    return corpus_count > 0;
+}
+
+
+/** Look up one yomigana. The buffers are emptied before each run so that every run reads the same */
+static LookupStats lookup(SKK::SkkEngine* engine, CountingFileAccessor* counter, SimulatedSdFileAccessor* simulated, BufferedFileAccessor* buffered, const char* yomigana, size_t yomiganalen) {
+    LookupStats stats = {};
+    for (int i = 0; i < REPEAT_COUNT; i++) {
+        SKK::CandidateReader reader;
+        if (buffered != nullptr) {
+            buffered->invalidate();
+        }
+        simulated->invalidate();
+        simulated->reset_stats();
+        counter->reset_counts();
+        auto start = std::chrono::steady_clock::now();
+        bool found = engine->henkan(yomigana, yomiganalen, &reader);
+        auto end = std::chrono::steady_clock::now();
+        double usec = std::chrono::duration<double, std::micro>(end - start).count();
+        if (i == 0 || usec < stats.usec) {
+            stats.usec = usec;
+        }
+        if (i == 0) {
+            stats.found = found;
+            stats.candidates = found ? reader.get_candidates_count() : 0;
+            stats.read_bytes = counter->read_bytes;
+            stats.read_calls = counter->read_calls;
+            stats.seek_calls = counter->seek_calls;
+            stats.device_usec = simulated->elapsed_usec;
+            stats.sector_reads = simulated->sector_reads + simulated->fat_reads;
+        }
+    }
+    return stats;
+}
+
+
+/** Benchmark one dictionary. The accesses are counted below the optional BufferedFileAccessor,
+ * so that the numbers are those that reach the SD card.
+ */
+static void benchmark_dict(const char* path, bool buffered) {
+    CstdioFileAccessor file;
+    CountingFileAccessor counter(&file);
+    SimulatedSdFileAccessor simulated(&counter);
+    BufferedFileAccessor bufferedfile;
+    static uint8_t sectorbuffer[BufferedFileAccessor::SECTOR_SIZE * 2];
+    FileAccessWrapper* dictfile = &simulated;
+
+    if (!simulated.open(path, FileAccessWrapper::FileMode::READ)) {
+        printf("benchmark: %s not found, skipped.\n", path);
+        return;
+    }
+    if (buffered) {
+        TEST_ASSERT_TRUE(bufferedfile.init(&simulated, sectorbuffer, sizeof(sectorbuffer)));
+        dictfile = &bufferedfile;
+    }
+    SKK::SkkDict dict;
+    SKK::SkkEngine engine;
+    TEST_ASSERT_TRUE(dict.init(dictfile));
+    TEST_ASSERT_TRUE(engine.init());
+    TEST_ASSERT_TRUE(engine.set_sysdict(&dict));
+
+    debug_impl_quiet = true;
+    printf("benchmark: %s%s, device estimate at SPI %lu Hz\n", path, buffered ? " (buffered)" : "", (unsigned long)simulated.params.spi_clock);
+    printf("  #   found cand      usec    bytes    reads    seeks  sectors  device[usec]\n");
+    LookupStats total = {};
+    double max_usec = 0;
+    double max_device_usec = 0;
+    uint32_t max_bytes = 0;
+    for (size_t i = 0; i < corpus_count; i++) {
+        LookupStats stats = lookup(&engine, &counter, &simulated, buffered ? &bufferedfile : nullptr, corpus_entries[i], corpus_lengths[i]);
+        printf("%3d %7d %4d %9.1f %8u %8u %8u %8u %13.0f\n", (int)i, (int)stats.found, (int)stats.candidates,
+               stats.usec, (unsigned)stats.read_bytes, (unsigned)stats.read_calls, (unsigned)stats.seek_calls,
+               (unsigned)stats.sector_reads, stats.device_usec);
+        total.usec += stats.usec;
+        total.device_usec += stats.device_usec;
+        total.sector_reads += stats.sector_reads;
+        total.read_bytes += stats.read_bytes;
+        total.read_calls += stats.read_calls;
+        total.seek_calls += stats.seek_calls;
+        if (stats.usec > max_usec) {
+            max_usec = stats.usec;
+        }
+        if (stats.device_usec > max_device_usec) {
+            max_device_usec = stats.device_usec;
+        }
+        if (stats.read_bytes > max_bytes) {
+            max_bytes = stats.read_bytes;
+        }
+
+        if (!has_reference) {
+            reference_found[i] = stats.found;
+            reference_counts[i] = stats.candidates;
+        } else {
+            TEST_ASSERT_EQUAL(reference_found[i], stats.found);
+            TEST_ASSERT_EQUAL(reference_counts[i], stats.candidates);
+        }
+    }
+    has_reference = true;
+    debug_impl_quiet = false;
+
+    printf("  average: %.1f usec, %.1f bytes, %.1f reads, %.1f seeks / max: %.1f usec, %u bytes\n",
+           total.usec / corpus_count, (double)total.read_bytes / corpus_count,
+           (double)total.read_calls / corpus_count, (double)total.seek_calls / corpus_count,
+           max_usec, (unsigned)max_bytes);
+    printf("  device estimate: average %.0f usec, %.1f sectors / max %.0f usec\n",
+           total.device_usec / corpus_count, (double)total.sector_reads / corpus_count, max_device_usec);
+}
+
+
+/** Check the SD model with a file of 3 clusters of 1 sector each */
+void test_benchmark_simulated_sd(void) {
+    const char* path = "test_benchmark_simulated_sd.bin";
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(path, FileAccessWrapper::FileMode::WRITE));
+    static uint8_t data[SimulatedSdFileAccessor::SECTOR_SIZE * 3];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+    out.write(data, sizeof(data));
+    out.close();
+
+    SimulatedSdFileAccessor::Params params;
+    params.sectors_per_cluster = 1;
+    CstdioFileAccessor file;
+    SimulatedSdFileAccessor simulated(&file, params);
+    TEST_ASSERT_TRUE(simulated.open(path, FileAccessWrapper::FileMode::READ));
+    double fetch = simulated.get_sector_fetch_usec();
+
+    // Reading within the cached sector costs only the call
+    TEST_ASSERT_EQUAL(0, simulated.read());
+    TEST_ASSERT_EQUAL(1, simulated.sector_reads);
+    TEST_ASSERT_EQUAL(1, simulated.read());
+    TEST_ASSERT_EQUAL(1, simulated.sector_reads);
+    TEST_ASSERT_TRUE(simulated.last_usec < fetch);
+
+    // Crossing into the next cluster reads the FAT, which evicts the data sector
+    uint8_t buf[SimulatedSdFileAccessor::SECTOR_SIZE];
+    TEST_ASSERT_EQUAL((int)sizeof(buf), simulated.read(buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL(2, buf[0]);
+    TEST_ASSERT_EQUAL(2, simulated.sector_reads);
+    TEST_ASSERT_EQUAL(1, simulated.fat_reads);
+    TEST_ASSERT_EQUAL(0, buf[510]);
+
+    // Seeking back walks the cluster chain from the head of the file
+    simulated.reset_stats();
+    simulated.seek(SimulatedSdFileAccessor::SECTOR_SIZE * 2);
+    simulated.seek(SimulatedSdFileAccessor::SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(1, simulated.fat_reads);
+    // The data sector was evicted by the FAT
+    TEST_ASSERT_EQUAL(0, simulated.read());
+    TEST_ASSERT_EQUAL(1, simulated.sector_reads);
+    TEST_ASSERT_TRUE(simulated.elapsed_usec > fetch * 2);
+
+    file.close();
+    remove(path);
+}
+
+
+void test_benchmark_henkan(void) {
+    TEST_ASSERT_TRUE(load_corpus(FILEPATH_CORPUS));
+    has_reference = false;
+    for (size_t i = 0; i < sizeof(FILEPATH_DICTS) / sizeof(FILEPATH_DICTS[0]); i++) {
+        benchmark_dict(FILEPATH_DICTS[i], false);
+    }
+    benchmark_dict(FILEPATH_DICTS[0], true);
+
+    // Another dictionary may have different entries, so it is not compared with the reference
+    const char* extra = getenv("SKK_BENCHMARK_DICT");
+    if (extra != nullptr) {
+        has_reference = false;
+        benchmark_dict(extra, false);
+        benchmark_dict(extra, true);
+    }
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_benchmark_simulated_sd);
+    RUN_TEST(test_benchmark_henkan);
+
+    return UNITY_END();
+}
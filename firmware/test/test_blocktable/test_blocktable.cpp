@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../SkdTestUtil.h"
+
+#include <skkdict.h>
+#include <candidatereader.h>
+#include <skkengine.h>
+
+// The file is created in the working directory and removed after each test.
+const char* FILEPATH_DICT = "test_blocktable.skd";
+
+
+/** Write an SKD whose table is 'TBZ' with 32-byte blocks and one phrase (0x00 = "XY")
+ *   block 0 : "AB" -> "XYZ", "AC" -> "Q", "XY", "AD" -> "R"   ("AC" and "AD" share "A" with the previous entry)
+ *   block 1 : "B"  -> "\x82\xF1XY"   (does not fit in block 0, so block 0 is padded. 0xF1 is a trail byte here, not a phrase code)
+ */
+static void write_blocktable_dict(void) {
+    const uint8_t blocks[] = {
+        // block 0 (64)
+        0, 2, 'A', 'B', 1, 3, 0, 3, 0x00, 'Z',
+        1, 1, 'C', 2, 4, 0, 1, 'Q', 2, 0x00,
+        1, 1, 'D', 1, 2, 0, 1, 'R',
+        0xFF, 0xFF, 0xFF, 0xFF,
+        // block 1 (96)
+        0, 1, 'B', 1, 4, 0, 4, 0x82, 0xF1, 0x00
+    };
+    const uint32_t blockshead = 64;
+    const uint32_t filesize = blockshead + sizeof(blocks);
+
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(FILEPATH_DICT, FileAccessWrapper::FileMode::WRITE));
+    write_skd_header(&out, filesize, 2);
+    write_skd_section_head(&out, "IDX", 5 * 2);
+    write_skd_index_item(&out, "A", blockshead);
+    write_skd_index_item(&out, "B", blockshead + 32);
+    write_skd_section_head(&out, "TBZ", filesize - 32);
+    out.write_uint16(32);
+    out.write_uint8(1);
+    out.write_uint16(3);
+    out.write((const uint8_t*)"\x02XY", 3);
+    // Padding up to the first block
+    const uint8_t padding[blockshead - 40] = { 0 };
+    out.write(padding, sizeof(padding));
+    out.write(blocks, sizeof(blocks));
+    out.close();
+}
+
+
+void test_blocktable_lookup(void) {
+    write_blocktable_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+    TEST_ASSERT_TRUE(dict.table_type == SKK::SkkDict::TableType::Blocks);
+    TEST_ASSERT_EQUAL(64, dict.table_head);
+    SKK::SkkEngine skk;
+    skk.init();
+    skk.set_sysdict(&dict);
+
+    char buf[16];
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(skk.henkan("AB", 2, &reader));
+    TEST_ASSERT_EQUAL(3, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("XYZ", buf);
+
+    // Rebuilt from the previous entry
+    TEST_ASSERT_TRUE(skk.henkan("AC", 2, &reader));
+    TEST_ASSERT_EQUAL(2, reader.get_candidates_count());
+    // Skip the first candidate without reading it
+    reader.move_next();
+    TEST_ASSERT_EQUAL(2, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("XY", buf);
+    reader.move_head();
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("Q", buf);
+
+    TEST_ASSERT_TRUE(skk.henkan("AD", 2, &reader));
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("R", buf);
+
+    TEST_ASSERT_TRUE(skk.henkan("B", 1, &reader));
+    TEST_ASSERT_EQUAL(4, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("\x82\xF1XY", buf);
+
+    TEST_ASSERT_FALSE(skk.henkan("AE", 2, &reader));
+    TEST_ASSERT_FALSE(skk.henkan("BA", 2, &reader));
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+void test_blocktable_skip_padding(void) {
+    write_blocktable_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+
+    char buf[16];
+    SKK::CandidateReader reader;
+    // Scan from block 0 without the index
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(dict.table_head, false, 0, "B", 1, &reader));
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("\x82\xF1XY", buf);
+    TEST_ASSERT_FALSE(dict.search_henkanentry_for(dict.table_head, false, 0, "C", 1, &reader));
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+void test_blocktable_prefetched(void) {
+    write_blocktable_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+
+    char buf[16];
+    uint8_t prefetchbuffer[16];
+    SKK::CandidateReader reader;
+    reader.set_prefetch_buffer(prefetchbuffer, sizeof(prefetchbuffer));
+    // Phrase codes are expanded from the prefetched block
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(dict.table_head, false, 0, "AC", 2, &reader));
+    TEST_ASSERT_TRUE(reader.is_prefetched());
+    TEST_ASSERT_TRUE(reader.move_to(2));
+    TEST_ASSERT_EQUAL(2, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("XY", buf);
+    TEST_ASSERT_TRUE(reader.move_prev());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("Q", buf);
+
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(dict.table_head, false, 0, "B", 1, &reader));
+    TEST_ASSERT_TRUE(reader.is_prefetched());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("\x82\xF1XY", buf);
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_blocktable_lookup);
+    RUN_TEST(test_blocktable_skip_padding);
+    RUN_TEST(test_blocktable_prefetched);
+
+    return UNITY_END();
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../CountingFileAccessor.h"
+#include "../SkdTestUtil.h"
+
+#include <skkdict.h>
+#include <candidatereader.h>
+
+// The file is created in the working directory and removed after each test.
+const char* FILEPATH_DICT = "test_candidatereader.skd";
+
+// Candidates of "AB" in the dictionary, in file order
+static const char* const CANDIDATES[] = { "1", "22", "333", "4", "55" };
+static constexpr uint8_t CANDIDATES_COUNT = 5;
+// Bytes of the candidates block: length byte + candidate
+static constexpr uint16_t CANDIDATES_LEN = 5 + 1 + 2 + 3 + 1 + 2;
+
+
+/** Write an SKD with "AB" -> CANDIDATES in 'TBL' */
+static void write_dict(void) {
+    uint8_t table[1 + 2 + 1 + 2 + CANDIDATES_LEN] = { 2, 'A', 'B', CANDIDATES_COUNT, (uint8_t)CANDIDATES_LEN, 0 };
+    uint16_t pos = 6;
+    for (uint8_t i = 0; i < CANDIDATES_COUNT; i++) {
+        uint8_t len = (uint8_t)strlen(CANDIDATES[i]);
+        table[pos++] = len;
+        memcpy(&table[pos], CANDIDATES[i], len);
+        pos += len;
+    }
+
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(FILEPATH_DICT, FileAccessWrapper::FileMode::WRITE));
+    write_skd_single_table(&out, "AB", table, sizeof(table));
+    out.close();
+}
+
+
+/** Move around and check each candidate. expected[i] is the candidate at index i + 1 */
+static void check_navigation(SKK::CandidateReader* reader, const char* const* expected, uint8_t count) {
+    char buf[16];
+    TEST_ASSERT_EQUAL(count, reader->get_candidates_count());
+    // Forward, reading only part of some candidates
+    reader->move_head();
+    for (uint8_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL(i + 1, reader->get_current_index());
+        TEST_ASSERT_EQUAL(strlen(expected[i]), reader->get_current_candidate_length());
+        if (i % 2 == 0) {
+            read_candidate(reader, buf);
+            TEST_ASSERT_EQUAL_STRING(expected[i], buf);
+        } else {
+            reader->read();
+        }
+        reader->move_next();
+    }
+    TEST_ASSERT_TRUE(reader->is_reached_end());
+
+    // Backward
+    TEST_ASSERT_TRUE(reader->move_to(count));
+    for (uint8_t i = count; i >= 1; i--) {
+        TEST_ASSERT_EQUAL(i, reader->get_current_index());
+        read_candidate(reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[i - 1], buf);
+        TEST_ASSERT_EQUAL(i > 1, reader->move_prev());
+    }
+
+    // Jumps
+    const uint8_t jumps[] = { 3, 1, count, 2, 2 };
+    for (size_t i = 0; i < sizeof(jumps); i++) {
+        TEST_ASSERT_TRUE(reader->move_to(jumps[i]));
+        read_candidate(reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[jumps[i] - 1], buf);
+    }
+    TEST_ASSERT_FALSE(reader->move_to(0));
+    TEST_ASSERT_FALSE(reader->move_to(count + 1));
+}
+
+
+static void run_navigation(uint8_t* buffer, uint16_t bufferlen, bool expect_prefetched) {
+    write_dict();
+    CstdioFileAccessor file;
+    CountingFileAccessor counter(&file);
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(counter.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&counter));
+
+    SKK::CandidateReader reader;
+    reader.set_prefetch_buffer(buffer, bufferlen);
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(0, false, 0, "AB", 2, &reader));
+    TEST_ASSERT_EQUAL(expect_prefetched, reader.is_prefetched());
+
+    counter.reset_counts();
+    check_navigation(&reader, CANDIDATES, CANDIDATES_COUNT);
+    if (expect_prefetched) {
+        // Everything is served from RAM
+        TEST_ASSERT_EQUAL(0, counter.read_calls);
+        TEST_ASSERT_EQUAL(0, counter.seek_calls);
+    }
+
+    // Learned and recently selected candidates come first
+    reader.set_pinned("9", 1);
+    const uint8_t preferred[] = { 3 };
+    reader.set_preferred(preferred, 1);
+    const char* const reordered[] = { "9", "333", "1", "22", "4", "55" };
+    check_navigation(&reader, reordered, CANDIDATES_COUNT + 1);
+
+    // A pinned candidate found in the dictionary is not repeated
+    reader.set_pinned("4", 1);
+    reader.set_preferred(preferred, 1);
+    const char* const deduplicated[] = { "4", "333", "1", "22", "55" };
+    check_navigation(&reader, deduplicated, CANDIDATES_COUNT);
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+void test_candidatereader_prefetched(void) {
+    static uint8_t buffer[CANDIDATES_COUNT * 2 + CANDIDATES_LEN];
+    run_navigation(buffer, sizeof(buffer), true);
+}
+
+
+void test_candidatereader_streaming(void) {
+    run_navigation(nullptr, 0, false);
+}
+
+
+void test_candidatereader_fallback(void) {
+    // One byte short of the offsets and the block
+    static uint8_t buffer[CANDIDATES_COUNT * 2 + CANDIDATES_LEN - 1];
+    run_navigation(buffer, sizeof(buffer), false);
+}
+
+
+void test_candidatereader_streaming_same_index(void) {
+    write_dict();
+    CstdioFileAccessor file;
+    CountingFileAccessor counter(&file);
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(counter.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&counter));
+
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(0, false, 0, "AB", 2, &reader));
+    TEST_ASSERT_FALSE(reader.is_prefetched());
+    TEST_ASSERT_TRUE(reader.move_to(3));
+
+    // Nothing read yet: the file position is already right
+    counter.reset_counts();
+    TEST_ASSERT_TRUE(reader.move_to(3));
+    TEST_ASSERT_EQUAL(0, counter.read_calls);
+    TEST_ASSERT_EQUAL(0, counter.seek_calls);
+
+    // Partly read: seek back to the head of the candidate, not of the entry
+    reader.read();
+    reader.read();
+    counter.reset_counts();
+    TEST_ASSERT_TRUE(reader.move_to(3));
+    TEST_ASSERT_EQUAL(1, counter.read_calls);
+    TEST_ASSERT_EQUAL(1, counter.seek_calls);
+    char buf[16];
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING(CANDIDATES[2], buf);
+    TEST_ASSERT_EQUAL(3, reader.get_current_index());
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+void test_candidatereader_move_to_offset(void) {
+    write_dict();
+    CstdioFileAccessor file;
+    CountingFileAccessor counter(&file);
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(counter.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&counter));
+
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(0, false, 0, "AB", 2, &reader));
+    TEST_ASSERT_FALSE(reader.is_prefetched());
+    // Return the 4th candidate first: 4, 1, 2, 3, 5
+    const uint8_t preferred[] = { 4 };
+    reader.set_preferred(preferred, 1);
+    const char* const expected[] = { "4", "1", "22", "333", "55" };
+
+    uint16_t offsets[CANDIDATES_COUNT];
+    reader.move_head();
+    for (uint8_t i = 0; i < CANDIDATES_COUNT; i++) {
+        offsets[i] = reader.get_current_offset();
+        TEST_ASSERT_NOT_EQUAL(INVALID_UINT16, offsets[i]);
+        reader.move_next();
+    }
+    TEST_ASSERT_EQUAL(INVALID_UINT16, reader.get_current_offset());
+
+    // Jumping back to a known offset is one seek and one read, wherever the reader is
+    const uint8_t jumps[] = { 4, 2, 5, 1, 3 };
+    char buf[16];
+    for (uint8_t i = 0; i < sizeof(jumps); i++) {
+        counter.reset_counts();
+        TEST_ASSERT_TRUE(reader.move_to_offset(jumps[i], offsets[jumps[i] - 1]));
+        TEST_ASSERT_EQUAL(1, counter.seek_calls);
+        TEST_ASSERT_EQUAL(1, counter.read_calls);
+        TEST_ASSERT_EQUAL(jumps[i], reader.get_current_index());
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[jumps[i] - 1], buf);
+    }
+    // Without a known offset, it is the same as move_to()
+    TEST_ASSERT_TRUE(reader.move_to_offset(3, INVALID_UINT16));
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING(expected[2], buf);
+    TEST_ASSERT_FALSE(reader.move_to_offset(CANDIDATES_COUNT + 1, offsets[0]));
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_candidatereader_prefetched);
+    RUN_TEST(test_candidatereader_streaming);
+    RUN_TEST(test_candidatereader_fallback);
+    RUN_TEST(test_candidatereader_streaming_same_index);
+    RUN_TEST(test_candidatereader_move_to_offset);
+
+    return UNITY_END();
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <sjisbuffer.h>
+
+
+static constexpr size_t CAPACITY = 16;
+static char memory[SjisBuffer::required_buffer_length(CAPACITY)];
+
+// "あaい" (SJIS)
+static const char TEXT_MIXED[] = "\x82\xa0" "a" "\x82\xa2";
+
+
+void test_sjisbuffer_init(void) {
+    SjisBuffer buf;
+    TEST_ASSERT_TRUE(buf.init(memory, sizeof(memory)));
+    TEST_ASSERT_EQUAL(CAPACITY, buf.capacity());
+    TEST_ASSERT_EQUAL(0, buf.length());
+    TEST_ASSERT_TRUE(buf.is_empty());
+    TEST_ASSERT_EQUAL_STRING("", buf.c_str());
+}
+
+
+void test_sjisbuffer_append_and_pop(void) {
+    SjisBuffer buf;
+    buf.init(memory, sizeof(memory));
+    TEST_ASSERT_EQUAL(5, buf.append(TEXT_MIXED, 5));
+    TEST_ASSERT_EQUAL(5, buf.length());
+    TEST_ASSERT_EQUAL_STRING(TEXT_MIXED, buf.c_str());
+
+    // 末尾から1文字ずつ消える
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+    TEST_ASSERT_EQUAL_STRING("\x82\xa0" "a", buf.c_str());
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+    TEST_ASSERT_EQUAL_STRING("\x82\xa0", buf.c_str());
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+    TEST_ASSERT_TRUE(buf.is_empty());
+    TEST_ASSERT_EQUAL(0, buf.pop_last_char());
+}
+
+
+void test_sjisbuffer_second_byte_looks_like_first_byte(void) {
+    // "＝" は 0x81 0x81。第2バイトが第1バイトの範囲にあっても文字の区切りを誤らない
+    SjisBuffer buf;
+    buf.init(memory, sizeof(memory));
+    buf.append("\x81\x81", 2);
+    buf.append_char('x');
+    buf.append("\x81\x81", 2);
+    TEST_ASSERT_EQUAL(2, buf.get_char_bytes(0));
+    TEST_ASSERT_EQUAL(1, buf.get_char_bytes(2));
+    TEST_ASSERT_EQUAL(3, buf.get_prev_char_index(5));
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+}
+
+
+void test_sjisbuffer_byte_by_byte(void) {
+    // 1バイトずつ追加しても、SJISの2バイト文字として扱われる
+    SjisBuffer buf;
+    buf.init(memory, sizeof(memory));
+    for (size_t i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(buf.append_char(TEXT_MIXED[i]));
+    }
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+
+    // 第2バイトを待っている第1バイトだけを消す
+    buf.append_char('\x82');
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+    buf.append_char('b');
+    TEST_ASSERT_EQUAL_STRING("\x82\xa0" "b", buf.c_str());
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+}
+
+
+void test_sjisbuffer_remove_head(void) {
+    SjisBuffer buf;
+    buf.init(memory, sizeof(memory));
+    buf.append(TEXT_MIXED, 5);
+    buf.remove_head(2);
+    TEST_ASSERT_EQUAL(3, buf.length());
+    TEST_ASSERT_EQUAL_STRING("a" "\x82\xa2", buf.c_str());
+    TEST_ASSERT_EQUAL(2, buf.pop_last_char());
+    TEST_ASSERT_EQUAL(1, buf.pop_last_char());
+    buf.append(TEXT_MIXED, 5);
+    buf.remove_head(10);
+    TEST_ASSERT_TRUE(buf.is_empty());
+}
+
+
+void test_sjisbuffer_capacity(void) {
+    SjisBuffer buf;
+    buf.init(memory, sizeof(memory));
+    for (uint8_t i = 0; i < CAPACITY; i++) {
+        TEST_ASSERT_TRUE(buf.append_char('a' + i));
+    }
+    TEST_ASSERT_FALSE(buf.append_char('z'));
+    TEST_ASSERT_EQUAL(0, buf.append("zz", 2));
+    TEST_ASSERT_EQUAL(CAPACITY, strlen(buf.c_str()));
+
+    buf.clear();
+    // 容量を超える分は切り捨てる
+    buf.append("0123456789", 10);
+    TEST_ASSERT_EQUAL(6, buf.append("abcdefghij", 10));
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdef", buf.c_str());
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sjisbuffer_init);
+    RUN_TEST(test_sjisbuffer_append_and_pop);
+    RUN_TEST(test_sjisbuffer_second_byte_looks_like_first_byte);
+    RUN_TEST(test_sjisbuffer_byte_by_byte);
+    RUN_TEST(test_sjisbuffer_remove_head);
+    RUN_TEST(test_sjisbuffer_capacity);
+
+    return UNITY_END();
+}
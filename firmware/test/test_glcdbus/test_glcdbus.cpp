@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <GlcdBus.h>
+
+
+// Mock of VPORT_t
+struct MockPort {
+    uint8_t DIR;
+    uint8_t OUT;
+    uint8_t IN;
+};
+
+// Arduino pin numbers of GLCD D0-D7 and the port bit each one is wired to (see screen.cpp)
+//   D0-D3 : pin 17-14 = PD3-PD0
+//   D4-D7 : pin 13-10 = PC5-PC2
+static const char DATA_PORT[8] = { 'D', 'D', 'D', 'D', 'C', 'C', 'C', 'C' };
+static const uint8_t DATA_BIT[8] = { 3, 2, 1, 0, 5, 4, 3, 2 };
+
+
+void test_glcdbus_write_bit_ordering(void) {
+    for (uint8_t i = 0; i < 8; i++) {
+        MockPort portd = { 0, 0, 0 };
+        MockPort portc = { 0, 0, 0 };
+        GlcdBus::write(portd, portc, (uint8_t)(1 << i));
+
+        uint8_t expected = (uint8_t)(1 << DATA_BIT[i]);
+        if (DATA_PORT[i] == 'D') {
+            TEST_ASSERT_EQUAL(expected, portd.OUT);
+            TEST_ASSERT_EQUAL(0, portc.OUT);
+        } else {
+            TEST_ASSERT_EQUAL(0, portd.OUT);
+            TEST_ASSERT_EQUAL(expected, portc.OUT);
+        }
+    }
+}
+
+
+void test_glcdbus_write_keeps_other_pins(void) {
+    // PD4(RW), PD5(E), PC0(CL), PC1(RES) and the unused bits must not be touched
+    MockPort portd = { 0, 0xF0, 0 };
+    MockPort portc = { 0, 0xC3, 0 };
+    GlcdBus::write(portd, portc, 0xFF);
+    TEST_ASSERT_EQUAL(0xFF, portd.OUT);
+    TEST_ASSERT_EQUAL(0xFF, portc.OUT);
+    GlcdBus::write(portd, portc, 0x00);
+    TEST_ASSERT_EQUAL(0xF0, portd.OUT);
+    TEST_ASSERT_EQUAL(0xC3, portc.OUT);
+}
+
+
+void test_glcdbus_read_roundtrip(void) {
+    for (int data = 0; data < 256; data++) {
+        MockPort portd = { 0, 0, 0 };
+        MockPort portc = { 0, 0, 0 };
+        GlcdBus::write(portd, portc, (uint8_t)data);
+        // Loop back with garbage on the non-bus bits
+        portd.IN = portd.OUT | 0xF0;
+        portc.IN = portc.OUT | 0xC3;
+        TEST_ASSERT_EQUAL(data, GlcdBus::read(portd, portc));
+    }
+}
+
+
+void test_glcdbus_direction(void) {
+    MockPort portd = { 0x30, 0, 0 };
+    MockPort portc = { 0x03, 0, 0 };
+    GlcdBus::set_output(portd, portc);
+    TEST_ASSERT_EQUAL(0x3F, portd.DIR);
+    TEST_ASSERT_EQUAL(0x3F, portc.DIR);
+    GlcdBus::set_input(portd, portc);
+    TEST_ASSERT_EQUAL(0x30, portd.DIR);
+    TEST_ASSERT_EQUAL(0x03, portc.DIR);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_glcdbus_write_bit_ordering);
+    RUN_TEST(test_glcdbus_write_keeps_other_pins);
+    RUN_TEST(test_glcdbus_read_roundtrip);
+    RUN_TEST(test_glcdbus_direction);
+
+    return UNITY_END();
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../SkdTestUtil.h"
+
+#include <skkdict.h>
+#include <candidatereader.h>
+#include <mruoverlay.h>
+
+// Files are created in the working directory and removed before each test.
+const char* FILEPATH_DICT = "test_mruoverlay.skd";
+const char* FILEPATH_MRU = "test_mruoverlay.mru";
+
+
+static void remove_files(void) {
+    remove(FILEPATH_DICT);
+    remove(FILEPATH_MRU);
+}
+
+
+/** Write an SKD with one entry "key" -> "A", "BB", "C" */
+static void write_dict(void) {
+    const uint8_t entry[] = { 3, 'k', 'e', 'y', 3, 7, 0, 1, 'A', 2, 'B', 'B', 1, 'C' };
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(FILEPATH_DICT, FileAccessWrapper::FileMode::WRITE));
+    write_skd_single_table(&out, "key", entry, sizeof(entry));
+    out.close();
+}
+
+
+static uint32_t get_mru_file_size(void) {
+    CstdioFileAccessor in;
+    if (!in.open(FILEPATH_MRU, FileAccessWrapper::FileMode::READ)) {
+        return 0;
+    }
+    uint32_t size = in.size();
+    in.close();
+    return size;
+}
+
+
+void test_mruoverlay_reorders_candidates(void) {
+    remove_files();
+    write_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+    uint8_t comparelen;
+    uint32_t addr = dict.search_startaddr_from_index_for("key", 3, &comparelen);
+
+    {
+        CstdioFileAccessor mrufile;
+        uint8_t table[SKK::MruOverlay::RECORD_SIZE * 2];
+        SKK::MruOverlay overlay;
+        TEST_ASSERT_TRUE(overlay.init(&mrufile, FILEPATH_MRU, table, sizeof(table)));
+        // "C" then "BB" are selected: most recent first
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 3));
+        TEST_ASSERT_TRUE(overlay.promote("other", 5, 2, 1));
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 2));
+        // A third key evicts the least recently selected one
+        TEST_ASSERT_TRUE(overlay.promote("third", 5, 4, 4));
+        uint8_t indices[SKK::MruOverlay::MAX_INDICES];
+        TEST_ASSERT_EQUAL(0, overlay.lookup("other", 5, 2, indices));
+    }
+
+    CstdioFileAccessor mrufile;
+    uint8_t table[SKK::MruOverlay::RECORD_SIZE * 2];
+    SKK::MruOverlay overlay;
+    TEST_ASSERT_TRUE(overlay.init(&mrufile, FILEPATH_MRU, table, sizeof(table)));
+    uint8_t indices[SKK::MruOverlay::MAX_INDICES];
+    // Candidate count is a part of the key
+    TEST_ASSERT_EQUAL(0, overlay.lookup("key", 3, 4, indices));
+    uint8_t count = overlay.lookup("key", 3, 3, indices);
+    TEST_ASSERT_EQUAL(2, count);
+
+    char buf[8];
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(addr, false, comparelen, "key", 3, &reader));
+    reader.set_preferred(indices, count);
+    TEST_ASSERT_EQUAL(3, reader.get_candidates_count());
+    const char* expected[] = { "BB", "C", "A" };
+    const uint8_t expected_index[] = { 2, 3, 1 };
+    for (int i = 0; i < 3; i++) {
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[i], buf);
+        TEST_ASSERT_EQUAL(expected_index[i], reader.get_current_dict_index());
+        reader.move_next();
+    }
+    TEST_ASSERT_TRUE(reader.is_reached_end());
+
+    // With a pinned candidate, the pinned one comes first and is not repeated
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(addr, false, comparelen, "key", 3, &reader));
+    reader.set_pinned("C", 1);
+    reader.set_preferred(indices, count);
+    const char* expected_pinned[] = { "C", "BB", "A" };
+    for (int i = 0; i < 3; i++) {
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected_pinned[i], buf);
+        reader.move_next();
+    }
+    TEST_ASSERT_TRUE(reader.is_reached_end());
+
+    file.close();
+    mrufile.close();
+    remove_files();
+}
+
+
+void test_mruoverlay_appends_changed_record(void) {
+    remove_files();
+    const uint32_t headerlen = SKK::MruOverlay::FILE_HEADER_LENGTH;
+    const uint32_t recordlen = SKK::MruOverlay::RECORD_SIZE;
+
+    {
+        CstdioFileAccessor mrufile;
+        uint8_t table[SKK::MruOverlay::RECORD_SIZE * 2];
+        SKK::MruOverlay overlay;
+        TEST_ASSERT_TRUE(overlay.init(&mrufile, FILEPATH_MRU, table, sizeof(table)));
+        // The first selection creates the file
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 3));
+        TEST_ASSERT_EQUAL(headerlen + recordlen, get_mru_file_size());
+        // Each selection appends only the changed record
+        TEST_ASSERT_TRUE(overlay.promote("other", 5, 2, 1));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 2, get_mru_file_size());
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 2));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 3, get_mru_file_size());
+        // Selecting the first one again writes nothing
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 2));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 3, get_mru_file_size());
+    }
+
+    {
+        // Later records replace earlier ones for the same key
+        CstdioFileAccessor mrufile;
+        uint8_t table[SKK::MruOverlay::RECORD_SIZE * 2];
+        SKK::MruOverlay overlay;
+        TEST_ASSERT_TRUE(overlay.init(&mrufile, FILEPATH_MRU, table, sizeof(table)));
+        TEST_ASSERT_EQUAL(2, overlay.used_count);
+        uint8_t indices[SKK::MruOverlay::MAX_INDICES];
+        TEST_ASSERT_EQUAL(2, overlay.lookup("key", 3, 3, indices));
+        TEST_ASSERT_EQUAL(2, indices[0]);
+        TEST_ASSERT_EQUAL(3, indices[1]);
+        TEST_ASSERT_EQUAL(1, overlay.lookup("other", 5, 2, indices));
+
+        // Reaching twice the table size rewrites the file with the table only
+        TEST_ASSERT_TRUE(overlay.promote("other", 5, 2, 2));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 4, get_mru_file_size());
+        TEST_ASSERT_TRUE(overlay.promote("key", 3, 3, 1));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 2, get_mru_file_size());
+        TEST_ASSERT_TRUE(overlay.promote("third", 5, 4, 4));
+        TEST_ASSERT_EQUAL(headerlen + recordlen * 3, get_mru_file_size());
+    }
+
+    // The least recently selected key was evicted, and the order survives a reload
+    CstdioFileAccessor mrufile;
+    uint8_t table[SKK::MruOverlay::RECORD_SIZE * 2];
+    SKK::MruOverlay overlay;
+    TEST_ASSERT_TRUE(overlay.init(&mrufile, FILEPATH_MRU, table, sizeof(table)));
+    uint8_t indices[SKK::MruOverlay::MAX_INDICES];
+    TEST_ASSERT_EQUAL(0, overlay.lookup("other", 5, 2, indices));
+    TEST_ASSERT_EQUAL(1, overlay.lookup("third", 5, 4, indices));
+    TEST_ASSERT_EQUAL(3, overlay.lookup("key", 3, 3, indices));
+    TEST_ASSERT_EQUAL(1, indices[0]);
+    TEST_ASSERT_EQUAL(2, indices[1]);
+    TEST_ASSERT_EQUAL(3, indices[2]);
+
+    mrufile.close();
+    remove_files();
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_mruoverlay_reorders_candidates);
+    RUN_TEST(test_mruoverlay_appends_changed_record);
+
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../SkdTestUtil.h"
+
+#include <skkdict.h>
+#include <candidatereader.h>
+#include <skkengine.h>
+
+// The file is created in the working directory and removed after each test.
+const char* FILEPATH_DICT = "test_okuriari.skd";
+
+
+/** Write an SKD with "AB" -> "X" in 'TBL', and "KAk" -> "1", "2" / "KAt" -> "3" / "YOn" -> "4" in 'OKR' */
+static void write_okuriari_dict(void) {
+    const uint8_t table[] = { 2, 'A', 'B', 1, 2, 0, 1, 'X' };
+    const uint8_t okuriari[] = {
+        3, 'K', 'A', 'k', 2, 4, 0, 1, '1', 1, '2',
+        3, 'K', 'A', 't', 1, 2, 0, 1, '3',
+        3, 'Y', 'O', 'n', 1, 2, 0, 1, '4'
+    };
+    const uint32_t tablehead = 10 + 6 + 6 + 6;
+    const uint32_t okrhead = tablehead + sizeof(table);
+    // Slot key length, slot count, 2 slots
+    const uint32_t okrentrieshead = okrhead + 6 + 3 + 4 * 2;
+    const uint32_t filesize = okrentrieshead + sizeof(okuriari);
+
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(FILEPATH_DICT, FileAccessWrapper::FileMode::WRITE));
+    write_skd_header(&out, filesize, 3);
+    write_skd_section_head(&out, "IDX", 1 + 2 + 3);
+    write_skd_index_item(&out, "AB", tablehead);
+    write_skd_section_head(&out, "TBL", sizeof(table));
+    out.write(table, sizeof(table));
+    write_skd_section_head(&out, "OKR", filesize - (okrhead + 6));
+    out.write_uint8(1);
+    out.write_uint16(2);
+    out.write_uint8('K');
+    out.write_uint24(okrentrieshead);
+    out.write_uint8('Y');
+    out.write_uint24(okrentrieshead + 11 + 9);
+    out.write(okuriari, sizeof(okuriari));
+    out.close();
+}
+
+
+void test_okuriari_lookup(void) {
+    write_okuriari_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+    TEST_ASSERT_TRUE(dict.has_okuriari);
+    SKK::SkkEngine skk;
+    skk.init();
+    skk.set_sysdict(&dict);
+
+    char buf[16];
+    SKK::CandidateReader reader;
+    // Okurigana is attached to every candidate
+    TEST_ASSERT_TRUE(skk.henkan_okuriari("KAk", 3, "ku", 2, &reader));
+    TEST_ASSERT_EQUAL(2, reader.get_candidates_count());
+    TEST_ASSERT_EQUAL(3, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("1ku", buf);
+    reader.move_next();
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("2ku", buf);
+    reader.move_head();
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("1ku", buf);
+
+    TEST_ASSERT_TRUE(skk.henkan_okuriari("KAt", 3, "tte", 3, &reader));
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("3tte", buf);
+    TEST_ASSERT_TRUE(skk.henkan_okuriari("YOn", 3, "nda", 3, &reader));
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("4nda", buf);
+
+    TEST_ASSERT_FALSE(skk.henkan_okuriari("KAx", 3, "xu", 2, &reader));
+    TEST_ASSERT_FALSE(skk.henkan_okuriari("ZAk", 3, "ku", 2, &reader));
+
+    // Okuri-nasi entries are not affected
+    TEST_ASSERT_TRUE(skk.henkan("AB", 2, &reader));
+    TEST_ASSERT_EQUAL(1, reader.get_current_candidate_length());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("X", buf);
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+void test_okuriari_with_pinned(void) {
+    write_okuriari_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_DICT, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+
+    char buf[16];
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(dict.search_okuriari_entry_for("KAk", 3, &reader));
+    // Learned candidates are stored without okurigana
+    reader.set_pinned("2", 1);
+    reader.set_okurigana("ku", 2);
+    const char* expected[] = { "2ku", "1ku" };
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL(3, reader.get_current_candidate_length());
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[i], buf);
+        reader.move_next();
+    }
+    TEST_ASSERT_TRUE(reader.is_reached_end());
+
+    reader.init_pinned_only("Z", 1);
+    reader.set_okurigana("ku", 2);
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("Zku", buf);
+
+    file.close();
+    remove(FILEPATH_DICT);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_okuriari_lookup);
+    RUN_TEST(test_okuriari_with_pinned);
+
+    return UNITY_END();
+}
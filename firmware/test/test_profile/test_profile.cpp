@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <profile.h>
+
+
+void test_profile_record(void) {
+    Profile::reset();
+    const Profile::Counter* counter = Profile::get_counter(Profile::Id::Henkan);
+    TEST_ASSERT_EQUAL(0, counter->count);
+
+    Profile::record(Profile::Id::Henkan, 30);
+    Profile::record(Profile::Id::Henkan, 10);
+    Profile::record(Profile::Id::Henkan, 20);
+    TEST_ASSERT_EQUAL(3, counter->count);
+    TEST_ASSERT_EQUAL(60, counter->total_usec);
+    TEST_ASSERT_EQUAL(10, counter->min_usec);
+    TEST_ASSERT_EQUAL(30, counter->max_usec);
+
+    // Other counters are not touched
+    TEST_ASSERT_EQUAL(0, Profile::get_counter(Profile::Id::DrawGlyph2)->count);
+
+    Profile::dump();
+    Profile::reset();
+    TEST_ASSERT_EQUAL(0, counter->count);
+    TEST_ASSERT_EQUAL(0, counter->max_usec);
+}
+
+
+static int return_early(bool early) {
+    PROFILE_SCOPE(KeyboardUpdate);
+    if (early) {
+        return 1;
+    }
+    return 0;
+}
+
+
+void test_profile_scope(void) {
+    Profile::reset();
+    return_early(true);
+    return_early(false);
+    TEST_ASSERT_EQUAL(2, Profile::get_counter(Profile::Id::KeyboardUpdate)->count);
+    TEST_ASSERT_EQUAL_STRING("Keyboard::update", Profile::get_name(Profile::Id::KeyboardUpdate));
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_profile_record);
+    RUN_TEST(test_profile_scope);
+
+    return UNITY_END();
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <ByteRingBuffer.h>
+
+
+void test_ringbuffer_push_pop(void) {
+    uint8_t memory[8];
+    ByteRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.init(memory, sizeof(memory)));
+    TEST_ASSERT_TRUE(ring.is_empty());
+    TEST_ASSERT_EQUAL(8, ring.free_space());
+
+    TEST_ASSERT_TRUE(ring.push((const uint8_t*)"abcde", 5));
+    TEST_ASSERT_EQUAL(5, ring.size());
+    // 収まらない追加は何もしない
+    TEST_ASSERT_FALSE(ring.push((const uint8_t*)"1234", 4));
+    TEST_ASSERT_EQUAL(5, ring.size());
+
+    uint8_t dst[8];
+    TEST_ASSERT_EQUAL(3, ring.pop(dst, 3));
+    TEST_ASSERT_EQUAL_MEMORY("abc", dst, 3);
+    TEST_ASSERT_EQUAL(2, ring.size());
+}
+
+
+void test_ringbuffer_wraparound(void) {
+    uint8_t memory[8];
+    ByteRingBuffer ring;
+    ring.init(memory, sizeof(memory));
+    uint8_t dst[8];
+
+    ring.push((const uint8_t*)"abcdef", 6);
+    ring.pop(dst, 5);
+    // 末尾で折り返して書き込む
+    TEST_ASSERT_TRUE(ring.push((const uint8_t*)"1234567", 7));
+    TEST_ASSERT_EQUAL(8, ring.size());
+    TEST_ASSERT_EQUAL(0, ring.free_space());
+
+    // 連続して読める範囲は、領域の末尾まで
+    const uint8_t* data;
+    TEST_ASSERT_EQUAL(3, ring.peek_contiguous(&data));
+    TEST_ASSERT_EQUAL_MEMORY("f12", data, 3);
+    ring.consume(3);
+    TEST_ASSERT_EQUAL(5, ring.peek_contiguous(&data));
+    TEST_ASSERT_EQUAL_MEMORY("34567", data, 5);
+
+    ring.consume(10);
+    TEST_ASSERT_TRUE(ring.is_empty());
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_ringbuffer_push_pop);
+    RUN_TEST(test_ringbuffer_wraparound);
+
+    return UNITY_END();
+}
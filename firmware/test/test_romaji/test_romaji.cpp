@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <romaji.h>
+
+
+/** 表を先頭から順に調べる、従来と同じ方法での検索（比較用）
+ * @param is_prefix [OUT]
+ */
+static const romajientry_t* lookup_linear(const char* romaji, uint8_t romaji_len, bool* is_prefix) {
+    const romajientry_t* found = nullptr;
+    *is_prefix = false;
+    for (uint8_t i = 0; i < romaji_get_table_entries(); i++) {
+        const romajientry_t* entry = romaji_get_table_entry(i);
+        size_t entry_romaji_len = strlen(entry->romaji);
+        if (memcmp(romaji, entry->romaji, romaji_len) != 0) {
+            continue;
+        }
+        if (entry_romaji_len == romaji_len) {
+            found = entry;
+        } else if (entry_romaji_len > romaji_len) {
+            *is_prefix = true;
+        }
+    }
+    return found;
+}
+
+
+void test_romaji_table_sorted(void) {
+    for (uint8_t i = 1; i < romaji_get_table_entries(); i++) {
+        const romajientry_t* prev = romaji_get_table_entry(i - 1);
+        const romajientry_t* cur = romaji_get_table_entry(i);
+        TEST_ASSERT_MESSAGE(memcmp(prev->romaji, cur->romaji, ROMAJI_MAX_LENGTH) < 0, cur->romaji);
+    }
+}
+
+
+void test_romaji_lookup_all_entries(void) {
+    for (uint8_t i = 0; i < romaji_get_table_entries(); i++) {
+        const romajientry_t* entry = romaji_get_table_entry(i);
+        bool is_prefix = false;
+        const romajientry_t* found = romaji_lookup(entry->romaji, strlen(entry->romaji), &is_prefix);
+        TEST_ASSERT_MESSAGE(found == entry, entry->romaji);
+    }
+}
+
+
+void test_romaji_lookup_matches_linear(void) {
+    // 3文字までのすべての小文字の並びについて、従来の方法と結果が一致すること
+    char romaji[3];
+    for (uint8_t len = 1; len <= 3; len++) {
+        uint32_t combinations = 1;
+        for (uint8_t i = 0; i < len; i++) {
+            combinations *= 26;
+        }
+        for (uint32_t n = 0; n < combinations; n++) {
+            uint32_t v = n;
+            for (uint8_t i = 0; i < len; i++) {
+                romaji[i] = 'a' + (v % 26);
+                v /= 26;
+            }
+            bool expected_prefix = false;
+            bool actual_prefix = false;
+            const romajientry_t* expected = lookup_linear(romaji, len, &expected_prefix);
+            const romajientry_t* actual = romaji_lookup(romaji, len, &actual_prefix);
+            TEST_ASSERT(expected == actual);
+            TEST_ASSERT(expected_prefix == actual_prefix);
+        }
+    }
+}
+
+
+void test_romaji_lookup_pending_and_dead(void) {
+    bool is_prefix = false;
+
+    // "n" だけでは変換できないが、"na" や "nn" などの先頭
+    TEST_ASSERT_NULL(romaji_lookup("n", 1, &is_prefix));
+    TEST_ASSERT_TRUE(is_prefix);
+
+    // "ky" は変換できないが、"kya" の先頭
+    TEST_ASSERT_NULL(romaji_lookup("ky", 2, &is_prefix));
+    TEST_ASSERT_TRUE(is_prefix);
+
+    // "xts" は "xtsu" の先頭
+    TEST_ASSERT_NULL(romaji_lookup("xts", 3, &is_prefix));
+    TEST_ASSERT_TRUE(is_prefix);
+
+    // "qa" はどの項目にもつながらない
+    TEST_ASSERT_NULL(romaji_lookup("qa", 2, &is_prefix));
+    TEST_ASSERT_FALSE(is_prefix);
+
+    // 長すぎる入力
+    TEST_ASSERT_NULL(romaji_lookup("xtsuu", 5, &is_prefix));
+    TEST_ASSERT_FALSE(is_prefix);
+
+    // 同じローマ字が複数書かれていたら、先に書かれた項目が使われる（"ss" は "っs"）
+    const romajientry_t* ss = romaji_lookup("ss", 2, &is_prefix);
+    TEST_ASSERT_NOT_NULL(ss);
+    TEST_ASSERT_EQUAL_MEMORY("\x82\xc1s", ss->hiragana, 3);
+}
+
+
+void test_romaji_lookup_benchmark(void) {
+    constexpr int ITERATIONS = 2000;
+    volatile uint32_t found_count = 0;
+    bool is_prefix;
+
+    clock_t start = clock();
+    for (int it = 0; it < ITERATIONS; it++) {
+        for (uint8_t i = 0; i < romaji_get_table_entries(); i++) {
+            const char* romaji = romaji_get_table_entry(i)->romaji;
+            if (lookup_linear(romaji, strlen(romaji), &is_prefix)) {
+                found_count += 1;
+            }
+        }
+    }
+    clock_t linear_clocks = clock() - start;
+
+    start = clock();
+    for (int it = 0; it < ITERATIONS; it++) {
+        for (uint8_t i = 0; i < romaji_get_table_entries(); i++) {
+            const char* romaji = romaji_get_table_entry(i)->romaji;
+            if (romaji_lookup(romaji, strlen(romaji), &is_prefix)) {
+                found_count += 1;
+            }
+        }
+    }
+    clock_t sorted_clocks = clock() - start;
+
+    uint32_t lookups = (uint32_t)ITERATIONS * romaji_get_table_entries();
+    printf("romaji lookup x%lu: linear %.1f ns/lookup, sorted %.1f ns/lookup\n",
+            (unsigned long)lookups,
+            (double)linear_clocks * 1e9 / CLOCKS_PER_SEC / lookups,
+            (double)sorted_clocks * 1e9 / CLOCKS_PER_SEC / lookups);
+    TEST_ASSERT_EQUAL(lookups * 2, found_count);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_romaji_table_sorted);
+    RUN_TEST(test_romaji_lookup_all_entries);
+    RUN_TEST(test_romaji_lookup_matches_linear);
+    RUN_TEST(test_romaji_lookup_pending_and_dead);
+    RUN_TEST(test_romaji_lookup_benchmark);
+
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+#include "../CstdioFileAccessor.h"
+
+#include <SjisGb18030Converter.h>
+
+// NOTE: test is executed on the root of this project.
+// Generated by tool/generate_sjisgb18030dict/generate_sjisgb18030dict.py
+const char* FILEPATH_TEST_table = "test/test_sjisgb18030/test_cnvsjgb2.tbl";
+
+CstdioFileAccessor tablefile;
+uint8_t blockbuffer[SjisGb18030Converter::SLOT_SIZE * 16];
+
+
+struct conversion_sample_t {
+    uint8_t sjis[2];
+    uint8_t gb18030_length;
+    uint8_t gb18030[4];
+};
+
+// Python の str.encode("gb18030") による変換結果
+static const conversion_sample_t SAMPLES[] = {
+    { { 0x82, 0xa0 }, 2, { 0xa4, 0xa2 } },              // あ
+    { { 0x83, 0x41 }, 2, { 0xa5, 0xa2 } },              // ア
+    { { 0x8d, 0x91 }, 2, { 0xb9, 0xfa } },              // 国
+    { { 0x96, 0xaf }, 2, { 0xc3, 0xf1 } },              // 民
+    { { 0x81, 0x5b }, 2, { 0xa9, 0x60 } },              // ー
+    { { 0x81, 0x5c }, 2, { 0xa8, 0x44 } },              // ―
+    { { 0x81, 0xf4 }, 4, { 0x81, 0x37, 0xac, 0x38 } },  // ♪
+    { { 0xea, 0xa4 }, 2, { 0xce, 0xf5 } },              // 熙（第84区）
+};
+
+
+static bool open_converter(SjisGb18030Converter* converter) {
+    tablefile.close();
+    if (!tablefile.open(FILEPATH_TEST_table, FileAccessWrapper::FileMode::READ)) {
+        return false;
+    }
+    return converter->init(&tablefile, blockbuffer, sizeof(blockbuffer));
+}
+
+
+void test_sjisgb18030_slot_index(void) {
+    TEST_ASSERT_EQUAL(0, SjisGb18030Converter::get_slot_index(1, 1));
+    TEST_ASSERT_EQUAL(94 * 94 - 1, SjisGb18030Converter::get_slot_index(94, 94));
+    TEST_ASSERT_EQUAL(INVALID_UINT16, SjisGb18030Converter::get_slot_index(0, 1));
+    TEST_ASSERT_EQUAL(INVALID_UINT16, SjisGb18030Converter::get_slot_index(95, 1));
+    TEST_ASSERT_EQUAL(INVALID_UINT16, SjisGb18030Converter::get_slot_index(1, 95));
+}
+
+
+void test_sjisgb18030_convert_samples(void) {
+    SjisGb18030Converter converter;
+    TEST_ASSERT_TRUE(open_converter(&converter));
+
+    for (size_t i = 0; i < sizeof(SAMPLES) / sizeof(SAMPLES[0]); i++) {
+        uint8_t dst[SjisGb18030Converter::SLOT_SIZE];
+        memset(dst, 0xAA, sizeof(dst));
+        uint8_t len = converter.convert_char((const char*)SAMPLES[i].sjis, dst);
+        TEST_ASSERT_EQUAL(SAMPLES[i].gb18030_length, len);
+        TEST_ASSERT_EQUAL_MEMORY(SAMPLES[i].gb18030, dst, len);
+    }
+}
+
+
+void test_sjisgb18030_unconvertible(void) {
+    SjisGb18030Converter converter;
+    TEST_ASSERT_TRUE(open_converter(&converter));
+    uint8_t dst[SjisGb18030Converter::SLOT_SIZE];
+
+    // 第13区（NEC特殊文字）はPythonのshift_jisでは扱えないので、テーブルでは空
+    TEST_ASSERT_EQUAL(0, converter.convert_char("\x87\x40", dst));
+    // 第95区以降（ユーザ定義領域）はテーブルの範囲外
+    TEST_ASSERT_EQUAL(0, converter.convert_char("\xf0\x40", dst));
+    // 1バイト文字は対象外
+    TEST_ASSERT_EQUAL(0, converter.convert_char("A", dst));
+}
+
+
+void test_sjisgb18030_block_reuse(void) {
+    SjisGb18030Converter converter;
+    TEST_ASSERT_TRUE(open_converter(&converter));
+    uint8_t dst[SjisGb18030Converter::SLOT_SIZE];
+
+    // "あいう" は同じブロックに収まるので、ファイルを読むのは最初の1回だけ
+    TEST_ASSERT_EQUAL(2, converter.convert_char("\x82\xa0", dst));
+    TEST_ASSERT_EQUAL(2, converter.convert_char("\x82\xa2", dst));
+    TEST_ASSERT_EQUAL(2, converter.convert_char("\x82\xa4", dst));
+    TEST_ASSERT_EQUAL(1, converter.miss_count);
+    TEST_ASSERT_EQUAL(2, converter.hit_count);
+    TEST_ASSERT_EQUAL_MEMORY("\xa4\xa6", dst, 2);
+
+    // 離れた文字は読み込みなおす
+    TEST_ASSERT_EQUAL(2, converter.convert_char("\x8d\x91", dst));
+    TEST_ASSERT_EQUAL(2, converter.miss_count);
+}
+
+
+void test_sjisgb18030_convert_text(void) {
+    SjisGb18030Converter converter;
+    TEST_ASSERT_TRUE(open_converter(&converter));
+
+    // "Aあ♪ｱ国" : ASCIIはそのまま、半角カナは読み飛ばす
+    const char* text = "A" "\x82\xa0" "\x81\xf4" "\xb1" "\x8d\x91";
+    const uint8_t expected[] = { 'A', 0xa4, 0xa2, 0x81, 0x37, 0xac, 0x38, 0xb9, 0xfa };
+    uint8_t dst[16];
+    size_t consumed = 0;
+    TEST_ASSERT_EQUAL(sizeof(expected), converter.convert_text(text, strlen(text), dst, sizeof(dst), &consumed));
+    TEST_ASSERT_EQUAL(strlen(text), consumed);
+    TEST_ASSERT_EQUAL_MEMORY(expected, dst, sizeof(expected));
+
+    // 書き出し先に収まらない文字の手前で止まる
+    TEST_ASSERT_EQUAL(3, converter.convert_text(text, strlen(text), dst, 6, &consumed));
+    TEST_ASSERT_EQUAL(3, consumed);
+    TEST_ASSERT_EQUAL(6, converter.convert_text(&text[consumed], strlen(text) - consumed, dst, 6, &consumed));
+    TEST_ASSERT_EQUAL_MEMORY(&expected[3], dst, 6);
+}
+
+
+void test_sjisgb18030_reject_legacy_table(void) {
+    // 従来の 'TET' 形式のテーブルは受け付けない
+    const char* path = "test_sjisgb18030_legacy.tmp";
+    FILE* fp = fopen(path, "wb");
+    TEST_ASSERT_TRUE(fp != nullptr);
+    fwrite("TET", 1, 3, fp);
+    for (uint32_t i = 3; i < SjisGb18030Converter::HEADER_LENGTH + (uint32_t)SjisGb18030Converter::SLOT_COUNT * SjisGb18030Converter::SLOT_SIZE; i++) {
+        fputc(0, fp);
+    }
+    fclose(fp);
+
+    SjisGb18030Converter converter;
+    CstdioFileAccessor otherfile;
+    TEST_ASSERT_TRUE(otherfile.open(path, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_FALSE(converter.init(&otherfile, blockbuffer, sizeof(blockbuffer)));
+    otherfile.close();
+    remove(path);
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sjisgb18030_slot_index);
+    RUN_TEST(test_sjisgb18030_convert_samples);
+    RUN_TEST(test_sjisgb18030_unconvertible);
+    RUN_TEST(test_sjisgb18030_block_reuse);
+    RUN_TEST(test_sjisgb18030_convert_text);
+    RUN_TEST(test_sjisgb18030_reject_legacy_table);
+
+    return UNITY_END();
+}
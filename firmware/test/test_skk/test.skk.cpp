@@ -13,6 +13,8 @@
 
 // Implement of FileAccessWrapper in Host PC.
 #include "../CstdioFileAccessor.h"
+#include "../CountingFileAccessor.h"
+#include <BufferedFileAccessor.h>
 
 #include <skkdict.h>
 #include <skkengine.h>
@@ -23,6 +25,8 @@ SKK::SkkEngine skkengine;
 
 // NOTE: test is executed on the root of this project.
 const char* FILEPATH_TEST_skkdict = "test/test_skk/test_skkdict.skd";
+// Same dictionary converted with the "sorted" index format ('IDS').
+const char* FILEPATH_TEST_skkdict_sorted = "test/test_skk/test_skkdict_sorted.skd";
 
 void test_skk_1(void) {
     SKK::CandidateReader reader;
@@ -52,10 +56,122 @@ void test_skk_1(void) {
     TEST_ASSERT_FALSE(skkengine.henkan((const char*)test2_buf, sizeof(test2_buf), &reader));
 }
 
+/** Look up the same yomigana with 'IDX' and 'IDS' dictionaries and compare the results. */
+void test_skk_sorted_index(void) {
+    CstdioFileAccessor linearfile;
+    CstdioFileAccessor sortedfile;
+    CountingFileAccessor linearcounter(&linearfile);
+    CountingFileAccessor sortedcounter(&sortedfile);
+    SKK::SkkDict lineardict;
+    SKK::SkkDict sorteddict;
+    SKK::SkkEngine linearengine;
+    SKK::SkkEngine sortedengine;
+
+    TEST_ASSERT_TRUE(linearcounter.open(FILEPATH_TEST_skkdict, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(sortedcounter.open(FILEPATH_TEST_skkdict_sorted, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(lineardict.init(&linearcounter));
+    TEST_ASSERT_TRUE(sorteddict.init(&sortedcounter));
+    TEST_ASSERT(lineardict.index_type == SKK::SkkDict::IndexType::Linear);
+    TEST_ASSERT(sorteddict.index_type == SKK::SkkDict::IndexType::SortedSlots);
+    TEST_ASSERT_TRUE(linearengine.init());
+    TEST_ASSERT_TRUE(sortedengine.init());
+    TEST_ASSERT_TRUE(linearengine.set_sysdict(&lineardict));
+    TEST_ASSERT_TRUE(sortedengine.set_sysdict(&sorteddict));
+
+    // "あ", "こく", "こくみん", "もみじ", "にほんご", "んじゃめな" in ShiftJIS
+    static const unsigned char yomiganalist[][11] = {
+        { 2, 0x82, 0xa0 },
+        { 4, 0x82, 0xb1, 0x82, 0xad },
+        { 8, 0x82, 0xb1, 0x82, 0xad, 0x82, 0xdd, 0x82, 0xf1 },
+        { 6, 0x82, 0xe0, 0x82, 0xdd, 0x82, 0xb6 },
+        { 8, 0x82, 0xc9, 0x82, 0xd9, 0x82, 0xf1, 0x82, 0xb2 },
+        { 10, 0x82, 0xf1, 0x82, 0xb6, 0x82, 0xe1, 0x82, 0xdf, 0x82, 0xc8 },
+    };
+
+    for (size_t i = 0; i < sizeof(yomiganalist) / sizeof(yomiganalist[0]); i++) {
+        const char* yomigana = (const char*)&yomiganalist[i][1];
+        size_t yomiganalen = yomiganalist[i][0];
+        SKK::CandidateReader linearreader;
+        SKK::CandidateReader sortedreader;
+
+        linearcounter.reset_counts();
+        bool linearfound = linearengine.henkan(yomigana, yomiganalen, &linearreader);
+        uint32_t linearseeks = linearcounter.seek_calls;
+        uint32_t linearbytes = linearcounter.read_bytes;
+
+        sortedcounter.reset_counts();
+        bool sortedfound = sortedengine.henkan(yomigana, yomiganalen, &sortedreader);
+        uint32_t sortedseeks = sortedcounter.seek_calls;
+        uint32_t sortedbytes = sortedcounter.read_bytes;
+
+        printf("[%d] found=%d linear: %u seeks, %u bytes / sorted: %u seeks, %u bytes\n",
+               (int)i, (int)linearfound, (unsigned)linearseeks, (unsigned)linearbytes, (unsigned)sortedseeks, (unsigned)sortedbytes);
+
+        TEST_ASSERT_EQUAL(linearfound, sortedfound);
+        if (linearfound) {
+            TEST_ASSERT_EQUAL(linearreader.get_candidates_count(), sortedreader.get_candidates_count());
+            int linearch, sortedch;
+            do {
+                linearch = linearreader.read();
+                sortedch = sortedreader.read();
+                TEST_ASSERT_EQUAL(linearch, sortedch);
+            } while (linearch >= 0);
+        }
+    }
+}
+
+/** Read the dictionary through BufferedFileAccessor and compare with direct reads. */
+void test_skk_buffered(void) {
+    CstdioFileAccessor plainfile;
+    CstdioFileAccessor innerfile;
+    BufferedFileAccessor bufferedfile;
+    static uint8_t sectorbuffer[BufferedFileAccessor::SECTOR_SIZE * 2];
+
+    TEST_ASSERT_TRUE(plainfile.open(FILEPATH_TEST_skkdict, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(bufferedfile.init(&innerfile, sectorbuffer, sizeof(sectorbuffer)));
+    TEST_ASSERT_TRUE(bufferedfile.open(FILEPATH_TEST_skkdict, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_EQUAL(plainfile.size(), bufferedfile.size());
+
+    // Positions around sector boundaries, and jumping back and forth
+    const uint32_t positions[] = { 0, 510, 511, 1022, 3, 1535, 100, bufferedfile.size() - 3 };
+    for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+        TEST_ASSERT_EQUAL(positions[i], plainfile.seek(positions[i]));
+        TEST_ASSERT_EQUAL(positions[i], bufferedfile.seek(positions[i]));
+        TEST_ASSERT_EQUAL(plainfile.read(), bufferedfile.read());
+        TEST_ASSERT_EQUAL(plainfile.read_uint16(), bufferedfile.read_uint16());
+        TEST_ASSERT_EQUAL(plainfile.position(), bufferedfile.position());
+    }
+    // End of file
+    TEST_ASSERT_EQUAL(-1, bufferedfile.read());
+
+    // Same lookup result as the unbuffered one in test_skk_1
+    SKK::SkkDict dict;
+    SKK::SkkEngine engine;
+    SKK::CandidateReader reader;
+    TEST_ASSERT_TRUE(dict.init(&bufferedfile));
+    TEST_ASSERT_TRUE(engine.init());
+    TEST_ASSERT_TRUE(engine.set_sysdict(&dict));
+    bufferedfile.reset_stats();
+    // "こくみん" in ShiftJIS
+    unsigned char hiragana[] = { 0x82, 0xb1, 0x82, 0xad, 0x82, 0xdd, 0x82, 0xf1 };
+    TEST_ASSERT_TRUE(engine.henkan((const char*)hiragana, 8, &reader));
+    printf("buffered henkan: %u hits, %u misses\n", (unsigned)bufferedfile.hit_count, (unsigned)bufferedfile.miss_count);
+    // "国民" in ShiftJIS
+    unsigned char ref_buf[] = { 0x8d, 0x91, 0x96, 0xaf };
+    char buf[4];
+    TEST_ASSERT(reader.get_candidates_count() == 1);
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (char)reader.read();
+    }
+    TEST_ASSERT(memcmp(buf, ref_buf, 4) == 0);
+}
+
 int main(void) {
     UNITY_BEGIN();
 
     RUN_TEST(test_skk_1);
+    RUN_TEST(test_skk_sorted_index);
+    RUN_TEST(test_skk_buffered);
 
     return UNITY_END();    
 }
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <unity.h>
+
+// Impl for debug utils
+#include "../debug_impl.h"
+
+#include <FileAccessWrapper.h>
+
+// Implement of FileAccessWrapper in Host PC.
+#include "../CstdioFileAccessor.h"
+#include "../CountingFileAccessor.h"
+#include "../SkdTestUtil.h"
+
+#include <skkdict.h>
+#include <candidatereader.h>
+#include <userdict.h>
+#include <skkengine.h>
+
+// Files are created in the working directory and removed before each test.
+const char* FILEPATH_DICT = "test_userdict.skd";
+const char* FILEPATH_LOG = "test_userdict.log";
+const char* FILEPATH_WORK = "test_userdict.tmp";
+const char* FILEPATH_MULTI = "test_userdict_multi.skd";
+
+
+static void remove_files(void) {
+    remove(FILEPATH_DICT);
+    remove(FILEPATH_LOG);
+    remove(FILEPATH_WORK);
+    remove(FILEPATH_MULTI);
+}
+
+
+/** UserDict and the files it uses */
+struct Fixture {
+    CstdioFileAccessor dictfile;
+    CstdioFileAccessor logfile;
+    CstdioFileAccessor workfile;
+    uint8_t table[SKK::UserDict::SLOT_SIZE * 4];
+    SKK::UserDict dict;
+
+    bool init(void) {
+        return this->dict.init(&this->dictfile, FILEPATH_DICT, &this->logfile, FILEPATH_LOG,
+                               &this->workfile, FILEPATH_WORK, this->table, sizeof(this->table));
+    }
+
+    ~Fixture() {
+        this->dictfile.close();
+        this->logfile.close();
+        this->workfile.close();
+    }
+};
+
+
+static void assert_found(SKK::UserDict* dict, const char* yomigana, const char* expected) {
+    uint8_t len = 0;
+    const char* found = dict->find(yomigana, strlen(yomigana), &len);
+    TEST_ASSERT_NOT_NULL(found);
+    TEST_ASSERT_EQUAL(strlen(expected), len);
+    TEST_ASSERT(memcmp(found, expected, len) == 0);
+}
+
+
+void test_userdict_learn_and_replay(void) {
+    remove_files();
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        uint8_t len;
+        TEST_ASSERT_NULL(f.dict.find("kanji", 5, &len));
+        TEST_ASSERT_TRUE(f.dict.learn("kanji", 5, "KANJI", 5));
+        TEST_ASSERT_TRUE(f.dict.learn("kana", 4, "KANA", 4));
+        // The later selection wins
+        TEST_ASSERT_TRUE(f.dict.learn("kanji", 5, "Kanji", 5));
+        assert_found(&f.dict, "kanji", "Kanji");
+        TEST_ASSERT_EQUAL(2, f.dict.dirty_count);
+    }
+    {
+        // Read back from the log
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        TEST_ASSERT_FALSE(f.dict.has_dict);
+        assert_found(&f.dict, "kanji", "Kanji");
+        assert_found(&f.dict, "kana", "KANA");
+    }
+}
+
+
+void test_userdict_compact(void) {
+    remove_files();
+    const char* keys[] = { "a", "bb", "ccc", "dddd", "ee", "f" };
+    const char* cands[] = { "A", "BB", "CCC", "DDDD", "EE", "F" };
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        // The 4th distinct entry fills the table and triggers compaction
+        for (int i = 0; i < 6; i++) {
+            TEST_ASSERT_TRUE(f.dict.learn(keys[i], strlen(keys[i]), cands[i], strlen(cands[i])));
+        }
+        TEST_ASSERT_TRUE(f.dict.has_dict);
+        TEST_ASSERT_EQUAL(2, f.dict.dirty_count);
+        // Overwrite an entry that is already in the compacted dict
+        TEST_ASSERT_TRUE(f.dict.learn("bb", 2, "Bb", 2));
+    }
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        TEST_ASSERT_TRUE(f.dict.has_dict);
+        TEST_ASSERT_EQUAL(3, f.dict.dirty_count);
+        for (int i = 0; i < 6; i++) {
+            assert_found(&f.dict, keys[i], i == 1 ? "Bb" : cands[i]);
+        }
+        // Not learned. Must not match a shorter key that is a prefix of it.
+        uint8_t len;
+        TEST_ASSERT_NULL(f.dict.find("ab", 2, &len));
+        TEST_ASSERT_NULL(f.dict.find("cccc", 4, &len));
+
+        TEST_ASSERT_TRUE(f.dict.compact());
+        TEST_ASSERT_EQUAL(0, f.dict.dirty_count);
+        TEST_ASSERT_EQUAL(SKK::UserDict::LOG_HEADER_LENGTH, f.logfile.size());
+        assert_found(&f.dict, "bb", "Bb");
+    }
+}
+
+
+/** Copy the first len bytes of src over dst, as if a copy was cut off */
+static void write_truncated_copy(const char* src, const char* dst, uint32_t len) {
+    CstdioFileAccessor in;
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(in.open(src, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(out.open(dst, FileAccessWrapper::FileMode::WRITE));
+    uint8_t buf[256];
+    TEST_ASSERT(len <= sizeof(buf));
+    TEST_ASSERT_EQUAL(len, in.read(buf, len));
+    out.write(buf, len);
+    in.close();
+    out.close();
+}
+
+
+void test_userdict_recover_interrupted_compact(void) {
+    remove_files();
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        TEST_ASSERT_TRUE(f.dict.learn("kanji", 5, "KANJI", 5));
+        TEST_ASSERT_TRUE(f.dict.learn("kana", 4, "KANA", 4));
+        TEST_ASSERT_TRUE(f.dict.compact());
+        // Learned after the compaction, so only in the log
+        TEST_ASSERT_TRUE(f.dict.learn("kanji", 5, "Kanji", 5));
+    }
+    // Power was lost while copying the work file over the compacted dict
+    write_truncated_copy(FILEPATH_WORK, FILEPATH_DICT, 12);
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        TEST_ASSERT_TRUE(f.dict.has_dict);
+        assert_found(&f.dict, "kana", "KANA");
+        assert_found(&f.dict, "kanji", "Kanji");
+    }
+    // A truncated work file must not replace a complete dict
+    write_truncated_copy(FILEPATH_DICT, FILEPATH_WORK, 12);
+    {
+        Fixture f;
+        TEST_ASSERT_TRUE(f.init());
+        TEST_ASSERT_TRUE(f.dict.has_dict);
+        assert_found(&f.dict, "kana", "KANA");
+    }
+}
+
+
+/** Write an SKD with one entry "key" -> "A", "BB", "C" */
+static void write_multi_candidate_dict(void) {
+    const uint8_t entry[] = { 3, 'k', 'e', 'y', 3, 7, 0, 1, 'A', 2, 'B', 'B', 1, 'C' };
+    CstdioFileAccessor out;
+    TEST_ASSERT_TRUE(out.open(FILEPATH_MULTI, FileAccessWrapper::FileMode::WRITE));
+    write_skd_single_table(&out, "key", entry, sizeof(entry));
+    out.close();
+}
+
+
+void test_candidatereader_pinned(void) {
+    remove_files();
+    write_multi_candidate_dict();
+    CstdioFileAccessor file;
+    SKK::SkkDict dict;
+    TEST_ASSERT_TRUE(file.open(FILEPATH_MULTI, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(dict.init(&file));
+
+    char buf[8];
+    SKK::CandidateReader reader;
+    uint8_t comparelen;
+    uint32_t addr = dict.search_startaddr_from_index_for("key", 3, &comparelen);
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(addr, false, comparelen, "key", 3, &reader));
+    TEST_ASSERT_EQUAL(3, reader.get_candidates_count());
+
+    // Pinned candidate that is also in the dict: not repeated
+    reader.set_pinned("BB", 2);
+    TEST_ASSERT_EQUAL(3, reader.get_candidates_count());
+    const char* expected[] = { "BB", "A", "C" };
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(i + 1, reader.get_current_index());
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[i], buf);
+        reader.move_next();
+    }
+    TEST_ASSERT_TRUE(reader.is_reached_end());
+
+    // Pinned candidate that is not in the dict: added in front
+    TEST_ASSERT_TRUE(dict.search_henkanentry_for(addr, false, comparelen, "key", 3, &reader));
+    reader.set_pinned("Z", 1);
+    TEST_ASSERT_EQUAL(4, reader.get_candidates_count());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("Z", buf);
+    reader.move_next();
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("A", buf);
+    reader.move_head();
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("Z", buf);
+
+    file.close();
+    remove_files();
+}
+
+
+void test_skkengine_learned_first(void) {
+    remove_files();
+    write_multi_candidate_dict();
+    CstdioFileAccessor file;
+    CountingFileAccessor counter(&file);
+    SKK::SkkDict sysdict;
+    TEST_ASSERT_TRUE(counter.open(FILEPATH_MULTI, FileAccessWrapper::FileMode::READ));
+    TEST_ASSERT_TRUE(sysdict.init(&counter));
+
+    Fixture f;
+    TEST_ASSERT_TRUE(f.init());
+    TEST_ASSERT_TRUE(f.dict.learn("key", 3, "BB", 2));
+
+    SKK::SkkEngine engine;
+    engine.init();
+    engine.set_sysdict(&sysdict);
+    engine.set_learningdict(&f.dict);
+
+    // The learned candidate comes back without touching the dictionary
+    char buf[8];
+    SKK::CandidateReader reader;
+    counter.reset_counts();
+    TEST_ASSERT_TRUE(engine.henkan("key", 3, &reader));
+    TEST_ASSERT_EQUAL(0, counter.read_calls);
+    TEST_ASSERT_EQUAL(0, counter.seek_calls);
+    TEST_ASSERT_TRUE(reader.is_pinned_only());
+    TEST_ASSERT_EQUAL(1, reader.get_candidates_count());
+    read_candidate(&reader, buf);
+    TEST_ASSERT_EQUAL_STRING("BB", buf);
+
+    // Asking for all candidates searches the dictionary and removes the duplicate
+    TEST_ASSERT_TRUE(engine.henkan("key", 3, &reader, true));
+    TEST_ASSERT_FALSE(reader.is_pinned_only());
+    TEST_ASSERT_EQUAL(3, reader.get_candidates_count());
+    const char* expected[] = { "BB", "A", "C" };
+    for (int i = 0; i < 3; i++) {
+        read_candidate(&reader, buf);
+        TEST_ASSERT_EQUAL_STRING(expected[i], buf);
+        reader.move_next();
+    }
+
+    // Learning another key does not affect this one; unknown keys are not found
+    TEST_ASSERT_TRUE(f.dict.learn("other", 5, "O", 1));
+    TEST_ASSERT_TRUE(engine.henkan("key", 3, &reader));
+    TEST_ASSERT_TRUE(reader.is_pinned_only());
+    TEST_ASSERT_FALSE(engine.henkan("none", 4, &reader));
+
+    file.close();
+    remove_files();
+}
+
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_userdict_learn_and_replay);
+    RUN_TEST(test_userdict_compact);
+    RUN_TEST(test_userdict_recover_interrupted_compact);
+    RUN_TEST(test_candidatereader_pinned);
+    RUN_TEST(test_skkengine_learned_first);
+
+    return UNITY_END();
+}
@@ -190,6 +190,8 @@ class SkkDictBinaryConverter:
 
     def __init__(self) -> None:
         self.entries:List[DataEntry_str] = []
+        # 送りありの項目。'TBL' とは別の 'OKR' 区間に置く
+        self.okuriari_entries:List[DataEntry_str] = []
         self.indexentries:List[IndexEntry_str] = []
         self.maximum_index_key_length = -1
         self.comment_str = ""
@@ -211,8 +213,15 @@ class SkkDictBinaryConverter:
         try:
             yomigana, candidates = line.split(' ', 1)
             candidates = [ v for v in candidates.split('/') if len(v) > 0 ]
+            ent = DataEntry_str(yomigana, candidates)
+            if self.is_okuriari_entry(ent):
+                # 送り仮名ごとの候補のブロック（"[わ/愛し合/]"）は、ブロックの外の候補と重なるので取り除く
+                candidates = self.remove_okuri_blocks(candidates)
             # 注記を取り除く（角変換候補のうち ';' 以降）
             candidates = [ v.split(';')[0] for v in candidates ]
+            if self.is_okuriari_entry(ent):
+                # 注記を取り除くと同じになる候補は、先のものだけを残す
+                candidates = list(dict.fromkeys(candidates))
         except:
             print("Exception in \"{}\"".format(line))
             traceback.print_exc()
@@ -221,6 +230,26 @@ class SkkDictBinaryConverter:
         return DataEntry_str(yomigana, candidates)
 
 
+    @staticmethod
+    def remove_okuri_blocks(candidates:List[str]) -> List[str]:
+        """
+        送りありの項目の候補から、"[" で始まり "]" で終わる送り仮名ごとのブロックを取り除く。
+        "あいしあw /愛し合/[わ/愛し合/]/" を '/' で区切った ['愛し合', '[わ', '愛し合', ']'] なら ['愛し合'] になる。
+        """
+        result = []
+        in_block = False
+        for v in candidates:
+            if in_block:
+                if v == ']':
+                    in_block = False
+                continue
+            if v.startswith('['):
+                in_block = True
+                continue
+            result.append(v)
+        return result
+
+
     def load_entries(self) -> None:
         self.yomigana_maxlen = -1
 
@@ -234,12 +263,14 @@ class SkkDictBinaryConverter:
             ent = self.read_entry(line)
 
             if self.is_entry_to_be_removed(ent):
-                pass
+                continue
+            elif self.is_okuriari_entry(ent):
+                self.okuriari_entries.append(ent)
             else:
                 self.entries.append(ent)
-                yomiganalen = len(ent.key.encode(ENC_SHIFTJIS))
-                if yomiganalen > self.yomigana_maxlen:
-                    self.yomigana_maxlen = yomiganalen
+            yomiganalen = len(ent.key.encode(ENC_SHIFTJIS))
+            if yomiganalen > self.yomigana_maxlen:
+                self.yomigana_maxlen = yomiganalen
 
         # self.entries.sort(key=lambda v: Util.convert_lebytes_to_uint16(v[0][0].encode("shiftjis")))
         # self.entries.sort(key=lambda v: v[0])
@@ -264,6 +295,7 @@ class SkkDictBinaryConverter:
 
 
         logger.debug("load_entries(): Loaded {} entries.".format(len(self.entries)))
+        logger.debug("load_entries(): Loaded {} okuri-ari entries.".format(len(self.okuriari_entries)))
         logger.debug("load_entries(): Yomigana maximum byte length = {}".format(self.yomigana_maxlen))
 
 
@@ -1012,6 +1044,299 @@ class SkkDictBinaryConverter:
             return False
 
 
+    def is_okuriari_entry(self, ent:DataEntry_str) -> bool:
+        """
+        送りありの項目（"かk /書/欠/" のように、語幹の後ろに送り仮名の子音が付くもの）か否かを判定する
+        """
+        return len(ent.key) >= 2 and self.is_alphabet(ent.key[-1]) and not self.is_alphabet(ent.key[-2])
+
+
+    def generate_okuriari_section(self, section_address:int) -> bytearray:
+        """
+        送りありの項目を、'TBL' の後ろに置く 'OKR' 区間として生成する。
+        'OKR' と区間の長さ (uint24) のあとに、スロット内のキーのバイト数 (uint8) とスロットの個数 (uint16) を置き、
+        読み仮名の先頭1文字をキーとする固定長スロット (NULでパディングしたキー + uint24のアドレス) をキーの昇順に並べる。
+        その後ろに、'TBL' と同じ形式の項目を読み仮名の昇順に並べる。
+        section_address は 'OKR' を置くアドレスで、スロットのアドレスはファイル先頭からの位置になる。
+        """
+        entries = sorted(self.okuriari_entries, key=lambda ent: ent.key.encode(ENC_SHIFTJIS))
+
+        # 先頭1文字が同じ項目の並びごとに、その最初の項目の位置をスロットにする
+        slots:List[Tuple[bytes, int]] = []
+        entries_bytes = bytearray()
+        for ent in entries:
+            headkey = ent.key[0].encode(ENC_SHIFTJIS)
+            if len(slots) == 0 or slots[-1][0] != headkey:
+                slots.append((headkey, len(entries_bytes)))
+            entries_bytes.extend(ent.to_bytes())
+
+        slot_keylen = max([ len(key) for key, _ in slots ], default=0)
+        entries_address = section_address + 3 + 3 + 1 + 2 + (slot_keylen + 3) * len(slots)
+
+        body = bytearray()
+        body.extend(Util.convert_uint8_to_bytes(slot_keylen))
+        body.extend(Util.convert_uint16_to_bytes(len(slots)))
+        for key, offset in slots:
+            body.extend(key + bytes(slot_keylen - len(key)))
+            body.extend(Util.convert_uint24_to_bytes(entries_address + offset))
+        body.extend(entries_bytes)
+
+        b = bytearray()
+        b.extend(list('OKR'.encode("ascii")))
+        b.extend(Util.convert_uint24_to_bytes(len(body)))
+        b.extend(body)
+
+        logger.info("generate_okuriari_section(): {} entries, {} slots, {} bytes.".format(len(entries), len(slots), len(b)))
+        return b
+
+
+    # 'TBZ' の定型句の最大数、定型句の表の最大バイト数、定型句の最大文字数
+    MAX_PHRASES = 48
+    MAX_PHRASES_BYTES = 192
+    MAX_PHRASE_CHARS = 4
+    # 'TBZ' のブロック内の、以降が詰め物であることを示す値
+    BLOCK_END_MARK = 0xFF
+
+
+    @staticmethod
+    def is_phrase_code(b:int) -> bool:
+        """
+        定型句の番号に使うバイトか否か（Shift_JISの文字の先頭には現れない値）
+        """
+        return b < 0x20 or 0xF0 <= b
+
+
+    @staticmethod
+    def get_phrase_code(index:int) -> int:
+        return index if index < 0x20 else 0xF0 + (index - 0x20)
+
+
+    def select_phrases(self, candidates:List[str]) -> List[str]:
+        """
+        変換候補に頻出する文字列を、1バイトの番号に置き換える定型句として選ぶ。
+        置き換えで減るバイト数の見込みが大きいものから、表の大きさの上限まで選ぶ。
+        """
+        counts:Dict[str, int] = {}
+        for candidate in candidates:
+            for head in range(len(candidate)):
+                for length in range(1, self.MAX_PHRASE_CHARS + 1):
+                    if head + length > len(candidate):
+                        break
+                    s = candidate[head:head+length]
+                    counts[s] = counts.get(s, 0) + 1
+
+        scored:List[Tuple[int, str]] = []
+        for s, count in counts.items():
+            bytelen = len(s.encode(ENC_SHIFTJIS))
+            if bytelen < 2:
+                continue
+            # 出現ごとに (バイト数 - 1) 減り、表に (1 + バイト数) 増える
+            gain = count * (bytelen - 1) - (1 + bytelen)
+            if gain > 0:
+                scored.append((gain, s))
+        scored.sort(key=lambda v: (-v[0], v[1]))
+
+        phrases:List[str] = []
+        tablelen = 0
+        for _, s in scored:
+            if len(phrases) >= self.MAX_PHRASES:
+                break
+            bytelen = len(s.encode(ENC_SHIFTJIS))
+            if tablelen + 1 + bytelen > self.MAX_PHRASES_BYTES:
+                continue
+            # 選んだ定型句の一部分でしかないものは、ほとんど置き換わらないので選ばない
+            if any(s in p for p in phrases):
+                continue
+            phrases.append(s)
+            tablelen += 1 + bytelen
+        return phrases
+
+
+    def encode_candidate(self, candidate:str, phrases:Dict[str, int]) -> bytes:
+        """
+        変換候補を 'TBZ' の形式にする。先頭に展開後のバイト数を置き、定型句は先頭から最長一致で番号に置き換える。
+        """
+        b = bytearray()
+        decodedlen = len(candidate.encode(ENC_SHIFTJIS))
+        if decodedlen > 0xFF:
+            raise Exception("Candidate is too long: {}".format(candidate))
+        b.extend(Util.convert_uint8_to_bytes(decodedlen))
+        pos = 0
+        while pos < len(candidate):
+            for length in range(self.MAX_PHRASE_CHARS, 0, -1):
+                s = candidate[pos:pos+length]
+                if len(s) == length and s in phrases:
+                    b.append(phrases[s])
+                    pos += length
+                    break
+            else:
+                chbytes = candidate[pos].encode(ENC_SHIFTJIS)
+                if self.is_phrase_code(chbytes[0]):
+                    raise Exception("Character conflicts with phrase codes: {}".format(repr(candidate)))
+                b.extend(chbytes)
+                pos += 1
+        return bytes(b)
+
+
+    def convert_table_to_blocks(self, binarydict:bytearray, block_size:int=512) -> bytearray:
+        """
+        'TBL' の変換候補テーブルを、固定長のブロックに詰めた 'TBZ' 形式へ置き換えたバイナリを生成する。
+        'TBZ' (uint24 区間の長さ) のあとに、ブロックのバイト数 (uint16)、定型句の個数 (uint8)、
+        定型句の表のバイト数 (uint16)、定型句 ([長さ][バイト列]) を置き、ファイル上で block_size の倍数の位置まで詰め物をする。
+        以降は block_size バイトごとのブロックで、項目はブロックの先頭から並べる。
+          項目：[直前の項目と共通する読み仮名のバイト数][残りのバイト数][残りの読み仮名][候補の個数][候補の総バイト数 (uint16)][候補...]
+          候補：[展開後のバイト数][定型句の番号を含むバイト列]
+        ブロックの先頭の項目と、インデックスが指す項目は、共通部分を0にして単独で読めるようにする。
+        項目がブロックの残りに収まらなければ BLOCK_END_MARK で埋めて次のブロックへ移る（ブロックより大きい項目は、次のブロックの先頭から続けて置き、その後ろを埋める）。
+        block_size をSDカードのセクタと同じにすると、1つのブロックを1回の読み込みで読める。
+        インデックスのアドレスは書き換えるので、'IDS' への変換の後、'OKR' の追加の前に行なう。
+        """
+        b = binarydict
+        addr = 3 + 3 # 'SKD' + uint24
+        commentlen = Util.convert_lebytes_to_uint16(b[addr:addr+2])
+        addr += 2 + commentlen
+        addr += 2 # yomiganamaxlen
+        index_magic = bytes(b[addr:addr+3])
+        addr += 3
+        indexlen = Util.convert_lebytes_to_uint24(b[addr:addr+3])
+        addr += 3
+        index_head = addr
+        index_tail = index_head + indexlen
+        table_magic_addr = index_tail
+        if bytes(b[table_magic_addr:table_magic_addr+3]) != b'TBL':
+            raise Exception("Magic number not found. TBL")
+        tablelen = Util.convert_lebytes_to_uint24(b[table_magic_addr+3:table_magic_addr+6])
+        table_head = table_magic_addr + 6
+        table_tail = table_head + tablelen
+
+        # インデックスのアドレス値の位置
+        address_positions:List[int] = []
+        if index_magic == b'IDX':
+            pos = index_head
+            while pos < index_tail:
+                keylen = b[pos]
+                pos += 1 + keylen
+                address_positions.append(pos)
+                pos += 3
+        elif index_magic == b'IDS':
+            slot_keylen = b[index_head]
+            pos = index_head + 1
+            while pos < index_tail:
+                pos += slot_keylen
+                address_positions.append(pos)
+                pos += 3
+        else:
+            raise Exception("Unknown index {}".format(index_magic))
+        index_targets = set([ Util.convert_lebytes_to_uint24(b[pos:pos+3]) for pos in address_positions ])
+
+        # 'TBL' の項目を読む
+        entries:List[Tuple[int, bytes, List[str]]] = []
+        pos = table_head
+        while pos < table_tail:
+            entry_addr = pos
+            keylen = b[pos] & 0x7F
+            pos += 1
+            key = bytes(b[pos:pos+keylen])
+            pos += keylen
+            count = b[pos]
+            pos += 1 + 2
+            candidates:List[str] = []
+            for _ in range(count):
+                candlen = b[pos]
+                candidates.append(bytes(b[pos+1:pos+1+candlen]).decode(ENC_SHIFTJIS))
+                pos += 1 + candlen
+            entries.append((entry_addr, key, candidates))
+
+        phraselist = self.select_phrases([ c for _, _, cands in entries for c in cands ])
+        phrases = { s: self.get_phrase_code(i) for i, s in enumerate(phraselist) }
+        phrasebytes = bytearray()
+        for s in phraselist:
+            sbytes = s.encode(ENC_SHIFTJIS)
+            phrasebytes.extend(Util.convert_uint8_to_bytes(len(sbytes)))
+            phrasebytes.extend(sbytes)
+
+        header = bytearray()
+        header.extend(Util.convert_uint16_to_bytes(block_size))
+        header.extend(Util.convert_uint8_to_bytes(len(phraselist)))
+        header.extend(Util.convert_uint16_to_bytes(len(phrasebytes)))
+        header.extend(phrasebytes)
+        blocks_head = table_head + len(header)
+        padding = (block_size - blocks_head % block_size) % block_size
+        header.extend(bytes(padding))
+        blocks_head += padding
+
+        blocks = bytearray()
+        new_address:Dict[int, int] = {}
+        block_used = 0
+        prev_key = b''
+        for entry_addr, key, candidates in entries:
+            encoded_candidates = bytearray()
+            for candidate in candidates:
+                encoded_candidates.extend(self.encode_candidate(candidate, phrases))
+
+            def encode_entry(sharedlen:int) -> bytes:
+                e = bytearray()
+                e.extend([ sharedlen, len(key) - sharedlen ])
+                e.extend(key[sharedlen:])
+                e.append(len(candidates))
+                e.extend(Util.convert_uint16_to_bytes(len(encoded_candidates)))
+                e.extend(encoded_candidates)
+                return bytes(e)
+
+            sharedlen = 0
+            if block_used > 0 and entry_addr not in index_targets:
+                while sharedlen < len(prev_key) and sharedlen < len(key) and prev_key[sharedlen] == key[sharedlen]:
+                    sharedlen += 1
+            e = encode_entry(sharedlen)
+            if block_used > 0 and block_used + len(e) > block_size:
+                blocks.extend([ self.BLOCK_END_MARK ] * (block_size - block_used))
+                block_used = 0
+                e = encode_entry(0)
+
+            new_address[entry_addr] = blocks_head + len(blocks)
+            blocks.extend(e)
+            block_used += len(e)
+            if block_used >= block_size:
+                # ブロックより大きい項目の後ろは、次のブロックの先頭まで埋める
+                remains = block_used % block_size
+                if remains > 0:
+                    blocks.extend([ self.BLOCK_END_MARK ] * (block_size - remains))
+                block_used = 0
+            prev_key = key
+
+        newb = bytearray()
+        newb.extend(b[:table_magic_addr])
+        newb.extend(list('TBZ'.encode("ascii")))
+        newb.extend(Util.convert_uint24_to_bytes(len(header) + len(blocks)))
+        newb.extend(header)
+        newb.extend(blocks)
+        newb.extend(b[table_tail:])
+
+        for pos in address_positions:
+            oldaddr = Util.convert_lebytes_to_uint24(newb[pos:pos+3])
+            if oldaddr in new_address:
+                newb[pos:pos+3] = Util.convert_uint24_to_bytes(new_address[oldaddr])
+
+        # Update File size
+        newb[3:6] = Util.convert_3bytes_to_lebytes(len(newb))
+
+        logger.info("convert_table_to_blocks(): {} phrases, {} blocks, table {} -> {} bytes.".format(len(phraselist), (len(blocks) + block_size - 1) // block_size, tablelen, len(header) + len(blocks)))
+        return newb
+
+
+    def append_okuriari_section(self, binarydict:bytearray) -> bytearray:
+        """
+        バイナリの末尾（'TBL' の後ろ）に 'OKR' 区間を追加する。
+        インデックスの形式を変えるとテーブルのアドレスがずれるので、その後に行なう。
+        """
+        newb = bytearray(binarydict)
+        newb.extend(self.generate_okuriari_section(len(binarydict)))
+
+        # Update File size
+        newb[3:6] = Util.convert_3bytes_to_lebytes(len(newb))
+        return newb
+
+
     def value_indexentry_address(self, binarydict:bytearray, searchtarget:bytes, newaddress:Optional[int]=None) -> Optional[int]:
         # b:bytes= self.new_content
         b = binarydict
@@ -1168,6 +1493,54 @@ class SkkDictBinaryConverter:
                 logger.debug("Not found address {} for {}".format(headaddr, indexentry[0]))
 
 
+    def convert_index_to_sorted_slots(self, binarydict:bytearray) -> bytearray:
+        """
+        'IDX' 形式のインデックスを、二分探索できる 'IDS' 形式へ置き換えたバイナリを生成する。
+        'IDS' は先頭1バイトにスロット内のキーのバイト数を置き、
+        以降に (NULでパディングした固定長のキー + uint24のアドレス) のスロットをキーの昇順に並べる。
+        アドレスが埋め込まれなかった項目は含めない。
+        """
+        b = binarydict
+        addr = 3 + 3 # 'SKD' + uint24
+        commentlen = Util.convert_lebytes_to_uint16(b[addr:addr+2])
+        addr += 2 + commentlen
+        addr += 2 # yomiganamaxlen
+        index_magic_addr = addr
+        addr += 3 # 'IDX'
+        old_indexlen = Util.convert_lebytes_to_uint24(b[addr:addr+3])
+        addr += 3
+        old_index_tail = addr + old_indexlen
+
+        entries = [ (key.encode("shiftjis"), keyaddr) for key, keyaddr in self.get_indexentries_from_binary(b) if keyaddr != 0 ]
+        entries.sort(key=lambda ent: ent[0])
+        slot_keylen = max([ len(key) for key, _ in entries ], default=0)
+        if slot_keylen > 0xFF:
+            raise Exception("Index key is too long for 'IDS': {} bytes".format(slot_keylen))
+
+        new_indexlen = 1 + (slot_keylen + 3) * len(entries)
+        # インデックス部の大きさが変わった分だけ、変換候補テーブルのアドレスがずれる
+        delta = new_indexlen - old_indexlen
+
+        newindex = bytearray()
+        newindex.extend(Util.convert_uint8_to_bytes(slot_keylen))
+        for key, keyaddr in entries:
+            newindex.extend(key + bytes(slot_keylen - len(key)))
+            newindex.extend(Util.convert_uint24_to_bytes(keyaddr + delta))
+
+        newb = bytearray()
+        newb.extend(b[:index_magic_addr])
+        newb.extend(list('IDS'.encode("ascii")))
+        newb.extend(Util.convert_uint24_to_bytes(len(newindex)))
+        newb.extend(newindex)
+        newb.extend(b[old_index_tail:])
+
+        # Update File size
+        newb[3:6] = Util.convert_3bytes_to_lebytes(len(newb))
+
+        logger.info("convert_index_to_sorted_slots(): {} slots, keylen={}, index {} -> {} bytes.".format(len(entries), slot_keylen, old_indexlen, new_indexlen))
+        return newb
+
+
     def sort_entries_indexbased(self) -> None:
         """
         生成済みのインデックスをもとに、変換候補を並び変える。
@@ -1226,6 +1599,16 @@ def main():
     if True:
         source_filepath = sys.argv[1]
         maximum_index_key_length = int(sys.argv[2])
+        # インデックスの形式 "linear" ('IDX') または "sorted" ('IDS')
+        index_format = sys.argv[3] if len(sys.argv) >= 4 else "linear"
+        if index_format not in ("linear", "sorted"):
+            print("Unknown index format \"{}\"".format(index_format))
+            sys.exit(1)
+        # 変換候補テーブルの形式 "plain" ('TBL') または "blocks" ('TBZ')
+        table_format = sys.argv[4] if len(sys.argv) >= 5 else "plain"
+        if table_format not in ("plain", "blocks"):
+            print("Unknown table format \"{}\"".format(table_format))
+            sys.exit(1)
     dest_filepath = source_filepath + "_SKKDICT-" + str(int(time.time()))
 
     print("Loading \"{}\"".format(source_filepath))
@@ -1265,6 +1648,20 @@ def main():
     util.write_correct_address_for_index(skkbinarydict_bytearray)
     print("OK.")
 
+    if index_format == "sorted":
+        print("Convert index to sorted slots...")
+        skkbinarydict_bytearray = util.convert_index_to_sorted_slots(skkbinarydict_bytearray)
+        print("OK.")
+
+    if table_format == "blocks":
+        print("Convert table to blocks...")
+        skkbinarydict_bytearray = util.convert_table_to_blocks(skkbinarydict_bytearray)
+        print("OK.")
+
+    print("Append okuri-ari section...")
+    skkbinarydict_bytearray = util.append_okuriari_section(skkbinarydict_bytearray)
+    print("OK.")
+
     # print("dump_index_statistic() ...")
     # util.dump_index_statistic()
     # print("OK.")
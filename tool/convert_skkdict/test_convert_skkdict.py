@@ -0,0 +1,32 @@
+"""
+convert_skkdict.py のテスト
+
+`python -m unittest test_convert_skkdict` で実行する。
+"""
+
+import unittest
+
+from convert_skkdict import SkkDictBinaryConverter
+
+
+class ReadEntryTest(unittest.TestCase):
+
+    def setUp(self) -> None:
+        self.converter = SkkDictBinaryConverter()
+
+    def test_okuriari_blocks_are_removed(self) -> None:
+        ent = self.converter.read_entry("あいしあw /愛し合/[わ/愛し合/]/[う/愛し合/]/")
+        self.assertEqual(ent.key, "あいしあw")
+        self.assertEqual(ent.values, ["愛し合"])
+
+    def test_okuriari_duplicates_are_removed(self) -> None:
+        ent = self.converter.read_entry("かk /書;write/欠/書/[く/書/]/")
+        self.assertEqual(ent.values, ["書", "欠"])
+
+    def test_okurinasi_brackets_are_kept(self) -> None:
+        ent = self.converter.read_entry("かっこ /[/]/「;注/")
+        self.assertEqual(ent.values, ["[", "]", "「"])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -23,6 +23,11 @@ from typing import List, Optional, Tuple
 
 
 romajitablefilepath = "romajitable.txt"
+outputfilepath = "romajidef.h"
+
+# firmware/lib/romaji/src/romaji.h の romajientry_t と合わせること
+ROMAJI_MAX_LENGTH = 4
+ROMAJI_HIRAGANA_MAX_LENGTH = 4
 
 def c_binstr(data:bytes) -> str:
     s = ""
@@ -31,47 +36,66 @@ def c_binstr(data:bytes) -> str:
     s += ""
     return s
 
-def format_romaji_hiragana(romaji:str, hiragana:str, hiraganabytelength:int) -> str:
-    s = "{{ \"{}\", \"{}\", {} }}"
-    return s.format(romaji, c_binstr(hiragana), hiraganabytelength)
+def format_romaji_hiragana(romaji:str, hiragana:bytes, hiraganabytelength:int) -> str:
+    s = "{{ \"{}\", \"{}\", {}, {} }}"
+    return s.format(romaji, c_binstr(hiragana), hiraganabytelength, len(hiragana))
+
+
+def load_romajitable(filepath:str) -> List[Tuple[bytes, bytes, int]]:
+    entries = []
+    with open(filepath, "rb") as f:
+        for line in f.readlines():
+            line = line.strip(b'\r\n')
+            if line[0:1] == b'#' or len(line.strip()) == 0:
+                continue
+            romaji, hiragana, hiraganabytelen = line.split(b',')
+            romaji = romaji.strip(b' ')
+            hiragana = hiragana.strip(b' ')
+            hiraganabytelen = int(hiraganabytelen.strip(b' '))
+            entries.append((romaji, hiragana, hiraganabytelen))
+    return entries
 
 
 def main():
-    f = open(romajitablefilepath, "rb")
+    entries = load_romajitable(romajitablefilepath)
+
+    # 同じローマ字が複数あるときは、先に書かれたものを使う（従来の線形探索と同じ）
+    table = {}
+    for romaji, hiragana, hiraganabytelen in entries:
+        if len(romaji) > ROMAJI_MAX_LENGTH:
+            raise ValueError("Too long romaji: {}".format(romaji))
+        if len(hiragana) > ROMAJI_HIRAGANA_MAX_LENGTH:
+            raise ValueError("Too long hiragana: {}".format(romaji))
+        if romaji in table:
+            print("Duplicated romaji ignored: {}".format(romaji.decode("ascii")))
+            continue
+        table[romaji] = (hiragana, hiraganabytelen)
+
     s = ""
 
     s += """
-typedef struct {
-    const char* romaji;
-    const char* hiragana;
-    uint8_t hiraganabytelength;
-} romajientry_t;
+// このファイルは tool/generate_romajitable/generate_romajitable.py で生成する。直接編集しないこと。
+// romajientry_t は romaji.h で定義する。
 
-romajientry_t romajitable[] = {
+// ローマ字の昇順（NUL埋めしたバイト列として）に並べる。romaji_lookup() はこの順序に依存する
+const romajientry_t romajitable[] = {
 
 """.lstrip()
 
-    for line in f.readlines():
-        line = line.strip(b'\n')
-        if line[0:1] == b'#':
-            continue
-        print(line)
-        romaji, hiragana, hiraganabytelen = line.split(b',')
-        romaji = romaji.strip(b' ')
-        hiragana = hiragana.strip(b' ')
-        hiraganabytelen = hiraganabytelen.strip(b' ')
+    # NULはアルファベットより小さいので、"n" の直後に "na", "nb", ... が並ぶ
+    for romaji in sorted(table.keys()):
+        hiragana, hiraganabytelen = table[romaji]
         s += "    "
-        s += format_romaji_hiragana(romaji.decode("ascii"), hiragana, hiraganabytelen.decode("ascii"))
+        s += format_romaji_hiragana(romaji.decode("ascii"), hiragana, hiraganabytelen)
         s += ",\n"
-    
-    f.close()
+
     s = s.strip(",\n")
     s += "\n};\n"
-    s += "\n#define ROMAJITABLE_ENTRIES (sizeof(romajitable) / sizeof(romajientry_t))\n"
+    s += "\nconstexpr uint8_t ROMAJITABLE_ENTRIES = sizeof(romajitable) / sizeof(romajientry_t);\n"
 
     print(s)
 
-    with open("romajidef.h", "w", encoding="ascii") as f2:
+    with open(outputfilepath, "w", encoding="utf-8", newline="\r\n") as f2:
         f2.write(s)
 
 
@@ -361,16 +361,73 @@ class SkkBinaryFile:
             f.write(data)
 
 
+class KutenDenseTableFile:
+    """
+    区点番号から直接位置を求められる変換テーブル
+
+    ヘッダ（16バイト）:
+      'TED' (Text encoding dense table), バージョン(1), スロットのバイト数(4), 区の数(94), 点の数(94), 予約(0埋め)
+    ヘッダに続いて、第1区第1点から第94区第94点までの順に、4バイト固定長のスロットが並ぶ。
+    区点(ku, ten)のスロットの位置は HEADER_LENGTH + ((ku - 1) * 94 + (ten - 1)) * 4 となる。
+    スロットにはGB18030のバイト列を先頭から詰め、余りは0で埋める。変換できない区点のスロットはすべて0とする。
+    """
+
+    MAGIC = b'TED'
+    VERSION = 1
+    HEADER_LENGTH = 16
+    SLOT_SIZE = 4
+    KU_COUNT = 94
+    TEN_COUNT = 94
+
+    def __init__(self) -> None:
+        self.slots:Dict[Tuple[int, int], bytes] = {}
+
+    def add_entry(self, kuten:Tuple[int, int], gb18030:bytes) -> None:
+        assert(1 <= len(gb18030) <= self.SLOT_SIZE)
+        assert(gb18030[0] != 0)
+        self.slots[kuten] = gb18030
+
+    @classmethod
+    def slot_offset(cls, kuten:Tuple[int, int]) -> int:
+        ku, ten = kuten
+        return cls.HEADER_LENGTH + ((ku - 1) * cls.TEN_COUNT + (ten - 1)) * cls.SLOT_SIZE
+
+    def build_binary(self) -> bytes:
+        data = bytearray()
+        data.extend(self.MAGIC)
+        data.extend(bytes([self.VERSION, self.SLOT_SIZE, self.KU_COUNT, self.TEN_COUNT]))
+        data.extend(bytes(self.HEADER_LENGTH - len(data)))
+        data.extend(bytes(self.KU_COUNT * self.TEN_COUNT * self.SLOT_SIZE))
+
+        for kuten, gb18030 in self.slots.items():
+            offset = self.slot_offset(kuten)
+            data[offset:offset+len(gb18030)] = gb18030
+
+        return bytes(data)
+
+    def save(self, filepath:str) -> None:
+        data = self.build_binary()
+        with open(filepath, "wb") as f:
+            f.write(data)
+
+
 def main():
     print("Start")
 
+    # --legacy を指定すると、従来のSKK辞書形式で出力する
+    use_legacy_format = "--legacy" in sys.argv[1:]
+
     # SJIS表記の全パターンのリストを作る
     srclist_sjis:List[bytes] = []
 
+    # SJISのバイト列と区点番号の対応
+    kuten_of_sjis:Dict[bytes, Tuple[int, int]] = {}
+
     for ku in range(1, 94+1):
         for ten in range(1, 94+1):
             sjisbytes = SJISUtil.kuten_to_sjis((ku, ten))
             srclist_sjis.append(sjisbytes)
+            kuten_of_sjis[sjisbytes] = (ku, ten)
 
     print("SJIS source list generated. {} items.".format(len(srclist_sjis)))
 
@@ -402,15 +459,27 @@ def main():
 
     print("Differencial: {}".format(len(srclist_sjis) - len(sjis_error_bytes) - len(convertedlist_gb18030)))
 
-    # SKKバイナリ辞書形式に押し込む
+    if use_legacy_format:
+        # SKKバイナリ辞書形式に押し込む
 
-    skkbin = SkkBinaryFile()
-    for entry in convertedlist_gb18030:
-        skkbin.add_entry(entry[0], [ entry[1] ])
-    
-    filename = "CNVSJGB.TBL" + "-" + str(int(time.time())) + ".bin"
-    print("Save to \"{}\"".format(filename))
-    skkbin.save(filename)
+        skkbin = SkkBinaryFile()
+        for entry in convertedlist_gb18030:
+            skkbin.add_entry(entry[0], [ entry[1] ])
+        
+        filename = "CNVSJGB.TBL" + "-" + str(int(time.time())) + ".bin"
+        print("Save to \"{}\"".format(filename))
+        skkbin.save(filename)
+
+    else:
+        # 区点番号で直接引ける形式に押し込む
+
+        densetable = KutenDenseTableFile()
+        for entry in convertedlist_gb18030:
+            densetable.add_entry(kuten_of_sjis[entry[0]], entry[1])
+
+        filename = "CNVSJGB2.TBL" + "-" + str(int(time.time())) + ".bin"
+        print("Save to \"{}\"".format(filename))
+        densetable.save(filename)
 
     print("Finished.")
 